@@ -0,0 +1,142 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <print>
+#include <vector>
+
+#include "backends/bytecode.hpp"
+#include "parser/all.hpp"
+#include "workload.hpp"
+
+// quickproto_bench: compile every workload of workload.hpp many times and report the throughput of each phase
+// Each phase is timed on its own; the median run is reported as it is the least noisy, with the spread next to it
+
+// TODO:
+// - compare against a saved baseline and fail on regressions, for CI
+// - run the workloads on separate processes, so allocator state does not carry over between them
+
+struct phase_times final
+{
+    char const *name;
+    std::vector<double> ms; // one per run
+
+    inline double median() const noexcept
+    {
+        auto sorted = ms;
+        std::ranges::sort(sorted);
+        auto const n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    }
+
+    inline double min() const noexcept { return std::ranges::min(ms); }
+
+    inline double stddev() const noexcept
+    {
+        double mean = 0.0;
+        for (auto t : ms)
+            mean += t;
+        mean /= ms.size();
+
+        double var = 0.0;
+        for (auto t : ms)
+            var += (t - mean) * (t - mean);
+        return std::sqrt(var / ms.size());
+    }
+};
+
+// Time `fn` in milliseconds
+template <typename Fn>
+inline double time_ms(Fn &&fn) noexcept
+{
+    auto const start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void run_workload(workload_params const &params, pass_pipeline const &pipeline, size_t runs) noexcept
+{
+    auto const source = generate_workload(params);
+    auto const text = (uchar const *)source.c_str();
+
+    size_t tokens = 0, nodes = 0, insns = 0;
+    phase_times lex{"lex"}, parse{"parse"}, passes{"passes"}, backend{"backend"};
+
+    for (size_t r{}; r < runs; ++r)
+    {
+        lex.ms.push_back(time_ms([&]
+                                 {
+                                     tokens = 0;
+                                     for (scanner scan{.text = text}; scan.peek.kind != token_kind::Eof; scan.next())
+                                         ++tokens; //
+                                 }));
+
+        // NOTE: the parser lexes on its own as it goes, so `parse` includes another lexing pass
+        auto p = parser{.scan{.text = text}};
+        parse.ms.push_back(time_ms([&]
+                                   { p.package(); }));
+
+        nodes = p.bld.reg.storage<node_op>().size();
+
+        passes.ms.push_back(time_ms([&]
+                                    { (void)pipeline.run(p.bld); }));
+
+        backend.ms.push_back(time_ms([&]
+                                     { insns = compile_bytecode(p.bld.reg, schedule_program(p.bld.reg)).code.size(); }));
+    }
+
+    std::println("{} ({} bytes, {} tokens, {} nodes, {} instructions)", params.name, source.size(), tokens, nodes, insns);
+
+    for (auto const *phase : {&lex, &parse, &passes, &backend})
+        std::println("  {:<8} {:>10.3f}ms median {:>10.3f}ms min {:>8.3f}ms stddev",
+                     phase->name, phase->median(), phase->min(), phase->stddev());
+
+    // NOTE: throughput is per second of the median run
+    std::println("  {:.0f} tokens/s lexing, {:.0f} nodes/s parsing, {:.0f} nodes/s end to end\n",
+                 1000.0 * tokens / lex.median(),
+                 1000.0 * nodes / parse.median(),
+                 1000.0 * nodes / (parse.median() + passes.median() + backend.median()));
+}
+
+int main(int argc, char **argv)
+{
+    size_t runs = 10;
+    char const *only = nullptr;
+    std::string_view passes = *find_preset("-O2");
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = std::max<size_t>(strtoull(argv[++i], nullptr, 10), 1);
+        else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc)
+            only = argv[++i];
+        else if (auto const preset = find_preset(argv[i]))
+            passes = *preset;
+        else if (std::string_view arg{argv[i]}; arg.starts_with("--passes="))
+            passes = arg.substr(std::size("--passes=") - 1);
+        else
+        {
+            std::println(
+                "Usage:\n"
+                "\t{} [--runs <runs>] [--only <preset>] [-O0|-O1|-O2] [--passes=<passes>]\n\n"
+                "Where:\n"
+                "\t<runs> - how many times to compile each workload (default to 10)\n"
+                "\t<preset> - the only workload to run\n"
+                "\t<passes> - the pass pipeline to time, as in `quickproto` (default to -O2)",
+                argv[0] //
+            );
+            return -1;
+        }
+    }
+
+    auto const pipeline = pass_pipeline::parse(passes);
+    if (!pipeline)
+        return -1;
+
+    for (auto const &params : workload_presets)
+        if (!only || params.name == only)
+            run_workload(params, *pipeline, runs);
+
+    return 0;
+}
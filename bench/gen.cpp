@@ -0,0 +1,90 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <print>
+
+#include "workload.hpp"
+
+// quickproto_gen: write a synthetic `.qp` program, see workload.hpp
+
+int main(int argc, char **argv)
+{
+    workload_params p = workload_presets[0];
+    char const *out_path = nullptr;
+
+    auto const number = [&](int &i) -> uint32_t
+    {
+        if (++i >= argc)
+        {
+            std::println("Expected a number after `{}`", argv[i - 1]);
+            std::exit(-1);
+        }
+
+        return (uint32_t)strtoul(argv[i++], nullptr, 10);
+    };
+
+    for (int i = 1; i < argc;)
+    {
+        if (strcmp(argv[i], "--preset") == 0 && i + 1 < argc)
+        {
+            auto const name = std::string_view{argv[i + 1]};
+            auto const iter = std::ranges::find(workload_presets, name, &workload_params::name);
+            if (iter == std::end(workload_presets))
+            {
+                std::println("Unknown preset `{}`", name);
+                return -1;
+            }
+
+            p = *iter;
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out_path = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "--funcs") == 0)
+            p.funcs = number(i);
+        else if (strcmp(argv[i], "--nesting") == 0)
+            p.nesting = number(i);
+        else if (strcmp(argv[i], "--straight") == 0)
+            p.straight = number(i);
+        else if (strcmp(argv[i], "--constants") == 0)
+            p.constants = number(i);
+        else if (strcmp(argv[i], "--memory") == 0)
+            p.memory = number(i);
+        else if (strcmp(argv[i], "--calls") == 0)
+            p.calls = number(i);
+        else if (strcmp(argv[i], "--seed") == 0)
+            p.seed = number(i);
+        else
+        {
+            std::println(
+                "Usage:\n"
+                "\t{} [--preset <preset>] [--funcs <n>] [--nesting <n>] [--straight <n>] [--constants <n>] [--memory <n>] [--calls <n>] [--seed <n>] [-o <out-name>]\n\n"
+                "Where:\n"
+                "\t<preset> - one of the workloads of `quickproto_bench`, tuned further by the other flags\n"
+                "\t<out-name> - file to write the program to (default to the console)",
+                argv[0] //
+            );
+            return -1;
+        }
+    }
+
+    auto const text = generate_workload(p);
+
+    auto const f = out_path ? fopen(out_path, "wb") : stdout;
+    if (!f)
+    {
+        std::println("Cannot open output file!");
+        return -1;
+    }
+
+    fwrite(text.data(), 1, text.size(), f);
+    if (f != stdout)
+        fclose(f);
+
+    return 0;
+}
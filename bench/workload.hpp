@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+// Synthetic workloads
+// Generates `.qp` programs whose shape is set by a few knobs, each stressing a different part of the compiler:
+// - `funcs`: many declarations (parser, env, DCE per function)
+// - `nesting`: deeply nested `if`/`else` (scopes, `Region`/`Phi` merging)
+// - `straight`: long straight-line code (peepholes, value numbering)
+// - `constants`: many global constants (global scope, constant folding)
+// - `memory`: struct and array traffic (`Load`/`Store`, memory reordering, SROA)
+// - `calls`: calls between functions (call graph, inlining)
+// Programs only use what the parser supports today; they are meant to be compiled, not run, as the call tree grows
+// exponentially with `calls`
+
+// TODO:
+// - loops with a named counter, once `for range` binds one
+// - recursion, once the inliner is told not to unroll it
+// - pointers and globals written from functions
+
+struct workload_params final
+{
+    std::string_view name;
+    uint32_t funcs = 16;
+    uint32_t nesting = 2;
+    uint32_t straight = 8;
+    uint32_t constants = 8;
+    uint32_t memory = 1;
+    uint32_t calls = 1;
+    uint64_t seed = 1;
+};
+
+// the workloads run by `quickproto_bench`, also selectable by name in `quickproto_gen`
+inline constexpr workload_params workload_presets[]{
+    {.name = "small"},
+    {.name = "many-funcs", .funcs = 2000, .nesting = 1, .straight = 4, .constants = 16},
+    {.name = "deep-nesting", .funcs = 32, .nesting = 48, .straight = 2},
+    {.name = "straight-line", .funcs = 16, .nesting = 0, .straight = 2000},
+    {.name = "constants", .funcs = 16, .constants = 5000},
+    {.name = "memory", .funcs = 64, .nesting = 1, .straight = 4, .memory = 64},
+    {.name = "calls", .funcs = 500, .nesting = 1, .straight = 4, .calls = 16},
+};
+
+namespace workload_detail
+{
+    // xorshift64, so a seed gives the same program on every platform
+    struct rng final
+    {
+        inline uint32_t next(uint32_t n) noexcept
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return uint32_t(state % n);
+        }
+
+        uint64_t state;
+    };
+
+    inline void indent(std::string &out, uint32_t depth) { out.append(depth, '\t'); }
+
+    inline void straight_line(std::string &out, rng &r, workload_params const &p, uint32_t depth)
+    {
+        static constexpr std::string_view ops[]{"+", "-", "*", "^", "&", "|"};
+
+        for (uint32_t i{}; i < p.straight; ++i)
+        {
+            indent(out, depth);
+
+            // NOTE: the shift keeps `y` from growing without bound
+            auto const op = ops[r.next((uint32_t)std::size(ops))];
+            if (p.constants != 0 && r.next(2) == 0)
+                std::format_to(std::back_inserter(out), "x = x {} c{}\n", op, r.next(p.constants));
+            else
+                std::format_to(std::back_inserter(out), "y = (y {} x) >> {}\n", op, 1 + r.next(3));
+        }
+    }
+
+    inline void nested(std::string &out, rng &r, workload_params const &p, uint32_t level, uint32_t depth)
+    {
+        if (level == p.nesting)
+            return straight_line(out, r, p, depth);
+
+        indent(out, depth);
+        std::format_to(std::back_inserter(out), "if x > y + {} {{\n", r.next(100));
+
+        indent(out, depth + 1);
+        out += "x = x - y\n";
+        nested(out, r, p, level + 1, depth + 1);
+
+        indent(out, depth);
+        out += "} else {\n";
+
+        indent(out, depth + 1);
+        std::format_to(std::back_inserter(out), "y = y + {}\n", 1 + r.next(9));
+
+        indent(out, depth);
+        out += "}\n";
+    }
+
+    inline void memory(std::string &out, rng &r, workload_params const &p)
+    {
+        for (uint32_t i{}; i < p.memory; ++i)
+        {
+            std::format_to(std::back_inserter(out),
+                           "\tvar p{0} Pair = Pair{{x, y + {1}}}\n"
+                           "\tvar a{0} [8]int = [8]int{{x, y, {1}, 2, 3, 4, 5, 6}}\n"
+                           "\tx = x + p{0}.x * p{0}.y + a{0}[{2}]\n",
+                           i, r.next(1000), r.next(8));
+        }
+    }
+}
+
+// Generate the program of `p`
+inline std::string generate_workload(workload_params const &p)
+{
+    using namespace workload_detail;
+
+    std::string out;
+    rng r{.state = p.seed ? p.seed : 1};
+
+    out += "package bench\n\n";
+
+    for (uint32_t i{}; i < p.constants; ++i)
+        std::format_to(std::back_inserter(out), "const c{} = {}\n", i, 1 + r.next(1 << 16));
+
+    out += "\ntype Pair struct {\n\tx int\n\ty int\n}\n";
+
+    for (uint32_t f{}; f < p.funcs; ++f)
+    {
+        std::format_to(std::back_inserter(out), "\nfunc f{}(a int, b int) int {{\n\tvar x int = a\n\tvar y int = b\n", f);
+
+        straight_line(out, r, p, 1);
+        nested(out, r, p, 0, 1);
+        memory(out, r, p);
+
+        // NOTE: only functions declared earlier can be called, as there are no forward declarations
+        for (uint32_t c{}; c < p.calls && f != 0; ++c)
+            std::format_to(std::back_inserter(out), "\tx = x + f{}(y, {})\n", r.next(f), c);
+
+        out += "\treturn x + y\n}\n";
+    }
+
+    out += "\nfunc main() {\n\tvar s int = 0\n";
+    for (uint32_t f{}; f < p.funcs; ++f)
+        std::format_to(std::back_inserter(out), "\ts += f{}({}, s)\n", f, f);
+    out += "}\n";
+
+    return out;
+}
@@ -1,20 +1,30 @@
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
+#include <new>
 
+#include "backends/c.hpp"
 #include "backends/dot.hpp"
+#include "backends/ir.hpp"
+#include "backends/jit.hpp"
+#include "cache.hpp"
+#include "package.hpp"
 #include "parser/all.hpp"
+#include "server.hpp"
+#include "stats.hpp"
 
 // TODO: parallelize DCE function calls, spawning them in a background thread each time a function is parsed
 // ^ how does this play out with "no forward declarations?"
 
 // TODO:
-// - visual debugger with tunable steppable vs non-steppable coroutines for compiler passes
+// - visual debugger stepping through the passes (see utils/steppable.hpp)
 // - DLL plugins for compilation phases
 // - lemma: now that you have memory ordering; any operation that occurs in a `Store` before being connected to the main `State` is const-foldable (but not the only case)
 // - more build flags:
-// ^ option to specify name of passes to run; also presets with certain passes such as opt(1), opt(2), debug or profile
+// ^ `debug` and `profile` pipeline presets next to `-O0`/`-O1`/`-O2`
 // ^ deduce backend based on `-o <out-name>.<ext>`
+// - run the benchmark on the sample programs as a separate target instead of a flag
 
 // DONE:
 // - peephole nodes during parsing, not after function parsed
@@ -26,8 +36,35 @@ struct cmd_args final
     inline static cmd_args parse(int argc, char **argv) noexcept;
 
     char const *in_path;
-    char const *out_path;
-    bool opt;
+    std::vector<char const *> in_paths; // every source of the package, `in_path` first
+    char const *out_path; // `nullptr` means the default of the backend
+    char const *backend;
+    char const *cache_dir; // `nullptr` means no caching
+    char const *stats_json; // where to write the statistics as JSON; `nullptr` for none
+    char const *trace_path; // where to write the trace; `nullptr` for none
+    std::string_view passes; // the pass pipeline, see opt/passes.hpp
+    double budget_ms; // time the passes may take, best effort; 0 means no limit
+    uint32_t unroll; // see `unroll_factor`
+    size_t bench_runs; // 0 unless benchmarking
+    bool stats;
+};
+
+struct backend_entry final
+{
+    char const *name;
+    char const *default_out; // `nullptr` means the console
+    std::unique_ptr<backend> (*make)();
+    bool (*finish)(char const *out_path) = nullptr; // run once the output file is closed
+};
+
+inline constexpr backend_entry backends[]{
+    {"dot", "out.dot", []() -> std::unique_ptr<backend> { return std::make_unique<dot_backend>(); }},
+    {"interp", nullptr, []() -> std::unique_ptr<backend> { return std::make_unique<interp_backend>(); }},
+    {"vm", nullptr, []() -> std::unique_ptr<backend> { return std::make_unique<vm_backend>(); }},
+    {"bytecode", "out.qpbc", []() -> std::unique_ptr<backend> { return std::make_unique<bytecode_backend>(); }},
+    {"jit", nullptr, []() -> std::unique_ptr<backend> { return std::make_unique<jit_backend>(); }},
+    {"ir", "out.qpir", []() -> std::unique_ptr<backend> { return std::make_unique<ir_backend>(); }},
+    {"c", "out.c", []() -> std::unique_ptr<backend> { return std::make_unique<c_backend>(); }, build_c_source},
 };
 
 struct file_deleter final
@@ -37,39 +74,258 @@ struct file_deleter final
 
 using file_ptr = std::unique_ptr<FILE, file_deleter>;
 
-inline size_t read_file(char const *path, uchar **out) noexcept;
+// NOTE: replaced here, as this is the only translation unit
+// ^ by default, the array, `nothrow` and sized forms call one of these four, so they are counted too
+void *operator new(size_t n)
+{
+    stats_allocs.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto const p = malloc(n ? n : 1))
+        return p;
+
+    throw std::bad_alloc{};
+}
+
+void *operator new(size_t n, std::align_val_t al)
+{
+    stats_allocs.fetch_add(1, std::memory_order_relaxed);
+
+    // NOTE: `aligned_alloc` wants the size to be a multiple of the alignment
+    auto const a = size_t(al);
+    if (auto const p = std::aligned_alloc(a, (std::max<size_t>(n, 1) + a - 1) / a * a))
+        return p;
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept
+{
+    if (!p)
+        return;
+
+    stats_frees.fetch_add(1, std::memory_order_relaxed);
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    if (!p)
+        return;
+
+    stats_frees.fetch_add(1, std::memory_order_relaxed);
+    free(p);
+}
+
+// Run bytecode written by the `bytecode` backend, skipping the front end
+inline void run_bytecode(char const *path, FILE *out) noexcept;
+
+// Run the program `runs` times on both the interpreter and the VM, then report how long a run takes on each
+inline void run_bench(entt::registry const &reg, size_t runs) noexcept;
+
+// Compile `argv` like the command line says; the body of `main`, also run by the compile server for each request
+inline int compile(int argc, char **argv) noexcept;
 
 int main(int argc, char **argv)
+{
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0)
+        return serve(argv[2], compile);
+
+    // NOTE: the client sends everything after the socket path, and the server puts the working directory in front
+    if (argc > 2 && strcmp(argv[1], "--connect") == 0)
+        return connect_server(argv[2], argc - 3, argv + 3);
+
+    return compile(argc, argv);
+}
+
+inline int compile(int argc, char **argv) noexcept
 {
     auto args = cmd_args::parse(argc, argv);
 
-    std::unique_ptr<uchar[]> text;
-    auto n = read_file(args.in_path, std::out_ptr(text));
-    ensure(n != -1, "Cannot read input file!");
+    if (std::string_view{args.in_path}.ends_with(".qpbc"))
+    {
+        file_ptr _out{args.out_path ? fopen(args.out_path, "w") : nullptr};
+        ensure(!args.out_path || _out, "Cannot open output file!");
+
+        run_bytecode(args.in_path, args.out_path ? _out.get() : stdout);
+        return 0;
+    }
+
+    // NOTE: IR files skip the front end, so the parser only gets an empty source
+    auto const from_ir = std::string_view{args.in_path}.ends_with(".qpir");
+
+    compile_stats stats;
+    if (args.stats || args.stats_json)
+        active_stats = &stats;
+
+    trace_enabled = args.trace_path != nullptr;
 
-    auto const start = std::chrono::system_clock::now();
+    auto const start = std::chrono::steady_clock::now();
+
+    // NOTE: the files are read and scanned in parallel, then parsed in parallel as far as the names they use allow
+    std::vector<source_file> files;
+    uchar const empty[1]{};
+
+    if (!from_ir)
+    {
+        stats_zone _{"lex"};
+        files = load_package(args.in_paths);
+    }
 
     auto p = parser{
-        // TODO: is this correct?
-        .scan{.text = text.get()},
+        // NOTE: `parse_package` points this to the files
+        .scan{.text = empty},
     };
 
-    p.package();
+    auto const pipeline = pass_pipeline::parse(args.passes);
+    ensure(pipeline.has_value(), "Invalid pass pipeline!");
+    unroll_factor = args.unroll;
 
-    auto f = fopen(args.out_path, "w");
+    // NOTE: a cached graph is already optimized and reordered, so it skips the passes too
+    std::optional<build_cache> cache;
+    std::optional<func_cache> funcs; // NOTE: used while parsing, when the package changed
+    uint64_t cache_key = 0;
+    bool cached = false;
+    bool resident = false; // kept by the compile server
+
+    scope_visibility ir_vis;
+    if (from_ir)
+    {
+        auto const view = ir_view::open(args.in_path);
+        ensure(view.has_value(), "Invalid or outdated IR file!");
+
+        stats_zone _{"load_ir"};
+        load_ir(*view, p.bld, ir_vis);
+        cached = true;
+    }
+    else
+    {
+        // NOTE: the compile server keeps the graphs of its requests in memory, even without `--cache`
+        if (args.cache_dir || server_graphs.serving())
+        {
+            stats_zone _{"cache"};
+
+            std::vector<decl_info> all;
+            for (auto const &f : files)
+                all.insert(all.end(), f.decls.begin(), f.decls.end());
+
+            auto const decls = hash_decls(all);
+            cache_key = package_hash(decls, hash_u64(hash_bytes(hash_seed, args.passes.data(), args.passes.size()), args.unroll));
+
+            if (args.cache_dir)
+            {
+                cache.emplace(args.cache_dir);
+
+                auto const changed = cache->update_manifest(args.in_paths, decls);
+                if (args.stats)
+                    std::println("{} of {} declaration(s) changed since the last build", changed, decls.size());
+
+                funcs.emplace(std::filesystem::path{args.cache_dir} / "funcs", all, decls);
+                p.funcs = &*funcs;
+            }
+
+            if (auto const view = server_graphs.find(cache_key))
+            {
+                load_ir(*view, p.bld, ir_vis);
+                cached = resident = true;
+                if (args.stats)
+                    std::println("Reusing the graph of {} kept by the server", args.in_path);
+            }
+            else if (auto const view = cache ? cache->find(cache_key) : std::nullopt)
+            {
+                load_ir(*view, p.bld, ir_vis);
+                cached = true;
+                if (args.stats)
+                    std::println("Reusing the cached graph of {}", args.in_path);
+            }
+        }
+
+        if (!cached)
+        {
+            parse_package(p, files);
+            if (funcs && args.stats)
+                std::println("Reused the graphs of {} unchanged function(s), cached {} more", funcs->reused.load(), funcs->stored.load());
+        }
+    }
+
+    auto const entry = std::ranges::find_if(backends, [&](backend_entry const &e)
+                                            { return strcmp(e.name, args.backend) == 0; });
+    ensure(entry != std::end(backends), "Unknown backend! Expected one of: dot, interp, vm, bytecode, jit, ir, c");
+
+    // the backends that run the program report to the console unless told otherwise
+    auto const out_path = args.out_path ? args.out_path : entry->default_out;
+    auto f = (out_path && args.bench_runs == 0) ? fopen(out_path, "wb") : stdout;
     ensure(f, "Cannot open output file!");
 
-    // TODO: call this from somewhere else
-    memory_reorder(p.bld);
-    // TODO: run DCE after memory reordering
+    if (!cached)
+    {
+        stats_zone _{"opt"};
+
+        std::optional<pass_pipeline::clock::time_point> deadline;
+        if (args.budget_ms > 0)
+            deadline = pass_pipeline::clock::now() +
+                       std::chrono::duration_cast<pass_pipeline::clock::duration>(std::chrono::duration<double, std::milli>(args.budget_ms));
+
+        (void)pipeline->run(p.bld, deadline);
+    }
+
+    // NOTE: a graph optimized under a time budget may be missing passes, so it is not kept
+    if (!from_ir && args.budget_ms <= 0)
+    {
+        if (cache && !cached)
+            cache->store(cache_key, p.bld.reg);
 
-    dot_backend dot;
-    dot.compile(f, p.bld.reg);
+        // NOTE: a graph from the on-disk cache is sent too, so the next request finds it in memory
+        if (!resident)
+            server_graphs.store(cache_key, p.bld.reg);
+    }
+
+    if (args.bench_runs != 0)
+        run_bench(p.bld.reg, args.bench_runs);
+    else
+    {
+        stats_zone _{"backend"};
+        entry->make()->compile(f, p.bld.reg);
+    }
 
-    auto const finish = std::chrono::system_clock::now();
-    std::println("Compiling {} took {:%T}", args.in_path, finish - start);
+    if (f != stdout)
+        fclose(f);
 
-    fclose(f);
+    if (entry->finish && args.bench_runs == 0)
+    {
+        stats_zone _{"build"};
+        ensure(entry->finish(out_path), "Building the output failed!");
+    }
+
+    auto const finish = std::chrono::steady_clock::now();
+    std::println("Compiling {} took {:.3f}ms", args.in_path, std::chrono::duration<double, std::milli>(finish - start).count());
+
+    if (active_stats)
+    {
+        active_stats = nullptr;
+        auto const graph = count_graph(p.bld.reg);
+
+        if (args.stats)
+            print_stats(stdout, stats, graph);
+
+        if (args.stats_json)
+        {
+            file_ptr json{fopen(args.stats_json, "w")};
+            ensure(json, "Cannot open the statistics file!");
+
+            write_stats_json(json.get(), stats, graph);
+        }
+    }
+
+    // NOTE: written last, as the events point into the sources
+    if (args.trace_path)
+    {
+        trace_enabled = false;
+
+        file_ptr trace{fopen(args.trace_path, "w")};
+        ensure(trace, "Cannot open the trace file!");
+
+        write_trace(trace.get());
+    }
 
     return 0;
 }
@@ -91,11 +347,24 @@ inline cmd_args cmd_args::parse(int argc, char **argv) noexcept
 
         std::println(
             "Usage:\n"
-            "\t{} <file-name> [-o <out-name>]\n\n"
+            "\t{} <file-name>... [-o <out-name>] [-O0|-O1|-O2] [--passes=<passes>] [--budget <ms>] [--unroll <factor>] [--backend <backend>] [--run] [--bench <runs>] [--cache <dir>] [--stats] [--stats-json <json-name>] [--trace <json-name>]\n"
+            "\t{} --serve <socket>\n"
+            "\t{} --connect <socket> <file-name> [<flags>...]\n\n"
             "Where:\n"
-            "\t<file-name> - name of file to compile\n"
-            "\t<out-name> - name of the output file to produce (default to out.dot)",
-            name.substr(name_start) //
+            "\t<file-name> - name of file to compile (several for a package split over files), a `.qpir` file written by the `ir` backend, or a `.qpbc` file to run on the VM\n"
+            "\t<out-name> - name of the output file to produce (default to out.dot/out.qpbc/out.qpir/out.c, or the console for `interp`/`vm`/`jit`)\n"
+            "\t<backend> - `dot` to export the graph (default), `interp`/`vm` to run the program and report its stats, `bytecode` to write the VM bytecode, `ir` to write the graph in binary, `jit` to run it as machine code, `c` to write C source and build it with `cc -O2`\n"
+            "\t-O0/-O1/-O2 - optimization preset (default to -O0, which only reorders memory); -O is -O2\n"
+            "\t<passes> - comma-separated passes to run instead of a preset, `(<passes>)*` repeating a group until it changes nothing; one of fold-calls, inline, sroa, bce, gvn, strength, vectorize, unroll, forward, mem-reorder, dce\n"
+            "\t<ms> - time the passes may take; once it runs out the rest of the passes are skipped, eg. `--budget 50` for interactive tools\n"
+            "\t<factor> - how many times `unroll` runs the body of a counted loop per test, at most (default to 4; 1 turns it off)\n"
+            "\t--run - same as `--backend jit`\n"
+            "\t<runs> - run the program this many times on both the interpreter and the VM, and compare their speed\n"
+            "\t<dir> - directory to keep optimized graphs in, so an unchanged program skips the front end and the passes (also `QUICKPROTO_CACHE`)\n"
+            "\t--stats - report the time spent in each phase, the nodes and edges of the final graph, peak memory and allocations\n"
+            "\t<json-name> - file to write the same statistics to, as JSON; or with `--trace`, file to write a Chrome trace of the compiler to (open it in Perfetto or chrome://tracing)\n"
+            "\t<socket> - Unix socket a compile server listens on; `--connect` compiles on the server instead, without starting a new compiler",
+            name.substr(name_start), name.substr(name_start), name.substr(name_start) //
         );
 
         // std::exit(0);
@@ -105,8 +374,17 @@ inline cmd_args cmd_args::parse(int argc, char **argv) noexcept
     in_path = argv[1];
     // in_path = "math.qp";
     // char const *in_path = argv[1];
-    char const *out_path = "out.dot";
-    bool opt = false;
+    std::vector<char const *> in_paths{in_path};
+    char const *out_path = nullptr;
+    char const *backend = "dot";
+    char const *cache_dir = getenv("QUICKPROTO_CACHE");
+    char const *stats_json = nullptr;
+    char const *trace_path = nullptr;
+    std::string_view passes = *find_preset("-O0");
+    double budget_ms = 0.0;
+    uint32_t unroll = unroll_factor;
+    size_t bench_runs = 0;
+    bool stats = false;
 
     for (int i = 2; i < argc;)
     {
@@ -117,38 +395,141 @@ inline cmd_args cmd_args::parse(int argc, char **argv) noexcept
 
             out_path = argv[i++];
         }
-        else if (strcmp(argv[i], "-O") == 0)
+        else if (auto const preset = find_preset(argv[i]))
+        {
+            ++i;
+            passes = *preset;
+        }
+        else if (std::string_view arg{argv[i]}; arg.starts_with("--passes="))
+        {
+            ++i;
+            passes = arg.substr(std::size("--passes=") - 1);
+        }
+        else if (strcmp(argv[i], "--budget") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected milliseconds after `--budget` parameter");
+
+            budget_ms = strtod(argv[i++], nullptr);
+        }
+        else if (strcmp(argv[i], "--unroll") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected unroll factor after `--unroll` parameter");
+
+            unroll = std::max<uint32_t>((uint32_t)strtoul(argv[i++], nullptr, 10), 1);
+        }
+        else if (strcmp(argv[i], "--backend") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected backend name after `--backend` parameter");
+
+            backend = argv[i++];
+        }
+        else if (strcmp(argv[i], "--run") == 0)
+        {
+            ++i;
+            backend = "jit";
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected directory after `--cache` parameter");
+
+            cache_dir = argv[i++];
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
         {
             ++i;
-            opt = true;
+            stats = true;
         }
-        // TODO: if not a flag, it should be a source
+        else if (strcmp(argv[i], "--stats-json") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected file name after `--stats-json` parameter");
+
+            stats_json = argv[i++];
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected file name after `--trace` parameter");
+
+            trace_path = argv[i++];
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            ++i;
+            ensure(i < argc, "Expected number of runs after `--bench` parameter");
+
+            bench_runs = std::max(strtoull(argv[i++], nullptr, 10), 1ull);
+        }
+        else if (argv[i][0] != '-')
+            in_paths.push_back(argv[i++]);
+        else
+            std::println("Ignoring unknown argument `{}`", argv[i++]);
     }
 
     return cmd_args{
         .in_path = in_path,
+        .in_paths = std::move(in_paths),
         .out_path = out_path,
-        .opt = opt,
+        .backend = backend,
+        .cache_dir = cache_dir,
+        .stats_json = stats_json,
+        .trace_path = trace_path,
+        .passes = passes,
+        .budget_ms = budget_ms,
+        .unroll = unroll,
+        .bench_runs = bench_runs,
+        .stats = stats,
     };
 }
 
-inline size_t read_file(char const *path, uchar **out) noexcept
+inline void run_bytecode(char const *path, FILE *out) noexcept
 {
-    file_ptr _file{fopen(path, "r")};
-    auto f = _file.get();
+    file_ptr _file{fopen(path, "rb")};
+    ensure(_file, "Cannot read input file!");
 
-    if (!f)
-        return size_t(-1);
+    auto const mod = read_bytecode(_file.get());
+    ensure(mod.has_value(), "Invalid or outdated bytecode file!");
 
-    fseek(f, 0, SEEK_END);
-    size_t n = ftell(f);
-    *out = new uchar[n];
-    rewind(f);
+    auto const start = std::chrono::steady_clock::now();
 
-    // Thanks a lot, Windows
-    auto const newn = fread(*out, 1, n, f);
-    if (newn != n)
-        (*out)[newn] = '\0';
+    vm_backend vm;
+    vm.report(out, vm.run(*mod));
 
-    return newn;
-}
\ No newline at end of file
+    auto const finish = std::chrono::steady_clock::now();
+    std::println("Running {} took {:.3f}ms", path, std::chrono::duration<double, std::milli>(finish - start).count());
+}
+
+inline void run_bench(entt::registry const &reg, size_t runs) noexcept
+{
+    using clock = std::chrono::steady_clock;
+    using micros = std::chrono::duration<double, std::micro>;
+
+    interp_backend interp;
+    auto const interp_start = clock::now();
+    for (size_t i{}; i < runs; ++i)
+        (void)interp.run(reg);
+    micros const interp_time = (clock::now() - interp_start) / runs;
+
+    // NOTE: compiling to bytecode happens once, so it is reported apart from the runs
+    auto const compile_start = clock::now();
+    auto const mod = compile_bytecode(reg, schedule_program(reg));
+    micros const compile_time = clock::now() - compile_start;
+
+    vm_backend vm;
+    char const *trapped = nullptr;
+    auto const vm_start = clock::now();
+    for (size_t i{}; i < runs; ++i)
+        trapped = vm.run(mod);
+    micros const vm_time = (clock::now() - vm_start) / runs;
+
+    if (trapped)
+        std::println("trap: {}", trapped);
+
+    std::println("interp: {:.1f}us per run ({} control steps)", interp_time.count(), interp.stats.ctrl_steps);
+    std::println("vm: {:.1f}us per run ({} instructions, compiled in {:.1f}us)", vm_time.count(), mod.code.size(), compile_time.count());
+    std::println("speedup: {:.2f}x", interp_time / vm_time);
+}
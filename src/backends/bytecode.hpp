@@ -0,0 +1,798 @@
+#pragma once
+
+#include <cstdio>
+#include <optional>
+
+#include "backends/interp.hpp"
+#include "backends/schedule.hpp"
+
+// Register-based bytecode
+// Every function gets a fixed set of registers, one for each value it computes; the operands of an instruction are registers
+// unless said otherwise. Instructions are specialized on the type of their operands, so the VM never looks at types
+
+// TODO:
+// - reuse registers once their value is dead, so that frames stay small
+// - fuse common pairs (eg. `CmpLt` + `Branch`) into a single instruction
+// - write the bytecode in a fixed byte order; it is only portable between machines with the same endianness for now
+// - store the source location of traps
+
+// X(name) for every opcode
+#define BC_OPS(X)                                                    \
+    X(LoadK)            /* dst = consts[a] */                        \
+    X(Arg)              /* dst = args[a] */                          \
+    X(GetGlobal)        /* dst = globals[a] */                       \
+    X(SetGlobal)        /* globals[b] = a */                         \
+    X(Move)             /* dst = a */                                \
+    X(UnaryCompl)       /* dst = ~a */                               \
+    X(UnaryNeg)         /* dst = -a */                               \
+    X(UnaryFneg)        /* dst = -a, as floats */                    \
+    X(UnaryNot)         /* dst = !a */                               \
+    X(Add) X(Sub) X(Mul) X(Div) X(Udiv)                              \
+    X(Fadd) X(Fsub) X(Fmul) X(Fdiv)                                  \
+    X(LogicAnd) X(LogicOr)                                           \
+    X(BitAnd) X(BitXor) X(BitOr)                                     \
+    X(ShiftLeft) X(ShiftRight) X(UshiftRight)                        \
+    X(CmpEq) X(CmpNe) X(CmpLt) X(CmpLe) X(CmpGt) X(CmpGe)            \
+    X(UcmpLt) X(UcmpLe) X(UcmpGt) X(UcmpGe)                          \
+    X(FcmpEq) X(FcmpNe) X(FcmpLt) X(FcmpLe) X(FcmpGt) X(FcmpGe)      \
+    X(Wrap)             /* dst = a truncated to `bc_wrap(b)` */      \
+    X(IntToFloat)                                                    \
+    X(FloatToInt)                                                    \
+    X(Struct)           /* dst = new object of b slots, lists[a] */  \
+    X(Alloca)           /* dst = new object of a slots */            \
+    X(Load)             /* dst = a[b] */                             \
+    X(LoadAt)           /* dst = a[b], `b` being a constant */       \
+    X(Store)            /* a[b] = dst, `b` being a constant */       \
+    X(CheckedIndex)     /* dst = a, trapping unless a < b */         \
+    X(CallStatic)       /* dst = funcs[a](lists[b]) */               \
+    X(ExternCall)       /* dst = 0, skipped */                       \
+    X(Jump)             /* go to a */                                \
+    X(Branch)           /* go to a if dst holds, b otherwise */      \
+    X(Return)           /* return a, nothing if a is `~0` */         \
+    X(Exit)                                                          \
+    X(Trap)             /* stop with `bc_trap(a)` */
+
+enum class bc_op : uint32_t
+{
+#define bc_op_enum(name) name,
+    BC_OPS(bc_op_enum)
+#undef bc_op_enum
+};
+
+inline constexpr uint32_t bc_op_count = 0
+#define bc_op_one(name) +1
+    BC_OPS(bc_op_one)
+#undef bc_op_one
+    ;
+
+// the sized integer type a value is truncated to
+enum class bc_wrap : uint32_t
+{
+    Int8,
+    Int16,
+    Int32,
+    Uint8,
+    Uint16,
+    Uint32,
+};
+
+enum class bc_trap : uint32_t
+{
+    DivisionByZero,
+    OutOfBounds,
+    InvalidAccess,
+    InvalidParam,
+    NoReturn,
+    NoBody,
+    Unsupported,
+    TypeError,
+    StackOverflow,
+    StepLimit,
+};
+
+inline constexpr char const *bc_trap_messages[]{
+    "division by zero",
+    "index out of bounds",
+    "invalid memory access",
+    "parameter of another function",
+    "control flow ended without a `Return`",
+    "called a function without a body",
+    "cannot evaluate this node",
+    "reached a node with a type error",
+    "stack overflow",
+    "step limit reached",
+};
+
+struct bc_insn final
+{
+    bc_op op;
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+};
+
+static_assert(sizeof(bc_insn) == 16);
+
+struct bc_func final
+{
+    uint32_t entry;  // index of the first instruction
+    uint32_t n_regs; // registers of a frame
+};
+
+struct bc_module final
+{
+    std::vector<bc_insn> code;
+    std::vector<rt_bits> consts;
+    std::vector<uint32_t> lists; // operands of calls and `Struct`s: the count, then the registers
+    std::vector<bc_func> funcs;  // `funcs[0]` is the global code
+    uint32_t n_globals = 0;
+};
+
+// Linearize the scheduled program into bytecode
+inline bc_module compile_bytecode(entt::registry const &reg, sched_program const &prog) noexcept;
+
+// Serialization
+// NOTE: the layout is the header followed by each array, in the order of `bc_module`
+
+inline constexpr uint32_t bc_magic = 'Q' | ('P' << 8) | ('B' << 16) | ('C' << 24);
+inline constexpr uint32_t bc_version = 1;
+
+struct bc_header final
+{
+    uint32_t magic = bc_magic;
+    uint32_t version = bc_version;
+    uint32_t n_code;
+    uint32_t n_consts;
+    uint32_t n_lists;
+    uint32_t n_funcs;
+    uint32_t n_globals;
+    uint32_t reserved = 0;
+};
+
+inline bool write_bytecode(FILE *out, bc_module const &mod) noexcept;
+
+// Read a module written by `write_bytecode`, checking it can run safely; `nullopt` if it cannot
+inline std::optional<bc_module> read_bytecode(FILE *in) noexcept;
+
+// Write the bytecode of the program, to be run later by the VM
+struct bytecode_backend final : backend
+{
+    inline void compile(FILE *out, entt::registry const &reg)
+    {
+        ensure(write_bytecode(out, compile_bytecode(reg, schedule_program(reg))), "Cannot write the bytecode!");
+    }
+};
+
+// the raw bits of a constant node
+inline rt_bits const_bits(value const *ty) noexcept
+{
+    if (auto i = ty->as<int_const>())
+        return i->n;
+    if (auto s = ty->as<sized_int_value>())
+        return (rt_bits)s->bounds().lo;
+    if (auto f = ty->as<float64>())
+        return std::bit_cast<rt_bits>(f->d);
+    if (auto b = ty->as<bool_const>())
+        return b->b;
+
+    return 0;
+}
+
+inline std::optional<bc_wrap> wrap_of(value const *ty) noexcept
+{
+    if (ty->as<sized_int_<int8_t>>())
+        return bc_wrap::Int8;
+    if (ty->as<sized_int_<int16_t>>())
+        return bc_wrap::Int16;
+    if (ty->as<sized_int_<int32_t>>())
+        return bc_wrap::Int32;
+    if (ty->as<sized_int_<uint8_t>>())
+        return bc_wrap::Uint8;
+    if (ty->as<sized_int_<uint16_t>>())
+        return bc_wrap::Uint16;
+    if (ty->as<sized_int_<uint32_t>>())
+        return bc_wrap::Uint32;
+
+    return std::nullopt;
+}
+
+struct bc_compiler final
+{
+    inline bc_compiler(entt::registry const &reg, sched_program const &prog, bc_module &mod) noexcept
+        : ops{*reg.storage<node_op>()},
+          types{*reg.storage<node_type>()},
+          ins{*reg.storage<node_inputs>()},
+          mem{*reg.storage<mem_effect>()},
+          targets{*reg.storage<func_of_call>()},
+          prog{prog},
+          mod{mod}
+    {
+    }
+
+    inline void func(uint32_t index) noexcept;
+    inline void node(entt::entity n) noexcept;
+    inline void edge(sched_block const &from) noexcept;
+
+    inline void emit(bc_op op, uint32_t dst = 0, uint32_t a = 0, uint32_t b = 0) noexcept
+    {
+        mod.code.push_back({op, dst, a, b});
+    }
+
+    // NOTE: packed values take one register per lane
+    inline uint32_t reg_of(entt::entity n) noexcept
+    {
+        auto [iter, added] = regs.try_emplace(n, n_regs);
+        if (added)
+            n_regs += is_packed(ops, ins, n) ? vector_width : 1;
+        return iter->second;
+    }
+
+    inline uint32_t temp() noexcept { return n_regs++; }
+
+    inline uint32_t constant(rt_bits bits) noexcept
+    {
+        auto [iter, added] = consts.try_emplace(bits, (uint32_t)mod.consts.size());
+        if (added)
+            mod.consts.push_back(bits);
+        return iter->second;
+    }
+
+    // push `count, regs...` to the lists of the module, return where they start
+    inline uint32_t list(std::span<entt::entity const> nodes) noexcept
+    {
+        auto const start = (uint32_t)mod.lists.size();
+        mod.lists.push_back((uint32_t)nodes.size());
+        for (auto n : nodes)
+            mod.lists.push_back(reg_of(n));
+        return start;
+    }
+
+    inline bool is_float(entt::entity n) const noexcept { return types.get(n).type->as<float_value>() != nullptr; }
+
+    inline void wrap(uint32_t dst, value const *ty) noexcept
+    {
+        if (auto w = wrap_of(ty))
+            emit(bc_op::Wrap, dst, dst, (uint32_t)*w);
+    }
+
+    entt::storage_for_t<node_op> const &ops;
+    entt::storage_for_t<node_type> const &types;
+    entt::storage_for_t<node_inputs> const &ins;
+    entt::storage_for_t<mem_effect> const &mem;
+    entt::storage_for_t<func_of_call> const &targets;
+
+    sched_program const &prog;
+    bc_module &mod;
+
+    // per function
+    uint32_t cur = 0;
+    sched_func const *f = nullptr;
+    entt::dense_map<entt::entity, uint32_t> regs;
+    uint32_t n_regs = 0;
+    std::vector<std::pair<size_t, uint32_t>> jumps_a, jumps_b; // (instruction, block) to point to the block once it is known
+
+    entt::dense_map<rt_bits, uint32_t> consts;
+};
+
+inline void bc_compiler::func(uint32_t index) noexcept
+{
+    cur = index;
+    f = &prog.funcs[index];
+    regs.clear();
+    n_regs = 0;
+    jumps_a.clear();
+    jumps_b.clear();
+
+    auto const entry = (uint32_t)mod.code.size();
+
+    for (auto g : f->globals)
+        emit(bc_op::GetGlobal, reg_of(g), prog.global_slot.at(g));
+
+    std::vector<uint32_t> block_pc(f->blocks.size());
+    for (size_t i{}; i < f->order.size(); ++i)
+    {
+        auto const b = f->order[i];
+        auto const &blk = f->blocks[b];
+        block_pc[b] = (uint32_t)mod.code.size();
+
+        for (auto n : blk.code)
+            node(n);
+
+        switch (blk.end)
+        {
+        case sched_end::Jump:
+        {
+            edge(blk);
+
+            // NOTE: no need to jump to the block that comes next
+            if (i + 1 < f->order.size() && f->order[i + 1] == blk.next[0])
+                break;
+
+            jumps_a.push_back({mod.code.size(), blk.next[0]});
+            emit(bc_op::Jump);
+            break;
+        }
+
+        case sched_end::Branch:
+            jumps_a.push_back({mod.code.size(), blk.next[0]});
+            jumps_b.push_back({mod.code.size(), blk.next[1]});
+            emit(bc_op::Branch, reg_of(blk.end_node));
+            break;
+
+        case sched_end::Return:
+        {
+            auto const &rins = ins.get(blk.end_node).nodes;
+            auto const has_value = rins.n != 0 && rins[0] != entt::null;
+            emit(bc_op::Return, 0, has_value ? reg_of(rins[0]) : ~0u);
+            break;
+        }
+
+        case sched_end::Exit:
+            emit(bc_op::Exit);
+            break;
+
+        case sched_end::Trap:
+            emit(bc_op::Trap, 0, (uint32_t)bc_trap::NoReturn);
+            break;
+        }
+    }
+
+    for (auto [insn, b] : jumps_a)
+        mod.code[insn].a = block_pc[b];
+    for (auto [insn, b] : jumps_b)
+        mod.code[insn].b = block_pc[b];
+
+    mod.funcs[index] = {.entry = entry, .n_regs = n_regs};
+}
+
+inline void bc_compiler::edge(sched_block const &from) noexcept
+{
+    auto const &phis = f->blocks[from.next[0]].phis;
+
+    // NOTE: every `Phi` reads the values from before the edge, so go through temporaries when there is more than one
+    std::vector<std::pair<uint32_t, uint32_t>> moves; // (phi, value)
+    for (auto phi : phis)
+        if (auto const &pins = ins.get(phi).nodes; from.edge < pins.n && pins[from.edge] != entt::null)
+            for (uint32_t l{}, lanes = is_packed(ops, ins, phi) ? vector_width : 1; l < lanes; ++l)
+                moves.push_back({reg_of(phi) + l, reg_of(pins[from.edge]) + l});
+
+    if (moves.size() == 1)
+    {
+        emit(bc_op::Move, moves[0].first, moves[0].second);
+        return;
+    }
+
+    std::vector<uint32_t> temps;
+    for (auto [phi, val] : moves)
+    {
+        temps.push_back(temp());
+        emit(bc_op::Move, temps.back(), val);
+    }
+
+    for (size_t i{}; i < moves.size(); ++i)
+        emit(bc_op::Move, moves[i].first, temps[i]);
+}
+
+inline void bc_compiler::node(entt::entity n) noexcept
+{
+    auto const op = ops.get(n);
+    auto const ty = types.get(n).type;
+    auto const &nins = ins.get(n).nodes;
+
+    auto const dst = reg_of(n);
+    auto const in = [&](uint32_t i) { return reg_of(nins[i]); };
+
+    switch (op)
+    {
+    case node_op::IConst:
+    case node_op::FConst:
+    case node_op::BConst:
+        emit(bc_op::LoadK, dst, constant(const_bits(ty)));
+        break;
+
+    case node_op::Proj:
+    {
+        auto const &eff = mem.get(n);
+        if (eff.target != f->start)
+            emit(bc_op::Trap, 0, (uint32_t)bc_trap::InvalidParam);
+        else
+            emit(bc_op::Arg, dst, eff.tag);
+        break;
+    }
+
+    case node_op::UnaryCompl:
+        emit(bc_op::UnaryCompl, dst, in(0));
+        wrap(dst, ty);
+        break;
+
+    case node_op::UnaryNeg:
+        if (is_float(n))
+            emit(bc_op::UnaryFneg, dst, in(0));
+        else
+        {
+            emit(bc_op::UnaryNeg, dst, in(0));
+            wrap(dst, ty);
+        }
+        break;
+
+    case node_op::UnaryNot:
+        emit(bc_op::UnaryNot, dst, in(0));
+        break;
+
+        // NOTE: the parser only emits the integer nodes for now, so floats are handled here as well
+#define arith_node(name, fname)                    \
+    case node_op::name:                            \
+        if (is_float(n))                           \
+            emit(bc_op::fname, dst, in(0), in(1)); \
+        else                                       \
+        {                                          \
+            emit(bc_op::name, dst, in(0), in(1));  \
+            wrap(dst, ty);                         \
+        }                                          \
+        break
+
+        arith_node(Add, Fadd);
+        arith_node(Sub, Fsub);
+        arith_node(Mul, Fmul);
+
+#undef arith_node
+
+    case node_op::Div:
+        if (is_float(n))
+            emit(bc_op::Fdiv, dst, in(0), in(1));
+        else if (is_unsigned_int(ty))
+            emit(bc_op::Udiv, dst, in(0), in(1));
+        else
+        {
+            emit(bc_op::Div, dst, in(0), in(1));
+            wrap(dst, ty);
+        }
+        break;
+
+#define same_node(name)                   \
+    case node_op::name:                   \
+        emit(bc_op::name, dst, in(0), in(1)); \
+        break
+
+        same_node(Fadd);
+        same_node(Fsub);
+        same_node(Fmul);
+        same_node(Fdiv);
+        same_node(LogicAnd);
+        same_node(LogicOr);
+        same_node(BitAnd);
+        same_node(BitXor);
+        same_node(BitOr);
+
+#undef same_node
+
+    case node_op::ShiftLeft:
+        emit(bc_op::ShiftLeft, dst, in(0), in(1));
+        wrap(dst, ty);
+        break;
+
+    case node_op::ShiftRight:
+        emit(is_unsigned_int(ty) ? bc_op::UshiftRight : bc_op::ShiftRight, dst, in(0), in(1));
+        break;
+
+    case node_op::CmpEq:
+        emit(is_float(nins[0]) ? bc_op::FcmpEq : bc_op::CmpEq, dst, in(0), in(1));
+        break;
+    case node_op::CmpNe:
+        emit(is_float(nins[0]) ? bc_op::FcmpNe : bc_op::CmpNe, dst, in(0), in(1));
+        break;
+
+        // NOTE: integers compare as signed unless they are unsigned sized integers
+#define cmp_node(name)                                                          \
+    case node_op::Cmp##name:                                                    \
+        emit(is_float(nins[0])                            ? bc_op::Fcmp##name   \
+             : is_unsigned_int(types.get(nins[0]).type) ? bc_op::Ucmp##name   \
+                                                          : bc_op::Cmp##name,   \
+             dst, in(0), in(1));                                                \
+        break
+
+        cmp_node(Lt);
+        cmp_node(Le);
+        cmp_node(Gt);
+        cmp_node(Ge);
+
+#undef cmp_node
+
+    case node_op::Cast:
+    {
+        auto const from_float = is_float(nins[0]), to_float = is_float(n);
+        if (from_float && !to_float)
+            emit(bc_op::FloatToInt, dst, in(0));
+        else if (!from_float && to_float)
+            emit(bc_op::IntToFloat, dst, in(0));
+        else
+            emit(bc_op::Move, dst, in(0));
+
+        if (!to_float)
+            wrap(dst, ty);
+        break;
+    }
+
+    // NOTE: pointers are the objects they point to, so these are moves
+    case node_op::Addr:
+    case node_op::Deref:
+        emit(bc_op::Move, dst, in(0));
+        break;
+
+    case node_op::Struct:
+    {
+        // NOTE: members without an initializer are zero
+        auto const comp = ty->as<array_value>() ? members_of(ty->as<array_value>()->type)
+                          : ty->as<struct_value>()
+                              ? members_of(ty->as<struct_value>()->type)
+                              : nins.n;
+
+        emit(bc_op::Struct, dst, list({nins.begin(), nins.end()}), (uint32_t)std::max<size_t>(comp, nins.n));
+        break;
+    }
+
+    case node_op::Alloca:
+    {
+        auto const ptr = ty->as<pointer_value>();
+        emit(bc_op::Alloca, dst, (uint32_t)(ptr && ptr->ty ? members_of(ptr->ty) : 1));
+        break;
+    }
+
+    case node_op::Load:
+    {
+        auto const obj = reg_of(mem.get(n).target);
+        if (nins.n != 0)
+            emit(bc_op::Load, dst, obj, in(0));
+        else
+            emit(bc_op::LoadAt, dst, obj, mem.get(n).tag);
+        break;
+    }
+
+    case node_op::Store:
+    {
+        auto const tag = mem.get(n).tag;
+        if (tag == ~uint32_t{})
+        {
+            emit(bc_op::Trap, 0, (uint32_t)bc_trap::Unsupported);
+            break;
+        }
+
+        // NOTE: the value of a `Store` is the stored value
+        emit(bc_op::Move, dst, in(0));
+        emit(bc_op::Store, dst, reg_of(mem.get(n).target), tag);
+        break;
+    }
+
+    case node_op::CheckedIndex:
+        emit(bc_op::CheckedIndex, dst, in(0), in(1));
+        break;
+
+        // NOTE: packed nodes become one instruction per lane, so the VM does not need to know about them
+    case node_op::VecSplat:
+        for (uint32_t l{}; l < vector_width; ++l)
+            emit(bc_op::Move, dst + l, in(0));
+        break;
+
+    case node_op::VecLoad:
+    {
+        auto const obj = reg_of(mem.get(n).target);
+        auto const index = temp();
+        for (uint32_t l{}; l < vector_width; ++l)
+        {
+            emit(bc_op::LoadK, index, constant(l));
+            emit(bc_op::Add, index, in(0), index);
+            emit(bc_op::Load, dst + l, obj, index);
+        }
+        break;
+    }
+
+    case node_op::VecAdd:
+    case node_op::VecSub:
+    case node_op::VecMul:
+    {
+        constexpr bc_op int_ops[]{bc_op::Add, bc_op::Sub, bc_op::Mul};
+        constexpr bc_op float_ops[]{bc_op::Fadd, bc_op::Fsub, bc_op::Fmul};
+
+        auto const which = (uint32_t)op - (uint32_t)node_op::VecAdd;
+        for (uint32_t l{}; l < vector_width; ++l)
+        {
+            emit(is_float(n) ? float_ops[which] : int_ops[which], dst + l, in(0) + l, in(1) + l);
+            if (!is_float(n))
+                wrap(dst + l, ty);
+        }
+        break;
+    }
+
+    case node_op::VecReduce:
+        emit(bc_op::Move, dst, in(0));
+        for (uint32_t l = 1; l < vector_width; ++l)
+            emit(is_float(n) ? bc_op::Fadd : bc_op::Add, dst, dst, in(0) + l);
+        if (!is_float(n))
+            wrap(dst, ty);
+        break;
+
+    case node_op::CallStatic:
+    {
+        auto const callee = targets.contains(n) ? prog.func_index.find(targets.get(n).func) : prog.func_index.end();
+        if (callee == prog.func_index.end())
+            emit(bc_op::Trap, 0, (uint32_t)bc_trap::NoBody);
+        else
+            emit(bc_op::CallStatic, dst, callee->second, list({nins.begin(), nins.end()}));
+        break;
+    }
+
+    case node_op::ExternCall:
+        emit(bc_op::ExternCall, dst);
+        break;
+
+    case node_op::Error:
+        emit(bc_op::Trap, 0, (uint32_t)bc_trap::TypeError);
+        break;
+
+    default:
+        emit(bc_op::Trap, 0, (uint32_t)bc_trap::Unsupported);
+        break;
+    }
+
+    // the global code publishes the globals the functions read
+    if (cur == 0)
+        if (auto iter = prog.global_slot.find(n); iter != prog.global_slot.end())
+            emit(bc_op::SetGlobal, 0, dst, iter->second);
+}
+
+inline bc_module compile_bytecode(entt::registry const &reg, sched_program const &prog) noexcept
+{
+    bc_module mod;
+    mod.funcs.resize(prog.funcs.size());
+    mod.n_globals = (uint32_t)prog.globals.size();
+
+    bc_compiler c{reg, prog, mod};
+    for (uint32_t i{}; i < prog.funcs.size(); ++i)
+        c.func(i);
+
+    return mod;
+}
+
+inline bool write_bytecode(FILE *out, bc_module const &mod) noexcept
+{
+    bc_header const header{
+        .n_code = (uint32_t)mod.code.size(),
+        .n_consts = (uint32_t)mod.consts.size(),
+        .n_lists = (uint32_t)mod.lists.size(),
+        .n_funcs = (uint32_t)mod.funcs.size(),
+        .n_globals = mod.n_globals,
+    };
+
+    auto const write = [&](auto const &vec)
+    {
+        return fwrite(vec.data(), sizeof(vec[0]), vec.size(), out) == vec.size();
+    };
+
+    return fwrite(&header, sizeof(header), 1, out) == 1 &&
+           write(mod.code) && write(mod.consts) && write(mod.lists) && write(mod.funcs);
+}
+
+inline std::optional<bc_module> read_bytecode(FILE *in) noexcept
+{
+    bc_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != bc_magic || header.version != bc_version)
+        return std::nullopt;
+
+    bc_module mod;
+    mod.n_globals = header.n_globals;
+
+    auto const read = [&](auto &vec, uint32_t n)
+    {
+        vec.resize(n);
+        return fread(vec.data(), sizeof(vec[0]), n, in) == n;
+    };
+
+    if (!read(mod.code, header.n_code) || !read(mod.consts, header.n_consts) ||
+        !read(mod.lists, header.n_lists) || !read(mod.funcs, header.n_funcs) || mod.funcs.empty())
+        return std::nullopt;
+
+    // NOTE: registers are checked against the frame of the function they belong to
+    for (size_t f{}; f < mod.funcs.size(); ++f)
+    {
+        auto const [entry, n_regs] = mod.funcs[f];
+        auto const end = (f + 1 < mod.funcs.size()) ? mod.funcs[f + 1].entry : (uint32_t)mod.code.size();
+        if (entry > end || end > mod.code.size())
+            return std::nullopt;
+
+        auto const is_reg = [&](uint32_t r) { return r < n_regs; };
+        auto const is_pc = [&](uint32_t pc) { return pc >= entry && pc < end; };
+        auto const is_list = [&](uint32_t l)
+        {
+            if (l >= mod.lists.size() || mod.lists[l] > mod.lists.size() - l - 1)
+                return false;
+
+            for (uint32_t i{}; i < mod.lists[l]; ++i)
+                if (!is_reg(mod.lists[l + 1 + i]))
+                    return false;
+            return true;
+        };
+
+        for (auto pc = entry; pc < end; ++pc)
+        {
+            auto const &insn = mod.code[pc];
+            bool ok = (uint32_t)insn.op < bc_op_count;
+
+            switch (insn.op)
+            {
+            case bc_op::LoadK:
+                ok = is_reg(insn.dst) && insn.a < mod.consts.size();
+                break;
+            case bc_op::Arg:
+            case bc_op::Alloca:
+            case bc_op::ExternCall:
+                ok = is_reg(insn.dst);
+                break;
+            case bc_op::GetGlobal:
+                ok = is_reg(insn.dst) && insn.a < mod.n_globals;
+                break;
+            case bc_op::SetGlobal:
+                ok = is_reg(insn.a) && insn.b < mod.n_globals;
+                break;
+            case bc_op::Move:
+            case bc_op::UnaryCompl:
+            case bc_op::UnaryNeg:
+            case bc_op::UnaryFneg:
+            case bc_op::UnaryNot:
+            case bc_op::IntToFloat:
+            case bc_op::FloatToInt:
+            case bc_op::LoadAt:
+            case bc_op::Store:
+                ok = is_reg(insn.dst) && is_reg(insn.a);
+                break;
+            case bc_op::Wrap:
+                ok = is_reg(insn.dst) && is_reg(insn.a) && insn.b <= (uint32_t)bc_wrap::Uint32;
+                break;
+            case bc_op::Struct:
+                ok = is_reg(insn.dst) && is_list(insn.a) && mod.lists[insn.a] <= insn.b;
+                break;
+            case bc_op::CallStatic:
+                ok = is_reg(insn.dst) && insn.a < mod.funcs.size() && is_list(insn.b);
+                break;
+            case bc_op::Jump:
+                ok = is_pc(insn.a);
+                break;
+            case bc_op::Branch:
+                ok = is_reg(insn.dst) && is_pc(insn.a) && is_pc(insn.b);
+                break;
+            case bc_op::Return:
+                ok = insn.a == ~0u || is_reg(insn.a);
+                break;
+            case bc_op::Exit:
+                break;
+            case bc_op::Trap:
+                ok = insn.a < std::size(bc_trap_messages);
+                break;
+            default: // binary operations
+                ok = ok && is_reg(insn.dst) && is_reg(insn.a) && is_reg(insn.b);
+                break;
+            }
+
+            if (!ok)
+                return std::nullopt;
+        }
+
+        // NOTE: the last instruction must leave the function or jump, so that the VM never runs past its end
+        if (entry == end)
+            return std::nullopt;
+
+        switch (mod.code[end - 1].op)
+        {
+        case bc_op::Jump:
+        case bc_op::Branch:
+        case bc_op::Return:
+        case bc_op::Exit:
+        case bc_op::Trap:
+            break;
+
+        default:
+            return std::nullopt;
+        }
+    }
+
+    return mod;
+}
@@ -0,0 +1,614 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <print>
+#include <string>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "backends/bytecode.hpp"
+#include "utils/out_buffer.hpp"
+
+// C source backend
+// Writes the scheduled program as a single C translation unit, then `build_c_source` compiles it with the system C compiler
+// Every `Start` becomes a C function, every block a label, and every node a local; `Phi`s are assigned on the edges into their block
+// NOTE: values are 64 bits of raw data, same as in the interpreter and the VM, so the results of all three can be compared directly
+
+// TODO:
+// - use the C types of the values, so the C compiler has something to work with besides `uint64_t`
+// - name functions and locals after their source names once nodes have them
+// - free objects; everything lives until the program exits for now
+// - run `ExternCall`s through the C standard library
+
+inline constexpr std::string_view c_prelude = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t qp_bits;
+
+static void qp_trap(char const *msg)
+{
+    fprintf(stderr, "trap: %s\n", msg);
+    exit(1);
+}
+
+static inline double qp_f(qp_bits bits)
+{
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline qp_bits qp_b(double d)
+{
+    qp_bits bits;
+    memcpy(&bits, &d, sizeof(d));
+    return bits;
+}
+
+static inline qp_bits qp_div(qp_bits a, qp_bits b)
+{
+    if (b == 0)
+        qp_trap("division by zero");
+
+    /* `min / -1` overflows, wrap it around instead */
+    return (b == ~(qp_bits)0) ? 0 - a : (qp_bits)((int64_t)a / (int64_t)b);
+}
+
+static inline qp_bits qp_udiv(qp_bits a, qp_bits b)
+{
+    if (b == 0)
+        qp_trap("division by zero");
+
+    return a / b;
+}
+
+static inline qp_bits qp_shl(qp_bits a, qp_bits b) { return b >= 64 ? 0 : a << b; }
+static inline qp_bits qp_shr(qp_bits a, qp_bits b) { return (qp_bits)((int64_t)a >> (b > 63 ? 63 : b)); }
+static inline qp_bits qp_ushr(qp_bits a, qp_bits b) { return b >= 64 ? 0 : a >> b; }
+
+static inline qp_bits qp_alloc(size_t n)
+{
+    qp_bits *obj = calloc(n ? n : 1, sizeof(qp_bits));
+    if (!obj)
+        qp_trap("out of memory");
+
+    return (qp_bits)(uintptr_t)obj;
+}
+
+#define QP_AT(obj, i) (((qp_bits *)(uintptr_t)(obj))[i])
+
+/* packed values, one lane per `qp_bits`; the C compiler lowers their operators to SSE/AVX */
+typedef qp_bits qp_vec __attribute__((vector_size(4 * sizeof(qp_bits))));
+typedef double qp_fvec __attribute__((vector_size(4 * sizeof(double))));
+
+static inline qp_vec qp_vsplat(qp_bits x) { return (qp_vec){x, x, x, x}; }
+
+static inline qp_vec qp_vload(qp_bits obj, qp_bits i)
+{
+    qp_vec v;
+    memcpy(&v, &QP_AT(obj, i), sizeof(v));
+    return v;
+}
+
+static inline qp_bits qp_vsum(qp_vec v) { return v[0] + v[1] + v[2] + v[3]; }
+
+static inline qp_bits qp_vfsum(qp_vec v)
+{
+    qp_fvec const f = (qp_fvec)v;
+    return qp_b(f[0] + f[1] + f[2] + f[3]);
+}
+
+)";
+
+static_assert(vector_width == 4, "update the packed types of `c_prelude`");
+
+// the C casts that truncate a parenthesized expression to the sized integer type `ty`; nothing for other types
+inline std::string_view c_wrap(value const *ty) noexcept
+{
+    auto const w = wrap_of(ty);
+    if (!w)
+        return "";
+
+    constexpr std::string_view casts[]{
+        "(qp_bits)(int64_t)(int8_t)",
+        "(qp_bits)(int64_t)(int16_t)",
+        "(qp_bits)(int64_t)(int32_t)",
+        "(qp_bits)(uint8_t)",
+        "(qp_bits)(uint16_t)",
+        "(qp_bits)(uint32_t)",
+    };
+
+    return casts[(uint32_t)*w];
+}
+
+struct c_emitter final
+{
+    inline c_emitter(entt::registry const &reg, sched_program const &prog, out_buffer &buf) noexcept
+        : ops{*reg.storage<node_op>()},
+          types{*reg.storage<node_type>()},
+          ins{*reg.storage<node_inputs>()},
+          mem{*reg.storage<mem_effect>()},
+          targets{*reg.storage<func_of_call>()},
+          prog{prog},
+          buf{buf}
+    {
+    }
+
+    inline void program() noexcept;
+    inline void func(uint32_t index) noexcept;
+    inline void node(entt::entity n) noexcept;
+    inline void edge(sched_block const &from) noexcept;
+
+    inline bool is_float(entt::entity n) const noexcept { return types.get(n).type->as<float_value>() != nullptr; }
+    inline char const *c_type(entt::entity n) const noexcept { return is_packed(ops, ins, n) ? "qp_vec" : "qp_bits"; }
+
+    inline void trap(bc_trap t) noexcept { buf.print("    qp_trap(\"{}\");\n", bc_trap_messages[(uint32_t)t]); }
+
+    entt::storage_for_t<node_op> const &ops;
+    entt::storage_for_t<node_type> const &types;
+    entt::storage_for_t<node_inputs> const &ins;
+    entt::storage_for_t<mem_effect> const &mem;
+    entt::storage_for_t<func_of_call> const &targets;
+
+    sched_program const &prog;
+    out_buffer &buf;
+
+    // per function
+    uint32_t cur = 0;
+    sched_func const *f = nullptr;
+};
+
+inline void c_emitter::program() noexcept
+{
+    buf.write(c_prelude);
+    buf.print("static qp_bits qp_globals[{}];\n\n", std::max<size_t>(prog.globals.size(), 1));
+
+    // NOTE: functions can call each other in any order, so declare them all first
+    for (uint32_t i{}; i < prog.funcs.size(); ++i)
+        buf.print("static qp_bits qp_f{}(qp_bits const *args);\n", i);
+
+    for (uint32_t i{}; i < prog.funcs.size(); ++i)
+        func(i);
+
+    buf.write("\nint main(void)\n"
+              "{\n"
+              "    return (int)qp_f0(NULL);\n"
+              "}\n");
+}
+
+inline void c_emitter::func(uint32_t index) noexcept
+{
+    cur = index;
+    f = &prog.funcs[index];
+
+    buf.print("\n// {}\nstatic qp_bits qp_f{}(qp_bits const *args)\n{{\n", index == 0 ? "global code" : "function", index);
+    if (index == 0)
+        buf.write("    (void)args;\n");
+
+    // NOTE: every local is declared upfront, so jumps never skip an initialization
+    auto const declare = [&](entt::entity n)
+    { buf.print("    {} v{} = {{0}};\n", c_type(n), n); };
+
+    for (auto g : f->globals)
+        declare(g);
+    for (auto b : f->order)
+    {
+        for (auto phi : f->blocks[b].phis)
+            declare(phi);
+        for (auto n : f->blocks[b].code)
+            declare(n);
+    }
+
+    for (auto g : f->globals)
+        buf.print("    v{} = qp_globals[{}];\n", g, prog.global_slot.at(g));
+
+    for (size_t i{}; i < f->order.size(); ++i)
+    {
+        auto const b = f->order[i];
+        auto const &blk = f->blocks[b];
+
+        // NOTE: the empty statement keeps the label valid in front of a declaration or the closing brace
+        if (!blk.preds.empty())
+            buf.print("b{}:;\n", b);
+
+        for (auto n : blk.code)
+            node(n);
+
+        switch (blk.end)
+        {
+        case sched_end::Jump:
+            edge(blk);
+
+            if (i + 1 < f->order.size() && f->order[i + 1] == blk.next[0])
+                break;
+
+            buf.print("    goto b{};\n", blk.next[0]);
+            break;
+
+        case sched_end::Branch:
+            buf.print("    if (v{}) goto b{};\n    goto b{};\n", blk.end_node, blk.next[0], blk.next[1]);
+            break;
+
+        case sched_end::Return:
+        {
+            auto const &rins = ins.get(blk.end_node).nodes;
+            if (rins.n != 0 && rins[0] != entt::null)
+                buf.print("    return v{};\n", rins[0]);
+            else
+                buf.write("    return 0;\n");
+            break;
+        }
+
+        case sched_end::Exit:
+            buf.write("    return 0;\n");
+            break;
+
+        case sched_end::Trap:
+            trap(bc_trap::NoReturn);
+            buf.write("    return 0;\n");
+            break;
+        }
+    }
+
+    buf.write("}\n");
+}
+
+inline void c_emitter::edge(sched_block const &from) noexcept
+{
+    auto const &phis = f->blocks[from.next[0]].phis;
+
+    std::vector<std::pair<entt::entity, entt::entity>> moves; // (phi, value)
+    for (auto phi : phis)
+        if (auto const &pins = ins.get(phi).nodes; from.edge < pins.n && pins[from.edge] != entt::null)
+            moves.push_back({phi, pins[from.edge]});
+
+    if (moves.empty())
+        return;
+
+    if (moves.size() == 1)
+    {
+        buf.print("    v{} = v{};\n", moves[0].first, moves[0].second);
+        return;
+    }
+
+    // NOTE: every `Phi` reads the values from before the edge, same as in the bytecode
+    buf.write("    {\n");
+    for (size_t i{}; i < moves.size(); ++i)
+        buf.print("        {} const t{} = v{};\n", c_type(moves[i].first), i, moves[i].second);
+    for (size_t i{}; i < moves.size(); ++i)
+        buf.print("        v{} = t{};\n", moves[i].first, i);
+    buf.write("    }\n");
+}
+
+inline void c_emitter::node(entt::entity n) noexcept
+{
+    auto const op = ops.get(n);
+    auto const ty = types.get(n).type;
+    auto const &nins = ins.get(n).nodes;
+
+    // NOTE: every expression is written straight into `buf`, with the inputs as `v<id>`
+    auto const unary = [&](std::string_view before, std::string_view after)
+    { buf.print("    v{} = {}v{}{};\n", n, before, nins[0], after); };
+
+    auto const binary = [&](std::string_view before, std::string_view sign, std::string_view after)
+    { buf.print("    v{} = {}v{} {} v{}{};\n", n, before, nins[0], sign, nins[1], after); };
+
+    // `name(a, b)`, truncated to `ty` if `wrap`
+    auto const call2 = [&](std::string_view name, bool wrap)
+    { buf.print("    v{} = {}({}(v{}, v{}));\n", n, wrap ? c_wrap(ty) : "", name, nins[0], nins[1]); };
+
+    auto const fbinary = [&](std::string_view sign)
+    { buf.print("    v{} = qp_b(qp_f(v{}) {} qp_f(v{}));\n", n, nins[0], sign, nins[1]); };
+
+    auto const wrapped = [&](std::string_view sign)
+    { buf.print("    v{} = {}(v{} {} v{});\n", n, c_wrap(ty), nins[0], sign, nins[1]); };
+
+    switch (op)
+    {
+    case node_op::IConst:
+    case node_op::FConst:
+    case node_op::BConst:
+        buf.print("    v{} = UINT64_C({:#x});\n", n, const_bits(ty));
+        break;
+
+    case node_op::Proj:
+    {
+        auto const &eff = mem.get(n);
+        if (eff.target != f->start)
+            trap(bc_trap::InvalidParam);
+        else
+            buf.print("    v{} = args[{}];\n", n, eff.tag);
+        break;
+    }
+
+    case node_op::UnaryCompl:
+        buf.print("    v{} = {}(~v{});\n", n, c_wrap(ty), nins[0]);
+        break;
+
+    case node_op::UnaryNeg:
+        if (is_float(n))
+            unary("qp_b(-qp_f(", "))");
+        else
+            buf.print("    v{} = {}(0 - v{});\n", n, c_wrap(ty), nins[0]);
+        break;
+
+    case node_op::UnaryNot:
+        unary("!", "");
+        break;
+
+#define arith_node(name, sign) \
+    case node_op::name:        \
+        if (is_float(n))       \
+            fbinary(sign);     \
+        else                   \
+            wrapped(sign);     \
+        break
+
+        arith_node(Add, "+");
+        arith_node(Sub, "-");
+        arith_node(Mul, "*");
+
+#undef arith_node
+
+    case node_op::Div:
+        if (is_float(n))
+            fbinary("/");
+        else if (is_unsigned_int(ty))
+            call2("qp_udiv", false);
+        else
+            call2("qp_div", true);
+        break;
+
+    case node_op::Fadd:
+        fbinary("+");
+        break;
+    case node_op::Fsub:
+        fbinary("-");
+        break;
+    case node_op::Fmul:
+        fbinary("*");
+        break;
+    case node_op::Fdiv:
+        fbinary("/");
+        break;
+
+    case node_op::LogicAnd:
+        binary("", "&&", "");
+        break;
+    case node_op::LogicOr:
+        binary("", "||", "");
+        break;
+    case node_op::BitAnd:
+        binary("", "&", "");
+        break;
+    case node_op::BitXor:
+        binary("", "^", "");
+        break;
+    case node_op::BitOr:
+        binary("", "|", "");
+        break;
+
+    case node_op::ShiftLeft:
+        call2("qp_shl", true);
+        break;
+
+    case node_op::ShiftRight:
+        call2(is_unsigned_int(ty) ? "qp_ushr" : "qp_shr", false);
+        break;
+
+    case node_op::CmpEq:
+        if (is_float(nins[0]))
+            buf.print("    v{} = qp_f(v{}) == qp_f(v{});\n", n, nins[0], nins[1]);
+        else
+            binary("", "==", "");
+        break;
+    case node_op::CmpNe:
+        if (is_float(nins[0]))
+            buf.print("    v{} = qp_f(v{}) != qp_f(v{});\n", n, nins[0], nins[1]);
+        else
+            binary("", "!=", "");
+        break;
+
+        // NOTE: integers compare as signed unless they are unsigned sized integers, same as in the bytecode
+#define cmp_node(name, sign)                                                                   \
+    case node_op::Cmp##name:                                                                   \
+        if (is_float(nins[0]))                                                                 \
+            buf.print("    v{} = qp_f(v{}) " sign " qp_f(v{});\n", n, nins[0], nins[1]);       \
+        else if (is_unsigned_int(types.get(nins[0]).type))                                     \
+            binary("", sign, "");                                                              \
+        else                                                                                   \
+            buf.print("    v{} = (int64_t)v{} " sign " (int64_t)v{};\n", n, nins[0], nins[1]); \
+        break
+
+        cmp_node(Lt, "<");
+        cmp_node(Le, "<=");
+        cmp_node(Gt, ">");
+        cmp_node(Ge, ">=");
+
+#undef cmp_node
+
+    case node_op::Cast:
+    {
+        auto const from_float = is_float(nins[0]), to_float = is_float(n);
+        if (from_float && !to_float)
+            buf.print("    v{} = {}((qp_bits)(int64_t)qp_f(v{}));\n", n, c_wrap(ty), nins[0]);
+        else if (!from_float && to_float)
+            unary("qp_b((double)(int64_t)", ")");
+        else
+            buf.print("    v{} = {}(v{});\n", n, to_float ? "" : c_wrap(ty), nins[0]);
+        break;
+    }
+
+    // NOTE: pointers are the objects they point to
+    case node_op::Addr:
+    case node_op::Deref:
+        unary("", "");
+        break;
+
+    case node_op::Struct:
+    {
+        auto const comp = ty->as<array_value>() ? members_of(ty->as<array_value>()->type)
+                          : ty->as<struct_value>()
+                              ? members_of(ty->as<struct_value>()->type)
+                              : nins.n;
+
+        buf.print("    v{} = qp_alloc({});\n", n, std::max<size_t>(comp, nins.n));
+        for (uint32_t i{}; i < nins.n; ++i)
+            buf.print("    QP_AT(v{}, {}) = v{};\n", n, i, nins[i]);
+        break;
+    }
+
+    case node_op::Alloca:
+    {
+        auto const ptr = ty->as<pointer_value>();
+        buf.print("    v{} = qp_alloc({});\n", n, ptr && ptr->ty ? members_of(ptr->ty) : 1);
+        break;
+    }
+
+    case node_op::Load:
+    {
+        auto const obj = mem.get(n).target;
+        if (nins.n != 0)
+            buf.print("    v{} = QP_AT(v{}, v{});\n", n, obj, nins[0]);
+        else
+            buf.print("    v{} = QP_AT(v{}, {});\n", n, obj, mem.get(n).tag);
+        break;
+    }
+
+    case node_op::Store:
+    {
+        auto const tag = mem.get(n).tag;
+        if (tag == ~uint32_t{})
+        {
+            trap(bc_trap::Unsupported);
+            break;
+        }
+
+        unary("", "");
+        buf.print("    QP_AT(v{}, {}) = v{};\n", mem.get(n).target, tag, n);
+        break;
+    }
+
+    // NOTE: the vectorizer only makes packed nodes of 64-bit lanes, so there is nothing to truncate
+    case node_op::VecSplat:
+        unary("qp_vsplat(", ")");
+        break;
+
+    case node_op::VecLoad:
+        buf.print("    v{} = qp_vload(v{}, v{});\n", n, mem.get(n).target, nins[0]);
+        break;
+
+#define packed_node(name, sign)                                                                            \
+    case node_op::name:                                                                                    \
+        if (is_float(n))                                                                                   \
+            buf.print("    v{} = (qp_vec)((qp_fvec)v{} " sign " (qp_fvec)v{});\n", n, nins[0], nins[1]); \
+        else                                                                                               \
+            binary("", sign, "");                                                                          \
+        break
+
+        packed_node(VecAdd, "+");
+        packed_node(VecSub, "-");
+        packed_node(VecMul, "*");
+
+#undef packed_node
+
+    case node_op::VecReduce:
+        unary(is_float(n) ? "qp_vfsum(" : "qp_vsum(", ")");
+        break;
+
+    case node_op::CheckedIndex:
+        buf.print("    if (v{} >= v{}) qp_trap(\"{}\");\n", nins[0], nins[1], bc_trap_messages[(uint32_t)bc_trap::OutOfBounds]);
+        unary("", "");
+        break;
+
+    case node_op::CallStatic:
+    {
+        auto const callee = targets.contains(n) ? prog.func_index.find(targets.get(n).func) : prog.func_index.end();
+        if (callee == prog.func_index.end())
+        {
+            trap(bc_trap::NoBody);
+            break;
+        }
+
+        // NOTE: the arguments go through a compound literal, which needs at least one element
+        buf.print("    v{} = qp_f{}((qp_bits[]){{", n, callee->second);
+        if (nins.n == 0)
+            buf.write("0");
+        for (uint32_t i{}; i < nins.n; ++i)
+            buf.print("{}v{}", i == 0 ? "" : ", ", nins[i]);
+        buf.write("});\n");
+        break;
+    }
+
+    case node_op::ExternCall:
+        buf.print("    v{} = 0;\n", n);
+        break;
+
+    case node_op::Error:
+        trap(bc_trap::TypeError);
+        break;
+
+    default:
+        trap(bc_trap::Unsupported);
+        break;
+    }
+
+    if (cur == 0)
+        if (auto iter = prog.global_slot.find(n); iter != prog.global_slot.end())
+            buf.print("    qp_globals[{}] = v{};\n", iter->second, n);
+}
+
+struct c_backend final : backend
+{
+    // Write the program to `out` as C source
+    inline void compile(FILE *out, entt::registry const &reg)
+    {
+        auto const prog = schedule_program(reg);
+        ensure(!prog.funcs.empty(), "Graph has no `Program` node!");
+
+        buf.open(out);
+        c_emitter{reg, prog, buf}.program();
+        buf.flush();
+    }
+
+    out_buffer buf; // reused between `compile` calls
+};
+
+extern char **environ; // NOTE: not every `unistd.h` declares it
+
+// Compile the C source at `path` with `$CC` (`cc` by default) into an executable next to it, without the extension
+inline bool build_c_source(char const *path) noexcept
+{
+    std::string_view const src{path};
+    auto const exe = src.substr(0, std::min(src.rfind('.'), src.size()));
+
+    auto const cc = getenv("CC");
+    std::string const exe_path{exe};
+
+    // NOTE: the arguments go straight to the compiler, without a shell that would interpret quotes or `$` in the paths
+    char *const argv[]{
+        const_cast<char *>(cc ? cc : "cc"),
+        const_cast<char *>("-O2"),
+        const_cast<char *>("-o"),
+        const_cast<char *>(exe_path.c_str()),
+        const_cast<char *>(path),
+        nullptr,
+    };
+    std::println("Running `{} -O2 -o {} {}`", argv[0], exe_path, path);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv, environ) != 0)
+        return false;
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return false;
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
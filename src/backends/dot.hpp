@@ -4,22 +4,26 @@
 #include <print>
 #include "backends/backend.hpp"
 #include "types/all.hpp"
+#include "utils/out_buffer.hpp"
+#include "trace.hpp"
 
 // TODO:
-// - on hover, show the type of the node
 // - show `Load`/`Store` nodes as `.x`/`.x = `
+// - show the names of structs/functions in the tooltip
 
 struct dot_backend final : backend
 {
     inline void compile(FILE *out, entt::registry const &reg);
+
+private:
+    out_buffer buf; // reused between `compile` calls
 };
 
-inline auto print_node(auto &out, entt::registry const &reg, entt::entity id) noexcept -> decltype(auto)
+// Print the attributes of the node, except for the tooltip
+inline auto print_node(auto out, entt::registry const &reg, entt::entity id) noexcept
 {
-    std::format_to(out, "n{} ", id);
-
-#define named_node(label) std::format_to(out, "[label=\"" label "\"]")
-#define circle_node(label, ...) std::format_to(out, "[label=\"" label "\", shape=circle" __VA_ARGS__ "]")
+#define named_node(label) std::format_to(out, "label=\"" label "\"")
+#define circle_node(label) std::format_to(out, "label=\"" label "\", shape=circle")
 
     auto &&[op, type] = reg.get<node_op const, node_type const>(id);
     switch (op)
@@ -49,25 +53,40 @@ inline auto print_node(auto &out, entt::registry const &reg, entt::entity id) no
     case node_op::Proj:
         // return std::format_to(out, "[label=\"Proj({})\"]", type.type->as<int_lit>()->n);
         // HACK: temporary
-        return std::format_to(out, "[label=\"Proj\"]");
+        return std::format_to(out, "label=\"Proj\"");
 
     case node_op::IConst:
-        return std::format_to(out, "[label=\"{}\"]", type.type->as<int_const>()->n);
+        return std::format_to(out, "label=\"{}\"", type.type->as<int_const>()->n);
     case node_op::FConst:
-        return std::format_to(out, "[label=\"{}\"]", type.type->as<float64>()->d);
+        return std::format_to(out, "label=\"{}\"", type.type->as<float64>()->d);
     case node_op::SConst:
-        return std::format_to(out, "[label=<string>]"); // TODO: show the contents here
+        return std::format_to(out, "label=<string>"); // TODO: show the contents here
     case node_op::BConst:
-        return std::format_to(out, "[label=\"{}\"]", type.type->as<bool_const>()->b);
+        return std::format_to(out, "label=\"{}\"", type.type->as<bool_const>()->b);
 
         // TODO: show struct name here
     case node_op::Struct:
         return named_node("Struct");
 
+    case node_op::VecSplat:
+        return named_node("VecSplat");
+    case node_op::VecLoad:
+        return named_node("VecLoad");
+    case node_op::VecAdd:
+        return named_node("VecAdd");
+    case node_op::VecSub:
+        return named_node("VecSub");
+    case node_op::VecMul:
+        return named_node("VecMul");
+    case node_op::VecReduce:
+        return named_node("VecReduce");
+
     case node_op::Addr:
         return named_node("Addr");
     case node_op::Deref:
         return named_node("Deref");
+    case node_op::CheckedIndex:
+        return named_node("CheckedIndex");
 
     case node_op::UnaryCompl:
         return circle_node("^");
@@ -76,13 +95,13 @@ inline auto print_node(auto &out, entt::registry const &reg, entt::entity id) no
     case node_op::UnaryNot:
         return circle_node("!");
     case node_op::Add:
-        return circle_node("+", ", tooltip=int32");
+        return circle_node("+");
     case node_op::Sub:
-        return circle_node("-", ", tooltip=int32");
+        return circle_node("-");
     case node_op::Mul:
-        return circle_node("*", ", tooltip=int32");
+        return circle_node("*");
     case node_op::Div:
-        return circle_node("/", ", tooltip=int32");
+        return circle_node("/");
     case node_op::CmpEq:
         return circle_node("==");
     case node_op::CmpNe:
@@ -107,13 +126,13 @@ inline auto print_node(auto &out, entt::registry const &reg, entt::entity id) no
         return circle_node("|");
 
     case node_op::Fadd:
-        return circle_node("+", ", tooltip=float64");
+        return circle_node("+");
     case node_op::Fsub:
-        return circle_node("-", ", tooltip=float64");
+        return circle_node("-");
     case node_op::Fmul:
-        return circle_node("*", ", tooltip=float64");
+        return circle_node("*");
     case node_op::Fdiv:
-        return circle_node("/", ", tooltip=float64");
+        return circle_node("/");
 
     case node_op::IfYes:
         return named_node("IfYes");
@@ -150,40 +169,84 @@ inline auto print_node(auto &out, entt::registry const &reg, entt::entity id) no
 #undef named_node
 }
 
+// Print a short description of `val` for the node's tooltip
+// NOTE: the names are static strings and the numbers are formatted in place, so this does not allocate
+inline auto print_tooltip(auto out, value const *val) noexcept
+{
+    if (auto i = val->as<int_value>())
+    {
+        if (auto c = val->as<int_const>())
+            return std::format_to(out, "int = {}", c->n);
+        if (auto b = i->bounds(); !b.is_full())
+            return std::format_to(out, "int in [{}, {}]", b.lo, b.hi);
+
+        return std::format_to(out, "int");
+    }
+
+    if (auto i = val->as<sized_int_value>())
+    {
+        auto const b = i->bounds();
+        return b.is_full()
+                   ? std::format_to(out, "sized int")
+                   : std::format_to(out, "sized int in [{}, {}]", b.lo, b.hi);
+    }
+
+    auto const name = val->as<value_error>()       ? "<error>"
+                      : val->as<float_value>()     ? "float"
+                      : val->as<bool_value>()      ? "bool"
+                      : val->as<string_>()         ? "string"
+                      : val->as<rune>()            ? "rune"
+                      : val->as<any_pointer>()     ? "pointer"
+                      : val->as<func>()            ? "func"
+                      : val->as<array_value>()     ? "array"
+                      : val->as<struct_value>()    ? "struct"
+                      : val->as<tuple>()           ? "tuple"
+                      : val->as<void_value>()      ? "void"
+                      : val->as<top_value>()       ? "top"
+                      : val->as<bot_value>()       ? "bot"
+                                                   : "<unknown>";
+
+    return std::format_to(out, "{}", name);
+}
+
 inline void dot_backend::compile(FILE *out, entt::registry const &reg)
 {
-    std::print(out, "digraph G {{\n"
-                    "  rankdir=BT;\n"
-                    "  node [shape=box];\n");
+    trace_zone _{"dot"};
+
+    buf.open(out);
+
+    buf.write("digraph G {\n"
+              "  rankdir=BT;\n"
+              "  node [shape=box];\n");
+
+    auto const types = reg.storage<node_type>();
 
     for (auto [id, ins] : reg.view<node_inputs const>().each())
     {
-        // TODO: find something more elegant and efficient
-        {
-            std::string str;
-            auto iter = std::back_inserter(str);
-            print_node(iter, reg, id);
-            std::println(out, "  {};", str);
-        }
+        buf.print("  n{} [", id);
+        print_node(buf.iter(), reg, id);
+        buf.write(", tooltip=\"");
+        print_tooltip(buf.iter(), types->get(id).type);
+        buf.write("\"];\n");
 
         for (size_t i{}; auto &&in : ins.nodes)
-            std::println(out, "  n{} -> n{} [label=\"in#{}\"];",
-                         id, in, i++);
+            buf.print("  n{} -> n{} [label=\"in#{}\"];\n", id, in, i++);
     }
 
     for (auto [dep, in] : reg.storage<ctrl_effect>()->each())
-        std::println(out, "  n{} -> n{} [color=red];", dep, in.target);
+        buf.print("  n{} -> n{} [color=red];\n", dep, in.target);
 
     // TODO: do you really need to show memory effect nodes?
     for (auto [dep, in] : reg.storage<mem_effect>()->each())
     {
         if (in.prev != entt::null)
-            std::println(out, "  n{} -> n{} [color=blue, style=dotted];", dep, in.prev);
-        std::println(out, "  n{} -> n{} [color=blue, label=\"#{}\"];", dep, in.target, in.tag);
+            buf.print("  n{} -> n{} [color=blue, style=dotted];\n", dep, in.prev);
+        buf.print("  n{} -> n{} [color=blue, label=\"#{}\"];\n", dep, in.target, in.tag);
     }
 
     for (auto [phi, region] : reg.storage<region_of_phi>()->each())
-        std::println(out, "  n{} -> n{} [style=dotted];", phi, region.region);
+        buf.print("  n{} -> n{} [style=dotted];\n", phi, region.region);
 
-    std::print(out, "}}");
+    buf.write("}");
+    buf.flush();
 }
@@ -0,0 +1,743 @@
+#pragma once
+
+#include <bit>
+#include <print>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "backends/backend.hpp"
+#include "backends/schedule.hpp"
+#include "types/all.hpp"
+
+// Graph interpreter
+// Runs the program straight from the graph: control flow follows the `ctrl_effect` chains starting from `Program`,
+// while data nodes are evaluated on demand and cached until the next control step that can change their value
+
+// TODO:
+// - `Store`s run when something uses them (the case for globals, the only ones the parser emits for now); run them in memory order instead
+// - order `Load`s after the `Store`s before them in the memory chain, rather than reading the latest value
+// - run `ExternCall`s through a table of built-in functions
+// - report the source location of a trap once nodes carry it
+// - copy nested aggregates deeply; a `Phi` or a call only copies the outer object for now
+
+using rt_bits = uint64_t; // raw bits of a runtime value; aggregates are the index of their object in the heap
+
+struct interp_stats final
+{
+    size_t ctrl_steps = 0;      // control nodes visited
+    size_t nodes_evaluated = 0; // data nodes evaluated (ie. cache misses)
+    size_t loads = 0;
+    size_t stores = 0;
+    size_t calls = 0;
+    size_t extern_calls = 0; // skipped, returning 0
+    size_t checks = 0;       // `CheckedIndex`es executed
+};
+
+struct interp_backend final : backend
+{
+    // Run the program, then write its exit code and the interpreter stats to `out`
+    inline void compile(FILE *out, entt::registry const &reg);
+
+    // Run the program; return the trap message, if any
+    inline char const *run(entt::registry const &reg) noexcept;
+
+    inline void report(FILE *out, char const *trapped) const noexcept;
+
+    size_t step_limit = size_t(1) << 32; // stop after this many control steps, in case the program never ends
+    interp_stats stats;
+};
+
+// the state of a running function
+struct interp_frame final
+{
+    entt::entity start;            // `Start` of the function, `Program` for the global code
+    std::span<rt_bits const> args; // values of the `Proj`s of `start`
+
+    entt::dense_map<entt::entity, std::pair<size_t, rt_bits>> cache; // data node -> (epoch, value)
+    entt::dense_map<entt::entity, rt_bits> results;                  // value of `Phi`s and control nodes that produce a value (eg. calls)
+    size_t epoch = 0;                                                // bumped by every control step that might change a cached value
+};
+
+struct interp_state final
+{
+    inline explicit interp_state(entt::registry const &reg, interp_stats &stats, size_t step_limit) noexcept;
+
+    // Follow the control flow from `entry` until a `Return` or `Exit`; return the node it stopped at (`null` on trap)
+    inline entt::entity run(interp_frame &frame, entt::entity entry) noexcept;
+
+    inline rt_bits eval(interp_frame &frame, entt::entity n) noexcept;
+    inline rt_bits compute(interp_frame &frame, entt::entity n) noexcept;
+    inline rt_bits call(interp_frame &caller, entt::entity n) noexcept;
+
+    // Set the `Phi`s of `region` to their `index`-th input, all at once
+    inline void enter_region(interp_frame &frame, entt::entity region, uint32_t index) noexcept;
+
+    // The heap object of `n` in the running call, resized to `size` zeroed slots; made on the first use, then reused
+    inline rt_bits object_of(entt::entity n, size_t size) noexcept;
+
+    // Copy the object `from` (made by another node) into the object of `n`, so that it outlives the next run of that node
+    inline rt_bits copy_object(entt::entity n, rt_bits from) noexcept;
+
+    inline rt_bits trap(char const *msg) noexcept
+    {
+        if (!trapped)
+            trapped = msg;
+        return 0;
+    }
+
+    entt::storage_for_t<node_op> const &ops;
+    entt::storage_for_t<node_type> const &types;
+    entt::storage_for_t<node_inputs> const &ins;
+    entt::storage_for_t<ctrl_effect> const &ctrl;
+    entt::storage_for_t<mem_effect> const &mem;
+    entt::storage_for_t<func_of_call> const &targets;
+    entt::storage_for_t<return_of_func> const &rets;
+
+    ctrl_successors succs;
+    entt::dense_map<entt::entity, std::vector<entt::entity>> phis; // `Region`/`Loop` -> its `Phi`s
+    entt::dense_map<entt::entity, rt_bits> globals;                // `Alloca`/`Store`s, which run once per program
+    entt::dense_set<entt::entity> object_phis;                     // `Phi`s of aggregates and packed values, which get their own copy
+    std::vector<std::vector<rt_bits>> heap;
+    std::vector<std::vector<rt_bits>> staged; // objects of `object_phis` while entering a region; kept to reuse their buffers
+
+    // NOTE: keyed by call depth, so a recursive call does not overwrite the objects of its caller
+    std::vector<entt::dense_map<entt::entity, rt_bits>> objects; // node -> its heap object, per call depth
+    size_t depth = 0;
+
+    interp_stats &stats;
+    size_t step_limit;
+    char const *trapped = nullptr;
+};
+
+// Truncate `bits` to the sized integer type of `ty`, if any, extending the sign back as needed
+template <std::integral... T>
+inline rt_bits wrap_to(value const *ty, rt_bits bits) noexcept
+{
+    (void)((ty->as<sized_int_<T>>() ? (bits = (rt_bits)(int64_t)(T)bits, true) : false) || ...);
+    return bits;
+}
+
+inline rt_bits wrap_int(value const *ty, rt_bits bits) noexcept
+{
+    return wrap_to<int8_t, int16_t, int32_t, uint8_t, uint16_t, uint32_t>(ty, bits);
+}
+
+inline bool is_unsigned_int(value const *ty) noexcept
+{
+    return ty->as<sized_int_<uint8_t>>() || ty->as<sized_int_<uint16_t>>() ||
+           ty->as<sized_int_<uint32_t>>() || ty->as<sized_int_<uint64_t>>();
+}
+
+inline size_t members_of(type const *ty) noexcept
+{
+    auto const comp = dynamic_cast<composite_type const *>(ty);
+    return comp ? comp->n_members : 1;
+}
+
+inline interp_state::interp_state(entt::registry const &reg, interp_stats &stats, size_t step_limit) noexcept
+    : ops{*reg.storage<node_op>()},
+      types{*reg.storage<node_type>()},
+      ins{*reg.storage<node_inputs>()},
+      ctrl{*reg.storage<ctrl_effect>()},
+      mem{*reg.storage<mem_effect>()},
+      targets{*reg.storage<func_of_call>()},
+      rets{*reg.storage<return_of_func>()},
+      succs{collect_successors(reg)},
+      stats{stats},
+      step_limit{step_limit}
+{
+    // NOTE: memory `Phi`s only order memory nodes, they have no value
+    for (auto [phi, region] : reg.storage<region_of_phi>()->each())
+        if (!mem.contains(phi))
+            phis[region.region].push_back(phi);
+
+    // NOTE: the node behind an aggregate makes its next value into the same object, see `object_of`
+    for (auto [phi, region] : reg.storage<region_of_phi>()->each())
+        if (!mem.contains(phi) && types.contains(phi))
+            if (auto const ty = types.get(phi).type; ty->as<struct_value>() || ty->as<array_value>())
+                object_phis.insert(phi);
+
+    // NOTE: packed nodes have the type of their lanes, so tell their `Phi`s apart by the inputs, through other `Phi`s too
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto [phi, region] : reg.storage<region_of_phi>()->each())
+        {
+            if (mem.contains(phi) || object_phis.contains(phi))
+                continue;
+
+            for (auto in : ins.get(phi).nodes)
+                if (is_packed_op(ops.get(in)) || object_phis.contains(in))
+                {
+                    object_phis.insert(phi);
+                    changed = true;
+                    break;
+                }
+        }
+    }
+}
+
+inline entt::entity interp_state::run(interp_frame &frame, entt::entity entry) noexcept
+{
+    auto cur = entry;
+    while (!trapped)
+    {
+        if (++stats.ctrl_steps > step_limit)
+            return trap("step limit reached"), entt::null;
+
+        switch (ops.get(cur))
+        {
+        case node_op::Return:
+        case node_op::Exit:
+            return cur;
+
+        case node_op::CallStatic:
+        case node_op::ExternCall:
+        {
+            auto const res = call(frame, cur);
+            frame.results[cur] = res;
+            ++frame.epoch; // the call might have written to memory
+            break;
+        }
+
+        case node_op::CheckedIndex:
+        {
+            ++stats.checks;
+            auto const &nins = ins.get(cur).nodes;
+            auto const i = eval(frame, nins[0]), len = eval(frame, nins[1]);
+            if (i >= len) // NOTE: negative indices wrap around to huge values
+                return trap("index out of bounds"), entt::null;
+
+            frame.results[cur] = i;
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        // pick the next control node; for branches, this is the `IfYes`/`IfNot` whose condition holds
+        ctrl_successor next{entt::null, 0};
+        if (auto iter = succs.find(cur); iter != succs.end())
+        {
+            for (auto s : iter->second)
+            {
+                auto const op = ops.get(s.node);
+                if (op == node_op::IfYes || op == node_op::IfNot)
+                {
+                    auto const cond = eval(frame, ins.get(s.node).nodes[0]) != 0;
+                    if (cond != (op == node_op::IfYes))
+                        continue;
+                }
+
+                next = s;
+                break;
+            }
+        }
+
+        if (next.node == entt::null)
+            return trap("control flow ended without a `Return`"), entt::null;
+
+        // NOTE: the end of a loop body goes back to its `Loop` through input 1, so both set their `Phi`s the same way
+        if (auto const op = ops.get(next.node); op == node_op::Region || op == node_op::Loop)
+            enter_region(frame, next.node, next.index);
+
+        cur = next.node;
+    }
+
+    return entt::null;
+}
+
+inline void interp_state::enter_region(interp_frame &frame, entt::entity region, uint32_t index) noexcept
+{
+    auto iter = phis.find(region);
+    if (iter == phis.end())
+    {
+        ++frame.epoch;
+        return;
+    }
+
+    // NOTE: every `Phi` reads the values from before entering the region, so compute all of them before updating any
+    std::vector<std::pair<entt::entity, rt_bits>> values;
+    values.reserve(iter->second.size());
+
+    for (auto phi : iter->second)
+    {
+        auto const &nins = ins.get(phi).nodes;
+        if (index >= nins.n)
+        {
+            trap("`Phi` has no input for this edge");
+            return;
+        }
+
+        values.push_back({phi, eval(frame, nins[index])});
+    }
+
+    // NOTE: the node behind an aggregate `Phi` makes its next value into the same object, so the `Phi` keeps its own copy
+    // ^ staged first, since a `Phi` might read the object of another `Phi` of this region
+    if (staged.size() < values.size())
+        staged.resize(values.size());
+
+    for (size_t i{}; i < values.size(); ++i)
+        if (auto const [phi, val] = values[i]; object_phis.contains(phi))
+        {
+            if (val >= heap.size())
+            {
+                trap("invalid memory access");
+                return;
+            }
+
+            staged[i].assign(heap[val].begin(), heap[val].end());
+        }
+
+    for (size_t i{}; i < values.size(); ++i)
+    {
+        auto const [phi, val] = values[i];
+        if (!object_phis.contains(phi))
+        {
+            frame.results[phi] = val;
+            continue;
+        }
+
+        auto const obj = object_of(phi, 0);
+        heap[obj].assign(staged[i].begin(), staged[i].end());
+        frame.results[phi] = obj;
+    }
+
+    ++frame.epoch;
+}
+
+inline rt_bits interp_state::object_of(entt::entity n, size_t size) noexcept
+{
+    if (objects.size() <= depth)
+        objects.resize(depth + 1);
+
+    auto [iter, fresh] = objects[depth].try_emplace(n, heap.size());
+    if (fresh)
+        heap.emplace_back();
+
+    heap[iter->second].assign(size, 0); // NOTE: keeps the capacity, so a reused object allocates nothing
+    return iter->second;
+}
+
+inline rt_bits interp_state::copy_object(entt::entity n, rt_bits from) noexcept
+{
+    if (trapped || from >= heap.size())
+        return trap("invalid memory access");
+
+    auto const obj = object_of(n, 0);
+    heap[obj] = heap[from];
+    return obj;
+}
+
+inline rt_bits interp_state::call(interp_frame &caller, entt::entity n) noexcept
+{
+    ++stats.calls;
+
+    if (ops.get(n) == node_op::ExternCall)
+    {
+        ++stats.extern_calls;
+        return 0;
+    }
+
+    auto const &nins = ins.get(n).nodes;
+    std::vector<rt_bits> args;
+    args.reserve(nins.n);
+    for (auto arg : nins)
+        args.push_back(eval(caller, arg));
+
+    auto const callee = targets.get(n).func;
+    if (!rets.contains(callee))
+        return trap("called a function without a body");
+
+    interp_frame frame{.start = callee, .args = args};
+    ++depth;
+    auto const end = run(frame, callee);
+    auto const res = (end != entt::null && ins.get(end).nodes.n != 0) ? eval(frame, ins.get(end).nodes[0]) : 0;
+    --depth;
+
+    if (end == entt::null)
+        return 0;
+
+    // NOTE: the callee reuses its objects on the next call, so the caller keeps a copy of a returned aggregate
+    auto const ty = types.get(n).type;
+    return (ty->as<struct_value>() || ty->as<array_value>()) ? copy_object(n, res) : res;
+}
+
+inline rt_bits interp_state::eval(interp_frame &frame, entt::entity n) noexcept
+{
+    if (trapped)
+        return 0;
+
+    switch (ops.get(n))
+    {
+    // these get their value from the control flow
+    case node_op::Phi:
+    case node_op::CallStatic:
+    case node_op::ExternCall:
+    case node_op::CheckedIndex:
+    {
+        auto iter = frame.results.find(n);
+        return iter != frame.results.end()
+                   ? iter->second
+                   : trap("value used before its control node ran");
+    }
+
+    // HACK: the parser only emits these for globals, so they run once per program
+    case node_op::Alloca:
+    case node_op::Store:
+    {
+        if (auto iter = globals.find(n); iter != globals.end())
+            return iter->second;
+
+        ++stats.nodes_evaluated;
+        auto const res = compute(frame, n);
+        globals[n] = res;
+        return res;
+    }
+
+    default:
+        break;
+    }
+
+    if (auto iter = frame.cache.find(n); iter != frame.cache.end() && iter->second.first == frame.epoch)
+        return iter->second.second;
+
+    ++stats.nodes_evaluated;
+    auto const res = compute(frame, n);
+    frame.cache[n] = {frame.epoch, res};
+    return res;
+}
+
+inline rt_bits interp_state::compute(interp_frame &frame, entt::entity n) noexcept
+{
+    auto const &nins = ins.get(n).nodes;
+    auto const ty = types.get(n).type;
+
+    auto const in = [&](uint32_t i) { return eval(frame, nins[i]); };
+    auto const fin = [&](uint32_t i) { return std::bit_cast<double>(in(i)); };
+    auto const is_float = [&](entt::entity e) { return types.get(e).type->as<float_value>() != nullptr; };
+
+    auto const float_bits = [](double d) { return std::bit_cast<rt_bits>(d); };
+
+    // the object and the slot accessed by a `Load`/`Store`
+    auto const slot = [&](uint64_t index) -> rt_bits *
+    {
+        auto const obj = eval(frame, mem.get(n).target);
+        if (trapped || obj >= heap.size() || index >= heap[obj].size())
+            return trap("invalid memory access"), nullptr;
+
+        return &heap[obj][index];
+    };
+
+    switch (ops.get(n))
+    {
+    case node_op::IConst:
+        return ty->as<int_const>()->n;
+    case node_op::FConst:
+        return float_bits(ty->as<float64>()->d);
+    case node_op::BConst:
+        return ty->as<bool_const>()->b;
+    case node_op::SConst:
+        return trap("strings are not supported yet");
+
+    case node_op::Proj:
+    {
+        auto const &eff = mem.get(n);
+        if (eff.target != frame.start || eff.tag >= frame.args.size())
+            return trap("parameter of another function");
+
+        return frame.args[eff.tag];
+    }
+
+    case node_op::UnaryCompl:
+        return wrap_int(ty, ~in(0));
+    case node_op::UnaryNeg:
+        return is_float(n) ? float_bits(-fin(0)) : wrap_int(ty, 0 - in(0));
+    case node_op::UnaryNot:
+        return !in(0);
+
+        // NOTE: the parser only emits the integer nodes for now, so floats are handled here as well
+#define arith_node(name, op)                                                     \
+    case node_op::name:                                                          \
+        return is_float(n) ? float_bits(fin(0) op fin(1)) : wrap_int(ty, in(0) op in(1))
+
+        arith_node(Add, +);
+        arith_node(Sub, -);
+        arith_node(Mul, *);
+
+#undef arith_node
+
+    case node_op::Div:
+    {
+        if (is_float(n))
+            return float_bits(fin(0) / fin(1));
+
+        auto const a = in(0), b = in(1);
+        if (b == 0)
+            return trap("division by zero");
+
+        if (is_unsigned_int(ty))
+            return a / b;
+
+        // NOTE: `min / -1` overflows, wrap it around instead
+        return (b == ~rt_bits{}) ? wrap_int(ty, 0 - a) : wrap_int(ty, (rt_bits)((int64_t)a / (int64_t)b));
+    }
+
+    case node_op::Fadd:
+        return float_bits(fin(0) + fin(1));
+    case node_op::Fsub:
+        return float_bits(fin(0) - fin(1));
+    case node_op::Fmul:
+        return float_bits(fin(0) * fin(1));
+    case node_op::Fdiv:
+        return float_bits(fin(0) / fin(1));
+
+    case node_op::LogicAnd:
+        return in(0) && in(1);
+    case node_op::LogicOr:
+        return in(0) || in(1);
+
+    case node_op::BitAnd:
+        return in(0) & in(1);
+    case node_op::BitXor:
+        return in(0) ^ in(1);
+    case node_op::BitOr:
+        return in(0) | in(1);
+
+    case node_op::ShiftLeft:
+    {
+        auto const a = in(0), b = in(1);
+        return b >= 64 ? 0 : wrap_int(ty, a << b);
+    }
+
+    case node_op::ShiftRight:
+    {
+        auto const a = in(0), b = in(1);
+        if (is_unsigned_int(ty))
+            return b >= 64 ? 0 : a >> b;
+
+        return (rt_bits)((int64_t)a >> std::min<rt_bits>(b, 63));
+    }
+
+    case node_op::CmpEq:
+        return is_float(nins[0]) ? fin(0) == fin(1) : in(0) == in(1);
+    case node_op::CmpNe:
+        return is_float(nins[0]) ? fin(0) != fin(1) : in(0) != in(1);
+
+        // NOTE: integers compare as signed unless they are unsigned sized integers
+#define cmp_node(name, op)                                                        \
+    case node_op::name:                                                           \
+        if (is_float(nins[0]))                                                    \
+            return fin(0) op fin(1);                                              \
+        if (is_unsigned_int(types.get(nins[0]).type))                             \
+            return in(0) op in(1);                                                \
+        return (int64_t)in(0) op (int64_t)in(1)
+
+        cmp_node(CmpLt, <);
+        cmp_node(CmpLe, <=);
+        cmp_node(CmpGt, >);
+        cmp_node(CmpGe, >=);
+
+#undef cmp_node
+
+    case node_op::Cast:
+    {
+        auto const from_float = is_float(nins[0]), to_float = is_float(n);
+        auto const val = in(0);
+
+        if (from_float && !to_float)
+            return wrap_int(ty, (rt_bits)(int64_t)std::bit_cast<double>(val));
+        if (!from_float && to_float)
+            return float_bits((double)(int64_t)val);
+
+        return from_float ? val : wrap_int(ty, val);
+    }
+
+    // NOTE: pointers are the objects they point to, so these are no-ops
+    case node_op::Addr:
+    case node_op::Deref:
+        return in(0);
+
+    case node_op::Struct:
+    {
+        // NOTE: members without an initializer are zero
+        auto const comp = ty->as<array_value>() ? members_of(ty->as<array_value>()->type)
+                          : ty->as<struct_value>()
+                              ? members_of(ty->as<struct_value>()->type)
+                              : nins.n;
+
+        // NOTE: evaluate the members before reusing the object, as they might read its previous value
+        // ^ the second `in` below is then a cache hit
+        for (uint32_t i{}; i < nins.n; ++i)
+            (void)in(i);
+
+        if (trapped)
+            return 0;
+
+        auto const obj = object_of(n, std::max<size_t>(comp, nins.n));
+        for (uint32_t i{}; i < nins.n; ++i)
+            heap[obj][i] = in(i);
+
+        return obj;
+    }
+
+    case node_op::Alloca:
+    {
+        auto const ptr = ty->as<pointer_value>();
+        heap.emplace_back(ptr && ptr->ty ? members_of(ptr->ty) : 1);
+        return heap.size() - 1;
+    }
+
+    case node_op::Load:
+    {
+        auto const index = (nins.n != 0) ? in(0) : mem.get(n).tag;
+        auto const s = slot(index);
+        if (!s)
+            return 0;
+
+        ++stats.loads;
+        return *s;
+    }
+
+    case node_op::Store:
+    {
+        auto const tag = mem.get(n).tag;
+        if (tag == ~uint32_t{})
+            return trap("`Store` at a runtime index");
+
+        auto const val = in(0);
+        auto const s = slot(tag);
+        if (!s)
+            return 0;
+
+        ++stats.stores;
+        *s = val;
+        return val;
+    }
+
+    // NOTE: packed values are objects of `vector_width` slots, one per packed node, overwritten every time it runs
+    case node_op::VecSplat:
+    {
+        auto const lane = in(0);
+        if (trapped)
+            return 0;
+
+        auto const obj = object_of(n, vector_width);
+        std::ranges::fill(heap[obj], lane);
+        return obj;
+    }
+
+    case node_op::VecLoad:
+    {
+        auto const index = in(0);
+        (void)slot(index); // NOTE: evaluates the target, so that `heap` does not grow while copying the lanes
+        if (trapped)
+            return 0;
+
+        auto const obj = object_of(n, vector_width);
+        for (uint32_t l{}; l < vector_width; ++l)
+        {
+            auto const s = slot(index + l);
+            if (!s)
+                return 0;
+
+            heap[obj][l] = *s;
+        }
+
+        ++stats.loads;
+        return obj;
+    }
+
+    case node_op::VecAdd:
+    case node_op::VecSub:
+    case node_op::VecMul:
+    {
+        auto const a = in(0), b = in(1);
+        if (trapped || a >= heap.size() || b >= heap.size())
+            return trap("invalid memory access");
+
+        // NOTE: `a` and `b` are objects of other nodes, so writing the lanes in place does not clobber them
+        auto const op = ops.get(n);
+        auto const obj = object_of(n, vector_width);
+        for (uint32_t l{}; l < vector_width; ++l)
+        {
+            auto const x = heap[a][l], y = heap[b][l];
+            if (is_float(n))
+            {
+                auto const fx = std::bit_cast<double>(x), fy = std::bit_cast<double>(y);
+                heap[obj][l] = float_bits(op == node_op::VecAdd ? fx + fy : op == node_op::VecSub ? fx - fy : fx * fy);
+            }
+            else
+                heap[obj][l] = wrap_int(ty, op == node_op::VecAdd ? x + y : op == node_op::VecSub ? x - y : x * y);
+        }
+
+        return obj;
+    }
+
+    case node_op::VecReduce:
+    {
+        auto const v = in(0);
+        if (trapped || v >= heap.size())
+            return trap("invalid memory access");
+
+        if (is_float(n))
+        {
+            double sum = 0.0;
+            for (auto lane : heap[v])
+                sum += std::bit_cast<double>(lane);
+            return float_bits(sum);
+        }
+
+        rt_bits sum = 0;
+        for (auto lane : heap[v])
+            sum += lane;
+        return wrap_int(ty, sum);
+    }
+
+    case node_op::Error:
+        return trap("reached a node with a type error");
+
+    default:
+        return trap("cannot evaluate this node");
+    }
+}
+
+inline char const *interp_backend::run(entt::registry const &reg) noexcept
+{
+    stats = {};
+    interp_state state{reg, stats, step_limit};
+
+    entt::entity program = entt::null;
+    for (auto [id, op] : state.ops.each())
+        if (op == node_op::Program)
+            program = id;
+
+    ensure(program != entt::null, "Graph has no `Program` node!");
+
+    interp_frame frame{.start = program};
+    (void)state.run(frame, frame.start);
+    return state.trapped;
+}
+
+inline void interp_backend::compile(FILE *out, entt::registry const &reg)
+{
+    report(out, run(reg));
+}
+
+inline void interp_backend::report(FILE *out, char const *trapped) const noexcept
+{
+    // TODO: read the exit code from the `Exit` node once it has one
+    if (trapped)
+        std::println(out, "trap: {}", trapped);
+    else
+        std::println(out, "exit code: {}", 0);
+
+    std::println(out, "control steps: {}", stats.ctrl_steps);
+    std::println(out, "nodes evaluated: {}", stats.nodes_evaluated);
+    std::println(out, "loads: {}", stats.loads);
+    std::println(out, "stores: {}", stats.stores);
+    std::println(out, "calls: {} ({} extern, skipped)", stats.calls, stats.extern_calls);
+    std::println(out, "bounds checks: {}", stats.checks);
+}
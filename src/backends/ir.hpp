@@ -0,0 +1,1092 @@
+#pragma once
+
+#include <bit>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <tuple>
+
+#include <entt/container/dense_map.hpp>
+
+#include "backends/backend.hpp"
+#include "builder.hpp"
+#include "types/all.hpp"
+#include "utils/function_ref.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define QUICKPROTO_IR_MMAP 1
+#else
+#define QUICKPROTO_IR_MMAP 0
+#endif
+
+// Binary IR
+// The node graph as flat arrays: nodes, their inputs, a constant pool of lattice values and a pool of the types they refer to
+// Every reference is an index into one of the arrays, and every array an offset from the start of the file, so the file
+// can be mapped anywhere and read in place; `load_ir` then rebuilds a `builder` from it
+
+// TODO:
+// - write the arrays in a fixed byte order; like the bytecode, files only move between machines with the same endianness
+// - keep the values of tuples, runes and errors; they are loaded as `top` for now
+// - keep the names of struct types once they have one, not just the hashes of their members
+// - let passes and backends read an `ir_view` directly instead of rebuilding the registry first
+// - store one file per package and link them on load
+
+inline constexpr uint32_t ir_magic = 'Q' | ('P' << 8) | ('I' << 16) | ('R' << 24);
+inline constexpr uint32_t ir_version = 6; // 2: `Loop`s have their back-edge as input 1, 3: packed nodes, 4: `CheckedIndex` moved after `Error`, 5: functions, `void` and `Import`s, 6: packed nodes moved after `Error`
+
+// stands for a missing node/value/type
+inline constexpr uint32_t ir_none = ~uint32_t{};
+
+// an array of the file, `offset` bytes from its start
+struct ir_section final
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ir_header final
+{
+    uint32_t magic = ir_magic;
+    uint32_t version = ir_version;
+    uint32_t program = ir_none;       // the `Program` node
+    uint32_t global_memory = ir_none; // the `GlobalMemory` node
+    ir_section nodes;
+    ir_section inputs; // `uint32_t` node indices
+    ir_section values;
+    ir_section types;
+    ir_section refs; // `uint32_t`s: members of struct values and struct types
+};
+
+enum ir_node_flags : uint8_t
+{
+    ir_has_mem = 1 << 0,
+    ir_mem_read = 1 << 1,
+    ir_mem_write = 1 << 2,
+    ir_error = 1 << 3,
+    ir_has_effect = 1 << 4, // `effect_of_func` is in `effect`
+};
+
+struct ir_node final
+{
+    node_op op;
+    uint8_t flags;
+    uint8_t vis;    // bit `i` for `ir_visibilities[i]`
+    uint8_t effect; // `func_effect`, if `ir_has_effect`
+    uint32_t type;  // index in the values
+    uint32_t first_input;
+    uint32_t n_inputs;
+    uint32_t ctrl; // `ctrl_effect` target
+    uint32_t mem_prev;
+    uint32_t mem_target;
+    uint32_t mem_tag;
+    uint32_t link; // `region_of_phi` of a `Phi`, `func_of_call` of a call, `return_of_func` of a `Start`, the name of an `Import`
+};
+
+static_assert(sizeof(ir_node) == 36);
+
+inline constexpr visibility ir_visibilities[]{
+    visibility::reachable,
+    visibility::global,
+    visibility::maybe_reachable,
+    visibility::unreachable,
+};
+
+enum class ir_value_kind : uint8_t
+{
+    Opaque, // not kept; loaded as `top_value`
+    Top,
+    Bot,
+    IntTop,
+    IntBot,
+    IntConst,   // `a`
+    IntRange,   // [`a`, `b`]
+    SizedTop,   // `sized` is the index in `ir_sized_ints`
+    SizedBot,   //
+    SizedConst, // `a`
+    SizedRange, // [`a`, `b`]
+    FloatTop,
+    FloatBot,
+    Float32, // `a` holds the bits
+    Float64, // `a` holds the bits
+    BoolTop,
+    BoolBot,
+    BoolConst, // `a`
+    StringTop,
+    StringBot,
+    String,
+    Nil,
+    PointerTop, // `ref` is the type
+    Pointer,    //
+    PointerBot, //
+    Array,      // `ref` is the type
+    Struct,     // `ref` is the type; the values of its members are `refs[a..a+b)`
+    Void,
+    Func, // `sized` is 1 for `extern`; the return value then the parameters are `refs[a..a+b)`
+};
+
+struct ir_value final
+{
+    ir_value_kind kind;
+    uint8_t sized;
+    uint16_t reserved;
+    uint32_t ref;
+    uint64_t a;
+    uint64_t b;
+};
+
+static_assert(sizeof(ir_value) == 24);
+
+enum class ir_type_kind : uint8_t
+{
+    Opaque, // not kept; loaded as `void`
+    Int,
+    Sized, // `sized` is the index in `ir_sized_ints`
+    Float64,
+    Bool,
+    String,
+    Rune,
+    Void,
+    Pointer, // `base`
+    Array,   // `n` elements of `base`
+    Struct,  // `n` members, as (name hash, type) pairs at `refs[first..first+2n)`
+};
+
+struct ir_type final
+{
+    ir_type_kind kind;
+    uint8_t sized;
+    uint16_t reserved;
+    uint32_t base;
+    uint32_t first;
+    uint32_t n;
+};
+
+static_assert(sizeof(ir_type) == 16);
+
+using ir_sized_ints = std::tuple<int8_t, int16_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t>;
+
+// Call `fn.template operator()<T>()` with the `index`th type of `ir_sized_ints`
+template <typename Fn>
+inline void visit_sized_int(uint8_t index, Fn &&fn) noexcept
+{
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        (void)((index == I ? (fn.template operator()<std::tuple_element_t<I, ir_sized_ints>>(), true) : false) || ...);
+    }(std::make_index_sequence<std::tuple_size_v<ir_sized_ints>>{});
+}
+
+// Call `fn.template operator()<T>()` for every type of `ir_sized_ints` along with its index, until it returns `true`
+template <typename Fn>
+inline bool find_sized_int(Fn &&fn) noexcept
+{
+    return [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        return (fn.template operator()<std::tuple_element_t<I, ir_sized_ints>>((uint8_t)I) || ...);
+    }(std::make_index_sequence<std::tuple_size_v<ir_sized_ints>>{});
+}
+
+// Write the graph in `reg`, to be loaded later with `ir_view` + `load_ir`
+struct ir_backend final : backend
+{
+    inline void compile(FILE *out, entt::registry const &reg);
+};
+
+// Write the nodes `ns` of `reg`; every other node they point to must be in `imports`, and is written as an `Import` of
+// that name, to be resolved by `splice_ir`
+inline void write_ir(FILE *out, entt::registry const &reg, std::span<entt::entity const> ns,
+                     entt::dense_map<entt::entity, hashed_name> const &imports = {});
+
+// A file written by `ir_backend`, mapped in memory and checked; the arrays point straight into the mapping
+struct ir_view final
+{
+    // `nullopt` if the file cannot be read, or is not a valid IR file of this version
+    inline static std::optional<ir_view> open(char const *path) noexcept;
+
+    // `nullopt` if `data` is not a valid IR file of this version; the view reads `data` in place, so it must outlive the view
+    inline static std::optional<ir_view> borrow(std::span<uint64_t const> data, size_t size) noexcept;
+
+    inline ir_view(ir_view &&other) noexcept;
+    ir_view(ir_view const &) = delete;
+    ir_view &operator=(ir_view const &) = delete;
+    inline ~ir_view() noexcept;
+
+    ir_header const *header = nullptr;
+    std::span<ir_node const> nodes;
+    std::span<uint32_t const> inputs;
+    std::span<ir_value const> values;
+    std::span<ir_type const> types;
+    std::span<uint32_t const> refs;
+
+private:
+    inline ir_view() noexcept = default;
+
+    // check every index in the file, so that loading it never reads out of bounds
+    inline bool validate(size_t size) noexcept;
+
+    void const *data = nullptr;
+    size_t size = 0;
+    bool owned = true;
+};
+
+// Rebuild the graph of `view` into `bld`, which must be empty; `vis` becomes the current (global) visibility scope
+inline void load_ir(ir_view const &view, builder &bld, scope_visibility &vis) noexcept;
+
+// Add the nodes of `view` (part of a graph, see `write_ir`) to the graph of `bld`; its `Program` and `GlobalMemory` become
+// the ones of `bld`, and every `Import` becomes `resolve(name, import)`
+// Return the entity of each node of `view`, or `nullopt` (adding nothing) if `resolve` gives `null` for any of them
+inline std::optional<std::vector<entt::entity>> splice_ir(ir_view const &view, builder &bld,
+                                                          function_ref<entt::entity(hashed_name, ir_node const &)> resolve) noexcept;
+
+struct ir_writer final
+{
+    struct value_hash final
+    {
+        inline size_t operator()(ir_value const &v) const noexcept
+        {
+            auto h = (size_t)v.kind * 31 + v.sized;
+            h = h * 31 + v.ref;
+            h = h * 1'000'003 ^ v.a;
+            return h * 1'000'003 ^ v.b;
+        }
+    };
+
+    struct value_eq final
+    {
+        inline bool operator()(ir_value const &lhs, ir_value const &rhs) const noexcept
+        {
+            return lhs.kind == rhs.kind && lhs.sized == rhs.sized && lhs.ref == rhs.ref && lhs.a == rhs.a && lhs.b == rhs.b;
+        }
+    };
+
+    inline uint32_t node_of(entt::entity n) const noexcept
+    {
+        if (n == entt::null)
+            return ir_none;
+
+        auto iter = index.find(n);
+        return iter != index.end() ? iter->second : ir_none;
+    }
+
+    inline uint32_t value_of(value const *v) noexcept;
+    inline uint32_t type_of(type const *t) noexcept;
+
+    std::vector<ir_node> nodes;
+    std::vector<uint32_t> inputs;
+    std::vector<ir_value> values;
+    std::vector<ir_type> types;
+    std::vector<uint32_t> refs;
+
+    entt::dense_map<entt::entity, uint32_t> index;
+    entt::dense_map<value const *, uint32_t> value_index;
+    entt::dense_map<ir_value, uint32_t, value_hash, value_eq> pool; // deduplicates constants by content
+    entt::dense_map<type const *, uint32_t> type_index;
+};
+
+inline uint32_t ir_writer::value_of(value const *v) noexcept
+{
+    if (auto iter = value_index.find(v); iter != value_index.end())
+        return iter->second;
+
+    ir_value res{};
+
+    if (!v || v->as<top_value>())
+        res.kind = ir_value_kind::Top;
+    else if (v->as<bot_value>())
+        res.kind = ir_value_kind::Bot;
+    else if (auto i = v->as<int_value>())
+    {
+        auto const b = i->bounds();
+        if (auto c = v->as<int_const>())
+            res = {.kind = ir_value_kind::IntConst, .a = c->n};
+        else if (v->as<int_range>())
+            res = {.kind = ir_value_kind::IntRange, .a = (uint64_t)b.lo, .b = (uint64_t)b.hi};
+        else
+            res.kind = v->as<int_bot>() ? ir_value_kind::IntBot : ir_value_kind::IntTop;
+    }
+    else if (v->as<sized_int_value>())
+    {
+        (void)find_sized_int([&]<typename T>(uint8_t index)
+                             {
+                                 if (!v->as<sized_int_<T>>())
+                                     return false;
+
+                                 res.sized = index;
+                                 if (auto c = v->as<sized_int_const<T>>())
+                                 {
+                                     res.kind = ir_value_kind::SizedConst;
+                                     res.a = (uint64_t)c->value;
+                                 }
+                                 else if (auto r = v->as<sized_int_range<T>>())
+                                 {
+                                     res.kind = ir_value_kind::SizedRange;
+                                     res.a = (uint64_t)r->b.lo;
+                                     res.b = (uint64_t)r->b.hi;
+                                 }
+                                 else
+                                     res.kind = v->as<sized_int_bot<T>>() ? ir_value_kind::SizedBot : ir_value_kind::SizedTop;
+
+                                 return true; //
+                             });
+    }
+    else if (v->as<float_value>())
+    {
+        if (auto f = v->as<float64>())
+            res = {.kind = ir_value_kind::Float64, .a = std::bit_cast<uint64_t>(f->d)};
+        else if (auto f = v->as<float32>())
+            res = {.kind = ir_value_kind::Float32, .a = std::bit_cast<uint32_t>(f->f)};
+        else
+            res.kind = v->as<float_bot>() ? ir_value_kind::FloatBot : ir_value_kind::FloatTop;
+    }
+    else if (v->as<bool_value>())
+    {
+        if (auto b = v->as<bool_const>())
+            res = {.kind = ir_value_kind::BoolConst, .a = b->b};
+        else
+            res.kind = v->as<bool_bot>() ? ir_value_kind::BoolBot : ir_value_kind::BoolTop;
+    }
+    else if (v->as<string_>())
+        res.kind = v->as<string_top>()   ? ir_value_kind::StringTop
+                   : v->as<string_bot>() ? ir_value_kind::StringBot
+                                         : ir_value_kind::String;
+    else if (v->as<nil_value>())
+        res.kind = ir_value_kind::Nil;
+    else if (auto p = v->as<pointer_value>())
+        res = {.kind = ir_value_kind::Pointer, .ref = type_of(p->ty)};
+    else if (auto p = v->as<pointer_top>())
+        res = {.kind = ir_value_kind::PointerTop, .ref = type_of(p->ty)};
+    else if (auto p = v->as<pointer_bot>())
+        res = {.kind = ir_value_kind::PointerBot, .ref = type_of(p->ty)};
+    else if (auto a = v->as<array_value>())
+        res = {.kind = ir_value_kind::Array, .ref = type_of(a->type)};
+    else if (auto s = v->as<struct_value>())
+    {
+        // NOTE: the members go first, so a value only ever refers to the ones before it
+        std::vector<uint32_t> members(s->n_values);
+        for (size_t i{}; i < s->n_values; ++i)
+            members[i] = value_of(s->values[i]);
+
+        res = {.kind = ir_value_kind::Struct, .ref = type_of(s->type), .a = refs.size(), .b = members.size()};
+        refs.insert(refs.end(), members.begin(), members.end());
+    }
+    else if (v->as<void_value>())
+        res.kind = ir_value_kind::Void;
+    else if (auto f = v->as<func_const>())
+    {
+        // NOTE: same as the members of a struct
+        std::vector<uint32_t> sig(1 + f->params.n);
+        sig[0] = value_of(f->ret);
+        for (size_t i{}; i < f->params.n; ++i)
+            sig[1 + i] = value_of(f->params[i]);
+
+        res = {.kind = ir_value_kind::Func, .sized = f->is_extern, .a = refs.size(), .b = sig.size()};
+        refs.insert(refs.end(), sig.begin(), sig.end());
+    }
+    else
+        res.kind = ir_value_kind::Opaque;
+
+    auto [iter, added] = pool.try_emplace(res, (uint32_t)values.size());
+    if (added)
+        values.push_back(res);
+
+    value_index[v] = iter->second;
+    return iter->second;
+}
+
+inline uint32_t ir_writer::type_of(type const *t) noexcept
+{
+    if (auto iter = type_index.find(t); iter != type_index.end())
+        return iter->second;
+
+    // NOTE: claimed before the members are written, as a struct can point to itself
+    auto const at = (uint32_t)types.size();
+    type_index[t] = at;
+    types.push_back({});
+
+    ir_type res{};
+
+    if (!t)
+        res.kind = ir_type_kind::Opaque;
+    else if (t->as<sint_type>())
+        res.kind = ir_type_kind::Int;
+    else if (t->as<float64_type>())
+        res.kind = ir_type_kind::Float64;
+    else if (t->as<bool_type>())
+        res.kind = ir_type_kind::Bool;
+    else if (t->as<string_type>())
+        res.kind = ir_type_kind::String;
+    else if (t->as<rune_type>())
+        res.kind = ir_type_kind::Rune;
+    else if (t->as<void_type>())
+        res.kind = ir_type_kind::Void;
+    else if (auto p = t->as<pointer_type>())
+        res = {.kind = ir_type_kind::Pointer, .base = type_of(p->base)};
+    else if (auto a = t->as<array_type>())
+        res = {.kind = ir_type_kind::Array, .base = type_of(a->base), .n = (uint32_t)a->n_members};
+    else if (auto s = t->as<struct_type>())
+    {
+        std::vector<uint32_t> members(2 * s->n_members);
+        for (size_t i{}; i < s->n_members; ++i)
+        {
+            members[2 * i] = (uint32_t)s->members[i].name;
+            members[2 * i + 1] = type_of(s->members[i].ty);
+        }
+
+        res = {.kind = ir_type_kind::Struct, .first = (uint32_t)refs.size(), .n = (uint32_t)s->n_members};
+        refs.insert(refs.end(), members.begin(), members.end());
+    }
+    else if (!find_sized_int([&]<typename T>(uint8_t index)
+                             {
+                                 if (!t->as<sized_int_type<T>>())
+                                     return false;
+
+                                 res = {.kind = ir_type_kind::Sized, .sized = index};
+                                 return true; //
+                             }))
+        res.kind = ir_type_kind::Opaque;
+
+    types[at] = res;
+    return at;
+}
+
+inline void ir_backend::compile(FILE *out, entt::registry const &reg)
+{
+    std::vector<entt::entity> ns;
+    for (auto [id, op] : reg.storage<node_op>()->each())
+        ns.push_back(id);
+
+    write_ir(out, reg, ns);
+}
+
+inline void write_ir(FILE *out, entt::registry const &reg, std::span<entt::entity const> ns,
+                     entt::dense_map<entt::entity, hashed_name> const &imports)
+{
+    auto const &ops = *reg.storage<node_op>();
+    auto const &types = *reg.storage<node_type>();
+    auto const &ins = *reg.storage<node_inputs>();
+    auto const &ctrl = *reg.storage<ctrl_effect>();
+    auto const &mem = *reg.storage<mem_effect>();
+    auto const reads = reg.storage<mem_read>();
+    auto const writes = reg.storage<mem_write>();
+    auto const errors = reg.storage<error_node>();
+    auto const regions = reg.storage<region_of_phi>();
+    auto const calls = reg.storage<func_of_call>();
+    auto const rets = reg.storage<return_of_func>();
+    auto const effects = reg.storage<effect_of_func>();
+
+    tag_storage const *vis[std::size(ir_visibilities)];
+    for (size_t i{}; i < std::size(ir_visibilities); ++i)
+        vis[i] = reg.storage<void>((entt::id_type)ir_visibilities[i]);
+
+    ir_writer w;
+    ir_header header;
+
+    for (auto id : ns)
+    {
+        auto const op = ops.get(id);
+        w.index[id] = (uint32_t)w.index.size();
+        if (op == node_op::Program)
+            header.program = w.index[id];
+        else if (op == node_op::GlobalMemory)
+            header.global_memory = w.index[id];
+    }
+
+    // NOTE: the `Import`s go last, so the nodes of `ns` keep their order
+    for (auto &&[id, name] : imports)
+        w.index[id] = (uint32_t)w.index.size();
+
+    w.nodes.reserve(w.index.size());
+    for (auto id : ns)
+    {
+        auto const op = ops.get(id);
+        ir_node n{
+            .op = op,
+            .type = w.value_of(types.get(id).type),
+            .first_input = (uint32_t)w.inputs.size(),
+            .ctrl = ctrl.contains(id) ? w.node_of(ctrl.get(id).target) : ir_none,
+            .mem_prev = ir_none,
+            .mem_target = ir_none,
+            .link = ir_none,
+        };
+
+        auto const &nins = ins.get(id).nodes;
+        n.n_inputs = (uint32_t)nins.n;
+        for (auto in : nins)
+            w.inputs.push_back(w.node_of(in));
+
+        if (mem.contains(id))
+        {
+            auto const &eff = mem.get(id);
+            n.flags |= ir_has_mem;
+            n.mem_prev = w.node_of(eff.prev);
+            n.mem_target = w.node_of(eff.target);
+            n.mem_tag = eff.tag;
+        }
+
+        if (reads && reads->contains(id))
+            n.flags |= ir_mem_read;
+        if (writes && writes->contains(id))
+            n.flags |= ir_mem_write;
+        if (errors && errors->contains(id))
+            n.flags |= ir_error;
+
+        if (effects && effects->contains(id))
+        {
+            n.flags |= ir_has_effect;
+            n.effect = (uint8_t)effects->get(id).effect;
+        }
+
+        if (regions && regions->contains(id))
+            n.link = w.node_of(regions->get(id).region);
+        else if (calls && calls->contains(id))
+            n.link = w.node_of(calls->get(id).func);
+        else if (rets && rets->contains(id))
+            n.link = w.node_of(rets->get(id).ret);
+
+        for (size_t i{}; i < std::size(vis); ++i)
+            if (vis[i] && vis[i]->contains(id))
+                n.vis |= 1 << i;
+
+        w.nodes.push_back(n);
+    }
+
+    // NOTE: calls look at the effect of the function, so the `Import` of a function carries it too
+    for (auto &&[id, name] : imports)
+    {
+        ir_node n{
+            .op = node_op::Import,
+            .type = w.value_of(types.get(id).type),
+            .first_input = (uint32_t)w.inputs.size(),
+            .n_inputs = 0,
+            .ctrl = ir_none,
+            .mem_prev = ir_none,
+            .mem_target = ir_none,
+            .link = (uint32_t)name,
+        };
+
+        if (effects && effects->contains(id))
+        {
+            n.flags |= ir_has_effect;
+            n.effect = (uint8_t)effects->get(id).effect;
+        }
+
+        w.nodes.push_back(n);
+    }
+
+    // NOTE: every array starts 8-byte aligned, so the reader can use them in place
+    uint64_t offset = sizeof(ir_header);
+    auto const section = [&](auto const &vec)
+    {
+        ir_section const s{.offset = offset, .count = vec.size()};
+        offset += (vec.size() * sizeof(vec[0]) + 7) & ~uint64_t{7};
+        return s;
+    };
+
+    header.nodes = section(w.nodes);
+    header.inputs = section(w.inputs);
+    header.values = section(w.values);
+    header.types = section(w.types);
+    header.refs = section(w.refs);
+
+    auto const write = [&](auto const &vec)
+    {
+        auto const bytes = vec.size() * sizeof(vec[0]);
+        uint64_t const zero = 0;
+        return fwrite(vec.data(), 1, bytes, out) == bytes &&
+               fwrite(&zero, 1, (8 - bytes % 8) % 8, out) == (8 - bytes % 8) % 8;
+    };
+
+    ensure(fwrite(&header, sizeof(header), 1, out) == 1 &&
+               write(w.nodes) && write(w.inputs) && write(w.values) && write(w.types) && write(w.refs),
+           "Cannot write the IR!");
+}
+
+inline std::optional<ir_view> ir_view::open(char const *path) noexcept
+{
+    ir_view view;
+
+#if QUICKPROTO_IR_MMAP
+    auto const fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ir_header))
+    {
+        close(fd);
+        return std::nullopt;
+    }
+
+    auto const data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return std::nullopt;
+
+    view.data = data;
+    view.size = (size_t)st.st_size;
+#else
+    // NOTE: no mapping here, so read the file in one go instead; `uint64_t`s keep the arrays aligned
+    auto f = fopen(path, "rb");
+    if (!f)
+        return std::nullopt;
+
+    fseek(f, 0, SEEK_END);
+    auto const n = (size_t)ftell(f);
+    rewind(f);
+
+    auto data = new uint64_t[(n + 7) / 8];
+    auto const read = fread(data, 1, n, f);
+    fclose(f);
+
+    view.data = data;
+    view.size = n;
+    if (read != n || n < sizeof(ir_header))
+        return std::nullopt;
+#endif
+
+    if (!view.validate(view.size))
+        return std::nullopt;
+
+    return std::optional<ir_view>{std::move(view)};
+}
+
+inline std::optional<ir_view> ir_view::borrow(std::span<uint64_t const> data, size_t size) noexcept
+{
+    if (size < sizeof(ir_header) || size > data.size_bytes())
+        return std::nullopt;
+
+    ir_view view;
+    view.data = data.data();
+    view.size = size;
+    view.owned = false;
+
+    if (!view.validate(view.size))
+        return std::nullopt;
+
+    return std::optional<ir_view>{std::move(view)};
+}
+
+inline ir_view::ir_view(ir_view &&other) noexcept
+    : header{std::exchange(other.header, nullptr)},
+      nodes{other.nodes},
+      inputs{other.inputs},
+      values{other.values},
+      types{other.types},
+      refs{other.refs},
+      data{std::exchange(other.data, nullptr)},
+      size{std::exchange(other.size, 0)},
+      owned{other.owned}
+{
+}
+
+inline ir_view::~ir_view() noexcept
+{
+    if (!data || !owned)
+        return;
+
+#if QUICKPROTO_IR_MMAP
+    munmap(const_cast<void *>(data), size);
+#else
+    delete[] (uint64_t const *)data;
+#endif
+}
+
+inline bool ir_view::validate(size_t file_size) noexcept
+{
+    auto const bytes = (uint8_t const *)data;
+    header = (ir_header const *)bytes;
+    if (header->magic != ir_magic || header->version != ir_version)
+        return false;
+
+    auto const get = [&]<typename T>(std::span<T const> &out, ir_section s)
+    {
+        if (s.offset % 8 != 0 || s.offset > file_size || s.count > (file_size - s.offset) / sizeof(T))
+            return false;
+
+        out = {(T const *)(bytes + s.offset), (size_t)s.count};
+        return true;
+    };
+
+    if (!get(nodes, header->nodes) || !get(inputs, header->inputs) || !get(values, header->values) ||
+        !get(types, header->types) || !get(refs, header->refs))
+        return false;
+
+    auto const node_ok = [&](uint32_t n) { return n == ir_none || n < nodes.size(); };
+    auto const range_ok = [](uint64_t first, uint64_t n, size_t size) { return first <= size && n <= size - first; };
+
+    if (!node_ok(header->program) || !node_ok(header->global_memory))
+        return false;
+
+    for (auto in : inputs)
+        if (!node_ok(in))
+            return false;
+
+    for (auto const &n : nodes)
+        if (n.op > node_op::Import || n.type >= values.size() || !range_ok(n.first_input, n.n_inputs, inputs.size()) ||
+            !node_ok(n.ctrl) || !node_ok(n.mem_prev) || !node_ok(n.mem_target) ||
+            (n.op != node_op::Import && !node_ok(n.link)) || n.effect > (uint8_t)func_effect::Write)
+            return false;
+
+    for (size_t i{}; i < values.size(); ++i)
+    {
+        auto const &v = values[i];
+        if (v.kind > ir_value_kind::Func || v.sized >= std::tuple_size_v<ir_sized_ints>)
+            return false;
+
+        switch (v.kind)
+        {
+        case ir_value_kind::PointerTop:
+        case ir_value_kind::Pointer:
+        case ir_value_kind::PointerBot:
+        case ir_value_kind::Array:
+            if (v.ref >= types.size())
+                return false;
+            break;
+
+        case ir_value_kind::Struct:
+            if (v.ref >= types.size() || !range_ok(v.a, v.b, refs.size()))
+                return false;
+
+            for (auto m : refs.subspan(v.a, v.b))
+                if (m >= i)
+                    return false;
+            break;
+
+        case ir_value_kind::Func:
+            if (v.b == 0 || !range_ok(v.a, v.b, refs.size()))
+                return false;
+
+            for (auto m : refs.subspan(v.a, v.b))
+                if (m >= i)
+                    return false;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    for (auto const &t : types)
+    {
+        if (t.kind > ir_type_kind::Struct || t.sized >= std::tuple_size_v<ir_sized_ints>)
+            return false;
+
+        if ((t.kind == ir_type_kind::Pointer || t.kind == ir_type_kind::Array) && t.base >= types.size())
+            return false;
+
+        if (t.kind == ir_type_kind::Struct)
+        {
+            if (!range_ok(t.first, 2 * (uint64_t)t.n, refs.size()))
+                return false;
+
+            for (uint32_t m{}; m < t.n; ++m)
+                if (refs[t.first + 2 * m + 1] >= types.size())
+                    return false;
+        }
+    }
+
+    return true;
+}
+
+namespace ir_detail
+{
+    // The values of `view`, along with the types they point to
+    inline std::vector<value const *> load_values(ir_view const &view) noexcept
+    {
+        // types, in two passes as they can refer to each other in cycles
+        std::vector<type *> types(view.types.size());
+        for (size_t i{}; i < types.size(); ++i)
+        {
+            auto const &t = view.types[i];
+            switch (t.kind)
+            {
+            case ir_type_kind::Int:
+                types[i] = new sint_type{};
+                break;
+            case ir_type_kind::Sized:
+                visit_sized_int(t.sized, [&]<typename T>()
+                                { types[i] = new sized_int_type<T>{}; });
+                break;
+            case ir_type_kind::Float64:
+                types[i] = new float64_type{};
+                break;
+            case ir_type_kind::Bool:
+                types[i] = new bool_type{};
+                break;
+            case ir_type_kind::String:
+                types[i] = new string_type{};
+                break;
+            case ir_type_kind::Rune:
+                types[i] = new rune_type{};
+                break;
+            case ir_type_kind::Pointer:
+                types[i] = new pointer_type{nullptr};
+                break;
+            case ir_type_kind::Array:
+                types[i] = new array_type{nullptr, t.n};
+                break;
+            case ir_type_kind::Struct:
+                types[i] = new struct_type{t.n, std::make_unique<member_decl[]>(t.n)};
+                break;
+            default:
+                types[i] = new void_type{};
+                break;
+            }
+        }
+
+        for (size_t i{}; i < types.size(); ++i)
+        {
+            auto const &t = view.types[i];
+            if (t.kind == ir_type_kind::Pointer)
+                static_cast<pointer_type *>(types[i])->base = types[t.base];
+            else if (t.kind == ir_type_kind::Array)
+                static_cast<array_type *>(types[i])->base = types[t.base];
+            else if (t.kind == ir_type_kind::Struct)
+                for (uint32_t m{}; m < t.n; ++m)
+                    static_cast<struct_type *>(types[i])->members[m] = {
+                        .name = (hashed_name)view.refs[t.first + 2 * m],
+                        .ty = types[view.refs[t.first + 2 * m + 1]],
+                    };
+        }
+
+        // values; the members of a struct come before it
+        std::vector<value const *> values(view.values.size());
+        for (size_t i{}; i < values.size(); ++i)
+        {
+            auto const &v = view.values[i];
+            auto const bounds = int_bounds{(int64_t)v.a, (int64_t)v.b};
+
+            switch (v.kind)
+            {
+            case ir_value_kind::Bot:
+                values[i] = bot_value::self();
+                break;
+            case ir_value_kind::IntTop:
+                values[i] = int_value::top();
+                break;
+            case ir_value_kind::IntBot:
+                values[i] = int_value::bot();
+                break;
+            case ir_value_kind::IntConst:
+                values[i] = int_value::make(v.a);
+                break;
+            case ir_value_kind::IntRange:
+                values[i] = int_value::make_range(bounds);
+                break;
+
+            case ir_value_kind::SizedTop:
+                visit_sized_int(v.sized, [&]<typename T>()
+                                { values[i] = sized_int_top<T>::self(); });
+                break;
+            case ir_value_kind::SizedBot:
+                visit_sized_int(v.sized, [&]<typename T>()
+                                { values[i] = new sized_int_bot<T>{}; });
+                break;
+            case ir_value_kind::SizedConst:
+                visit_sized_int(v.sized, [&]<typename T>()
+                                { values[i] = new sized_int_const<T>{(T)v.a}; });
+                break;
+            case ir_value_kind::SizedRange:
+                visit_sized_int(v.sized, [&]<typename T>()
+                                { values[i] = new sized_int_range<T>{bounds}; });
+                break;
+
+            case ir_value_kind::FloatTop:
+                values[i] = float_top::self();
+                break;
+            case ir_value_kind::FloatBot:
+                values[i] = float_bot::self();
+                break;
+            case ir_value_kind::Float32:
+                values[i] = new float32{std::bit_cast<float>((uint32_t)v.a)};
+                break;
+            case ir_value_kind::Float64:
+                values[i] = new float64{std::bit_cast<double>(v.a)};
+                break;
+
+            case ir_value_kind::BoolTop:
+                values[i] = bool_top::self();
+                break;
+            case ir_value_kind::BoolBot:
+                values[i] = bool_bot::self();
+                break;
+            case ir_value_kind::BoolConst:
+                values[i] = bool_const::make(v.a != 0);
+                break;
+
+            case ir_value_kind::StringTop:
+                values[i] = string_top::self();
+                break;
+            case ir_value_kind::StringBot:
+                values[i] = new string_bot{};
+                break;
+            case ir_value_kind::String:
+                values[i] = new string_value{};
+                break;
+
+            case ir_value_kind::Nil:
+                values[i] = nil_value::self();
+                break;
+            case ir_value_kind::PointerTop:
+                values[i] = new pointer_top{types[v.ref]};
+                break;
+            case ir_value_kind::Pointer:
+                values[i] = new pointer_value{types[v.ref]};
+                break;
+            case ir_value_kind::PointerBot:
+                values[i] = new pointer_bot{types[v.ref]};
+                break;
+
+            case ir_value_kind::Array:
+                values[i] = new array_value{static_cast<array_type const *>(types[v.ref])};
+                break;
+
+            case ir_value_kind::Struct:
+            {
+                auto members = new value const *[v.b];
+                for (uint64_t m{}; m < v.b; ++m)
+                    members[m] = values[view.refs[v.a + m]];
+
+                values[i] = new struct_value{static_cast<struct_type const *>(types[v.ref]), v.b, members};
+                break;
+            }
+
+            case ir_value_kind::Void:
+                values[i] = void_value::self();
+                break;
+
+            case ir_value_kind::Func:
+            {
+                auto const n = (size_t)v.b - 1;
+                auto params = std::make_unique_for_overwrite<value const *[]>(n);
+                for (size_t p{}; p < n; ++p)
+                    params[p] = values[view.refs[v.a + 1 + p]];
+
+                values[i] = new func_const{v.sized != 0, values[view.refs[v.a]], {n, std::move(params)}};
+                break;
+            }
+
+            default:
+                values[i] = top_value::self();
+                break;
+            }
+        }
+
+        return values;
+    }
+
+    // Give the nodes of `view` their components; `ids` has the entity of each node, and the nodes for which `existing(i)`
+    // is true are only pointed to
+    template <typename Pred>
+    inline void load_nodes(ir_view const &view, entt::registry &reg, std::span<value const *const> values,
+                           std::span<entt::entity const> ids, Pred &&existing) noexcept
+    {
+        auto const id = [&](uint32_t n) { return n == ir_none ? entt::null : ids[n]; };
+
+        tag_storage *vis_pools[std::size(ir_visibilities)];
+        for (size_t i{}; i < std::size(ir_visibilities); ++i)
+            vis_pools[i] = &reg.storage<void>((entt::id_type)ir_visibilities[i]);
+
+        for (size_t i{}; i < ids.size(); ++i)
+        {
+            auto const &n = view.nodes[i];
+            auto const self = ids[i];
+            if (existing(i))
+                continue;
+
+            reg.emplace<node_op>(self, n.op);
+            reg.emplace<node_type>(self, values[n.type]);
+
+            auto nins = smallvec<entt::entity>::gen(n.n_inputs, [&](size_t in)
+                                                          { return id(view.inputs[n.first_input + in]); });
+            for (uint32_t in{}; in < nins.n; ++in)
+                if (nins[in] != entt::null)
+                    reg.get_or_emplace<users>(nins[in]).entries.push_back({self, in});
+            reg.emplace<node_inputs>(self, std::move(nins));
+
+            if (n.ctrl != ir_none)
+                reg.emplace<ctrl_effect>(self, ids[n.ctrl]);
+
+            if (n.flags & ir_has_mem)
+                reg.emplace<mem_effect>(self, id(n.mem_prev), id(n.mem_target), n.mem_tag);
+            if (n.flags & ir_mem_read)
+                reg.emplace<mem_read>(self);
+            if (n.flags & ir_mem_write)
+                reg.emplace<mem_write>(self);
+            if (n.flags & ir_error)
+                reg.emplace<error_node>(self);
+            if (n.flags & ir_has_effect)
+                reg.emplace<effect_of_func>(self, (func_effect)n.effect);
+
+            if (n.link != ir_none)
+            {
+                if (n.op == node_op::Phi)
+                    reg.emplace<region_of_phi>(self, ids[n.link]);
+                else if (n.op == node_op::CallStatic || n.op == node_op::ExternCall)
+                    reg.emplace<func_of_call>(self, ids[n.link]);
+                else if (n.op == node_op::Start)
+                    reg.emplace<return_of_func>(self, ids[n.link]);
+            }
+
+            for (size_t v{}; v < std::size(vis_pools); ++v)
+                if (n.vis & (1 << v))
+                    vis_pools[v]->emplace(self);
+        }
+    }
+}
+
+inline void load_ir(ir_view const &view, builder &bld, scope_visibility &vis) noexcept
+{
+    auto &reg = bld.reg;
+    auto const values = ir_detail::load_values(view);
+
+    // NOTE: the entities are all created first, as a node can refer to any node after it
+    std::vector<entt::entity> ids(view.nodes.size());
+    reg.create(ids.begin(), ids.end());
+
+    auto const id = [&](uint32_t n) { return n == ir_none ? entt::null : ids[n]; };
+    ir_detail::load_nodes(view, reg, values, ids, [](size_t) { return false; });
+
+    bld.push_vis<visibility::global>(vis);
+
+    // same as what the parser sets up for a package
+    bld.pkg_mem = id(view.header->program);
+    bld.glob_mem = id(view.header->global_memory);
+    bld.state = {
+        .func = bld.glob_mem,
+        .ctrl = bld.pkg_mem,
+        .mem = bld.glob_mem,
+    };
+}
+
+inline std::optional<std::vector<entt::entity>> splice_ir(ir_view const &view, builder &bld,
+                                                          function_ref<entt::entity(hashed_name, ir_node const &)> resolve) noexcept
+{
+    auto const existing = [&](size_t i)
+    {
+        return view.nodes[i].op == node_op::Import || i == view.header->program || i == view.header->global_memory;
+    };
+
+    // NOTE: resolved before anything is added, so a missing name leaves the graph as it was
+    std::vector<entt::entity> ids(view.nodes.size(), entt::null);
+    for (size_t i{}; i < ids.size(); ++i)
+        if (auto const &n = view.nodes[i]; n.op == node_op::Import)
+            if ((ids[i] = resolve((hashed_name)n.link, n)) == entt::null)
+                return std::nullopt;
+
+    if (view.header->program != ir_none)
+        ids[view.header->program] = bld.pkg_mem;
+    if (view.header->global_memory != ir_none)
+        ids[view.header->global_memory] = bld.glob_mem;
+
+    auto const values = ir_detail::load_values(view);
+    for (size_t i{}; i < ids.size(); ++i)
+        if (!existing(i))
+            ids[i] = bld.reg.create();
+
+    ir_detail::load_nodes(view, bld.reg, values, ids, existing);
+    return ids;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <csetjmp>
+#include <print>
+
+#include "backends/vm.hpp"
+#include "backends/x64.hpp"
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#define QUICKPROTO_JIT 1
+#else
+#define QUICKPROTO_JIT 0
+#endif
+
+// JIT backend
+// Generates x86-64 code for the program into executable memory and runs `main` on it, without going through an assembler
+// Programs that use something the code generator does not support yet run on the VM instead
+
+// TODO:
+// - Windows support (`VirtualAlloc` instead of `mmap`, the Microsoft x64 calling convention for `trap_fn`)
+// - emit unwind information, so debuggers and profilers can walk jitted frames
+// - write the code out as an object file, for an ahead-of-time backend
+// - guard the native stack against deep recursion, which the VM traps on instead
+
+// NOTE: jitted code is a sequence of functions, the global code first, as laid out by `x64::generate`
+struct jit_program final
+{
+    using entry_fn = rt_bits (*)(rt_bits const *args);
+
+    inline jit_program() noexcept = default;
+
+    inline jit_program(jit_program &&other) noexcept
+        : memory{std::exchange(other.memory, nullptr)}, size{std::exchange(other.size, 0)}, entries{std::move(other.entries)}
+    {
+    }
+
+    jit_program(jit_program const &) = delete;
+    jit_program &operator=(jit_program const &) = delete;
+
+    inline ~jit_program() noexcept
+    {
+#if QUICKPROTO_JIT
+        if (memory)
+            munmap(memory, size);
+#endif
+    }
+
+    inline entry_fn entry(uint32_t func) const noexcept { return (entry_fn)((uint8_t *)memory + entries[func]); }
+
+    void *memory = nullptr;
+    size_t size = 0;
+    std::vector<size_t> entries;
+};
+
+// where `jit_trap` jumps to; set while jitted code runs
+inline thread_local std::jmp_buf *jit_trap_target = nullptr;
+
+[[noreturn]] inline void jit_trap(uint32_t trap) noexcept
+{
+    std::longjmp(*jit_trap_target, (int)trap + 1);
+}
+
+// Generate machine code for `mod` and map it as executable; `nullopt` if `mod` uses something not supported yet
+inline std::optional<jit_program> compile_jit(bc_module const &mod) noexcept
+{
+#if QUICKPROTO_JIT
+    x64::assembler as;
+    auto entries = x64::generate(as, mod, jit_trap);
+    if (!entries)
+        return std::nullopt;
+
+    jit_program prog;
+    prog.size = as.code.size();
+    prog.entries = std::move(*entries);
+
+    // NOTE: written first, then made executable, so the memory is never writable and executable at once
+    auto const memory = mmap(nullptr, prog.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ensure(memory != MAP_FAILED, "Cannot allocate memory for the JIT!");
+
+    prog.memory = memory;
+    memcpy(prog.memory, as.code.data(), prog.size);
+    ensure(mprotect(prog.memory, prog.size, PROT_READ | PROT_EXEC) == 0, "Cannot make the JIT code executable!");
+
+    return prog;
+#else
+    (void)mod;
+    return std::nullopt;
+#endif
+}
+
+struct jit_backend final : backend
+{
+    // Compile the program to machine code and run it, then write its exit code to `out`
+    // ^ falls back to the VM if the program cannot be jitted
+    inline void compile(FILE *out, entt::registry const &reg);
+
+    // Run `prog`; return the trap message, if any
+    inline char const *run(jit_program const &prog) noexcept
+    {
+        std::jmp_buf target;
+        auto const previous = std::exchange(jit_trap_target, &target);
+
+        // NOTE: nothing with a destructor may live in this frame after `setjmp`
+        char const *trapped = nullptr;
+        if (auto const trap = setjmp(target); trap != 0)
+            trapped = bc_trap_messages[trap - 1];
+        else
+            (void)prog.entry(0)(nullptr);
+
+        jit_trap_target = previous;
+        return trapped;
+    }
+
+    inline void report(FILE *out, char const *trapped) const noexcept
+    {
+        // TODO: read the exit code from the `Exit` node once it has one
+        if (trapped)
+            std::println(out, "trap: {}", trapped);
+        else
+            std::println(out, "exit code: {}", 0);
+    }
+};
+
+inline void jit_backend::compile(FILE *out, entt::registry const &reg)
+{
+    auto const mod = compile_bytecode(reg, schedule_program(reg));
+    ensure(!mod.funcs.empty(), "Graph has no `Program` node!");
+
+    auto const prog = compile_jit(mod);
+    if (!prog)
+    {
+        std::println("The JIT does not support this program (or platform) yet, running it on the VM");
+
+        vm_backend vm;
+        return vm.report(out, vm.run(mod));
+    }
+
+    std::println("Generated {} bytes of machine code", prog->size);
+    report(out, run(*prog));
+}
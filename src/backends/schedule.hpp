@@ -0,0 +1,740 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "builder.hpp"
+
+// Global code motion (GCM) and linearization, for the backends that need the graph as a list of basic blocks
+// Follows Click's "Global Code Motion/Global Value Numbering": every data node is scheduled as early as its inputs allow,
+// as late as its users allow, and then placed in the least nested loop between the two
+
+// TODO:
+// - split critical edges once a block can end in a `Branch` to a `Region`
+// - sink nodes used only on one side of a `Branch` even when they are not inside a loop
+// - cache the schedule of functions that did not change between compilations
+
+// a control node following `node`; `index` is the input of the `Region`/`Loop` the edge goes through, so `Phi`s know which value to take
+struct ctrl_successor final
+{
+    entt::entity node;
+    uint32_t index;
+};
+
+using ctrl_successors = entt::dense_map<entt::entity, std::vector<ctrl_successor>>;
+
+// Invert the `ctrl_effect`s (and the inputs of `Region`/`Loop`s), so the control flow can be followed forwards
+inline ctrl_successors collect_successors(entt::registry const &reg) noexcept
+{
+    ctrl_successors succs;
+    for (auto [id, eff] : reg.storage<ctrl_effect>()->each())
+        succs[eff.target].push_back({id, 0});
+
+    // `Region`s link to their predecessors through their inputs, and so do `Loop`s (`[entry, back-edge]`)
+    auto const &ins = *reg.storage<node_inputs>();
+    for (auto [id, op] : reg.storage<node_op>()->each())
+    {
+        if (op != node_op::Region && op != node_op::Loop)
+            continue;
+
+        for (uint32_t i{}; auto pred : ins.get(id).nodes)
+            succs[pred].push_back({id, i++});
+    }
+
+    return succs;
+}
+
+enum class sched_end : uint8_t
+{
+    Jump,   // go to `next[0]` through input `edge` of its `Region`/`Loop`
+    Branch, // go to `next[0]` if `end_node` holds, `next[1]` otherwise
+    Return, // `end_node` is the `Return`
+    Exit,   // `end_node` is the `Exit`
+    Trap,   // control flow ends without a `Return`
+};
+
+struct sched_block final
+{
+    entt::entity head;              // `Start`/`Program`, `Region`, `Loop`, `IfYes` or `IfNot`
+    std::vector<entt::entity> phis; // `Phi`s of `head` that are used; they get their value on the edge into the block
+    std::vector<entt::entity> code; // data nodes and straight-line control nodes (calls, checks), in execution order
+
+    sched_end end = sched_end::Trap;
+    entt::entity end_node = entt::null;
+    uint32_t next[2]{~0u, ~0u};
+    uint32_t edge = 0;
+
+    std::vector<uint32_t> preds;      // blocks jumping or branching to this one
+    std::vector<uint32_t> pred_edges; // input of `head` each of `preds` goes through
+    uint32_t idom = 0;
+    uint32_t dom_depth = 0;
+    uint32_t loop_depth = 0;
+};
+
+struct sched_func final
+{
+    entt::entity start;                               // `Start`, or `Program` for the global code
+    std::vector<sched_block> blocks;                  // `blocks[0]` is the entry
+    std::vector<uint32_t> order;                      // blocks in reverse post-order, the order backends should emit them in
+    std::vector<entt::entity> globals;                // global nodes used by the function, read once on entry
+    entt::dense_map<entt::entity, uint32_t> block_of; // every scheduled node -> its block
+};
+
+struct sched_program final
+{
+    // Is `n` a global read by `func`, rather than a node computed by it?
+    inline bool is_global_in(uint32_t func, entt::entity n) const noexcept
+    {
+        return func != 0 && global_slot.contains(n);
+    }
+
+    std::vector<sched_func> funcs;                       // `funcs[0]` is the global code, which calls `main`
+    entt::dense_map<entt::entity, uint32_t> func_index;  // `Start`/`Program` -> index in `funcs`
+    std::vector<entt::entity> globals;                   // global nodes used by functions, computed by `funcs[0]` before anything else
+    entt::dense_map<entt::entity, uint32_t> global_slot; // index of each of `globals`
+};
+
+// Split the functions reachable from `Program` into blocks and place every data node they use in one of them
+inline sched_program schedule_program(entt::registry const &reg) noexcept;
+
+struct scheduler final
+{
+    inline explicit scheduler(entt::registry const &reg) noexcept;
+
+    inline static bool is_ctrl(node_op op) noexcept
+    {
+        switch (op)
+        {
+        case node_op::Program:
+        case node_op::GlobalMemory:
+        case node_op::Start:
+        case node_op::Return:
+        case node_op::Exit:
+        case node_op::IfYes:
+        case node_op::IfNot:
+        case node_op::Loop:
+        case node_op::Region:
+        case node_op::CallStatic:
+        case node_op::ExternCall:
+        case node_op::CheckedIndex:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    // Nodes that must not run earlier than their users need them, as they read memory or might trap
+    inline static bool is_pinned_late(node_op op) noexcept
+    {
+        return op == node_op::Load || op == node_op::VecLoad || op == node_op::Store || op == node_op::Div;
+    }
+
+    // Call `fn` on every node `n` needs to be computed before it
+    // NOTE: `Load`/`VecLoad`/`Store`s also depend on the object they access and on the previous global `Store`
+    template <typename Fn>
+    inline void deps(entt::entity n, Fn &&fn) const noexcept
+    {
+        for (uint32_t i{}; auto in : ins.get(n).nodes)
+        {
+            if (in != entt::null && ops.contains(in))
+                fn(in, i);
+            ++i;
+        }
+
+        auto const op = ops.get(n);
+        if (op != node_op::Load && op != node_op::VecLoad && op != node_op::Store)
+            return;
+
+        auto const &eff = mem.get(n);
+        if (eff.target != entt::null && ops.contains(eff.target) && !is_ctrl(ops.get(eff.target)))
+            fn(eff.target, ~0u);
+
+        if (eff.prev != entt::null && ops.contains(eff.prev))
+            if (auto const prev = ops.get(eff.prev); prev == node_op::Store || prev == node_op::Alloca)
+                fn(eff.prev, ~0u);
+    }
+
+    // Split the control flow starting at `start` into blocks
+    inline sched_func build_blocks(entt::entity start) const noexcept;
+
+    // Compute the reverse post-order, the dominator tree and the loop nesting of the blocks
+    inline void analyze(sched_func &f) const noexcept;
+
+    // Place the data nodes of `f` in its blocks and order the code of each block
+    inline void place(sched_program &prog, uint32_t func) const noexcept;
+
+    inline uint32_t common_dominator(sched_func const &f, uint32_t a, uint32_t b) const noexcept
+    {
+        while (a != b)
+        {
+            while (f.blocks[a].dom_depth > f.blocks[b].dom_depth)
+                a = f.blocks[a].idom;
+            while (f.blocks[b].dom_depth > f.blocks[a].dom_depth)
+                b = f.blocks[b].idom;
+
+            if (a != b)
+                a = f.blocks[a].idom, b = f.blocks[b].idom;
+        }
+
+        return a;
+    }
+
+    entt::storage_for_t<node_op> const &ops;
+    entt::storage_for_t<node_inputs> const &ins;
+    entt::storage_for_t<ctrl_effect> const &ctrl;
+    entt::storage_for_t<mem_effect> const &mem;
+    entt::storage_for_t<func_of_call> const &targets;
+    entt::storage_for_t<return_of_func> const &rets;
+    entt::storage_for_t<region_of_phi> const &regions;
+    tag_storage const *global_vis;
+
+    ctrl_successors succs;
+};
+
+inline scheduler::scheduler(entt::registry const &reg) noexcept
+    : ops{*reg.storage<node_op>()},
+      ins{*reg.storage<node_inputs>()},
+      ctrl{*reg.storage<ctrl_effect>()},
+      mem{*reg.storage<mem_effect>()},
+      targets{*reg.storage<func_of_call>()},
+      rets{*reg.storage<return_of_func>()},
+      regions{*reg.storage<region_of_phi>()},
+      global_vis{reg.storage<void>((entt::id_type)visibility::global)},
+      succs{collect_successors(reg)}
+{
+}
+
+inline sched_func scheduler::build_blocks(entt::entity start) const noexcept
+{
+    sched_func f{.start = start};
+
+    std::vector<uint32_t> work;
+    auto const block_for = [&](entt::entity head)
+    {
+        if (auto iter = f.block_of.find(head); iter != f.block_of.end())
+            return iter->second;
+
+        auto const b = (uint32_t)f.blocks.size();
+        f.blocks.push_back({.head = head});
+        f.block_of[head] = b;
+        work.push_back(b);
+        return b;
+    };
+
+    (void)block_for(start);
+    while (!work.empty())
+    {
+        auto const b = work.back();
+        work.pop_back();
+
+        auto cur = f.blocks[b].head;
+        for (;;)
+        {
+            auto const op = ops.get(cur);
+            f.block_of[cur] = b;
+
+            if (op == node_op::Return || op == node_op::Exit)
+            {
+                f.blocks[b].end = (op == node_op::Return) ? sched_end::Return : sched_end::Exit;
+                f.blocks[b].end_node = cur;
+                break;
+            }
+
+            if (cur != f.blocks[b].head)
+                f.blocks[b].code.push_back(cur);
+
+            ctrl_successor yes{entt::null, 0}, no{entt::null, 0}, other{entt::null, 0};
+            if (auto iter = succs.find(cur); iter != succs.end())
+            {
+                for (auto s : iter->second)
+                {
+                    auto const sop = ops.get(s.node);
+                    if (sop == node_op::IfYes && yes.node == entt::null)
+                        yes = s;
+                    else if (sop == node_op::IfNot && no.node == entt::null)
+                        no = s;
+                    else if (sop != node_op::IfYes && sop != node_op::IfNot && other.node == entt::null)
+                        other = s;
+                }
+            }
+
+            if (yes.node != entt::null && no.node != entt::null)
+            {
+                auto const then_block = block_for(yes.node);
+                auto const else_block = block_for(no.node);
+
+                auto &blk = f.blocks[b];
+                blk.end = sched_end::Branch;
+                blk.end_node = ins.get(yes.node).nodes[0];
+                blk.next[0] = then_block;
+                blk.next[1] = else_block;
+                break;
+            }
+
+            if (other.node != entt::null)
+            {
+                auto const sop = ops.get(other.node);
+                if (sop != node_op::Region && sop != node_op::Loop)
+                {
+                    cur = other.node;
+                    continue;
+                }
+
+                auto const target = block_for(other.node);
+                f.blocks[b].end = sched_end::Jump;
+                f.blocks[b].next[0] = target;
+                f.blocks[b].edge = other.index;
+                break;
+            }
+
+            f.blocks[b].end = sched_end::Trap;
+            break;
+        }
+    }
+
+    return f;
+}
+
+inline void scheduler::analyze(sched_func &f) const noexcept
+{
+    auto &blocks = f.blocks;
+    auto const n = (uint32_t)blocks.size();
+
+    auto const for_each_next = [&](uint32_t b, auto &&fn)
+    {
+        auto const &blk = blocks[b];
+        if (blk.end == sched_end::Jump)
+            fn(blk.next[0], blk.edge);
+        else if (blk.end == sched_end::Branch)
+            fn(blk.next[0], 0), fn(blk.next[1], 0);
+    };
+
+    for (uint32_t b{}; b < n; ++b)
+        for_each_next(b, [&](uint32_t s, uint32_t edge)
+                      {
+                          blocks[s].preds.push_back(b);
+                          blocks[s].pred_edges.push_back(edge); //
+                      });
+
+    // reverse post-order
+    {
+        std::vector<uint8_t> seen(n);
+        std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 0}}; // (block, next successor to visit)
+        seen[0] = true;
+
+        while (!stack.empty())
+        {
+            auto &[b, i] = stack.back();
+            auto const &blk = blocks[b];
+            auto const n_next = (blk.end == sched_end::Jump) ? 1u : (blk.end == sched_end::Branch) ? 2u
+                                                                                                    : 0u;
+            if (i < n_next)
+            {
+                auto const s = blk.next[i++];
+                if (!seen[s])
+                {
+                    seen[s] = true;
+                    stack.push_back({s, 0});
+                }
+                continue;
+            }
+
+            f.order.push_back(b);
+            stack.pop_back();
+        }
+
+        std::ranges::reverse(f.order);
+    }
+
+    // dominators, as in Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm"
+    {
+        std::vector<uint32_t> rpo_index(n);
+        for (uint32_t i{}; i < f.order.size(); ++i)
+            rpo_index[f.order[i]] = i;
+
+        constexpr auto undefined = ~0u;
+        std::vector<uint32_t> idom(n, undefined);
+        idom[0] = 0;
+
+        auto const intersect = [&](uint32_t a, uint32_t b)
+        {
+            while (a != b)
+            {
+                while (rpo_index[a] > rpo_index[b])
+                    a = idom[a];
+                while (rpo_index[b] > rpo_index[a])
+                    b = idom[b];
+            }
+            return a;
+        };
+
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (auto b : f.order)
+            {
+                if (b == 0)
+                    continue;
+
+                auto new_idom = undefined;
+                for (auto p : blocks[b].preds)
+                {
+                    if (idom[p] == undefined)
+                        continue;
+
+                    new_idom = (new_idom == undefined) ? p : intersect(p, new_idom);
+                }
+
+                if (new_idom != idom[b])
+                {
+                    idom[b] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+
+        for (auto b : f.order)
+        {
+            blocks[b].idom = idom[b];
+            blocks[b].dom_depth = (b == 0) ? 0 : blocks[idom[b]].dom_depth + 1;
+        }
+    }
+
+    // loop nesting: every block that reaches a back-edge without going through its `Loop` is inside that loop
+    for (uint32_t b{}; b < n; ++b)
+    {
+        auto const &blk = blocks[b];
+        if (blk.end != sched_end::Jump || blk.edge != 1 || ops.get(blocks[blk.next[0]].head) != node_op::Loop)
+            continue;
+
+        auto const header = blk.next[0];
+        std::vector<uint8_t> in_loop(n);
+        std::vector<uint32_t> work{b};
+        in_loop[header] = true;
+
+        while (!work.empty())
+        {
+            auto const top = work.back();
+            work.pop_back();
+
+            if (in_loop[top])
+                continue;
+
+            in_loop[top] = true;
+            for (auto p : blocks[top].preds)
+                work.push_back(p);
+        }
+
+        for (uint32_t i{}; i < n; ++i)
+            blocks[i].loop_depth += in_loop[i];
+    }
+}
+
+inline void scheduler::place(sched_program &prog, uint32_t func) const noexcept
+{
+    auto &f = prog.funcs[func];
+    auto &blocks = f.blocks;
+
+    // the globals computed by `funcs[0]` are read by the other functions instead
+    auto const is_global = [&](entt::entity n)
+    {
+        if (func == 0 || !global_vis || !global_vis->contains(n))
+            return false;
+
+        switch (ops.get(n))
+        {
+        case node_op::IConst:
+        case node_op::FConst:
+        case node_op::BConst:
+        case node_op::SConst:
+            return false; // cheaper to compute again than to read
+
+        default:
+            return !is_ctrl(ops.get(n));
+        }
+    };
+
+    struct node_use final
+    {
+        entt::entity user;
+        uint32_t index; // input of `user`, only needed for `Phi`s
+    };
+
+    // collect the data nodes in post-order (inputs before users), along with their users
+    std::vector<entt::entity> post;
+    entt::dense_map<entt::entity, std::vector<node_use>> uses;
+    entt::dense_set<entt::entity> visited;
+    std::vector<entt::entity> used_phis;
+
+    auto const visit = [&](this auto const &self, entt::entity n, entt::entity user, uint32_t index) -> void
+    {
+        uses[n].push_back({user, index});
+        if (!visited.emplace(n).second)
+            return;
+
+        auto const op = ops.get(n);
+        if (is_ctrl(op))
+            return;
+
+        if (is_global(n))
+        {
+            f.globals.push_back(n);
+            if (!prog.global_slot.contains(n))
+            {
+                prog.global_slot[n] = (uint32_t)prog.globals.size();
+                prog.globals.push_back(n);
+            }
+            return;
+        }
+
+        // NOTE: the inputs of a `Phi` are visited later, as they might depend on the `Phi` itself
+        if (op == node_op::Phi)
+            used_phis.push_back(n);
+        else
+            deps(n, [&](entt::entity in, uint32_t i)
+                 { self(in, n, i); });
+
+        post.push_back(n);
+    };
+
+    for (auto const &blk : blocks)
+    {
+        for (auto n : blk.code)
+            deps(n, [&](entt::entity in, uint32_t i)
+                 { visit(in, n, i); });
+
+        if (blk.end == sched_end::Branch)
+            visit(blk.end_node, blk.head, 0);
+        else if (blk.end == sched_end::Return)
+            deps(blk.end_node, [&](entt::entity in, uint32_t i)
+                 { visit(in, blk.end_node, i); });
+    }
+
+    // the global code computes every global used by the functions first
+    if (func == 0)
+        for (size_t i{}; i < prog.globals.size(); ++i)
+            visit(prog.globals[i], entt::null, 0);
+
+    for (size_t i{}; i < used_phis.size(); ++i)
+    {
+        auto const phi = used_phis[i];
+        for (uint32_t j{}; auto in : ins.get(phi).nodes)
+        {
+            if (in != entt::null && ops.contains(in))
+                visit(in, phi, j);
+            ++j;
+        }
+    }
+
+    // the block a use happens in; the predecessor of the `Region` for `Phi` inputs
+    auto const use_block = [&](node_use use) -> uint32_t
+    {
+        if (use.user == entt::null)
+            return ~0u;
+
+        auto const b = f.block_of.at(use.user);
+        if (ops.get(use.user) != node_op::Phi)
+            return b;
+
+        auto res = ~0u;
+        auto const &blk = blocks[b];
+        for (size_t i{}; i < blk.preds.size(); ++i)
+            if (blk.pred_edges[i] == use.index)
+                res = (res == ~0u) ? blk.preds[i] : common_dominator(f, res, blk.preds[i]);
+
+        return res;
+    };
+
+    // `Phi`s belong to their `Region`/`Loop`
+    for (auto phi : used_phis)
+    {
+        auto const region = regions.contains(phi) ? regions.get(phi).region : entt::null;
+        auto const iter = f.block_of.find(region);
+        if (iter == f.block_of.end() || blocks[iter->second].head != region)
+        {
+            f.block_of[phi] = 0; // NOTE: never set, same as a `Phi` the interpreter reaches before its `Region`
+            continue;
+        }
+
+        f.block_of[phi] = iter->second;
+        blocks[iter->second].phis.push_back(phi);
+    }
+
+    // parameters and the globals computed by the global code are known on entry
+    auto const is_pinned_entry = [&](entt::entity n)
+    {
+        return ops.get(n) == node_op::Proj || (func == 0 && prog.global_slot.contains(n));
+    };
+
+    auto const block_of_ctrl = [&](entt::entity n)
+    {
+        auto const iter = f.block_of.find(n);
+        return iter != f.block_of.end() ? iter->second : 0u;
+    };
+
+    // schedule early: in the deepest block of the inputs
+    entt::dense_map<entt::entity, uint32_t> early;
+    for (auto n : post)
+    {
+        if (ops.get(n) == node_op::Phi)
+            continue;
+
+        uint32_t e = 0;
+        if (!is_pinned_entry(n))
+            deps(n, [&](entt::entity in, uint32_t)
+                 {
+                     if (is_global(in))
+                         return;
+
+                     auto const op = ops.get(in);
+                     auto const b = (is_ctrl(op) || op == node_op::Phi) ? block_of_ctrl(in) : early.at(in);
+                     if (blocks[b].dom_depth > blocks[e].dom_depth)
+                         e = b; //
+                 });
+
+        early[n] = e;
+    }
+
+    // schedule late: in the closest common dominator of the users, then hoist out of as many loops as possible
+    for (auto iter = post.rbegin(); iter != post.rend(); ++iter)
+    {
+        auto const n = *iter;
+        auto const op = ops.get(n);
+        if (op == node_op::Phi)
+            continue;
+
+        if (is_pinned_entry(n))
+        {
+            f.block_of[n] = 0;
+            continue;
+        }
+
+        auto const e = early.at(n);
+        auto late = ~0u;
+        for (auto use : uses[n])
+        {
+            auto const ub = use_block(use);
+            if (ub != ~0u)
+                late = (late == ~0u) ? ub : common_dominator(f, late, ub);
+        }
+
+        if (late == ~0u || blocks[late].dom_depth < blocks[e].dom_depth)
+            late = e;
+
+        auto best = late;
+        if (!is_pinned_late(op))
+            for (auto cur = late; cur != e && cur != 0;)
+            {
+                cur = blocks[cur].idom;
+                if (blocks[cur].loop_depth < blocks[best].loop_depth)
+                    best = cur;
+            }
+
+        f.block_of[n] = best;
+    }
+
+    // order each block: data nodes go right before their first use, after the control nodes before it
+    std::vector<std::vector<entt::entity>> placed(blocks.size());
+    for (auto n : post)
+        if (ops.get(n) != node_op::Phi)
+            placed[f.block_of.at(n)].push_back(n);
+
+    entt::dense_set<entt::entity> emitted;
+    for (uint32_t b{}; b < blocks.size(); ++b)
+    {
+        auto &blk = blocks[b];
+        std::vector<entt::entity> code;
+
+        auto const emit = [&](this auto const &self, entt::entity n) -> void
+        {
+            auto const iter = f.block_of.find(n);
+            if (iter == f.block_of.end() || iter->second != b)
+                return;
+
+            auto const op = ops.get(n);
+            if (is_ctrl(op) || op == node_op::Phi || !emitted.emplace(n).second)
+                return;
+
+            deps(n, [&](entt::entity in, uint32_t)
+                 { self(in); });
+            code.push_back(n);
+        };
+
+        if (func == 0 && b == 0)
+            for (auto g : prog.globals)
+                emit(g);
+
+        for (auto c : blk.code)
+        {
+            deps(c, [&](entt::entity in, uint32_t)
+                 { emit(in); });
+            code.push_back(c);
+        }
+
+        if (blk.end == sched_end::Branch)
+            emit(blk.end_node);
+        else if (blk.end == sched_end::Return)
+            deps(blk.end_node, [&](entt::entity in, uint32_t)
+                 { emit(in); });
+        else if (blk.end == sched_end::Jump)
+            for (auto phi : blocks[blk.next[0]].phis)
+                if (auto const &pins = ins.get(phi).nodes; blk.edge < pins.n)
+                    emit(pins[blk.edge]);
+
+        for (auto n : placed[b])
+            emit(n);
+
+        blk.code = std::move(code);
+    }
+}
+
+inline sched_program schedule_program(entt::registry const &reg) noexcept
+{
+    sched_program prog;
+    scheduler s{reg};
+
+    entt::entity program = entt::null;
+    for (auto [id, op] : s.ops.each())
+        if (op == node_op::Program)
+            program = id;
+
+    if (program == entt::null)
+        return prog;
+
+    // find the functions through the calls, so the ones never called are left out
+    std::vector<entt::entity> starts{program};
+    prog.func_index[program] = 0;
+
+    for (size_t i{}; i < starts.size(); ++i)
+    {
+        prog.funcs.push_back(s.build_blocks(starts[i]));
+
+        auto &f = prog.funcs.back();
+        s.analyze(f);
+
+        for (auto const &blk : f.blocks)
+            for (auto c : blk.code)
+            {
+                if (s.ops.get(c) != node_op::CallStatic || !s.targets.contains(c))
+                    continue;
+
+                auto const callee = s.targets.get(c).func;
+                if (s.rets.contains(callee) && !prog.func_index.contains(callee))
+                {
+                    prog.func_index[callee] = (uint32_t)starts.size();
+                    starts.push_back(callee);
+                }
+            }
+    }
+
+    // NOTE: the functions go first, so the global code knows which globals they need
+    for (uint32_t i = 1; i < prog.funcs.size(); ++i)
+        s.place(prog, i);
+    s.place(prog, 0);
+
+    return prog;
+}
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <print>
+
+#include "backends/bytecode.hpp"
+
+// Bytecode VM
+// Runs a `bc_module` with a computed-goto dispatch loop (a `switch` on compilers without labels as values)
+
+// TODO:
+// - run `ExternCall`s through a table of built-in functions, same as the interpreter
+// - grow the register stack instead of trapping once it is full
+// - count every instruction under a debug flag, for profiling
+
+#if defined(__GNUC__) && !defined(QUICKPROTO_VM_SWITCH)
+#define QUICKPROTO_VM_COMPUTED_GOTO 1
+#else
+#define QUICKPROTO_VM_COMPUTED_GOTO 0
+#endif
+
+struct vm_stats final
+{
+    size_t jumps = 0; // `Jump`s taken, mostly loop back-edges
+    size_t loads = 0;
+    size_t stores = 0;
+    size_t calls = 0;
+    size_t extern_calls = 0; // skipped, returning 0
+    size_t checks = 0;       // `CheckedIndex`es executed
+};
+
+struct vm_state final
+{
+    inline vm_state(bc_module const &mod, vm_stats &stats, size_t step_limit, size_t stack_size) noexcept
+        : mod{mod}, stack(stack_size), globals(mod.n_globals), stats{stats}, step_limit{step_limit}
+    {
+    }
+
+    // Run `funcs[func]` on a new frame; return its result (0 on trap)
+    inline rt_bits run(uint32_t func, rt_bits const *args, uint32_t n_args) noexcept;
+
+    inline rt_bits trap(bc_trap t) noexcept
+    {
+        if (!trapped)
+            trapped = bc_trap_messages[(uint32_t)t];
+        return 0;
+    }
+
+    bc_module const &mod;
+    std::vector<rt_bits> stack; // registers of the running frames; never resized, so frames can keep pointers to it
+    size_t top = 0;
+    std::vector<rt_bits> globals;
+    std::vector<std::vector<rt_bits>> heap;
+
+    vm_stats &stats;
+    size_t step_limit;
+    char const *trapped = nullptr;
+};
+
+struct vm_backend final : backend
+{
+    // Compile the program to bytecode and run it, then write its exit code and the VM stats to `out`
+    inline void compile(FILE *out, entt::registry const &reg);
+
+    // Run `mod`; return the trap message, if any
+    inline char const *run(bc_module const &mod) noexcept
+    {
+        stats = {};
+        vm_state state{mod, stats, step_limit, stack_size};
+        (void)state.run(0, nullptr, 0);
+        return state.trapped;
+    }
+
+    inline void report(FILE *out, char const *trapped) const noexcept;
+
+    size_t step_limit = size_t(1) << 32; // stop after this many jumps, in case the program never ends
+    size_t stack_size = size_t(1) << 20; // registers for all the frames
+    vm_stats stats;
+};
+
+// TODO: check `pc->dst` and friends against the frame once in debug builds
+inline rt_bits vm_state::run(uint32_t func, rt_bits const *args, uint32_t n_args) noexcept
+{
+    auto const &fn = mod.funcs[func];
+    if (top + fn.n_regs > stack.size())
+        return trap(bc_trap::StackOverflow);
+
+    rt_bits *const regs = stack.data() + top;
+    std::fill_n(regs, fn.n_regs, 0);
+
+    top += fn.n_regs;
+    struct pop_frame final
+    {
+        inline ~pop_frame() { top -= n; }
+
+        size_t &top;
+        size_t n;
+    } const pop{top, fn.n_regs};
+
+    auto const code = mod.code.data();
+    auto const consts = mod.consts.data();
+    auto const lists = mod.lists.data();
+    auto const fbits = [](rt_bits bits) { return std::bit_cast<double>(bits); };
+    auto const float_bits = [](double d) { return std::bit_cast<rt_bits>(d); };
+
+    bc_insn const *pc = code + fn.entry;
+
+#define R(x) regs[pc->x]
+#define F(x) fbits(regs[pc->x])
+
+#if QUICKPROTO_VM_COMPUTED_GOTO
+#define vm_label(name) &&op_##name,
+    static void *const labels[]{BC_OPS(vm_label)};
+#undef vm_label
+
+#define vm_op(name) op_##name:
+#define vm_next() goto *labels[(uint32_t)pc->op]
+#else
+#define vm_op(name) case bc_op::name:
+#define vm_next() goto dispatch
+#endif
+
+#define vm_binary(name, expr) \
+    vm_op(name)               \
+    {                         \
+        R(dst) = (expr);      \
+        ++pc;                 \
+        vm_next();            \
+    }
+
+    vm_next();
+
+#if !QUICKPROTO_VM_COMPUTED_GOTO
+dispatch:
+    switch (pc->op)
+#endif
+    {
+        vm_binary(LoadK, consts[pc->a]);
+        vm_op(Arg)
+        {
+            if (pc->a >= n_args)
+                return trap(bc_trap::InvalidParam);
+
+            R(dst) = args[pc->a];
+            ++pc;
+            vm_next();
+        }
+        vm_binary(GetGlobal, globals[pc->a]);
+        vm_op(SetGlobal)
+        {
+            globals[pc->b] = R(a);
+            ++pc;
+            vm_next();
+        }
+        vm_binary(Move, R(a));
+
+        vm_binary(UnaryCompl, ~R(a));
+        vm_binary(UnaryNeg, 0 - R(a));
+        vm_binary(UnaryFneg, float_bits(-F(a)));
+        vm_binary(UnaryNot, !R(a));
+
+        vm_binary(Add, R(a) + R(b));
+        vm_binary(Sub, R(a) - R(b));
+        vm_binary(Mul, R(a) * R(b));
+        vm_op(Div)
+        {
+            auto const a = R(a), b = R(b);
+            if (b == 0)
+                return trap(bc_trap::DivisionByZero);
+
+            // NOTE: `min / -1` overflows, wrap it around instead
+            R(dst) = (b == ~rt_bits{}) ? 0 - a : (rt_bits)((int64_t)a / (int64_t)b);
+            ++pc;
+            vm_next();
+        }
+        vm_op(Udiv)
+        {
+            if (R(b) == 0)
+                return trap(bc_trap::DivisionByZero);
+
+            R(dst) = R(a) / R(b);
+            ++pc;
+            vm_next();
+        }
+
+        vm_binary(Fadd, float_bits(F(a) + F(b)));
+        vm_binary(Fsub, float_bits(F(a) - F(b)));
+        vm_binary(Fmul, float_bits(F(a) * F(b)));
+        vm_binary(Fdiv, float_bits(F(a) / F(b)));
+
+        vm_binary(LogicAnd, R(a) && R(b));
+        vm_binary(LogicOr, R(a) || R(b));
+        vm_binary(BitAnd, R(a) & R(b));
+        vm_binary(BitXor, R(a) ^ R(b));
+        vm_binary(BitOr, R(a) | R(b));
+
+        vm_binary(ShiftLeft, R(b) >= 64 ? 0 : R(a) << R(b));
+        vm_binary(ShiftRight, (rt_bits)((int64_t)R(a) >> std::min<rt_bits>(R(b), 63)));
+        vm_binary(UshiftRight, R(b) >= 64 ? 0 : R(a) >> R(b));
+
+        vm_binary(CmpEq, R(a) == R(b));
+        vm_binary(CmpNe, R(a) != R(b));
+        vm_binary(CmpLt, (int64_t)R(a) < (int64_t)R(b));
+        vm_binary(CmpLe, (int64_t)R(a) <= (int64_t)R(b));
+        vm_binary(CmpGt, (int64_t)R(a) > (int64_t)R(b));
+        vm_binary(CmpGe, (int64_t)R(a) >= (int64_t)R(b));
+        vm_binary(UcmpLt, R(a) < R(b));
+        vm_binary(UcmpLe, R(a) <= R(b));
+        vm_binary(UcmpGt, R(a) > R(b));
+        vm_binary(UcmpGe, R(a) >= R(b));
+        vm_binary(FcmpEq, F(a) == F(b));
+        vm_binary(FcmpNe, F(a) != F(b));
+        vm_binary(FcmpLt, F(a) < F(b));
+        vm_binary(FcmpLe, F(a) <= F(b));
+        vm_binary(FcmpGt, F(a) > F(b));
+        vm_binary(FcmpGe, F(a) >= F(b));
+
+        vm_op(Wrap)
+        {
+            auto const a = R(a);
+            switch ((bc_wrap)pc->b)
+            {
+            case bc_wrap::Int8:
+                R(dst) = (rt_bits)(int64_t)(int8_t)a;
+                break;
+            case bc_wrap::Int16:
+                R(dst) = (rt_bits)(int64_t)(int16_t)a;
+                break;
+            case bc_wrap::Int32:
+                R(dst) = (rt_bits)(int64_t)(int32_t)a;
+                break;
+            case bc_wrap::Uint8:
+                R(dst) = (uint8_t)a;
+                break;
+            case bc_wrap::Uint16:
+                R(dst) = (uint16_t)a;
+                break;
+            case bc_wrap::Uint32:
+                R(dst) = (uint32_t)a;
+                break;
+            }
+
+            ++pc;
+            vm_next();
+        }
+        vm_binary(IntToFloat, float_bits((double)(int64_t)R(a)));
+        vm_binary(FloatToInt, (rt_bits)(int64_t)F(a));
+
+        vm_op(Struct)
+        {
+            auto const list = lists + pc->a;
+            auto &obj = heap.emplace_back(pc->b);
+            for (uint32_t i{}; i < list[0]; ++i)
+                obj[i] = regs[list[1 + i]];
+
+            R(dst) = heap.size() - 1;
+            ++pc;
+            vm_next();
+        }
+        vm_op(Alloca)
+        {
+            heap.emplace_back(pc->a);
+            R(dst) = heap.size() - 1;
+            ++pc;
+            vm_next();
+        }
+        vm_op(Load)
+        {
+            auto const obj = R(a), index = R(b);
+            if (obj >= heap.size() || index >= heap[obj].size())
+                return trap(bc_trap::InvalidAccess);
+
+            ++stats.loads;
+            R(dst) = heap[obj][index];
+            ++pc;
+            vm_next();
+        }
+        vm_op(LoadAt)
+        {
+            auto const obj = R(a);
+            if (obj >= heap.size() || pc->b >= heap[obj].size())
+                return trap(bc_trap::InvalidAccess);
+
+            ++stats.loads;
+            R(dst) = heap[obj][pc->b];
+            ++pc;
+            vm_next();
+        }
+        vm_op(Store)
+        {
+            auto const obj = R(a);
+            if (obj >= heap.size() || pc->b >= heap[obj].size())
+                return trap(bc_trap::InvalidAccess);
+
+            ++stats.stores;
+            heap[obj][pc->b] = R(dst);
+            ++pc;
+            vm_next();
+        }
+        vm_op(CheckedIndex)
+        {
+            ++stats.checks;
+
+            // NOTE: negative indices wrap around to huge values
+            if (R(a) >= R(b))
+                return trap(bc_trap::OutOfBounds);
+
+            R(dst) = R(a);
+            ++pc;
+            vm_next();
+        }
+
+        vm_op(CallStatic)
+        {
+            ++stats.calls;
+
+            // NOTE: the arguments go right above the frame, the callee's frame right above them
+            auto const list = lists + pc->b;
+            auto const n = list[0];
+            if (top + n > stack.size())
+                return trap(bc_trap::StackOverflow);
+
+            auto const call_args = stack.data() + top;
+            for (uint32_t i{}; i < n; ++i)
+                call_args[i] = regs[list[1 + i]];
+
+            top += n;
+            auto const res = run(pc->a, call_args, n);
+            top -= n;
+
+            if (trapped)
+                return 0;
+
+            R(dst) = res;
+            ++pc;
+            vm_next();
+        }
+        vm_op(ExternCall)
+        {
+            ++stats.calls;
+            ++stats.extern_calls;
+            R(dst) = 0;
+            ++pc;
+            vm_next();
+        }
+
+        vm_op(Jump)
+        {
+            if (++stats.jumps > step_limit)
+                return trap(bc_trap::StepLimit);
+
+            pc = code + pc->a;
+            vm_next();
+        }
+        vm_op(Branch)
+        {
+            pc = code + (R(dst) ? pc->a : pc->b);
+            vm_next();
+        }
+        vm_op(Return)
+        {
+            return (pc->a == ~0u) ? 0 : R(a);
+        }
+        vm_op(Exit)
+        {
+            return 0;
+        }
+        vm_op(Trap)
+        {
+            return trap((bc_trap)pc->a);
+        }
+
+#if !QUICKPROTO_VM_COMPUTED_GOTO
+    default:
+        break;
+#endif
+    }
+
+    return trap(bc_trap::Unsupported);
+
+#undef vm_binary
+#undef vm_next
+#undef vm_op
+#undef F
+#undef R
+}
+
+inline void vm_backend::report(FILE *out, char const *trapped) const noexcept
+{
+    // TODO: read the exit code from the `Exit` node once it has one
+    if (trapped)
+        std::println(out, "trap: {}", trapped);
+    else
+        std::println(out, "exit code: {}", 0);
+
+    std::println(out, "jumps: {}", stats.jumps);
+    std::println(out, "loads: {}", stats.loads);
+    std::println(out, "stores: {}", stats.stores);
+    std::println(out, "calls: {} ({} extern, skipped)", stats.calls, stats.extern_calls);
+    std::println(out, "bounds checks: {}", stats.checks);
+}
+
+inline void vm_backend::compile(FILE *out, entt::registry const &reg)
+{
+    auto const mod = compile_bytecode(reg, schedule_program(reg));
+    ensure(!mod.funcs.empty(), "Graph has no `Program` node!");
+
+    report(out, run(mod));
+}
@@ -0,0 +1,909 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+#include "backends/bytecode.hpp"
+
+// x86-64 code generation
+// Selects machine code for each instruction of the (scheduled and linearized) bytecode, after giving each of its registers
+// a machine register or a stack slot through linear scan (Poletto and Sarkar, "Linear Scan Register Allocation")
+
+// TODO:
+// - select instructions from the graph patterns directly (eg. `CmpLt` + `Branch` into a single `cmp` + `jl`), instead of one bytecode instruction at a time
+// - use memory operands and the allocated registers directly, instead of going through `rax`/`rcx` every time
+// - split intervals at calls instead of keeping them in callee-saved registers or spilling them whole
+// - support memory (`Struct`/`Alloca`/`Load`/`Store`) and globals once objects have a native layout
+// - count loop iterations, so the step limit of the interpreter/VM applies to native code as well
+
+// NOTE: the convention between jitted functions is `rt_bits fn(rt_bits const *args)`, SysV-wise; the same as the entry from C++
+// ^ traps call `trap_fn(code)`, which must not return
+
+namespace x64
+{
+    enum reg : uint8_t
+    {
+        rax,
+        rcx,
+        rdx,
+        rbx,
+        rsp,
+        rbp,
+        rsi,
+        rdi,
+        r8,
+        r9,
+        r10,
+        r11,
+        r12,
+        r13,
+        r14,
+        r15,
+    };
+
+    // condition codes, as used by `jcc`/`setcc`
+    enum cond : uint8_t
+    {
+        O = 0x0,
+        B = 0x2,
+        AE = 0x3,
+        E = 0x4,
+        NE = 0x5,
+        BE = 0x6,
+        A = 0x7,
+        P = 0xA,
+        NP = 0xB,
+        L = 0xC,
+        GE = 0xD,
+        LE = 0xE,
+        G = 0xF,
+    };
+
+    // preserved across calls, so they can hold values that live across one
+    inline constexpr reg callee_saved[]{rbx, r12, r13, r14, r15};
+    // NOTE: `rax`, `rcx` and `rdx` are kept as scratch registers
+    inline constexpr reg caller_saved[]{rsi, rdi, r8, r9, r10, r11};
+
+    struct assembler final
+    {
+        inline void byte(uint8_t b) { code.push_back(b); }
+
+        inline void bytes(std::initializer_list<uint8_t> bs) { code.insert(code.end(), bs); }
+
+        template <typename T>
+        inline void imm(T value)
+        {
+            uint8_t raw[sizeof(T)];
+            memcpy(raw, &value, sizeof(T));
+            code.insert(code.end(), raw, raw + sizeof(T));
+        }
+
+        inline void rex(bool w, uint8_t r, uint8_t b)
+        {
+            uint8_t const prefix = 0x40 | (w << 3) | ((r >> 3) << 2) | (b >> 3);
+            if (prefix != 0x40)
+                byte(prefix);
+        }
+
+        // `op r/m64, reg` (or `op reg, r/m64`, depending on the opcode) between two registers
+        inline void rr(uint8_t op, uint8_t reg, uint8_t rm)
+        {
+            rex(true, reg, rm);
+            byte(op);
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        // same as `rr`, for two-byte opcodes (`0F xx`)
+        inline void rr0f(uint8_t op, uint8_t reg, uint8_t rm)
+        {
+            rex(true, reg, rm);
+            bytes({0x0F, op});
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        // `op reg, [base + disp]`, `base` being neither `rsp` nor `r12`
+        inline void mem(uint8_t op, uint8_t reg, uint8_t base, int32_t disp)
+        {
+            rex(true, reg, base);
+            byte(op);
+            byte(0x80 | ((reg & 7) << 3) | (base & 7));
+            imm(disp);
+        }
+
+        // `op reg, [rsp + disp]`
+        inline void mem_rsp(uint8_t op, uint8_t reg, int32_t disp)
+        {
+            rex(true, reg, rsp);
+            byte(op);
+            byte(0x84 | ((reg & 7) << 3));
+            byte(0x24);
+            imm(disp);
+        }
+
+        inline void mov(uint8_t dst, uint8_t src)
+        {
+            if (dst != src)
+                rr(0x89, src, dst);
+        }
+
+        inline void mov_imm(uint8_t dst, uint64_t value)
+        {
+            if (value == 0)
+                return zero(dst);
+
+            rex(true, 0, dst);
+            byte(0xB8 + (dst & 7));
+            imm(value);
+        }
+
+        inline void zero(uint8_t dst)
+        {
+            rex(false, dst, dst);
+            byte(0x31);
+            byte(0xC0 | ((dst & 7) << 3) | (dst & 7));
+        }
+
+        inline void load(uint8_t dst, uint8_t base, int32_t disp) { mem(0x8B, dst, base, disp); }
+        inline void store(uint8_t base, int32_t disp, uint8_t src) { mem(0x89, src, base, disp); }
+
+        inline void push(uint8_t r)
+        {
+            rex(false, 0, r);
+            byte(0x50 + (r & 7));
+        }
+
+        inline void pop(uint8_t r)
+        {
+            rex(false, 0, r);
+            byte(0x58 + (r & 7));
+        }
+
+        // `setcc al` + `movzx eax, al`
+        inline void set(cond c)
+        {
+            bytes({0x0F, (uint8_t)(0x90 + c), 0xC0});
+            bytes({0x0F, 0xB6, 0xC0});
+        }
+
+        // jump with a 32-bit offset to fill later; return where the offset is
+        inline size_t jcc(cond c)
+        {
+            bytes({0x0F, (uint8_t)(0x80 + c)});
+            imm<int32_t>(0);
+            return code.size() - 4;
+        }
+
+        inline size_t jmp()
+        {
+            byte(0xE9);
+            imm<int32_t>(0);
+            return code.size() - 4;
+        }
+
+        inline size_t call()
+        {
+            byte(0xE8);
+            imm<int32_t>(0);
+            return code.size() - 4;
+        }
+
+        // point the offset at `at` (as returned by `jcc`/`jmp`/`call`) to `target`
+        inline void patch(size_t at, size_t target)
+        {
+            auto const rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+            memcpy(code.data() + at, &rel, 4);
+        }
+
+        // `movq xmm0, rax` + `movq xmm1, rcx`
+        inline void to_xmm()
+        {
+            bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0});
+            bytes({0x66, 0x48, 0x0F, 0x6E, 0xC9});
+        }
+
+        // `movq rax, xmm0`
+        inline void from_xmm() { bytes({0x66, 0x48, 0x0F, 0x7E, 0xC0}); }
+
+        std::vector<uint8_t> code;
+    };
+
+    // where a bytecode register lives
+    struct location final
+    {
+        inline bool is_reg() const noexcept { return slot < 0; }
+
+        reg r = rax;
+        int32_t slot = -1; // offset from `rbp` if spilled
+    };
+
+    struct interval final
+    {
+        uint32_t vreg;
+        uint32_t start;
+        uint32_t end;
+        bool crosses_call = false;
+    };
+
+    struct func_alloc final
+    {
+        std::vector<location> locs; // per bytecode register
+        std::vector<reg> saved;     // callee-saved registers the function uses
+        uint32_t n_slots = 0;
+    };
+
+    // Call `use(reg)` for every register `insn` reads and `def(reg)` for every register it writes
+    template <typename Use, typename Def>
+    inline void operands(bc_module const &mod, bc_insn const &insn, Use &&use, Def &&def) noexcept
+    {
+        auto const list = [&](uint32_t at)
+        {
+            for (uint32_t i{}; i < mod.lists[at]; ++i)
+                use(mod.lists[at + 1 + i]);
+        };
+
+        switch (insn.op)
+        {
+        case bc_op::LoadK:
+        case bc_op::Arg:
+        case bc_op::GetGlobal:
+        case bc_op::Alloca:
+        case bc_op::ExternCall:
+            def(insn.dst);
+            break;
+
+        case bc_op::SetGlobal:
+            use(insn.a);
+            break;
+
+        case bc_op::Move:
+        case bc_op::UnaryCompl:
+        case bc_op::UnaryNeg:
+        case bc_op::UnaryFneg:
+        case bc_op::UnaryNot:
+        case bc_op::Wrap:
+        case bc_op::IntToFloat:
+        case bc_op::FloatToInt:
+        case bc_op::LoadAt:
+            use(insn.a);
+            def(insn.dst);
+            break;
+
+        case bc_op::Struct:
+            list(insn.a);
+            def(insn.dst);
+            break;
+
+        case bc_op::Store:
+            use(insn.a);
+            use(insn.dst);
+            break;
+
+        case bc_op::CallStatic:
+            list(insn.b);
+            def(insn.dst);
+            break;
+
+        case bc_op::Jump:
+        case bc_op::Exit:
+        case bc_op::Trap:
+            break;
+
+        case bc_op::Branch:
+            use(insn.dst);
+            break;
+
+        case bc_op::Return:
+            if (insn.a != ~0u)
+                use(insn.a);
+            break;
+
+        default: // binary operations
+            use(insn.a);
+            use(insn.b);
+            def(insn.dst);
+            break;
+        }
+    }
+
+    // Linear scan over the instructions in [begin, end) of `mod`, which make up a function with `n_regs` registers
+    inline func_alloc allocate(bc_module const &mod, uint32_t begin, uint32_t end, uint32_t n_regs) noexcept
+    {
+        // NOTE: positions are relative to `begin`; the blocks are in reverse post-order, so a register is live
+        // ^ in [first mention, last mention] except around loops, which are extended below
+        constexpr auto none = ~0u;
+        std::vector<interval> ivs(n_regs);
+        for (uint32_t r{}; r < n_regs; ++r)
+            ivs[r] = {r, none, 0};
+
+        std::vector<uint32_t> calls;
+        std::vector<std::pair<uint32_t, uint32_t>> loops; // (target, back-jump)
+
+        for (auto pc = begin; pc < end; ++pc)
+        {
+            auto const &insn = mod.code[pc];
+            auto const pos = pc - begin;
+            auto const mention = [&](uint32_t r)
+            {
+                ivs[r].start = std::min(ivs[r].start, pos);
+                ivs[r].end = std::max(ivs[r].end, pos);
+            };
+
+            operands(mod, insn, mention, mention);
+
+            if (insn.op == bc_op::CallStatic)
+                calls.push_back(pos);
+            if (insn.op == bc_op::Jump && insn.a <= pc)
+                loops.push_back({insn.a - begin, pos});
+        }
+
+        // anything live somewhere in a loop is live in the whole loop, as it might be needed by the next iteration
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (auto [head, back] : loops)
+                for (auto &iv : ivs)
+                {
+                    if (iv.start == none || iv.start > back || iv.end < head)
+                        continue;
+
+                    if (iv.start > head || iv.end < back)
+                    {
+                        iv.start = std::min(iv.start, head);
+                        iv.end = std::max(iv.end, back);
+                        changed = true;
+                    }
+                }
+        }
+
+        std::erase_if(ivs, [&](interval const &iv)
+                      { return iv.start == none; });
+
+        for (auto &iv : ivs)
+            iv.crosses_call = std::ranges::any_of(calls, [&](uint32_t c)
+                                                  { return iv.start < c && c < iv.end; });
+
+        std::ranges::sort(ivs, {}, &interval::start);
+
+        func_alloc res{.locs = std::vector<location>(n_regs)};
+        std::vector<reg> free_callee{std::begin(callee_saved), std::end(callee_saved)};
+        std::vector<reg> free_caller{std::begin(caller_saved), std::end(caller_saved)};
+        std::vector<interval const *> active; // sorted by end
+
+        auto const is_callee_saved = [](reg r)
+        { return std::ranges::find(callee_saved, r) != std::end(callee_saved); };
+
+        auto const spill = [&](uint32_t vreg)
+        {
+            res.locs[vreg] = {.slot = (int32_t)res.n_slots++};
+        };
+
+        auto const give = [&](interval const &iv, reg r)
+        {
+            res.locs[iv.vreg] = {.r = r};
+            if (is_callee_saved(r) && std::ranges::find(res.saved, r) == res.saved.end())
+                res.saved.push_back(r);
+
+            active.insert(std::ranges::upper_bound(active, iv.end, {}, &interval::end), &iv);
+        };
+
+        for (auto const &iv : ivs)
+        {
+            // expire the intervals that ended
+            while (!active.empty() && active.front()->end < iv.start)
+            {
+                auto const r = res.locs[active.front()->vreg].r;
+                (is_callee_saved(r) ? free_callee : free_caller).push_back(r);
+                active.erase(active.begin());
+            }
+
+            if (!iv.crosses_call && !free_caller.empty())
+            {
+                give(iv, free_caller.back());
+                free_caller.pop_back();
+                continue;
+            }
+
+            if (!free_callee.empty())
+            {
+                give(iv, free_callee.back());
+                free_callee.pop_back();
+                continue;
+            }
+
+            // spill whichever ends last, the current interval or an active one whose register it can use
+            auto victim = active.rend();
+            for (auto iter = active.rbegin(); iter != active.rend(); ++iter)
+                if (!iv.crosses_call || is_callee_saved(res.locs[(*iter)->vreg].r))
+                {
+                    victim = iter;
+                    break;
+                }
+
+            if (victim == active.rend() || (*victim)->end <= iv.end)
+            {
+                spill(iv.vreg);
+                continue;
+            }
+
+            auto const r = res.locs[(*victim)->vreg].r;
+            spill((*victim)->vreg);
+            active.erase(std::next(victim).base());
+            give(iv, r);
+        }
+
+        return res;
+    }
+
+    // Generate the machine code of every function of `mod` into `as` and return where each one starts
+    // ^ `nullopt` if the program uses something not supported yet
+    inline std::optional<std::vector<size_t>> generate(assembler &as, bc_module const &mod, void (*trap_fn)(uint32_t)) noexcept
+    {
+        std::vector<size_t> entries(mod.funcs.size());
+        std::vector<std::pair<size_t, uint32_t>> call_fixups; // (offset, function)
+
+        for (uint32_t f{}; f < mod.funcs.size(); ++f)
+        {
+            auto const begin = mod.funcs[f].entry;
+            auto const end = (f + 1 < mod.funcs.size()) ? mod.funcs[f + 1].entry : (uint32_t)mod.code.size();
+
+            uint32_t max_args = 0;
+            for (auto pc = begin; pc < end; ++pc)
+            {
+                switch (mod.code[pc].op)
+                {
+                case bc_op::GetGlobal:
+                case bc_op::SetGlobal:
+                case bc_op::Struct:
+                case bc_op::Alloca:
+                case bc_op::Load:
+                case bc_op::LoadAt:
+                case bc_op::Store:
+                    return std::nullopt;
+
+                case bc_op::CallStatic:
+                    max_args = std::max(max_args, mod.lists[mod.code[pc].b]);
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            auto alloc = allocate(mod, begin, end, mod.funcs[f].n_regs);
+
+            // frame: [rbp - 8 * saved] callee-saved registers, then the `args` pointer, the spill slots and the arguments of calls
+            auto const saved_size = 8 * (int32_t)alloc.saved.size();
+            auto const args_slot = -(saved_size + 8);
+            auto const slot_at = [&](int32_t slot) { return args_slot - 8 * (slot + 1); };
+
+            auto frame = 8 + 8 * (int32_t)alloc.n_slots + 8 * (int32_t)max_args;
+            if ((saved_size + frame) % 16 != 0)
+                frame += 8;
+
+            entries[f] = as.code.size();
+
+            // prologue
+            as.push(rbp);
+            as.mov(rbp, rsp);
+            for (auto r : alloc.saved)
+                as.push(r);
+            as.bytes({0x48, 0x81, 0xEC}); // sub rsp, frame
+            as.imm(frame);
+            as.store(rbp, args_slot, rdi);
+
+            auto const epilogue = [&]
+            {
+                // lea rsp, [rbp - saved_size]
+                as.bytes({0x48, 0x8D, 0xA5});
+                as.imm(-saved_size);
+                for (auto iter = alloc.saved.rbegin(); iter != alloc.saved.rend(); ++iter)
+                    as.pop(*iter);
+                as.pop(rbp);
+                as.byte(0xC3);
+            };
+
+            auto const get = [&](uint8_t scratch, uint32_t vreg)
+            {
+                auto const loc = alloc.locs[vreg];
+                if (loc.is_reg())
+                    as.mov(scratch, loc.r);
+                else
+                    as.load(scratch, rbp, slot_at(loc.slot));
+            };
+
+            auto const set = [&](uint32_t vreg, uint8_t scratch)
+            {
+                auto const loc = alloc.locs[vreg];
+                if (loc.is_reg())
+                    as.mov(loc.r, scratch);
+                else
+                    as.store(rbp, slot_at(loc.slot), scratch);
+            };
+
+            std::vector<size_t> labels(end - begin);
+            std::vector<std::pair<size_t, uint32_t>> jumps;      // (offset, bytecode target)
+            std::vector<std::pair<size_t, bc_trap>> trap_jumps; // (offset, trap)
+
+            for (auto pc = begin; pc < end; ++pc)
+            {
+                auto const &insn = mod.code[pc];
+                labels[pc - begin] = as.code.size();
+
+                auto const binary = [&](auto &&body)
+                {
+                    get(rax, insn.a);
+                    get(rcx, insn.b);
+                    body();
+                    set(insn.dst, rax);
+                };
+
+                auto const unary = [&](auto &&body)
+                {
+                    get(rax, insn.a);
+                    body();
+                    set(insn.dst, rax);
+                };
+
+                auto const compare = [&](cond c)
+                {
+                    binary([&]
+                           {
+                               as.rr(0x39, rcx, rax); // cmp rax, rcx
+                               as.set(c); //
+                           });
+                };
+
+                // NOTE: `a < b` is `b > a`, which is what `ucomisd` answers without being true for NaNs
+                auto const fcompare = [&](cond c, bool swap)
+                {
+                    binary([&]
+                           {
+                               as.to_xmm();
+                               as.bytes({0x66, 0x0F, 0x2E, (uint8_t)(swap ? 0xC8 : 0xC1)}); // ucomisd
+                               as.set(c); //
+                           });
+                };
+
+                auto const sse = [&](uint8_t op)
+                {
+                    binary([&]
+                           {
+                               as.to_xmm();
+                               as.bytes({0xF2, 0x0F, op, 0xC1}); // op xmm0, xmm1
+                               as.from_xmm(); //
+                           });
+                };
+
+                switch (insn.op)
+                {
+                case bc_op::LoadK:
+                    as.mov_imm(rax, mod.consts[insn.a]);
+                    set(insn.dst, rax);
+                    break;
+
+                case bc_op::Arg:
+                    as.load(rax, rbp, args_slot);
+                    as.load(rax, rax, 8 * (int32_t)insn.a);
+                    set(insn.dst, rax);
+                    break;
+
+                case bc_op::Move:
+                    unary([] {});
+                    break;
+
+                case bc_op::UnaryCompl:
+                    unary([&]
+                          { as.rr(0xF7, 2, rax); });
+                    break;
+                case bc_op::UnaryNeg:
+                    unary([&]
+                          { as.rr(0xF7, 3, rax); });
+                    break;
+                case bc_op::UnaryFneg:
+                    unary([&]
+                          {
+                              as.mov_imm(rcx, uint64_t(1) << 63);
+                              as.rr(0x31, rcx, rax); // xor rax, rcx
+                          });
+                    break;
+                case bc_op::UnaryNot:
+                    unary([&]
+                          {
+                              as.rr(0x85, rax, rax); // test rax, rax
+                              as.set(E); //
+                          });
+                    break;
+
+                case bc_op::Add:
+                    binary([&]
+                           { as.rr(0x01, rcx, rax); });
+                    break;
+                case bc_op::Sub:
+                    binary([&]
+                           { as.rr(0x29, rcx, rax); });
+                    break;
+                case bc_op::Mul:
+                    binary([&]
+                           { as.rr0f(0xAF, rax, rcx); });
+                    break;
+
+                case bc_op::Div:
+                case bc_op::Udiv:
+                    binary([&]
+                           {
+                               as.rr(0x85, rcx, rcx); // test rcx, rcx
+                               trap_jumps.push_back({as.jcc(E), bc_trap::DivisionByZero});
+
+                               if (insn.op == bc_op::Udiv)
+                               {
+                                   as.zero(rdx);
+                                   as.rr(0xF7, 6, rcx); // div rcx
+                                   return;
+                               }
+
+                               // NOTE: `min / -1` overflows (and faults), wrap it around instead
+                               as.bytes({0x48, 0x83, 0xF9, 0xFF}); // cmp rcx, -1
+                               auto const not_minus_one = as.jcc(NE);
+                               as.rr(0xF7, 3, rax); // neg rax
+                               auto const done = as.jmp();
+
+                               as.patch(not_minus_one, as.code.size());
+                               as.bytes({0x48, 0x99}); // cqo
+                               as.rr(0xF7, 7, rcx);    // idiv rcx
+                               as.patch(done, as.code.size()); //
+                           });
+                    break;
+
+                case bc_op::Fadd:
+                    sse(0x58);
+                    break;
+                case bc_op::Fsub:
+                    sse(0x5C);
+                    break;
+                case bc_op::Fmul:
+                    sse(0x59);
+                    break;
+                case bc_op::Fdiv:
+                    sse(0x5E);
+                    break;
+
+                case bc_op::LogicAnd:
+                    binary([&]
+                           {
+                               as.rr(0x85, rax, rax);              // test rax, rax
+                               as.bytes({0x0F, 0x95, 0xC0});       // setne al
+                               as.rr(0x85, rcx, rcx);              // test rcx, rcx
+                               as.bytes({0x0F, 0x95, 0xC1});       // setne cl
+                               as.bytes({0x20, 0xC8});             // and al, cl
+                               as.bytes({0x0F, 0xB6, 0xC0}); // movzx eax, al
+                           });
+                    break;
+                case bc_op::LogicOr:
+                    binary([&]
+                           {
+                               as.rr(0x09, rcx, rax); // or rax, rcx
+                               as.set(NE); //
+                           });
+                    break;
+
+                case bc_op::BitAnd:
+                    binary([&]
+                           { as.rr(0x21, rcx, rax); });
+                    break;
+                case bc_op::BitXor:
+                    binary([&]
+                           { as.rr(0x31, rcx, rax); });
+                    break;
+                case bc_op::BitOr:
+                    binary([&]
+                           { as.rr(0x09, rcx, rax); });
+                    break;
+
+                case bc_op::ShiftLeft:
+                case bc_op::UshiftRight:
+                    binary([&]
+                           {
+                               // NOTE: shifting by 64 or more gives 0, rather than what the CPU does (shifting by `b % 64`)
+                               as.bytes({0x48, 0x83, 0xF9, 0x3F}); // cmp rcx, 63
+                               auto const too_big = as.jcc(A);
+                               as.rr(0xD3, insn.op == bc_op::ShiftLeft ? 4 : 5, rax); // shl/shr rax, cl
+                               auto const done = as.jmp();
+
+                               as.patch(too_big, as.code.size());
+                               as.zero(rax);
+                               as.patch(done, as.code.size()); //
+                           });
+                    break;
+                case bc_op::ShiftRight:
+                    binary([&]
+                           {
+                               as.bytes({0x48, 0x83, 0xF9, 0x3F}); // cmp rcx, 63
+                               auto const in_range = as.jcc(BE);
+                               as.bytes({0xB9, 0x3F, 0x00, 0x00, 0x00}); // mov ecx, 63
+                               as.patch(in_range, as.code.size());
+                               as.rr(0xD3, 7, rax); // sar rax, cl
+                           });
+                    break;
+
+                case bc_op::CmpEq:
+                    compare(E);
+                    break;
+                case bc_op::CmpNe:
+                    compare(NE);
+                    break;
+                case bc_op::CmpLt:
+                    compare(L);
+                    break;
+                case bc_op::CmpLe:
+                    compare(LE);
+                    break;
+                case bc_op::CmpGt:
+                    compare(G);
+                    break;
+                case bc_op::CmpGe:
+                    compare(GE);
+                    break;
+                case bc_op::UcmpLt:
+                    compare(B);
+                    break;
+                case bc_op::UcmpLe:
+                    compare(BE);
+                    break;
+                case bc_op::UcmpGt:
+                    compare(A);
+                    break;
+                case bc_op::UcmpGe:
+                    compare(AE);
+                    break;
+
+                case bc_op::FcmpEq:
+                case bc_op::FcmpNe:
+                    binary([&]
+                           {
+                               auto const eq = insn.op == bc_op::FcmpEq;
+                               as.to_xmm();
+                               as.bytes({0x66, 0x0F, 0x2E, 0xC1});                   // ucomisd xmm0, xmm1
+                               as.bytes({0x0F, (uint8_t)(0x90 + (eq ? E : NE)), 0xC0}); // sete/setne al
+                               as.bytes({0x0F, (uint8_t)(0x90 + (eq ? NP : P)), 0xC1}); // setnp/setp cl
+                               as.bytes({(uint8_t)(eq ? 0x20 : 0x08), 0xC8});          // and/or al, cl
+                               as.bytes({0x0F, 0xB6, 0xC0});                         // movzx eax, al
+                           });
+                    break;
+                case bc_op::FcmpLt:
+                    fcompare(A, true);
+                    break;
+                case bc_op::FcmpLe:
+                    fcompare(AE, true);
+                    break;
+                case bc_op::FcmpGt:
+                    fcompare(A, false);
+                    break;
+                case bc_op::FcmpGe:
+                    fcompare(AE, false);
+                    break;
+
+                case bc_op::Wrap:
+                    unary([&]
+                          {
+                              switch ((bc_wrap)insn.b)
+                              {
+                              case bc_wrap::Int8:
+                                  as.bytes({0x48, 0x0F, 0xBE, 0xC0}); // movsx rax, al
+                                  break;
+                              case bc_wrap::Int16:
+                                  as.bytes({0x48, 0x0F, 0xBF, 0xC0}); // movsx rax, ax
+                                  break;
+                              case bc_wrap::Int32:
+                                  as.bytes({0x48, 0x63, 0xC0}); // movsxd rax, eax
+                                  break;
+                              case bc_wrap::Uint8:
+                                  as.bytes({0x0F, 0xB6, 0xC0}); // movzx eax, al
+                                  break;
+                              case bc_wrap::Uint16:
+                                  as.bytes({0x0F, 0xB7, 0xC0}); // movzx eax, ax
+                                  break;
+                              case bc_wrap::Uint32:
+                                  as.bytes({0x89, 0xC0}); // mov eax, eax
+                                  break;
+                              } //
+                          });
+                    break;
+
+                case bc_op::IntToFloat:
+                    unary([&]
+                          {
+                              as.bytes({0xF2, 0x48, 0x0F, 0x2A, 0xC0}); // cvtsi2sd xmm0, rax
+                              as.from_xmm(); //
+                          });
+                    break;
+                case bc_op::FloatToInt:
+                    unary([&]
+                          {
+                              as.bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0}); // movq xmm0, rax
+                              as.bytes({0xF2, 0x48, 0x0F, 0x2C, 0xC0}); // cvttsd2si rax, xmm0
+                          });
+                    break;
+
+                case bc_op::CheckedIndex:
+                    binary([&]
+                           {
+                               // NOTE: negative indices wrap around to huge values
+                               as.rr(0x39, rcx, rax); // cmp rax, rcx
+                               trap_jumps.push_back({as.jcc(AE), bc_trap::OutOfBounds}); //
+                           });
+                    break;
+
+                case bc_op::CallStatic:
+                {
+                    auto const list = insn.b;
+                    for (uint32_t i{}; i < mod.lists[list]; ++i)
+                    {
+                        get(rax, mod.lists[list + 1 + i]);
+                        as.mem_rsp(0x89, rax, 8 * (int32_t)i); // mov [rsp + 8 * i], rax
+                    }
+
+                    as.bytes({0x48, 0x8D, 0x3C, 0x24}); // lea rdi, [rsp]
+                    call_fixups.push_back({as.call(), insn.a});
+                    set(insn.dst, rax);
+                    break;
+                }
+
+                case bc_op::ExternCall:
+                    as.zero(rax);
+                    set(insn.dst, rax);
+                    break;
+
+                case bc_op::Jump:
+                    jumps.push_back({as.jmp(), insn.a});
+                    break;
+
+                case bc_op::Branch:
+                    get(rax, insn.dst);
+                    as.rr(0x85, rax, rax); // test rax, rax
+                    jumps.push_back({as.jcc(NE), insn.a});
+                    jumps.push_back({as.jmp(), insn.b});
+                    break;
+
+                case bc_op::Return:
+                    if (insn.a == ~0u)
+                        as.zero(rax);
+                    else
+                        get(rax, insn.a);
+                    epilogue();
+                    break;
+
+                case bc_op::Exit:
+                    as.zero(rax);
+                    epilogue();
+                    break;
+
+                case bc_op::Trap:
+                    trap_jumps.push_back({as.jmp(), (bc_trap)insn.a});
+                    break;
+
+                default:
+                    return std::nullopt;
+                }
+            }
+
+            for (auto [at, target] : jumps)
+                as.patch(at, labels[target - begin]);
+
+            // NOTE: `trap_fn` does not return, so nothing needs to be kept alive around the call
+            for (auto [at, trap] : trap_jumps)
+            {
+                as.patch(at, as.code.size());
+                as.bytes({0xBF}); // mov edi, trap
+                as.imm((uint32_t)trap);
+                as.mov_imm(rax, (uint64_t)trap_fn);
+                as.bytes({0xFF, 0xD0}); // call rax
+            }
+        }
+
+        for (auto [at, f] : call_fixups)
+            as.patch(at, entries[f]);
+
+        return entries;
+    }
+}
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <entt/container/dense_map.hpp>
 #include <entt/entity/registry.hpp>
 
 #include "base.hpp"
@@ -72,20 +73,82 @@ struct builder final
     // TODO: ensure not null
     inline void pop_vis() { scopes = scopes->prev; }
 
+    // Replace the inputs of an existing node with `nins`
+    // invariant: `users` is updated for both the old and the new inputs
+    inline void set_inputs(entt::entity n, std::span<entt::entity const> nins) noexcept;
+
+    // Redirect every data user of `old` to `with`
+    // NOTE: this does not touch the `ctrl_effect`/`mem_effect` links pointing to `old`
+    inline void replace_uses(entt::entity old, entt::entity with) noexcept;
+
+    // Take every node for which `removed(node)` is true out of the memory chain, linking their successors to their `prev`
+    // NOTE: the removed nodes keep their `mem_effect`, so they can still be destroyed afterwards
+    template <typename Pred>
+    inline void unlink_mem(Pred &&removed) noexcept;
+
+    // Take `n` (a node that is both control and data, eg. a call) out of the control chain
+    // ^ its control users (`Region`/`Loop`s and `ctrl_effect`s) move to `ctrl_out` and its data users move to `data_out`
+    inline void unlink_ctrl(entt::entity n, entt::entity ctrl_out, entt::entity data_out) noexcept;
+
+    // Destroy the node, removing it from the `users` of its inputs
+    // invariant: the node has no users left
+    inline void destroy(entt::entity n) noexcept;
+
     inline void report_errors();
 
     // TODO: is there any node (other than `Region`) with more than 1 effect dependency?
     entt::registry reg;
     scope_visibility *scopes;
 
+    // The accesses to one object (the target of their `mem_effect`) since `func_state::mem`, in order
+    struct mem_chain final
+    {
+        entt::entity first, last;
+    };
+
+    // The memory of a function while it is parsed: one chain per object, hanging off the last node that might touch any
+    // memory; accesses to different objects are never ordered against each other, see `mem_of`
+    struct mem_state final
+    {
+        entt::entity mem;
+        entt::dense_map<entt::entity, mem_chain> chains;
+    };
+
     struct func_state
     {
         entt::entity func; // the `Start` node of the function
         entt::entity ctrl;
-        entt::entity mem;
+        entt::entity mem; // the last node that might touch any memory (calls, allocations, `Return`s...)
         uint32_t next_slot = 0;
+        entt::dense_map<entt::entity, mem_chain> chains; // object -> the accesses to it since `mem`
     };
 
+    // The memory node an access to `root` (the target of its `mem_effect`) comes after
+    inline entt::entity mem_of(entt::entity root) const noexcept
+    {
+        auto iter = state.chains.find(root);
+        return iter != state.chains.end() ? iter->second.last : state.mem;
+    }
+
+    // Make `n` the last access to `root`
+    inline void set_mem(entt::entity root, entt::entity n) noexcept
+    {
+        state.chains.try_emplace(root, mem_chain{n, n}).first->second.last = n;
+    }
+
+    // Put the chains back in line after `state.mem` and return the last node, for a node that might touch any memory
+    // NOTE: the node has a single `prev`, so the chains are ordered one after the other; `memory_reorder` can take apart
+    // what this orders needlessly
+    inline entt::entity join_mem() noexcept;
+
+    inline mem_state save_mem() const { return {.mem = state.mem, .chains = state.chains}; }
+
+    inline void restore_mem(mem_state const &saved)
+    {
+        state.mem = saved.mem;
+        state.chains = saved.chains;
+    }
+
     // Push a new function state, return the old one so you can reset it
     // Must call `builder.pop_vis` when done with the function
     // TODO: pass the function name here
@@ -141,6 +204,103 @@ inline entt::entity builder::make(value const *val, node_op op, size_t n_ins, en
     return n;
 }
 
+inline void builder::set_inputs(entt::entity n, std::span<entt::entity const> nins) noexcept
+{
+    auto &&ins = reg.get<node_inputs>(n).nodes;
+
+    // TODO: optimize
+    for (uint32_t i{}; i < ins.n; ++i)
+        std::erase_if(reg.get<users>(ins[i]).entries, [&](users::entry e)
+                      { return e.id == n && e.index == i; });
+
+    ins = compress(nins);
+
+    for (uint32_t i{}; i < ins.n; ++i)
+        reg.get_or_emplace<users>(ins[i]).entries.push_back({n, i});
+}
+
+inline void builder::replace_uses(entt::entity old, entt::entity with) noexcept
+{
+    auto *old_users = reg.try_get<users>(old);
+    if (!old_users || old == with)
+        return;
+
+    // NOTE: moved out as `get_or_emplace` below might touch the same storage
+    auto entries = std::move(old_users->entries);
+    reg.remove<users>(old);
+
+    auto &&ins = reg.storage<node_inputs>();
+    auto &&with_users = reg.get_or_emplace<users>(with).entries;
+    for (auto [id, index] : entries)
+    {
+        ins.get(id).nodes[index] = with;
+        with_users.push_back({id, index});
+    }
+}
+
+template <typename Pred>
+inline void builder::unlink_mem(Pred &&removed) noexcept
+{
+    auto &&mem = reg.storage<mem_effect>();
+
+    for (auto [id, eff] : mem.each())
+        while (eff.prev != entt::null && removed(eff.prev))
+            eff.prev = mem.get(eff.prev).prev;
+}
+
+inline void builder::unlink_ctrl(entt::entity n, entt::entity ctrl_out, entt::entity data_out) noexcept
+{
+    auto const &ops = reg.storage<node_op>();
+    auto &&ins = reg.storage<node_inputs>();
+
+    if (auto *n_users = reg.try_get<users>(n))
+    {
+        auto entries = std::move(n_users->entries);
+        reg.remove<users>(n);
+
+        for (auto [id, index] : entries)
+        {
+            auto const op = ops.get(id);
+            auto const with = (op == node_op::Region || op == node_op::Loop) ? ctrl_out : data_out;
+
+            ins.get(id).nodes[index] = with;
+            reg.get_or_emplace<users>(with).entries.push_back({id, index});
+        }
+    }
+
+    // TODO: optimize; keep reverse links for effects
+    for (auto [id, eff] : reg.storage<ctrl_effect>().each())
+        if (eff.target == n)
+            eff.target = ctrl_out;
+}
+
+inline void builder::destroy(entt::entity n) noexcept
+{
+    auto &&ins = reg.get<node_inputs>(n).nodes;
+
+    // TODO: optimize
+    for (uint32_t i{}; i < ins.n; ++i)
+        if (auto *in_users = reg.try_get<users>(ins[i]))
+            std::erase_if(in_users->entries, [&](users::entry e)
+                          { return e.id == n; });
+
+    reg.destroy(n);
+}
+
+inline entt::entity builder::join_mem() noexcept
+{
+    auto &&mem = reg.storage<mem_effect>();
+
+    for (auto &&[root, chain] : state.chains)
+    {
+        mem.get(chain.first).prev = state.mem;
+        state.mem = chain.last;
+    }
+
+    state.chains.clear();
+    return state.mem;
+}
+
 inline void builder::report_errors()
 {
     for (auto &&[id, ty] : reg.view<error_node const, node_type const>().each())
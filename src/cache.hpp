@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "backends/ir.hpp"
+#include "decls.hpp"
+#include "env.hpp"
+#include "opt/call_graph.hpp"
+
+// Incremental compilation cache
+// Every top-level declaration gets a content hash: its own tokens, plus the signatures of everything it depends on,
+// transitively. It is reused at two levels:
+// - the parsed graph of each function, keyed by the hash of its declaration (see `func_cache`); the parser skips the body
+// ^ of an unchanged function and splices its graph from the last build in, its globals found again by name
+// - the optimized graph of a whole package, keyed by all of the hashes; an unchanged package skips the front end and the
+// ^ passes altogether
+// NOTE: the passes still run on the whole package once any declaration changed. They are whole-program (inlining and call
+// folding cross functions), so the optimized graph of a function is not a function of its own hash
+
+// TODO:
+// - keep optimized functions too, once passes can run on a single function (see opt/passes.hpp)
+// - cache the functions that rebind a global name, or use a global without one; they are parsed every time for now
+// - key a function on the signatures of what it calls only, not on the constants it reads, once constants are not folded into users
+// - evict old entries; the cache only grows for now
+// - lock the cache directory, for concurrent builds
+
+// Bump when a change to the compiler changes the graph it makes for the same source, so older entries are not reused
+inline constexpr uint32_t cache_version = 1;
+
+// the hashes of a top-level declaration
+struct decl_hash final
+{
+    hashed_name name;   // the first name declared
+    uint32_t reserved = 0;
+    uint64_t signature; // what users of the declaration see: the header of a function, everything for the rest
+    uint64_t content;   // own tokens + the signatures of its transitive dependencies
+};
+
+static_assert(sizeof(decl_hash) == 24);
+
+// Hash the declarations of a package, in order
+inline std::vector<decl_hash> hash_decls(std::span<decl_info const> decls) noexcept
+{
+    entt::dense_map<hashed_name, uint32_t, token_hash> by_name;
+    for (uint32_t i{}; i < decls.size(); ++i)
+        for (auto name : decls[i].defines)
+            by_name.try_emplace(name, i);
+
+    std::vector<decl_hash> res;
+    res.reserve(decls.size());
+
+    for (uint32_t i{}; i < decls.size(); ++i)
+    {
+        // NOTE: the dependencies are visited in a fixed order (by index), so the hash does not depend on the order of uses
+        entt::dense_set<uint32_t> seen;
+        seen.insert(i);
+        std::vector<uint32_t> work{i}, deps;
+        while (!work.empty())
+        {
+            auto const d = work.back();
+            work.pop_back();
+
+            for (auto use : decls[d].uses)
+                if (auto iter = by_name.find(use); iter != by_name.end() && seen.insert(iter->second).second)
+                {
+                    deps.push_back(iter->second);
+                    work.push_back(iter->second);
+                }
+        }
+
+        std::ranges::sort(deps);
+
+        auto content = decls[i].own;
+        for (auto d : deps)
+            content = hash_u64(content, decls[d].signature);
+
+        auto const name = decls[i].defines.empty() ? hashed_name{} : decls[i].defines[0];
+        res.push_back({.name = name, .signature = decls[i].signature, .content = content});
+    }
+
+    return res;
+}
+
+// the key of a package in the cache; `salt` covers whatever else changes the output (flags, compiler version)
+inline uint64_t package_hash(std::span<decl_hash const> decls, uint64_t salt) noexcept
+{
+    auto h = hash_u64(hash_seed, salt);
+    h = hash_u64(h, ir_version);
+    h = hash_u64(h, cache_version);
+
+    for (auto const &d : decls)
+        h = hash_u64(h, d.content);
+    return h;
+}
+
+// A directory of optimized graphs keyed by `package_hash`, plus the declaration hashes of the last build of each package
+struct build_cache final
+{
+    inline explicit build_cache(std::filesystem::path dir) noexcept : dir{std::move(dir)}
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(this->dir, ec);
+    }
+
+    inline std::filesystem::path entry(uint64_t key) const { return dir / std::format("{:016x}.qpir", key); }
+
+    // The cached graph of `key`, if any
+    inline std::optional<ir_view> find(uint64_t key) const noexcept { return ir_view::open(entry(key).string().c_str()); }
+
+    // Write the graph of `reg` as the entry of `key`
+    inline void store(uint64_t key, entt::registry const &reg) const noexcept
+    {
+        // NOTE: written aside then renamed, so a reader never sees half an entry
+        auto const path = entry(key);
+        auto tmp = path;
+        tmp += ".tmp";
+
+        auto f = fopen(tmp.string().c_str(), "wb");
+        if (!f)
+            return;
+
+        ir_backend{}.compile(f, reg);
+        fclose(f);
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+    }
+
+    // Compare `decls` with what was recorded for the package of `sources` last time, then record them; return how many
+    // declarations changed
+    // ^ every declaration counts as changed the first time
+    inline size_t update_manifest(std::span<char const *const> sources, std::span<decl_hash const> decls) const noexcept
+    {
+        auto package = hash_seed;
+        for (auto src : sources)
+            package = hash_bytes(package, src, strlen(src) + 1);
+
+        auto const path = dir / std::format("{:016x}.decls", package);
+
+        std::vector<decl_hash> old;
+        if (auto f = fopen(path.string().c_str(), "rb"))
+        {
+            fseek(f, 0, SEEK_END);
+            old.resize((size_t)ftell(f) / sizeof(decl_hash));
+            rewind(f);
+            old.resize(fread(old.data(), sizeof(decl_hash), old.size(), f));
+            fclose(f);
+        }
+
+        entt::dense_map<hashed_name, uint64_t, token_hash> before;
+        for (auto const &d : old)
+            before[d.name] = d.content;
+
+        auto const changed = std::ranges::count_if(decls, [&](decl_hash const &d)
+                                                   {
+                                                       auto iter = before.find(d.name);
+                                                       return iter == before.end() || iter->second != d.content; //
+                                                   });
+
+        if (auto f = fopen(path.string().c_str(), "wb"))
+        {
+            fwrite(decls.data(), sizeof(decl_hash), decls.size(), f);
+            fclose(f);
+        }
+
+        return (size_t)changed;
+    }
+
+    std::filesystem::path dir;
+};
+
+// The parsed graph of each function of a package, as binary IR keyed by the hash of its declaration
+// The globals a function uses are written as `Import`s of their name, and found again in the package that splices it
+// NOTE: shared by the parsers of every file of a package, which may run on any thread
+struct func_cache final
+{
+    // `infos` and `decls` are the declarations of the package, and their hashes, in the same order
+    inline func_cache(std::filesystem::path dir, std::span<decl_info const> infos, std::span<decl_hash const> decls) noexcept;
+
+    inline std::filesystem::path entry(uint64_t key) const { return dir / std::format("{:016x}.qpfn", key); }
+
+    // Add the cached graph of the function `name` to `bld` as a new function and return its `Start`
+    // ^ `null`, adding nothing, if it is not cached or a global it uses is missing from `e` or changed its effect
+    inline entt::entity splice(hashed_name name, builder &bld, env const &e) const noexcept;
+
+    // Keep the graph of the function `name` that starts at `start`, just parsed, if it is not cached yet
+    // ^ skipped if it uses a global that has no name in `e`, as it could not be found again
+    // NOTE: a function that rebinds a global name cannot be spliced back either; the parser does not store those
+    inline void store(hashed_name name, entt::entity start, builder &bld, env const &e) const noexcept;
+
+    std::filesystem::path dir;
+    entt::dense_map<hashed_name, uint64_t, token_hash> keys; // function name -> key
+
+    mutable std::atomic<size_t> reused = 0;
+    mutable std::atomic<size_t> stored = 0;
+};
+
+inline func_cache::func_cache(std::filesystem::path dir, std::span<decl_info const> infos, std::span<decl_hash const> decls) noexcept
+    : dir{std::move(dir)}
+{
+    std::error_code ec;
+    std::filesystem::create_directories(this->dir, ec);
+
+    // NOTE: the graph of a function is made before any pass, so the key does not depend on the pipeline
+    for (size_t i{}; i < infos.size(); ++i)
+        if (infos[i].keyword == token_kind::KwFunc && !infos[i].defines.empty())
+            keys[decls[i].name] = hash_u64(hash_u64(hash_u64(hash_seed, decls[i].content), ir_version), cache_version);
+}
+
+inline entt::entity func_cache::splice(hashed_name name, builder &bld, env const &e) const noexcept
+{
+    auto const key = keys.find(name);
+    if (key == keys.end())
+        return entt::null;
+
+    auto const view = ir_view::open(entry(key->second).string().c_str());
+    if (!view)
+        return entt::null;
+
+    // NOTE: checked before splicing, so a bad entry adds nothing
+    uint32_t start = ir_none;
+    for (uint32_t i{}; i < view->nodes.size(); ++i)
+        if (view->nodes[i].op == node_op::Start)
+        {
+            if (start != ir_none || !(view->nodes[i].flags & ir_has_mem))
+                return entt::null;
+
+            start = i;
+        }
+
+    if (start == ir_none)
+        return entt::null;
+
+    auto const &effects = bld.reg.storage<effect_of_func>();
+    auto const ids = splice_ir(*view, bld, [&](hashed_name used, ir_node const &import) -> entt::entity
+                               {
+                                   auto const index = e.get_name(used);
+                                   if (!is_value(index))
+                                       return entt::null;
+
+                                   // NOTE: the calls in the body have the effect of their callee, which the key does not cover
+                                   auto const of = e.values[(uint32_t)index];
+                                   auto const had = (import.flags & ir_has_effect) != 0;
+                                   if (had != effects.contains(of) || (had && (uint8_t)effects.get(of).effect != import.effect))
+                                       return entt::null;
+
+                                   return of; //
+                               });
+    if (!ids)
+        return entt::null;
+
+    // NOTE: same as `builder::new_func`, the function gets the next slot of global memory
+    auto const res = (*ids)[start];
+    bld.reg.get<mem_effect>(res).tag = bld.state.next_slot++;
+
+    reused.fetch_add(1, std::memory_order_relaxed);
+    return res;
+}
+
+inline void func_cache::store(hashed_name name, entt::entity start, builder &bld, env const &e) const noexcept
+{
+    auto const key = keys.find(name);
+    if (key == keys.end())
+        return;
+
+    auto const path = entry(key->second);
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec))
+        return;
+
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &regions = bld.reg.storage<region_of_phi>();
+    auto const &calls = bld.reg.storage<func_of_call>();
+    auto const &rets = bld.reg.storage<return_of_func>();
+
+    func_info info{.start = start, .ret = rets.get(start).ret};
+    collect_func_body(bld, info);
+
+    std::vector<entt::entity> ns{start};
+    ns.insert(ns.end(), info.body.begin(), info.body.end());
+
+    entt::dense_set<entt::entity> inside;
+    for (auto n : ns)
+        inside.insert(n);
+    inside.insert(bld.glob_mem);
+    inside.insert(bld.pkg_mem);
+
+    // every node outside the function that it points to
+    entt::dense_map<entt::entity, hashed_name> imports;
+    auto const use = [&](entt::entity n)
+    {
+        if (n != entt::null && !inside.contains(n))
+            imports.try_emplace(n, hashed_name{});
+    };
+
+    for (auto n : ns)
+    {
+        for (auto in : ins.get(n).nodes)
+            use(in);
+
+        if (ctrl.contains(n))
+            use(ctrl.get(n).target);
+        if (mem.contains(n))
+        {
+            use(mem.get(n).prev);
+            use(mem.get(n).target);
+        }
+
+        if (regions.contains(n))
+            use(regions.get(n).region);
+        if (calls.contains(n))
+            use(calls.get(n).func);
+        if (rets.contains(n))
+            use(rets.get(n).ret);
+    }
+
+    size_t named = 0;
+    for (auto &&[global, index] : e.top->table)
+    {
+        if (!is_value(index))
+            continue;
+
+        if (auto iter = imports.find(e.values[(uint32_t)index]); iter != imports.end() && iter->second == hashed_name{})
+        {
+            iter->second = global;
+            ++named;
+        }
+    }
+
+    if (named != imports.size())
+        return;
+
+    ns.push_back(bld.glob_mem);
+    ns.push_back(bld.pkg_mem);
+
+    // NOTE: written aside then renamed, so a reader never sees half an entry
+    auto tmp = path;
+    tmp += std::format(".{}.tmp", (uint32_t)start);
+
+    auto f = fopen(tmp.string().c_str(), "wb");
+    if (!f)
+        return;
+
+    write_ir(f, bld.reg, ns, imports);
+    fclose(f);
+
+    std::filesystem::rename(tmp, path, ec);
+    stored.fetch_add(1, std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+
+#include "scanner.hpp"
+
+// Declaration scanning
+// Splits a source into its top-level declarations with only the scanner, without building any nodes, so it is cheap
+// enough to run on every file of a package up front (and on any thread)
+
+// TODO:
+// - `uses` over-approximates: it also has member names, parameter names and locals that shadow a top-level name
+// - record the token range of each declaration, so the parser can later skip straight to one
+
+// FNV-1a, one byte at a time
+inline constexpr uint64_t hash_seed = 0xCBF29CE484222325;
+
+inline constexpr uint64_t hash_bytes(uint64_t h, void const *data, size_t n) noexcept
+{
+    auto const bytes = (uchar const *)data;
+    for (size_t i{}; i < n; ++i)
+        h = (h ^ bytes[i]) * 0x100000001B3;
+    return h;
+}
+
+inline uint64_t hash_u64(uint64_t h, uint64_t v) noexcept { return hash_bytes(h, &v, sizeof(v)); }
+
+// a top-level declaration, as seen by the scanner
+struct decl_info final
+{
+    token_kind keyword = token_kind::Eof; // the first token, eg. `func` or `package`
+    std::vector<hashed_name> defines;     // the names it declares; more than one for `const (...)` and `var (...)`
+    std::vector<hashed_name> uses;        // every other identifier
+    uint64_t own = hash_seed;             // hash of its tokens
+    uint64_t signature = hash_seed;       // hash of what users see: the header of a function, every token for the rest
+};
+
+// Split `text` into its top-level declarations, in source order; the `package` clause is the first one
+inline std::vector<decl_info> scan_decls(uchar const *text) noexcept
+{
+    std::vector<decl_info> res(1);
+    uint32_t depth = 0;
+    bool in_body = false; // past the header of a function
+    bool grouped = false; // in a `const (...)` or `var (...)` list
+    auto prev = token_kind::Eof;
+
+    scanner scan{.text = text};
+    while (scan.peek.kind != token_kind::Eof)
+    {
+        auto const t = scan.next();
+        auto &d = res.back();
+
+        if (d.keyword == token_kind::Eof)
+            d.keyword = t.kind;
+        else if (prev == d.keyword && t.kind == token_kind::LeftParen)
+            grouped = d.keyword == token_kind::KwConst || d.keyword == token_kind::KwVar;
+
+        // NOTE: identifiers and keywords come with a hash from the scanner; literals are hashed by their text
+        auto h = hash_u64(hash_seed, (uint64_t)t.kind);
+        if (t.kind == token_kind::Ident || t.kind >= token_kind::KwBreak && t.kind <= token_kind::KwVar)
+            h = hash_u64(h, (uint64_t)t.hash);
+        else if (t.kind >= token_kind::Integer && t.kind <= token_kind::String)
+            h = hash_bytes(h, text + t.start, t.len);
+
+        if (t.kind == token_kind::Ident)
+        {
+            // NOTE: the name after `@` is an annotation, not the name of the declaration
+            auto const declares = (depth == 0 && d.defines.empty() && prev != token_kind::At) ||
+                                  (grouped && depth == 1 && (prev == token_kind::LeftParen || prev == token_kind::Semicolon));
+
+            (declares ? d.defines : d.uses).push_back(t.hash);
+        }
+
+        if (depth == 0 && t.kind == token_kind::LeftBrace && d.keyword == token_kind::KwFunc && !in_body)
+        {
+            d.signature = d.own;
+            in_body = true;
+        }
+
+        d.own = hash_u64(d.own, h);
+        prev = t.kind;
+
+        switch (t.kind)
+        {
+        case token_kind::LeftParen:
+        case token_kind::LeftBracket:
+        case token_kind::LeftBrace:
+            ++depth;
+            break;
+
+        case token_kind::RightParen:
+        case token_kind::RightBracket:
+        case token_kind::RightBrace:
+            depth -= depth != 0;
+            break;
+
+        case token_kind::Semicolon:
+            if (depth == 0)
+            {
+                if (!in_body)
+                    d.signature = d.own;
+
+                res.emplace_back();
+                in_body = false;
+                grouped = false;
+                prev = token_kind::Eof;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (res.back().keyword == token_kind::Eof)
+        res.pop_back();
+    else if (!in_body)
+        res.back().signature = res.back().own;
+
+    return res;
+}
@@ -43,6 +43,7 @@
 // memory state
 #include "nodegen/alloca.hpp"
 #include "nodegen/cast.hpp"
+#include "nodegen/checked_index.hpp"
 #include "nodegen/load.hpp"
 #include "nodegen/store.hpp"
 
@@ -79,7 +79,7 @@ inline entt::entity make(builder &bld, Gen const &gen)
         // TODO: update this to reflect the changes
         // TODO: set the tag
         bld.reg.emplace<mem_effect>(n) = {
-            .prev = bld.state.mem,
+            .prev = bld.join_mem(),
             .target = bld.state.func,
         };
         bld.reg.emplace<mem_read>(n);
@@ -92,7 +92,7 @@ inline entt::entity make(builder &bld, Gen const &gen)
         // TODO: update this to reflect the changes
         // TODO: set the tag
         bld.reg.emplace<mem_effect>(n) = {
-            .prev = bld.state.mem,
+            .prev = bld.join_mem(),
             .target = bld.state.func,
         };
         bld.reg.emplace<mem_write>(n);
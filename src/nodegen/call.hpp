@@ -8,7 +8,7 @@
 struct call_node final
 {
     using ctrl_node = void;
-    using mem_write = void; // TODO: this should be determined at runtime; or is it that it's always `write` but for `PureCall` it is `read`?
+    // NOTE: the memory effect depends on the callee, so it is set on `emit`
 
     // TODO: figure out the exact inputs you need for this node
     entt::entity func;
@@ -42,7 +42,30 @@ inline entt::entity call_node::emit(builder &bld, value const *val) const
                             ? node_op::ExternCall
                             : node_op::CallStatic;
 
-    // TODO: as optimization, figure out if it's a pure call and cut the link to `mem_state` if so
     // TODO: this node still might affect I/O and similar
-    return bld.make(val, nodety, args);
+    auto const call = bld.make(val, nodety, args);
+    bld.reg.emplace<func_of_call>(call, func);
+
+    // extern functions and functions still being parsed (ie. recursive calls) are assumed to write memory
+    auto const effect = bld.reg.all_of<effect_of_func>(func)
+                            ? bld.reg.get<effect_of_func>(func).effect
+                            : func_effect::Write;
+
+    // pure calls are not part of the memory chain, so they can be freely reordered, merged or removed
+    if (effect == func_effect::Pure)
+        return call;
+
+    // NOTE: the callee might touch any memory, so the call comes after every access so far
+    bld.reg.emplace<mem_effect>(call) = {
+        .prev = bld.join_mem(),
+        .target = bld.state.func,
+    };
+
+    if (effect == func_effect::Read)
+        bld.reg.emplace<mem_read>(call);
+    else
+        bld.reg.emplace<mem_write>(call);
+
+    bld.state.mem = call;
+    return call;
 }
\ No newline at end of file
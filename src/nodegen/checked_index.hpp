@@ -0,0 +1,29 @@
+#pragma once
+
+#include "nodegen/basic.hpp"
+
+// `index` as an index of an array of `len` elements, checked at runtime
+// NOTE: this is a control node, so that the check does not float above the branch that guards it
+struct checked_index_node final
+{
+    using ctrl_node = void;
+
+    entt::entity index, len;
+
+    inline value const *infer(type_storage const &types) const;
+    inline entt::entity emit(builder &bld, value const *val) const;
+};
+
+static_assert(nodegen<checked_index_node>);
+
+inline value const *checked_index_node::infer(type_storage const &types) const
+{
+    // TODO: narrow the index to [0, len) once the check traps on failure
+    return types.get(index).type;
+}
+
+inline entt::entity checked_index_node::emit(builder &bld, value const *val) const
+{
+    entt::entity const ins[]{index, len};
+    return bld.make(val, node_op::CheckedIndex, ins);
+}
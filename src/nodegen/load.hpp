@@ -11,6 +11,7 @@ struct load_node final
 {
     entt::entity base;
     int_value const *offset = nullptr;
+    entt::entity index = entt::null; // the node computing `offset`, if any (eg. a `CheckedIndex`)
 
     inline value const *infer(type_storage const &types) const;
     inline entt::entity emit(builder &bld, value const *val) const;
@@ -28,16 +29,19 @@ inline value const *load_node::infer(type_storage const &types) const
 inline entt::entity load_node::emit(builder &bld, value const *val) const
 {
     // TODO: is the value correct?
-    auto const load = bld.make(val, node_op::Load, {});
+    auto const load = (index != entt::null)
+                          ? bld.make(val, node_op::Load, std::span(&index, 1))
+                          : bld.make(val, node_op::Load, {});
     // TODO: tag=-1 should not be Top, instead it should propagate up
+    // NOTE: only ordered against the other accesses to `base`, see `builder::mem_of`
     bld.reg.emplace<mem_effect>(load) = {
-        .prev = bld.state.mem, // TODO: is this correct?
+        .prev = bld.mem_of(base),
         .target = base,
         .tag = offset->as<int_const>() ? (uint32_t)offset->as<int_const>()->n : ~uint32_t{},
     };
 
     bld.reg.emplace<mem_read>(load);
-    bld.state.mem = load;
+    bld.set_mem(base, load);
 
     return load;
 }
\ No newline at end of file
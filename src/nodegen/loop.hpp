@@ -3,9 +3,12 @@
 
 #include "nodegen/basic.hpp"
 
+// `Loop` In=[entry, back-edge]
+// The loop is made with its entry only; the back-edge is added once the body is parsed, see `parser::close_loop`
+
 struct loop_node final
 {
-    using ctrl_node = void;
+    entt::entity entry; // control flow before the loop
 
     inline value const *infer(type_storage const &types) const;
     inline entt::entity emit(builder &bld, value const *val) const;
@@ -21,5 +24,34 @@ inline value const *loop_node::infer(type_storage const &types) const
 
 inline entt::entity loop_node::emit(builder &bld, value const *val) const
 {
-    return bld.make(val, node_op::Loop, {});
-}
\ No newline at end of file
+    auto const ret = bld.make(val, node_op::Loop, std::span(&entry, 1));
+    bld.state.ctrl = ret;
+    return ret;
+}
+
+// Type of a loop `Phi` whose value before the loop has type `entry`
+// NOTE: the value coming from the back-edge is not known while the body is parsed, so constants are widened to the top
+// of their kind; otherwise the body would be folded as if the variable never changed
+// TODO: iterate the body to a fixed point instead, so eg. a counter keeps its sign
+template <std::integral... T>
+inline value const *widen_sized(value const *entry) noexcept
+{
+    value const *res = nullptr;
+    (void)((entry->as<sized_int_<T>>() ? (res = sized_int_top<T>::self(), true) : false) || ...);
+    return res;
+}
+
+inline value const *loop_phi_type(value const *entry) noexcept
+{
+    if (entry->as<int_value>())
+        return int_value::top();
+    if (entry->as<bool_value>())
+        return bool_top::self();
+    if (entry->as<float_value>())
+        return float_top::self();
+
+    if (auto const sized = widen_sized<int8_t, int16_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t>(entry))
+        return sized;
+
+    return entry;
+}
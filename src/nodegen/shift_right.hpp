@@ -15,12 +15,12 @@ static_assert(nodegen<shift_right_node>);
 
 inline value const *shift_right_node::infer(type_storage const &types) const
 {
-    return types.get(lhs).type->lsh(types.get(rhs).type);
+    return types.get(lhs).type->rsh(types.get(rhs).type);
 }
 
 inline entt::entity shift_right_node::emit(builder &bld, value const *val) const
 {
     entt::entity const ins[]{lhs, rhs};
     // TODO: more cases here
-    return bld.make(val, node_op::ShiftLeft, ins);
+    return bld.make(val, node_op::ShiftRight, ins);
 }
\ No newline at end of file
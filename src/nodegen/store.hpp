@@ -35,7 +35,8 @@ inline entt::entity store_node::emit(builder &bld, value const *val) const
     if (bld.reg.get<node_op>(lhs) == node_op::Load)
     {
         // update the `prev` node as the LHS is generated first, but we need the RHS to be evaluated first
-        bld.reg.emplace<mem_effect>(store, bld.reg.get<mem_effect const>(lhs)).prev = bld.state.mem;
+        auto &&eff = bld.reg.emplace<mem_effect>(store, bld.reg.get<mem_effect const>(lhs));
+        eff.prev = bld.mem_of(eff.target);
     }
     else
     {
@@ -43,14 +44,14 @@ inline entt::entity store_node::emit(builder &bld, value const *val) const
         // TODO: recheck this
         // TODO: tag=-1 should not be Top, instead it should propagate up
         bld.reg.emplace<mem_effect>(store) = {
-            .prev = bld.state.mem, // TODO: is this correct?
+            .prev = bld.mem_of(lhs),
             .target = lhs,
             .tag = offset->as<int_const>() ? (uint32_t)offset->as<int_const>()->n : ~uint32_t{},
         };
     }
 
     bld.reg.emplace<mem_write>(store);
-    bld.state.mem = store;
+    bld.set_mem(bld.reg.get<mem_effect>(store).target, store);
 
     return store;
 }
\ No newline at end of file
@@ -11,15 +11,12 @@
 
 // TODO:
 // - projections should have names; the projection of a function is a parameter, the projections of program memory are heap, global, local (functions)
-// - `CallStatic` and `PureCallStatic`; the second one doesn't have an `effect` link
-// - `checked_index` by default, which can be lowered to `index` iff `index < len` is `true`
 // - optimization: Loads at an index with known type are just a `const` node
 // - no need for sized math operations, just generate a `truncate` (& ~0) node as needed and just have `Iadd`/`Uadd`/similar
 // ^ you probably still need `F32add` and `F64add` + similar due to memory layout of floats
 // ^ also for uint you don't need an "expand" node, but for  sint/floats you probably need an "s/fextendMtoN" instruction
 // - `delay_typecheck` component to resolve out-of-order declarations and such
 // - evaluate the type of every node when parsing, then `const_fold` would simply check `type.is_known` and replace the node with `Const(type)`
-// - (maybe) it's a good idea to mark `Return` nodes with a component, so you can later easily jump to them to cut unused functions
 // - merge non-basic edges into a single component type, interpreted based on `node_op`
 // - multi-assign + multi-declare variables
 // - store nodes by hash (hash=id, but based on node kind, etc.) - called hash-cons; it also helps with constant pooling
@@ -36,6 +33,9 @@
 // - [x] `Start` node to be specified on `load`/`store` nodes to avoid reordering
 // - [x] export graph to dot format
 // - [x] separate node from builder in files
+// - [x] mark `Return` nodes with a component (`return_of_func`), so you can later easily jump to them to cut unused functions
+// - [x] pure calls (`CallStatic` without a `mem_effect` link), see `effect_of_func`
+// - [x] `checked_index` by default, which can be lowered to `index` iff `index < len` is `true`, see `eliminate_bounds_checks`
 
 // TODO: can you fit all ops in a uint8_t?
 // TODO: specify `Out` links of each node (ie. can you link a ctrl, memory, data edge to this node?)
@@ -61,7 +61,7 @@ enum class node_op : uint8_t
 
     IfYes,  // IfYes In=[ctrlNode, condNode]
     IfNot,  // IfNot In=[ctrlNode, condNode]
-    Loop,   // Loop In=[ctrlNode] Out=[IfYes, IfNot]
+    Loop,   // Loop In=[entry, backEdge] Out=[IfYes, IfNot]
     Region, // Region - a merge point for multiple control flows
     Phi,    // Phi In=[regionNode, dataNode x len(regionIn)]
 
@@ -116,8 +116,46 @@ enum class node_op : uint8_t
     Struct, // Struct Value=structValue In=[members...]
 
     Error, // TODO: temporary hack
+
+    // NOTE: new ops are appended after `Error` so the numbering of the ops above stays the same
+    CheckedIndex, // CheckedIndex In=[ctrlNode, indexNode, lenNode] - `indexNode`, if `0 <= indexNode < lenNode`
+
+    // packed nodes, computing `vector_width` lanes at once; see `vectorize_loops`
+    // NOTE: they have the type of their lanes, and work on floats if the lanes are floats
+    VecSplat,  // VecSplat In=[scalar] - every lane is `scalar`
+    VecLoad,   // VecLoad In=[indexNode; memState] - like `Load`, but lanes `indexNode` to `indexNode + vector_width - 1`
+    VecAdd,    // VecAdd In=[lhs, rhs]
+    VecSub,    // VecSub In=[lhs, rhs]
+    VecMul,    // VecMul In=[lhs, rhs]
+    VecReduce, // VecReduce In=[vec] - the sum of the lanes of `vec`, as a scalar
+
+    Import, // Import - a global of another file, while a file of a package is parsed on its own; see `parser::unit_package`
 };
 
+// lanes of a packed node; 4 x 64 bits fill an AVX register
+inline constexpr uint32_t vector_width = 4;
+
+// Does `op` make a packed value? (`VecReduce` takes one but makes a scalar)
+inline constexpr bool is_packed_op(node_op op) noexcept
+{
+    return op >= node_op::VecSplat && op <= node_op::VecMul;
+}
+
+// Does `n` hold `vector_width` lanes?
+// NOTE: packed `Phi`s have the type of their lanes as well, so they are told apart by their value before the loop
+template <typename Ops, typename Ins>
+inline bool is_packed(Ops const &ops, Ins const &ins, entt::entity n) noexcept
+{
+    auto const op = ops.get(n);
+    if (op == node_op::Phi)
+    {
+        auto const &nins = ins.get(n).nodes;
+        return nins.n != 0 && nins[0] != entt::null && is_packed_op(ops.get(nins[0]));
+    }
+
+    return is_packed_op(op);
+}
+
 // component
 // HACK: use a non-polymorphic C++ type to represent node type
 struct node_type final
@@ -161,6 +199,7 @@ struct ctrl_effect final
                 -> StaticMemory (GlobalMemory)
                 -> FunctionMemory (Start/Local)
     ^ then when an executable is compiled, all `PackageMemory` is propagated to `ProgramMemory` for whole program optimizations
+    ^ `alias_class` (opt/alias.hpp) sorts the targets of memory nodes this way
 */
 struct mem_effect final
 {
@@ -190,6 +229,35 @@ struct region_of_phi final
     entt::entity region;
 };
 
+// component
+// present only on `CallStatic`/`ExternCall` nodes, connects them to the `Start` of the called function
+struct func_of_call final
+{
+    entt::entity func;
+};
+
+// component
+// present only on `Start` nodes of functions with a body, connects them to the `Return` of the function
+struct return_of_func final
+{
+    entt::entity ret;
+};
+
+// the memory effects of a function, as seen by its callers
+enum class func_effect : uint8_t
+{
+    Pure,  // touches only its own locals; calls to it have no `mem_effect`
+    Read,  // reads memory it does not own; calls to it are `mem_read`
+    Write, // writes memory it does not own, or the effect is unknown; calls to it are `mem_write`
+};
+
+// component
+// present only on `Start` nodes of functions with a body, computed once the whole function is parsed
+struct effect_of_func final
+{
+    func_effect effect;
+};
+
 // component
 // present only for nodes where type checking fails (eg. trying to add a boolean to an array)
 struct error_node final
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+
+#include "builder.hpp"
+#include "types/int.hpp"
+
+// Alias analysis
+// Every memory node touches a place: a range of slots of some memory. The memory is the node its `mem_effect` targets,
+// sorted into the classes sketched next to `mem_effect`: `Program` is any memory at all, the others never overlap each
+// other, except that an object reached through a value (`Heap`) may be any object
+// Slots are the `tag` of the node; a runtime index (`tag == ~0`) touches every slot its type allows, or every slot at all
+
+// TODO:
+// - split `Program` into the package and the program, once there are several packages
+// - tell the objects behind pointers apart, once pointers are written through
+// - the range of an index from the conditions guarding it, as in `eliminate_bounds_checks`
+// - cache the places of the nodes, rather than finding them again on every query
+
+enum class alias_class : uint8_t
+{
+    Program,  // any memory: calls, `Start`s and the roots of the memory chains
+    Global,   // a slot of `GlobalMemory`
+    Function, // a parameter of a function, read from its `Start`
+    Object,   // a single allocation (`Alloca`) or aggregate (`Struct`), told apart by `root`
+    Heap,     // an object reached through some other value (a `Load`, a `Phi`, a parameter...), maybe any `Object`
+};
+
+// The slots of memory a node touches
+struct mem_place final
+{
+    alias_class cls = alias_class::Program;
+    entt::entity root = entt::null;  // the memory itself, for every class but `Program`
+    entt::entity index = entt::null; // the node computing the first slot, for runtime indices
+    uint32_t width = 1;              // the number of slots from the first one
+    int64_t lo = 0;                  // the first slot that might be touched
+    int64_t hi = int_bounds::max;    // the last slot that might be touched
+};
+
+// The class of the memory `target` is
+inline alias_class class_of_memory(builder &bld, entt::entity target) noexcept
+{
+    if (target == entt::null || !bld.reg.valid(target))
+        return alias_class::Program;
+
+    switch (bld.reg.get<node_op>(target))
+    {
+    case node_op::Program:
+        return alias_class::Program;
+    case node_op::GlobalMemory:
+        return alias_class::Global;
+    case node_op::Start:
+        return alias_class::Function;
+    case node_op::Alloca:
+    case node_op::Struct:
+        return alias_class::Object;
+    default:
+        return alias_class::Heap;
+    }
+}
+
+// The place the memory node `n` touches
+inline mem_place place_of(builder &bld, entt::entity n) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+
+    if (!mem.contains(n))
+        return {};
+
+    auto const op = ops.get(n);
+    auto const &eff = mem.get(n);
+
+    switch (op)
+    {
+    // NOTE: an allocation touches the whole of the new object
+    case node_op::Alloca:
+        return {.cls = alias_class::Object, .root = n};
+
+    case node_op::Proj:
+        return {.cls = alias_class::Function, .root = eff.target, .lo = eff.tag, .hi = eff.tag};
+
+    case node_op::Load:
+    case node_op::VecLoad:
+    case node_op::Store:
+        break;
+
+    // calls, `Start`s and anything else might touch any memory
+    default:
+        return {};
+    }
+
+    mem_place res{.cls = class_of_memory(bld, eff.target), .root = eff.target};
+    if (res.cls == alias_class::Program)
+        return {};
+
+    if (eff.tag != ~uint32_t{})
+    {
+        res.lo = res.hi = eff.tag;
+        return res;
+    }
+
+    // NOTE: `Store`s take the value as their input, not the index, so they touch every slot
+    auto const &nins = ins.get(n).nodes;
+    if (op == node_op::Store || nins.n == 0 || nins[0] == entt::null)
+        return res;
+
+    // NOTE: the slot is the checked index, so both checks of the same index point at the same slot
+    auto index = nins[0];
+    if (ops.get(index) == node_op::CheckedIndex)
+        index = ins.get(index).nodes[0];
+
+    res.index = index;
+    res.width = (op == node_op::VecLoad) ? vector_width : 1;
+
+    if (auto const i = bld.reg.get<node_type>(index).type->as<int_value>())
+    {
+        auto const b = i->bounds();
+        res.lo = std::max<int64_t>(b.lo, 0);
+        if (!checked_add(b.hi, (int64_t)res.width - 1, res.hi))
+            res.hi = int_bounds::max;
+    }
+
+    return res;
+}
+
+// Might `a` and `b` touch the same slot?
+inline bool may_alias(mem_place const &a, mem_place const &b) noexcept
+{
+    if (a.cls == alias_class::Program || b.cls == alias_class::Program)
+        return true;
+
+    if (a.root != b.root)
+    {
+        // NOTE: the same object can be reached through different values, or be a known object as well
+        auto const any_object = [](alias_class c)
+        { return c == alias_class::Object || c == alias_class::Heap; };
+
+        return (a.cls == alias_class::Heap || b.cls == alias_class::Heap) && any_object(a.cls) && any_object(b.cls);
+    }
+
+    return a.lo <= b.hi && b.lo <= a.hi;
+}
+
+// Do `a` and `b` always touch exactly the same slots?
+inline bool must_alias(mem_place const &a, mem_place const &b) noexcept
+{
+    if (a.cls == alias_class::Program || a.cls != b.cls || a.root != b.root || a.width != b.width)
+        return false;
+
+    if (a.index != entt::null || b.index != entt::null)
+        return a.index == b.index;
+
+    return a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+}
+
+// Might the memory nodes `a` and `b` touch the same slot?
+inline bool may_alias(builder &bld, entt::entity a, entt::entity b) noexcept
+{
+    return may_alias(place_of(bld, a), place_of(bld, b));
+}
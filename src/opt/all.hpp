@@ -1,5 +1,18 @@
 
 #pragma once
 
+#include "opt/alias.hpp"
+#include "opt/bce.hpp"
 #include "opt/dce.hpp"
-#include "opt/mem_reorder.hpp"
\ No newline at end of file
+#include "opt/effects.hpp"
+#include "opt/fold_calls.hpp"
+#include "opt/forward.hpp"
+#include "opt/gvn.hpp"
+#include "opt/inline.hpp"
+#include "opt/loops.hpp"
+#include "opt/mem_reorder.hpp"
+#include "opt/passes.hpp"
+#include "opt/sroa.hpp"
+#include "opt/strength.hpp"
+#include "opt/unroll.hpp"
+#include "opt/vectorize.hpp"
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "builder.hpp"
+#include "types/int.hpp"
+
+// Bounds-check elimination (BCE)
+
+// TODO:
+// - use the conditions of the dominating `IfYes`/`IfNot`s as well, not only the range of the index
+// ^ eg. `if i < len { a[i] }` where `i` is not otherwise bounded
+// - hoist the checks that cannot be removed out of loops, checking the whole range of the counter once
+
+// Is `index` always inside [0, len)?
+inline bool in_bounds(value const *index, value const *len) noexcept
+{
+    auto const n = len->as<int_const>();
+    if (!n || n->n > (uint64_t)int_bounds::max)
+        return false;
+
+    int_bounds b;
+    if (auto const i = index->as<int_value>())
+        b = i->bounds();
+    else if (auto const sized = index->as<sized_int_value>())
+        b = sized->bounds();
+    else
+        return false;
+
+    return b.lo >= 0 && b.hi < (int64_t)n->n;
+}
+
+// Remove every `CheckedIndex` whose index is provably in bounds; return the number of checks removed
+inline size_t eliminate_bounds_checks(builder &bld) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &types = bld.reg.storage<node_type>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+
+    std::vector<entt::entity> removed;
+    for (auto [id, op] : ops.each())
+    {
+        if (op != node_op::CheckedIndex)
+            continue;
+
+        auto const &nins = ins.get(id).nodes;
+        if (in_bounds(types.get(nins[0]).type, types.get(nins[1]).type))
+            removed.push_back(id);
+    }
+
+    // NOTE: the index goes straight to the `Load`s, the control flow skips the check
+    for (auto check : removed)
+    {
+        bld.unlink_ctrl(check, ctrl.get(check).target, ins.get(check).nodes[0]);
+        bld.destroy(check);
+    }
+
+    return removed.size();
+}
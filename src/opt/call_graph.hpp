@@ -0,0 +1,138 @@
+#pragma once
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "builder.hpp"
+
+// TODO:
+// - cache this between passes, update it incrementally instead of rebuilding it
+// - handle `ExternCall`s as opaque nodes of the graph
+
+struct func_info final
+{
+    entt::entity start;
+    entt::entity ret;
+    std::vector<entt::entity> body;  // every node reachable from `ret` without leaving the function (`start` excluded)
+    std::vector<entt::entity> calls; // the `CallStatic` nodes inside `body`
+    uint32_t call_sites = 0;         // number of `CallStatic` nodes calling this function
+    bool recursive = false;          // true if the function can reach itself through `calls`
+};
+
+struct call_graph final
+{
+    inline func_info *find(entt::entity start) noexcept
+    {
+        auto iter = funcs.find(start);
+        return iter != funcs.end() ? &iter->second : nullptr;
+    }
+
+    entt::dense_map<entt::entity, func_info> funcs; // keyed by the `Start` of the function
+};
+
+// Collect the nodes of the function starting at `start` by walking every edge backwards from its `Return`
+// NOTE: globals and other functions' `Start`s are not part of the body
+inline void collect_func_body(builder &bld, func_info &info) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &phis = bld.reg.storage<region_of_phi>();
+    auto const &globals = bld.reg.storage<void>((entt::id_type)visibility::global);
+
+    entt::dense_set<entt::entity> visited;
+    std::vector<entt::entity> to_visit{info.ret};
+
+    auto const outside = [&](entt::entity n)
+    {
+        if (n == entt::null || n == info.start || globals.contains(n))
+            return true;
+
+        switch (ops.get(n))
+        {
+        case node_op::Program:
+        case node_op::GlobalMemory:
+        case node_op::Start:
+            return true;
+
+        default:
+            return false;
+        }
+    };
+
+    while (!to_visit.empty())
+    {
+        auto const top = to_visit.back();
+        to_visit.pop_back();
+
+        if (outside(top) || !visited.insert(top).second)
+            continue;
+
+        info.body.push_back(top);
+        if (ops.get(top) == node_op::CallStatic)
+            info.calls.push_back(top);
+
+        auto &&nins = ins.get(top).nodes;
+        to_visit.insert(to_visit.end(), nins.begin(), nins.end());
+
+        if (ctrl.contains(top))
+            to_visit.push_back(ctrl.get(top).target);
+
+        if (mem.contains(top))
+        {
+            to_visit.push_back(mem.get(top).prev);
+            to_visit.push_back(mem.get(top).target);
+        }
+
+        if (phis.contains(top))
+            to_visit.push_back(phis.get(top).region);
+    }
+}
+
+inline call_graph build_call_graph(builder &bld) noexcept
+{
+    call_graph cg;
+
+    for (auto [start, ret] : bld.reg.storage<return_of_func>().each())
+    {
+        auto &&info = cg.funcs[start];
+        info = {.start = start, .ret = ret.ret};
+        collect_func_body(bld, info);
+    }
+
+    auto const &targets = bld.reg.storage<func_of_call>();
+
+    // NOTE: calls from the global scope (eg. the call to `main`) are also call sites
+    for (auto [call, target] : targets.each())
+        if (auto callee = cg.find(target.func))
+            ++callee->call_sites;
+
+    // TODO: use SCCs here instead once the number of functions grows
+    for (auto &&[start, info] : cg.funcs)
+    {
+        entt::dense_set<entt::entity> seen;
+        std::vector<entt::entity> to_visit{start};
+
+        while (!to_visit.empty() && !info.recursive)
+        {
+            auto const top = to_visit.back();
+            to_visit.pop_back();
+
+            auto caller = cg.find(top);
+            if (!caller)
+                continue;
+
+            for (auto call : caller->calls)
+            {
+                auto const callee = targets.get(call).func;
+                if (callee == start)
+                    info.recursive = true;
+                else if (seen.insert(callee).second)
+                    to_visit.push_back(callee);
+            }
+        }
+    }
+
+    return cg;
+}
@@ -1,11 +1,17 @@
 
 #pragma once
 
+#include <entt/container/dense_set.hpp>
+
 #include "builder.hpp"
+#include "stats.hpp"
+#include "utils/steppable.hpp"
 
 // TODO: this again, but for global nodes
 inline void prune_dead_code(builder &bld, entt::entity ret) noexcept
 {
+    stats_zone _{"prune"};
+
     // TODO: should this be here or somewhere else?
     // bld.report_errors();
 
@@ -67,3 +73,155 @@ inline void prune_dead_code(builder &bld, entt::entity ret) noexcept
 
     // new_nodes.clear();
 }
+
+// Is `op` a value that only depends on its inputs, so it can be dropped or shared when nothing tells it apart?
+// NOTE: `Div` can trap and `Proj`s are the parameters of their function, so those are kept
+inline bool is_pure_value(node_op op) noexcept
+{
+    switch (op)
+    {
+    case node_op::UnaryCompl:
+    case node_op::UnaryNeg:
+    case node_op::UnaryNot:
+    case node_op::Add:
+    case node_op::Sub:
+    case node_op::Mul:
+    case node_op::LogicAnd:
+    case node_op::LogicOr:
+    case node_op::BitAnd:
+    case node_op::BitXor:
+    case node_op::BitOr:
+    case node_op::ShiftLeft:
+    case node_op::ShiftRight:
+    case node_op::Fadd:
+    case node_op::Fsub:
+    case node_op::Fmul:
+    case node_op::Fdiv:
+    case node_op::CmpEq:
+    case node_op::CmpNe:
+    case node_op::CmpLt:
+    case node_op::CmpLe:
+    case node_op::CmpGt:
+    case node_op::CmpGe:
+    case node_op::IConst:
+    case node_op::FConst:
+    case node_op::SConst:
+    case node_op::BConst:
+    case node_op::Phi:
+    case node_op::VecSplat:
+    case node_op::VecAdd:
+    case node_op::VecSub:
+    case node_op::VecMul:
+    case node_op::VecReduce:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// The nodes some `ctrl_effect`/`mem_effect` points to; they are in use even without data users
+inline entt::dense_set<entt::entity> effect_targets(builder &bld) noexcept
+{
+    entt::dense_set<entt::entity> res;
+
+    for (auto [id, eff] : bld.reg.storage<ctrl_effect>().each())
+        res.emplace(eff.target);
+
+    for (auto [id, eff] : bld.reg.storage<mem_effect>().each())
+    {
+        res.emplace(eff.prev);
+        res.emplace(eff.target);
+    }
+
+    return res;
+}
+
+// nodes destroyed between two steps of `remove_dead_values_steps`
+inline constexpr size_t remove_dead_values_step = 256;
+
+// Destroy every pure value with no users, then the inputs left without users by that, a few nodes per step; the changes
+// are the number of nodes destroyed
+// `Load`s nobody uses leave the memory chain first, as no other node depends on a read (eg. after `forward_loads`)
+// TODO: also remove the cycles of `Phi`s that only use each other (eg. a loop counter nobody reads)
+// TODO: remove `Store`s overwritten before anything reads them, once `Store`s carry the control flow they run in
+inline steppable remove_dead_values_steps(builder &bld) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &effects = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+
+    // NOTE: a `Load` other nodes read from (eg. an array inside a struct) is in use, even without data users
+    entt::dense_set<entt::entity> accessed;
+    for (auto [id, eff] : mem.each())
+        accessed.emplace(eff.target);
+
+    std::vector<entt::entity> unused_reads;
+    for (auto [id, op] : ops.each())
+        if ((op == node_op::Load || op == node_op::VecLoad) && !accessed.contains(id))
+            if (auto const *n_users = bld.reg.try_get<users>(id); !n_users || n_users->entries.empty())
+                unused_reads.push_back(id);
+
+    if (!unused_reads.empty())
+    {
+        entt::dense_set<entt::entity> removed_reads{unused_reads.begin(), unused_reads.end()};
+        bld.unlink_mem([&](entt::entity n)
+                       { return removed_reads.contains(n); });
+    }
+
+    auto const targets = effect_targets(bld);
+
+    auto const is_dead = [&](entt::entity n)
+    {
+        if (!ops.contains(n) || !is_pure_value(ops.get(n)) || effects.contains(n) || mem.contains(n) || targets.contains(n))
+            return false;
+
+        auto const *n_users = bld.reg.try_get<users>(n);
+        return !n_users || n_users->entries.empty();
+    };
+
+    std::vector<entt::entity> dead;
+    for (auto [id, op] : ops.each())
+        if (is_dead(id))
+            dead.push_back(id);
+
+    // NOTE: the inputs of the reads might have no other users
+    for (auto n : unused_reads)
+    {
+        auto const &n_ins = ins.get(n).nodes;
+        std::vector<entt::entity> const nins{n_ins.begin(), n_ins.end()};
+        bld.destroy(n);
+
+        for (auto in : nins)
+            if (in != entt::null && is_dead(in))
+                dead.push_back(in);
+    }
+
+    size_t removed = unused_reads.size();
+    while (!dead.empty())
+    {
+        auto const n = dead.back();
+        dead.pop_back();
+
+        // NOTE: a node can be pushed twice when two of its users die
+        if (!bld.reg.valid(n))
+            continue;
+
+        auto const &n_ins = ins.get(n).nodes;
+        std::vector<entt::entity> const nins{n_ins.begin(), n_ins.end()};
+        bld.destroy(n);
+
+        for (auto in : nins)
+            if (in != entt::null && in != n && is_dead(in))
+                dead.push_back(in);
+
+        if (++removed == remove_dead_values_step)
+            co_yield std::exchange(removed, 0);
+    }
+
+    co_return removed;
+}
+
+// Same as `remove_dead_values_steps`, all at once; return the number of nodes destroyed
+inline size_t remove_dead_values(builder &bld) noexcept { return remove_dead_values_steps(bld).finish(); }
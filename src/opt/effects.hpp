@@ -0,0 +1,84 @@
+#pragma once
+
+#include "opt/call_graph.hpp"
+#include "types/ptr.hpp"
+
+// TODO:
+// - recursive calls are seen as `Write`, as the callee is not fully parsed yet; refine them once the function is done
+// - `ExternCall`s could be annotated with their effects (eg. `@pure`)
+// - pointer parameters that are only read from should not make the function `Read` if the caller owns the memory
+
+// Compute the memory effect of a fully parsed function from its own memory chain
+// NOTE: the calls in the body already carry the effect of their callee, as functions are declared before use
+inline func_effect classify_func(builder &bld, func_info const &info) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &types = bld.reg.storage<node_type>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &reads = bld.reg.storage<mem_read>();
+    auto const &writes = bld.reg.storage<mem_write>();
+
+    entt::dense_set<entt::entity> body{info.body.begin(), info.body.end()};
+
+    // memory owned by the function: allocations and values made in the body, or parameters passed by value
+    // NOTE: a `Deref` is made in the body, but the memory it points to may be anyone's, so it is never local
+    auto const is_local = [&](entt::entity target)
+    {
+        if (target == info.start)
+            return true;
+        if (!body.contains(target))
+            return false;
+
+        switch (ops.get(target))
+        {
+        case node_op::Deref:
+            return false;
+        case node_op::Proj:
+            return !types.get(target).type->as<any_pointer>();
+        default:
+            return true;
+        }
+    };
+
+    auto effect = func_effect::Pure;
+    for (auto n : info.body)
+    {
+        switch (ops.get(n))
+        {
+        // parameters, allocations and the return are the function's own memory
+        case node_op::Proj:
+        case node_op::Alloca:
+        case node_op::Return:
+            continue;
+
+        case node_op::ExternCall:
+            return func_effect::Write;
+
+        // the call's `mem_effect` targets this function, but its tags reflect the callee's effect
+        case node_op::CallStatic:
+            if (writes.contains(n))
+                return func_effect::Write;
+            if (reads.contains(n))
+                effect = func_effect::Read;
+            continue;
+
+        // NOTE: the `Load`s and `Store`s through it are classified below, so a `Store` still makes the function `Write`
+        case node_op::Deref:
+            effect = std::max(effect, func_effect::Read);
+            continue;
+
+        default:
+            break;
+        }
+
+        if (!mem.contains(n) || is_local(mem.get(n).target))
+            continue;
+
+        if (writes.contains(n))
+            return func_effect::Write;
+        if (reads.contains(n))
+            effect = std::max(effect, func_effect::Read);
+    }
+
+    return effect;
+}
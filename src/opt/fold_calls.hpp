@@ -0,0 +1,440 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+
+#include "nodegen/basic.hpp"
+#include "opt/call_graph.hpp"
+#include "types/all.hpp"
+
+// Compile-time evaluation of calls
+// A pure call whose arguments are all constants always returns the same value, so it is run once here and replaced by it
+// The callee runs over the `value` lattice, the same way the parser folds constants: control flow follows the `ctrl_effect`
+// chains from its `Start` like in the interpreter, and every value it computes must be a constant
+// NOTE: the evaluation gives up on anything it cannot decide (a non-constant value, a trap, a node it does not know, or
+// running out of fuel), leaving the call as it is; so the program still traps at runtime where it would have
+
+// TODO:
+// - strings, once `string_value` keeps its contents (eg. `hash("name")`)
+// - `Cast`s, `Alloca`s and `Store`s to local aggregates, and calls returning aggregates
+// - cache the results by callee and arguments, for calls repeated with the same constants
+
+// the control steps and nodes a call may evaluate before giving up, nested calls included
+static constexpr size_t fold_call_fuel = 4096;
+
+namespace fold_detail
+{
+    // a control node following another one; `index` is the input of the `Region`/`Loop` the edge goes through
+    struct successor final
+    {
+        entt::entity node;
+        uint32_t index;
+    };
+
+    // the state of a function running at compile time
+    struct frame final
+    {
+        entt::entity start;                                   // `Start` of the function
+        std::span<value const *const> args;                   // values of the `Proj`s of `start`
+        entt::dense_map<entt::entity, value const *> cache;   // data node -> value, until the next `Region`/`Loop`
+        entt::dense_map<entt::entity, value const *> results; // value of `Phi`s and control nodes (calls, checks)
+    };
+
+    struct evaluator final
+    {
+        inline explicit evaluator(builder &bld) noexcept;
+
+        // The value `call` returns, or `nullptr` if it is not a constant known at compile time
+        inline value const *call(entt::entity call, std::span<value const *const> args) noexcept;
+
+        // Follow the control flow from `entry` until a `Return`; return it (`null` on failure)
+        inline entt::entity run(frame &f, entt::entity entry) noexcept;
+
+        // Set the `Phi`s of `region` to their `index`-th input, all at once
+        inline bool enter_region(frame &f, entt::entity region, uint32_t index) noexcept;
+
+        inline value const *eval(frame &f, entt::entity n) noexcept;
+        inline value const *compute(frame &f, entt::entity n) noexcept;
+
+        entt::storage_for_t<node_op> const &ops;
+        entt::storage_for_t<node_type> const &types;
+        entt::storage_for_t<node_inputs> const &ins;
+        entt::storage_for_t<ctrl_effect> const &ctrl;
+        entt::storage_for_t<mem_effect> const &mem;
+        entt::storage_for_t<func_of_call> const &targets;
+        entt::storage_for_t<return_of_func> const &rets;
+
+        entt::dense_map<entt::entity, std::vector<successor>> succs;
+        entt::dense_map<entt::entity, std::vector<entt::entity>> phis; // `Region`/`Loop` -> its `Phi`s
+
+        size_t fuel = 0;
+    };
+
+    inline evaluator::evaluator(builder &bld) noexcept
+        : ops{bld.reg.storage<node_op>()},
+          types{bld.reg.storage<node_type>()},
+          ins{bld.reg.storage<node_inputs>()},
+          ctrl{bld.reg.storage<ctrl_effect>()},
+          mem{bld.reg.storage<mem_effect>()},
+          targets{bld.reg.storage<func_of_call>()},
+          rets{bld.reg.storage<return_of_func>()}
+    {
+        for (auto [id, eff] : ctrl.each())
+            succs[eff.target].push_back({id, 0});
+
+        // `Region`s and `Loop`s link to their predecessors through their inputs
+        for (auto [id, op] : ops.each())
+        {
+            if (op != node_op::Region && op != node_op::Loop)
+                continue;
+
+            for (uint32_t i{}; auto pred : ins.get(id).nodes)
+                succs[pred].push_back({id, i++});
+        }
+
+        // NOTE: memory `Phi`s only order memory nodes, they have no value
+        for (auto [phi, region] : bld.reg.storage<region_of_phi>().each())
+            if (!mem.contains(phi))
+                phis[region.region].push_back(phi);
+    }
+
+    inline value const *evaluator::call(entt::entity call, std::span<value const *const> args) noexcept
+    {
+        auto const callee = targets.get(call).func;
+        if (!rets.contains(callee))
+            return nullptr;
+
+        frame f{.start = callee, .args = args};
+        auto const end = run(f, callee);
+        if (end == entt::null)
+            return nullptr;
+
+        auto const &rins = ins.get(end).nodes;
+        return (rins.n != 0) ? eval(f, rins[0]) : nullptr;
+    }
+
+    inline entt::entity evaluator::run(frame &f, entt::entity entry) noexcept
+    {
+        auto cur = entry;
+        while (fuel != 0)
+        {
+            --fuel;
+
+            switch (ops.get(cur))
+            {
+            case node_op::Return:
+                return cur;
+
+            // NOTE: the callee of a pure function is pure as well
+            case node_op::CallStatic:
+            {
+                auto const &nins = ins.get(cur).nodes;
+                std::vector<value const *> args;
+                args.reserve(nins.n);
+                for (auto arg : nins)
+                {
+                    auto const val = eval(f, arg);
+                    if (!val)
+                        return entt::null;
+
+                    args.push_back(val);
+                }
+
+                auto const res = call(cur, args);
+                if (!res)
+                    return entt::null;
+
+                f.results[cur] = res;
+                break;
+            }
+
+            // NOTE: an index out of bounds traps at runtime, so leave it to the runtime
+            case node_op::CheckedIndex:
+            {
+                auto const &nins = ins.get(cur).nodes;
+                auto const i = eval(f, nins[0]), len = eval(f, nins[1]);
+                auto const ci = i ? i->as<int_const>() : nullptr;
+                auto const clen = len ? len->as<int_const>() : nullptr;
+                if (!ci || !clen || (int64_t)ci->n < 0 || (int64_t)ci->n >= (int64_t)clen->n)
+                    return entt::null;
+
+                f.results[cur] = i;
+                break;
+            }
+
+            case node_op::Start:
+            case node_op::IfYes:
+            case node_op::IfNot:
+            case node_op::Region:
+            case node_op::Loop:
+                break;
+
+            // `Exit`s, `ExternCall`s and anything else the evaluation cannot run
+            default:
+                return entt::null;
+            }
+
+            // pick the next control node; for branches, this is the `IfYes`/`IfNot` whose condition holds
+            successor next{entt::null, 0};
+            if (auto iter = succs.find(cur); iter != succs.end())
+            {
+                for (auto s : iter->second)
+                {
+                    auto const op = ops.get(s.node);
+                    if (op == node_op::IfYes || op == node_op::IfNot)
+                    {
+                        auto const cond = eval(f, ins.get(s.node).nodes[0]);
+                        auto const b = cond ? cond->as<bool_const>() : nullptr;
+                        if (!b)
+                            return entt::null;
+
+                        if (b->b != (op == node_op::IfYes))
+                            continue;
+                    }
+
+                    next = s;
+                    break;
+                }
+            }
+
+            if (next.node == entt::null)
+                return entt::null;
+
+            if (auto const op = ops.get(next.node); op == node_op::Region || op == node_op::Loop)
+                if (!enter_region(f, next.node, next.index))
+                    return entt::null;
+
+            cur = next.node;
+        }
+
+        return entt::null;
+    }
+
+    inline bool evaluator::enter_region(frame &f, entt::entity region, uint32_t index) noexcept
+    {
+        // NOTE: every `Phi` reads the values from before entering the region, so compute all of them before updating any
+        std::vector<std::pair<entt::entity, value const *>> values;
+        if (auto iter = phis.find(region); iter != phis.end())
+        {
+            for (auto phi : iter->second)
+            {
+                auto const &nins = ins.get(phi).nodes;
+                auto const val = (index < nins.n) ? eval(f, nins[index]) : nullptr;
+                if (!val)
+                    return false;
+
+                values.push_back({phi, val});
+            }
+        }
+
+        for (auto [phi, val] : values)
+            f.results[phi] = val;
+
+        f.cache.clear();
+        return true;
+    }
+
+    inline value const *evaluator::eval(frame &f, entt::entity n) noexcept
+    {
+        if (fuel == 0 || n == entt::null)
+            return nullptr;
+
+        switch (ops.get(n))
+        {
+        // these get their value from the control flow
+        case node_op::Phi:
+        case node_op::CallStatic:
+        case node_op::CheckedIndex:
+        {
+            auto iter = f.results.find(n);
+            return iter != f.results.end() ? iter->second : nullptr;
+        }
+
+        default:
+            break;
+        }
+
+        if (auto iter = f.cache.find(n); iter != f.cache.end())
+            return iter->second;
+
+        --fuel;
+        auto const res = compute(f, n);
+        f.cache[n] = res;
+        return res;
+    }
+
+    inline value const *evaluator::compute(frame &f, entt::entity n) noexcept
+    {
+        auto const &nins = ins.get(n).nodes;
+
+        value const *in[2]{};
+        for (uint32_t i{}; i < std::min<uint32_t>(nins.n, 2); ++i)
+            if (in[i] = eval(f, nins[i]); !in[i])
+                return nullptr;
+
+        value const *res = nullptr;
+        switch (ops.get(n))
+        {
+        case node_op::IConst:
+        case node_op::FConst:
+        case node_op::BConst:
+            res = types.get(n).type;
+            break;
+
+        case node_op::Proj:
+        {
+            auto const &eff = mem.get(n);
+            if (eff.target != f.start || eff.tag >= f.args.size())
+                return nullptr;
+
+            res = f.args[eff.tag];
+            break;
+        }
+
+        case node_op::UnaryCompl:
+            res = in[0]->bcompl();
+            break;
+        case node_op::UnaryNeg:
+            res = in[0]->neg();
+            break;
+        case node_op::UnaryNot:
+            res = in[0]->bnot();
+            break;
+
+#define binary_node(name, fn)       \
+    case node_op::name:             \
+        res = in[0]->fn(in[1]);     \
+        break
+
+            binary_node(Add, add);
+            binary_node(Sub, sub);
+            binary_node(Mul, mul);
+            binary_node(Div, div);
+            binary_node(Fadd, add);
+            binary_node(Fsub, sub);
+            binary_node(Fmul, mul);
+            binary_node(Fdiv, div);
+            binary_node(LogicAnd, logic_and);
+            binary_node(LogicOr, logic_or);
+            binary_node(BitAnd, band);
+            binary_node(BitXor, bxor);
+            binary_node(BitOr, bor);
+            binary_node(ShiftLeft, lsh);
+            binary_node(ShiftRight, rsh);
+            binary_node(CmpEq, eq);
+            binary_node(CmpNe, ne);
+            binary_node(CmpLt, lt);
+            binary_node(CmpLe, le);
+            binary_node(CmpGt, gt);
+            binary_node(CmpGe, ge);
+
+#undef binary_node
+
+        // NOTE: pointers are the objects they point to
+        case node_op::Addr:
+        case node_op::Deref:
+            return in[0];
+
+        // a member of an aggregate built in the function
+        case node_op::Load:
+        {
+            auto const &eff = mem.get(n);
+            if (!ops.contains(eff.target) || ops.get(eff.target) != node_op::Struct)
+                return nullptr;
+
+            auto const index = (nins.n != 0) ? in[0]->as<int_const>() : nullptr;
+            auto const slot = index ? index->n : (nins.n == 0) ? eff.tag : ~uint64_t{};
+
+            // NOTE: members without an initializer are only known at runtime for now
+            auto const &members = ins.get(eff.target).nodes;
+            return (slot < members.n) ? eval(f, members[slot]) : nullptr;
+        }
+
+        default:
+            return nullptr;
+        }
+
+        // NOTE: anything not constant (eg. a division by zero, which is top) is only known at runtime
+        return res->is_const() ? res : nullptr;
+    }
+}
+
+// Replace every pure call with constant arguments by the value it returns, if the callee can compute it within
+// `fold_call_fuel`; return the number of calls folded
+inline size_t fold_calls(builder &bld) noexcept
+{
+    using namespace fold_detail;
+
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &types = bld.reg.storage<node_type>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &targets = bld.reg.storage<func_of_call>();
+    auto const &rets = bld.reg.storage<return_of_func>();
+    auto &&globals = bld.reg.storage<void>((entt::id_type)visibility::global);
+
+    // NOTE: strings are constants without their contents, so they cannot be computed with
+    auto const is_known = [](value const *v)
+    {
+        return v->as<int_const>() || v->as<float64>() || v->as<bool_const>();
+    };
+
+    scope_visibility vis;
+    bld.push_vis<visibility::reachable>(vis);
+
+    size_t total{};
+    std::vector<std::pair<entt::entity, value const *>> folded;
+    std::vector<value const *> args;
+
+    // NOTE: folding a call can make the arguments of others constant, so keep going until nothing changes
+    do
+    {
+        evaluator ev{bld};
+        folded.clear();
+
+        for (auto [call, target] : targets.each())
+        {
+            // pure calls are the ones without a `mem_effect`
+            if (ops.get(call) != node_op::CallStatic || mem.contains(call) || !rets.contains(target.func))
+                continue;
+
+            args.clear();
+            for (auto arg : ins.get(call).nodes)
+            {
+                auto const val = types.get(arg).type;
+                if (!is_known(val))
+                    break;
+
+                args.push_back(val);
+            }
+
+            if (args.size() != ins.get(call).nodes.n)
+                continue;
+
+            ev.fuel = fold_call_fuel;
+            if (auto const res = ev.call(call, args); res && is_known(res))
+                folded.push_back({call, res});
+        }
+
+        for (auto [call, res] : folded)
+        {
+            auto const c = make(bld, value_node{res});
+
+            // NOTE: calls of the global code (eg. initializers of global tables) are replaced by global constants
+            if (globals.contains(call))
+                globals.emplace(c);
+
+            bld.unlink_ctrl(call, ctrl.get(call).target, c);
+            bld.destroy(call);
+        }
+
+        total += folded.size();
+    } while (!folded.empty());
+
+    bld.pop_vis();
+
+    return total;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+
+#include "opt/alias.hpp"
+
+// Load forwarding
+// A `Load` reads what the last node writing its place left there: if that is a `Store` to exactly the same slot, the `Load`
+// is the stored value; if a `Load` of exactly the same slot comes first, with no write that might touch it in between,
+// both read the same value
+// NOTE: the walk follows the memory chain up from the `Load`, skipping every node that cannot touch its place
+
+// TODO:
+// - `Load`s of a `Struct` at a constant slot are the member itself, even with writes in between
+// - forward through memory `Phi`s, when every input leads to the same value
+// - stop after a number of nodes, as the walks are quadratic in the length of the chain
+
+// Replace every `Load` that reads a value already at hand with that value; return the number of `Load`s removed
+inline size_t forward_loads(builder &bld) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto &&mem = bld.reg.storage<mem_effect>();
+    auto const &reads = bld.reg.storage<mem_read>();
+    auto const &writes = bld.reg.storage<mem_write>();
+
+    // NOTE: a `Load` is only replaced by one with the same inputs, so the bounds check it depends on is the same as well
+    auto const same_inputs = [&](entt::entity a, entt::entity b)
+    {
+        auto const &ia = ins.get(a).nodes;
+        auto const &ib = ins.get(b).nodes;
+        return ia.n == ib.n && std::equal(ia.begin(), ia.end(), ib.begin());
+    };
+
+    entt::dense_map<entt::entity, entt::entity> forwarded; // `Load` -> the node holding its value
+    for (auto [id, eff] : mem.each())
+    {
+        if (ops.get(id) != node_op::Load)
+            continue;
+
+        auto const place = place_of(bld, id);
+        for (auto dep = eff.prev; mem.contains(dep); dep = mem.get(dep).prev)
+        {
+            auto const other = place_of(bld, dep);
+            if (!may_alias(place, other))
+                continue;
+
+            // NOTE: a `Store` is its own value, same as for globals
+            auto const op = ops.get(dep);
+            if (must_alias(place, other) && (op == node_op::Store || (op == node_op::Load && same_inputs(id, dep))))
+            {
+                forwarded[id] = dep;
+                break;
+            }
+
+            if (writes.contains(dep) || !reads.contains(dep))
+                break;
+        }
+    }
+
+    // NOTE: chains of forwarded `Load`s end at the first one, which is kept
+    auto const value_of = [&](entt::entity n)
+    {
+        for (auto iter = forwarded.find(n); iter != forwarded.end(); iter = forwarded.find(n))
+            n = iter->second;
+        return n;
+    };
+
+    for (auto [id, eff] : mem.each())
+        if (forwarded.contains(eff.target))
+            eff.target = value_of(eff.target);
+
+    for (auto [load, value] : forwarded)
+        bld.replace_uses(load, value_of(value));
+
+    bld.unlink_mem([&](entt::entity n)
+                   { return forwarded.contains(n); });
+
+    for (auto [load, value] : forwarded)
+        bld.destroy(load);
+
+    return forwarded.size();
+}
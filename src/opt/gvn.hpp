@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <entt/container/dense_set.hpp>
+
+#include "builder.hpp"
+#include "decls.hpp"
+#include "opt/dce.hpp"
+#include "types/int.hpp"
+
+// Global value numbering (GVN)
+// Pure values with the same op and the same inputs compute the same thing, so every such node is replaced by the first one
+// Nodes are numbered inputs first, so the users of merged nodes get merged as well in the same run
+
+// TODO:
+// - `Phi`s of the same `Region` with the same inputs
+// - `Load`s of the same place with the same memory state
+// - hash-cons in `builder.make` instead, so duplicates are never created (see nodes.hpp)
+
+namespace gvn_detail
+{
+    inline bool is_commutative(node_op op) noexcept
+    {
+        switch (op)
+        {
+        case node_op::Add:
+        case node_op::Mul:
+        case node_op::LogicAnd:
+        case node_op::LogicOr:
+        case node_op::BitAnd:
+        case node_op::BitXor:
+        case node_op::BitOr:
+        case node_op::Fadd:
+        case node_op::Fmul:
+        case node_op::CmpEq:
+        case node_op::CmpNe:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    // Do the constants `a` and `b` hold the same value?
+    // NOTE: integers are made anew for every literal, the other constants only compare equal if they are the same object
+    inline bool same_const(value const *a, value const *b) noexcept
+    {
+        if (a == b)
+            return true;
+
+        auto const ia = a->as<int_const>();
+        auto const ib = b->as<int_const>();
+        return ia && ib && ia->n == ib->n;
+    }
+
+    inline uint64_t const_hash(value const *v) noexcept
+    {
+        if (auto const i = v->as<int_const>())
+            return i->n;
+        return (uint64_t)(uintptr_t)v;
+    }
+}
+
+// Merge every pure value into an earlier one with the same op and inputs; return the number of nodes merged
+inline size_t number_values(builder &bld) noexcept
+{
+    using namespace gvn_detail;
+
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &types = bld.reg.storage<node_type>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &effects = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &globals = bld.reg.storage<void>((entt::id_type)visibility::global);
+
+    auto const targets = effect_targets(bld);
+
+    // NOTE: `Phi`s are left out as they are the only pure values in a cycle
+    auto const is_candidate = [&](entt::entity n)
+    {
+        if (!ops.contains(n))
+            return false;
+
+        auto const op = ops.get(n);
+        return op != node_op::Phi && is_pure_value(op) &&
+               !effects.contains(n) && !mem.contains(n) && !targets.contains(n);
+    };
+
+    // NOTE: global and local nodes are not merged, as they are scheduled differently
+    auto const hash = [&](entt::entity n)
+    {
+        auto const op = ops.get(n);
+        auto h = hash_u64(hash_u64(hash_seed, (uint64_t)op), globals.contains(n));
+
+        if (ins.get(n).nodes.n == 0)
+            return hash_u64(h, const_hash(types.get(n).type));
+
+        // NOTE: summed, so commutative ops hash the same either way
+        uint64_t sum = 0;
+        for (auto in : ins.get(n).nodes)
+            sum = is_commutative(op) ? sum + (uint64_t)entt::to_integral(in) : hash_u64(sum, (uint64_t)entt::to_integral(in));
+        return hash_u64(h, sum);
+    };
+
+    auto const same = [&](entt::entity a, entt::entity b)
+    {
+        if (ops.get(a) != ops.get(b) || globals.contains(a) != globals.contains(b))
+            return false;
+
+        auto const &ia = ins.get(a).nodes;
+        auto const &ib = ins.get(b).nodes;
+        if (ia.n != ib.n)
+            return false;
+        if (ia.n == 0)
+            return same_const(types.get(a).type, types.get(b).type);
+
+        if (std::equal(ia.begin(), ia.end(), ib.begin()))
+            return true;
+        return ia.n == 2 && is_commutative(ops.get(a)) && ia[0] == ib[1] && ia[1] == ib[0];
+    };
+
+    // number the inputs of a node before the node itself
+    std::vector<entt::entity> order;
+    {
+        entt::dense_set<entt::entity> visited;
+        std::vector<std::pair<entt::entity, bool>> stack; // (node, are its inputs pushed)
+
+        for (auto [id, op] : ops.each())
+        {
+            if (!is_candidate(id) || visited.contains(id))
+                continue;
+
+            stack.push_back({id, false});
+            while (!stack.empty())
+            {
+                auto [n, expanded] = stack.back();
+                stack.pop_back();
+
+                if (expanded)
+                {
+                    order.push_back(n);
+                    continue;
+                }
+
+                if (!visited.emplace(n).second)
+                    continue;
+
+                stack.push_back({n, true});
+                for (auto in : ins.get(n).nodes)
+                    if (in != entt::null && !visited.contains(in) && is_candidate(in))
+                        stack.push_back({in, false});
+            }
+        }
+    }
+
+    std::unordered_multimap<uint64_t, entt::entity> leaders;
+    leaders.reserve(order.size());
+
+    size_t merged = 0;
+    for (auto n : order)
+    {
+        auto const h = hash(n);
+
+        auto leader = entt::entity{entt::null};
+        for (auto [it, end] = leaders.equal_range(h); it != end; ++it)
+            if (same(it->second, n))
+            {
+                leader = it->second;
+                break;
+            }
+
+        if (leader == entt::null)
+        {
+            leaders.emplace(h, n);
+            continue;
+        }
+
+        // NOTE: the users of `n` come later in `order`, so they are hashed with `leader` as their input
+        bld.replace_uses(n, leader);
+        bld.destroy(n);
+        ++merged;
+    }
+
+    return merged;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "opt/call_graph.hpp"
+
+// TODO:
+// - inline non-leaf callees as well, cloning the calls in their body
+// - re-run the peepholes on the cloned nodes, as the `Proj`s are now (possibly) constants
+// - inline `ExternCall`s marked as such once there is a way to import their body
+
+// functions with a score below this are inlined at every call site
+static constexpr uint32_t inline_threshold = 32;
+
+// Cost of inlining the given function at all of its call sites; the lower the better
+inline uint32_t inline_score(func_info const &info) noexcept
+{
+    // the body would be cloned endlessly
+    if (info.recursive)
+        return ~uint32_t{};
+
+    // the original body is removed together with the only call (see `remove_func`), so inlining is free
+    if (info.call_sites == 1)
+        return 0;
+
+    // NOTE: calls inside the body count more, as they are memory barriers even after inlining
+    return uint32_t(info.body.size() + 4 * info.calls.size());
+}
+
+// Clone the body of `callee` in place of `call`, return the node that replaces the call's value (if any)
+inline entt::entity inline_call(builder &bld, func_info const &callee, entt::entity call) noexcept
+{
+    auto &&ops = bld.reg.storage<node_op>();
+    auto &&types = bld.reg.storage<node_type>();
+    auto &&ins = bld.reg.storage<node_inputs>();
+    auto &&ctrl = bld.reg.storage<ctrl_effect>();
+    auto &&mem = bld.reg.storage<mem_effect>();
+    auto &&reads = bld.reg.storage<mem_read>();
+    auto &&writes = bld.reg.storage<mem_write>();
+    auto &&phis = bld.reg.storage<region_of_phi>();
+    auto &&targets = bld.reg.storage<func_of_call>();
+
+    auto const call_ctrl = ctrl.get(call).target;
+    // pure calls are not in the memory chain; the callee only touches its locals, so hang them off the caller's `Start`
+    auto const call_mem = mem.contains(call)
+                              ? mem.get(call)
+                              : [&]
+    {
+        auto start = call_ctrl;
+        while (ops.get(start) != node_op::Start && ops.get(start) != node_op::Program)
+            start = ctrl.contains(start) ? ctrl.get(start).target : ins.get(start).nodes[0];
+
+        return mem_effect{.prev = start, .target = start};
+    }();
+    auto const &args = ins.get(call).nodes;
+
+    entt::dense_map<entt::entity, entt::entity> cloned;
+
+    auto const is_param = [&](entt::entity n)
+    {
+        return ops.get(n) == node_op::Proj && mem.get(n).target == callee.start;
+    };
+
+    // `Proj`s of the callee's `Start` are the call's arguments
+    for (auto n : callee.body)
+    {
+        if (is_param(n))
+            cloned[n] = args[mem.get(n).tag];
+        else if (n != callee.ret)
+            cloned[n] = bld.make(types.get(n).type, ops.get(n), {});
+    }
+
+    // the callee's `Start` becomes the state of the caller right before the call
+    auto const map = [&](entt::entity n, entt::entity start_as)
+    {
+        if (n == callee.start)
+            return start_as;
+
+        auto iter = cloned.find(n);
+        return iter != cloned.end() ? iter->second : n;
+    };
+
+    std::vector<entt::entity> nins;
+    for (auto n : callee.body)
+    {
+        if (n == callee.ret || is_param(n))
+            continue;
+
+        auto const c = cloned[n];
+
+        nins.clear();
+        for (auto in : ins.get(n).nodes)
+            nins.push_back(map(in, call_ctrl));
+        bld.set_inputs(c, nins);
+
+        if (ctrl.contains(n))
+            ctrl.emplace(c, map(ctrl.get(n).target, call_ctrl));
+
+        if (mem.contains(n))
+        {
+            auto const m = mem.get(n);
+            mem.emplace(c) = {
+                .prev = map(m.prev, call_mem.prev),
+                .target = map(m.target, call_mem.target),
+                .tag = m.tag,
+            };
+        }
+
+        if (reads.contains(n))
+            reads.emplace(c);
+        if (writes.contains(n))
+            writes.emplace(c);
+
+        if (phis.contains(n))
+            phis.emplace(c, map(phis.get(n).region, call_ctrl));
+
+        if (targets.contains(n))
+            targets.emplace(c, targets.get(n));
+    }
+
+    // the state after the call is the state right before the callee's `Return`
+    auto const &ret_ins = ins.get(callee.ret).nodes;
+    auto const result = ret_ins.n != 0 ? map(ret_ins[0], call_ctrl) : entt::null;
+    auto const ctrl_out = map(ctrl.get(callee.ret).target, call_ctrl);
+    auto const mem_out = map(mem.get(callee.ret).prev, call_mem.prev);
+    // NOTE: for pure calls nothing links to `mem_out`, so the callee's locals are left out of the caller's chain
+
+    // NOTE: the call is both a control and a data node
+    bld.unlink_ctrl(call, ctrl_out, result);
+
+    for (auto [id, eff] : mem.each())
+    {
+        if (eff.prev == call)
+            eff.prev = mem_out;
+        if (eff.target == call)
+            eff.target = mem_out;
+    }
+
+    bld.destroy(call);
+    return result;
+}
+
+// Destroy `callee`, its `Start` included, unless something other than its own body uses the `Start` (eg. as a value)
+// NOTE: the caller makes sure no call targets `callee` anymore; return whether it was removed
+inline bool remove_func(builder &bld, func_info const &callee) noexcept
+{
+    auto &&ins = bld.reg.storage<node_inputs>();
+
+    entt::dense_set<entt::entity> dead;
+    dead.insert(callee.start);
+    for (auto n : callee.body)
+        dead.insert(n);
+
+    if (auto const *start_users = bld.reg.try_get<users>(callee.start))
+        for (auto e : start_users->entries)
+            if (!dead.contains(e.id))
+                return false;
+
+    // NOTE: the function goes all at once, so only the nodes outside of it (eg. globals) need to forget their users
+    for (auto n : dead)
+        for (auto in : ins.get(n).nodes)
+            if (in != entt::null && !dead.contains(in))
+                if (auto *in_users = bld.reg.try_get<users>(in))
+                    std::erase_if(in_users->entries, [&](users::entry e)
+                                  { return dead.contains(e.id); });
+
+    std::vector<entt::entity> const to_destroy{dead.begin(), dead.end()};
+    bld.reg.destroy(to_destroy.begin(), to_destroy.end());
+    return true;
+}
+
+// Inline every `CallStatic` whose callee scores below `inline_threshold`; return the number of calls inlined
+inline size_t inline_calls(builder &bld) noexcept
+{
+    scope_visibility vis;
+    bld.push_vis<visibility::reachable>(vis);
+
+    auto const &targets = bld.reg.storage<func_of_call>();
+    auto const &globals = bld.reg.storage<void>((entt::id_type)visibility::global);
+
+    size_t total{};
+    std::vector<std::pair<entt::entity, func_info const *>> to_inline;
+
+    // NOTE: only leaf functions are inlined on each run, so the bodies in the call graph stay valid while cloning
+    // ^ callers whose calls were all inlined become leaves themselves, so keep going until nothing changes
+    do
+    {
+        auto cg = build_call_graph(bld);
+        to_inline.clear();
+
+        for (auto [call, target] : targets.each())
+        {
+            // TODO: the call to `main` is left as is, as there is no function to inline it into
+            if (bld.reg.get<node_op>(call) != node_op::CallStatic || globals.contains(call))
+                continue;
+
+            auto callee = cg.find(target.func);
+            if (callee && callee->calls.empty() && inline_score(*callee) < inline_threshold)
+                to_inline.push_back({call, callee});
+        }
+
+        entt::dense_map<func_info const *, uint32_t> inlined; // callee -> its call sites inlined on this run
+        for (auto [call, callee] : to_inline)
+        {
+            (void)inline_call(bld, *callee, call);
+            ++inlined[callee];
+        }
+
+        // NOTE: otherwise the original body stays around next to its copies
+        for (auto [callee, n] : inlined)
+            if (n == callee->call_sites)
+                (void)remove_func(bld, *callee);
+
+        total += to_inline.size();
+    } while (!to_inline.empty());
+
+    bld.pop_vis();
+
+    return total;
+}
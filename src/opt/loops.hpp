@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "builder.hpp"
+#include "opt/dce.hpp"
+#include "types/int.hpp"
+
+// Loop tree
+// Every `Loop` has In=[entry, back-edge]; its body is every control node that reaches the back-edge without going through
+// the `Loop` itself. Bodies of nested loops are inside the bodies of their parents, so the loops form a tree
+
+// TODO:
+// - cache this between passes, update it incrementally instead of rebuilding it
+// - let the scheduler use this instead of finding the loops again on its blocks
+// - loops with several back-edges, once `continue` is implemented
+// - induction variables derived from others (eg. `j = i + 1`), and ones stepping with `Sub`
+
+struct loop_info final
+{
+    entt::entity head;              // the `Loop`
+    entt::entity back;              // the last control node of the body, ie. input 1 of `head`
+    uint32_t parent;                // index of the enclosing loop, `loop_tree::none` for outermost loops
+    uint32_t depth;                 // 1 for outermost loops
+    std::vector<entt::entity> body; // every control node of the loop, `head` and nested loops included
+};
+
+struct loop_tree final
+{
+    static constexpr uint32_t none = ~0u;
+
+    // Index of the innermost loop `ctrl` is in, or `none`
+    inline uint32_t loop_of(entt::entity ctrl) const noexcept
+    {
+        auto iter = innermost.find(ctrl);
+        return iter != innermost.end() ? iter->second : none;
+    }
+
+    // Number of loops `ctrl` is in
+    inline uint32_t depth(entt::entity ctrl) const noexcept
+    {
+        auto const l = loop_of(ctrl);
+        return l != none ? loops[l].depth : 0;
+    }
+
+    std::vector<loop_info> loops;                      // parents before their children
+    entt::dense_map<entt::entity, uint32_t> innermost; // control node -> index of the innermost loop it is in
+};
+
+// Find every loop of the program and how they nest
+inline loop_tree build_loop_tree(builder &bld) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+
+    loop_tree tree;
+
+    for (auto [id, op] : ops.each())
+    {
+        // NOTE: a loop whose body is still being parsed has no back-edge yet
+        if (op != node_op::Loop || ins.get(id).nodes.n != 2)
+            continue;
+
+        auto &l = tree.loops.emplace_back(loop_info{.head = id, .back = ins.get(id).nodes[1], .parent = loop_tree::none, .depth = 1});
+
+        // walk the control flow backwards from the back-edge until the head
+        entt::dense_set<entt::entity> visited{id};
+        std::vector<entt::entity> work{l.back};
+        l.body.push_back(id);
+
+        while (!work.empty())
+        {
+            auto const n = work.back();
+            work.pop_back();
+
+            if (n == entt::null || !ops.contains(n) || !visited.emplace(n).second)
+                continue;
+
+            l.body.push_back(n);
+
+            // NOTE: `Region`s and `Loop`s link to their predecessors through their inputs, everything else through its `ctrl_effect`
+            if (auto const nop = ops.get(n); nop == node_op::Region || nop == node_op::Loop)
+                work.insert(work.end(), ins.get(n).nodes.begin(), ins.get(n).nodes.end());
+            else if (ctrl.contains(n))
+                work.push_back(ctrl.get(n).target);
+        }
+    }
+
+    // NOTE: a loop is inside another one iff it is smaller and its head is in the body of the other one,
+    // so going from the largest to the smallest, the last loop that claimed the head is the parent
+    std::ranges::sort(tree.loops, std::ranges::greater{}, [](loop_info const &l)
+                      { return l.body.size(); });
+
+    for (uint32_t i{}; i < tree.loops.size(); ++i)
+    {
+        auto &l = tree.loops[i];
+        if (auto const parent = tree.loop_of(l.head); parent != loop_tree::none)
+        {
+            l.parent = parent;
+            l.depth = tree.loops[parent].depth + 1;
+        }
+
+        for (auto n : l.body)
+            tree.innermost[n] = i;
+    }
+
+    return tree;
+}
+
+// A `Phi` of a `Loop` that goes up by the same constant every iteration
+struct induction_var final
+{
+    entt::entity phi;
+    entt::entity init; // the value before the loop
+    int64_t step;      // the sum of the constants added over one iteration
+};
+
+// The constant value of `n`, if any
+inline std::optional<int64_t> int_const_of(builder &bld, entt::entity n) noexcept
+{
+    if (auto const c = bld.reg.get<node_type>(n).type->as<int_const>())
+        return (int64_t)c->n;
+    return std::nullopt;
+}
+
+// Is `phi` an induction variable of its `Loop`, ie. is its back-edge value `phi + c1 + c2 + ...`?
+// NOTE: only untyped integers for now, as sized ones would need to wrap at their own size
+inline std::optional<induction_var> find_induction(builder &bld, entt::entity phi) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+
+    if (ops.get(phi) != node_op::Phi || !bld.reg.get<node_type>(phi).type->as<int_value>())
+        return std::nullopt;
+
+    auto const region = bld.reg.get<region_of_phi>(phi).region;
+    if (ops.get(region) != node_op::Loop || ins.get(phi).nodes.n != 2)
+        return std::nullopt;
+
+    int64_t step = 0;
+    auto n = ins.get(phi).nodes[1];
+    while (n != phi)
+    {
+        if (ops.get(n) != node_op::Add)
+            return std::nullopt;
+
+        auto const &nins = ins.get(n).nodes;
+        auto const lhs = int_const_of(bld, nins[0]), rhs = int_const_of(bld, nins[1]);
+        auto const c = rhs ? rhs : lhs;
+        if (!c || !checked_add(step, *c, step))
+            return std::nullopt;
+
+        n = rhs ? nins[0] : nins[1];
+    }
+
+    if (step == 0)
+        return std::nullopt;
+
+    return induction_var{.phi = phi, .init = ins.get(phi).nodes[0], .step = step};
+}
+
+// How many times the body of `loop` runs, given `cond` is its exit test (the condition of its `IfYes`/`IfNot`)
+// NOTE: only `iv < c` and `iv <= c` are counted, with `iv` an induction variable of `loop` that starts at a constant and goes up
+inline std::optional<uint64_t> trip_count(builder &bld, entt::entity loop, entt::entity cond) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+
+    auto const op = ops.get(cond);
+    if (op != node_op::CmpLt && op != node_op::CmpLe)
+        return std::nullopt;
+
+    auto const lhs = ins.get(cond).nodes[0];
+    auto const bound = int_const_of(bld, ins.get(cond).nodes[1]);
+    if (!bound || ops.get(lhs) != node_op::Phi || bld.reg.get<region_of_phi>(lhs).region != loop)
+        return std::nullopt;
+
+    auto const iv = find_induction(bld, lhs);
+    if (!iv || iv->step <= 0)
+        return std::nullopt;
+
+    auto const init = int_const_of(bld, iv->init);
+    if (!init)
+        return std::nullopt;
+
+    // NOTE: `iv <= c` is `iv < c + 1`, unless that overflows
+    auto end = *bound;
+    if (op == node_op::CmpLe && !checked_add(end, 1, end))
+        return std::nullopt;
+
+    if (end <= *init)
+        return 0;
+
+    return ((uint64_t)end - (uint64_t)*init + (uint64_t)iv->step - 1) / (uint64_t)iv->step;
+}
+
+// The parts of a straight-line loop that unrolling and vectorization work on
+struct loop_shape final
+{
+    entt::entity head;
+    entt::entity cond;                // the exit test
+    std::vector<entt::entity> chain;  // the control nodes of the body after its `IfYes`, in order
+    std::vector<entt::entity> phis;   // the `Phi`s of `head`
+    std::vector<entt::entity> values; // the data nodes of the body that change between iterations, inputs first
+};
+
+// Collect the body of `l`; return nothing if it is not a straight line of nodes that can be cloned
+inline std::optional<loop_shape> shape_of(builder &bld, loop_info const &l) noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+    auto const &ctrl = bld.reg.storage<ctrl_effect>();
+    auto const &mem = bld.reg.storage<mem_effect>();
+    auto const &phis = bld.reg.storage<region_of_phi>();
+
+    loop_shape res{.head = l.head};
+
+    // the body must be `IfYes` followed by bounds checks only
+    auto n = l.back;
+    while (n != l.head && ops.get(n) == node_op::CheckedIndex)
+    {
+        res.chain.push_back(n);
+        n = ctrl.get(n).target;
+    }
+
+    if (ops.get(n) != node_op::IfYes || ctrl.get(n).target != l.head || l.body.size() != res.chain.size() + 2)
+        return std::nullopt;
+
+    std::ranges::reverse(res.chain);
+    res.cond = ins.get(n).nodes[0];
+
+    for (auto [phi, region] : phis.each())
+        if (region.region == l.head)
+            res.phis.push_back(phi);
+
+    // a node changes between iterations iff it depends on a `Phi` of the loop or on a control node of the body
+    // NOTE: `Phi`s of other `Region`/`Loop`s are not in the body, so they never change inside it
+    entt::dense_map<entt::entity, bool> variant;
+    for (auto phi : res.phis)
+        variant[phi] = true;
+    for (auto c : res.chain)
+        variant[c] = true;
+
+    // NOTE: a `Load`/`VecLoad` also depends on the place it reads from
+    auto const for_each_dep = [&](entt::entity n, auto &&fn)
+    {
+        for (auto in : ins.get(n).nodes)
+            if (in != entt::null)
+                fn(in);
+
+        if ((ops.get(n) == node_op::Load || ops.get(n) == node_op::VecLoad) && mem.get(n).target != entt::null)
+            fn(mem.get(n).target);
+    };
+
+    bool clonable = true;
+    std::vector<std::pair<entt::entity, bool>> stack; // (node, are its inputs visited)
+
+    auto const visit = [&](entt::entity root)
+    {
+        stack.push_back({root, false});
+        while (!stack.empty())
+        {
+            auto [top, expanded] = stack.back();
+            stack.pop_back();
+
+            if (!expanded)
+            {
+                if (variant.contains(top))
+                    continue;
+
+                if (ops.get(top) == node_op::Phi)
+                {
+                    variant[top] = false;
+                    continue;
+                }
+
+                variant[top] = false; // NOTE: updated once the inputs are done
+                stack.push_back({top, true});
+                for_each_dep(top, [&](entt::entity in)
+                             {
+                                 if (!variant.contains(in))
+                                     stack.push_back({in, false}); //
+                             });
+                continue;
+            }
+
+            bool changes = false;
+            for_each_dep(top, [&](entt::entity in)
+                         { changes |= variant.contains(in) && variant.at(in); });
+
+            if (!changes)
+                continue;
+
+            variant[top] = true;
+            res.values.push_back(top);
+
+            // NOTE: `Div`s can trap, but they would run on every iteration anyway
+            auto const op = ops.get(top);
+            clonable &= (is_pure_value(op) || op == node_op::Div || op == node_op::Load || op == node_op::VecLoad) && !ctrl.contains(top);
+        }
+    };
+
+    for (auto phi : res.phis)
+        visit(ins.get(phi).nodes[1]);
+    for (auto c : res.chain)
+        for (auto in : ins.get(c).nodes)
+            visit(in);
+
+    if (!clonable)
+        return std::nullopt;
+
+    return res;
+}
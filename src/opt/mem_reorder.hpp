@@ -2,64 +2,53 @@
 #pragma once
 
 #include "builder.hpp"
+#include "opt/alias.hpp"
+#include "utils/steppable.hpp"
 
 // TODO: do you need the whole builder here or just the registry?
 // TODO: run memory reordering, then DCE
 // TODO: can/should this run when the edge is constructed?
 
-inline void memory_reorder(builder &bld) noexcept
+// memory nodes looked at between two steps of `memory_reorder_steps`
+inline constexpr size_t memory_reorder_step = 256;
+
+// Move every memory node up the chain past the nodes it does not depend on, a few nodes per step; the changes are the
+// number of links moved
+// NOTE: a node depends on the ones before it that might touch the same place (see `may_alias`), unless both only read
+inline steppable memory_reorder_steps(builder &bld) noexcept
 {
+    size_t moved = 0, seen = 0;
+
     auto &&mem_chain = bld.reg.storage<mem_effect>();
     auto const &reads = bld.reg.storage<mem_read>();
     auto const &writes = bld.reg.storage<mem_write>();
 
+    auto const only_reads = [&](entt::entity n)
+    { return reads.contains(n) && !writes.contains(n); };
+
     for (auto &&[id, mem] : mem_chain.each())
     {
+        auto const place = place_of(bld, id);
         auto earliest_dep = mem.prev;
 
         while (mem_chain.contains(earliest_dep))
         {
-            auto &&prev = mem_chain.get(earliest_dep);
-
-            if (writes.contains(earliest_dep) &&
-                // TODO: correctly check for offset equality (include -1 check)
-                ((mem.target != prev.target) || (mem.tag != prev.tag)))
-            {
-                // Reads/writes can happen in parallel with writes as long as they target different places or offsets
-                earliest_dep = prev.prev;
-            }
-            else
-            {
+            // Reads can happen in parallel, and so can nodes that touch different places
+            if (!(only_reads(id) && only_reads(earliest_dep)) && may_alias(place, place_of(bld, earliest_dep)))
                 break;
-            }
 
-            // TODO: more optimizations
+            earliest_dep = mem_chain.get(earliest_dep).prev;
         }
 
+        moved += mem.prev != earliest_dep;
         mem.prev = earliest_dep;
-    }
-
-    for (auto &&[id, mem] : entt::basic_view{mem_chain, reads}.each())
-    {
-        auto earliest_dep = mem.prev;
 
-        while (mem_chain.contains(earliest_dep))
-        {
-            auto &&prev = mem_chain.get(earliest_dep);
-
-            if (reads.contains(earliest_dep))
-            {
-                // Read operations can happen in parallel
-                earliest_dep = prev.prev;
-            }
-            else
-            {
-                break;
-            }
+        if (++seen % memory_reorder_step == 0)
+            co_yield std::exchange(moved, 0);
+    }
 
-            // TODO: more optimizations
-        }
+    co_return moved;
+}
 
-        mem.prev = earliest_dep;
-    }
-}
\ No newline at end of file
+// Same as `memory_reorder_steps`, all at once; return the number of links moved
+inline size_t memory_reorder(builder &bld) noexcept { return memory_reorder_steps(bld).finish(); }
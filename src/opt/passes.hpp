@@ -0,0 +1,258 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <print>
+#include <string_view>
+#include <vector>
+
+#include "builder.hpp"
+#include "opt/bce.hpp"
+#include "opt/dce.hpp"
+#include "opt/fold_calls.hpp"
+#include "opt/forward.hpp"
+#include "opt/gvn.hpp"
+#include "opt/inline.hpp"
+#include "opt/mem_reorder.hpp"
+#include "opt/sroa.hpp"
+#include "opt/strength.hpp"
+#include "opt/unroll.hpp"
+#include "opt/vectorize.hpp"
+#include "stats.hpp"
+#include "utils/steppable.hpp"
+
+// Pass manager
+// Every whole-graph pass is registered here by name, and `--passes` (or an `-O` preset) picks which run and in which order:
+// - `a,b,c` runs the passes one after the other
+// - `(a,b)*` runs the group again until none of its passes change anything, up to `max_iterations` times
+// Each pass returns how many changes it made; with `--stats` the pipeline reports the time, changes and node delta of each
+// With a time budget (`--budget`), the pipeline stops once it runs out: passes that can be stepped (see utils/steppable.hpp)
+// are dropped between two steps, the others are not started; what already ran stays, so the result is a valid graph that
+// is optimized as far as the budget allowed
+
+// TODO:
+// - passes per function (eg. DCE while parsing) in the same registry, with a `scope` to tell them apart
+// - verify the graph between passes in debug builds
+// - let passes declare what they need to run first (eg. `sroa` after `inline`) instead of leaving it to the pipeline
+// - budgets per function, once passes can run on a single function; then interleave them with parsing
+// - make `gvn` steppable as well; `inline` and `sroa` need to finish a call/aggregate before they can yield
+
+struct pass_info final
+{
+    std::string_view name;
+    std::string_view description;
+    size_t (*run)(builder &bld) noexcept;
+    steppable (*steps)(builder &bld) noexcept = nullptr; // the same pass a bit at a time, if it can be cut short
+};
+
+inline constexpr pass_info pass_registry[]{
+    {"fold-calls", "run pure calls with constant arguments at compile time", fold_calls},
+    {"inline", "inline small leaf functions at their call sites", inline_calls},
+    {"sroa", "replace non-escaping aggregates with their members", scalar_replace},
+    {"bce", "remove the bounds checks of indices known to be in bounds", eliminate_bounds_checks},
+    {"gvn", "merge pure values with the same op and inputs", number_values},
+    {"strength", "turn multiplications of induction variables into additions", reduce_strength},
+    {"vectorize", "run counted loops over arrays a few elements at a time", vectorize_loops},
+    {"unroll", "run the body of small counted loops several times per test", unroll_loops},
+    {"forward", "replace loads of values already at hand with those values", forward_loads},
+    {"mem-reorder", "move memory nodes past the ones they do not depend on", memory_reorder, memory_reorder_steps},
+    {"dce", "remove pure values nobody uses", remove_dead_values, remove_dead_values_steps},
+};
+
+inline pass_info const *find_pass(std::string_view name) noexcept
+{
+    for (auto const &p : pass_registry)
+        if (p.name == name)
+            return &p;
+    return nullptr;
+}
+
+struct pipeline_preset final
+{
+    std::string_view flag;
+    std::string_view passes;
+};
+
+// NOTE: `mem-reorder` is in every preset, as the memory chain is fully serialized otherwise
+// NOTE: `fold-calls` runs before `inline`, as inlined bodies keep the types of the callee and no longer fold
+inline constexpr pipeline_preset pipeline_presets[]{
+    {"-O0", "mem-reorder"},
+    {"-O1", "fold-calls,gvn,bce,strength,forward,mem-reorder,dce"},
+    {"-O2", "fold-calls,inline,(sroa,gvn,bce,dce)*,strength,vectorize,unroll,gvn,forward,mem-reorder,dce"},
+    {"-O", "fold-calls,inline,(sroa,gvn,bce,dce)*,strength,vectorize,unroll,gvn,forward,mem-reorder,dce"},
+};
+
+inline std::optional<std::string_view> find_preset(std::string_view flag) noexcept
+{
+    for (auto const &p : pipeline_presets)
+        if (p.flag == flag)
+            return p.passes;
+    return std::nullopt;
+}
+
+struct pass_pipeline final
+{
+    using clock = std::chrono::steady_clock;
+
+    // a single pass, or a group run to a fixed point
+    struct step final
+    {
+        std::vector<pass_info const *> passes;
+        bool fixed_point = false;
+    };
+
+    // a fixed-point group stops after this many runs even if it still changes the graph
+    static constexpr size_t max_iterations = 8;
+
+    // Parse a list like `inline,(sroa,gvn)*,dce`; print what is wrong and return nothing if it is not valid
+    inline static std::optional<pass_pipeline> parse(std::string_view text) noexcept;
+
+    // Run every step on the graph, stopping at `deadline` if any; return the total number of changes
+    inline size_t run(builder &bld, std::optional<clock::time_point> deadline = std::nullopt) const noexcept;
+
+    std::vector<step> steps;
+};
+
+inline std::optional<pass_pipeline> pass_pipeline::parse(std::string_view text) noexcept
+{
+    pass_pipeline res;
+    step *group = nullptr; // the open `(...)`, if any
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        if (text[i] == ',')
+        {
+            ++i;
+            continue;
+        }
+
+        if (text[i] == '(')
+        {
+            if (group)
+            {
+                std::println("Pass groups cannot be nested: `{}`", text);
+                return std::nullopt;
+            }
+
+            group = &res.steps.emplace_back(step{.fixed_point = true});
+            ++i;
+            continue;
+        }
+
+        if (text[i] == ')')
+        {
+            if (!group || i + 1 >= text.size() || text[i + 1] != '*')
+            {
+                std::println("Expected `(<passes>)*` in `{}`", text);
+                return std::nullopt;
+            }
+
+            group = nullptr;
+            i += 2;
+            continue;
+        }
+
+        auto const end = text.find_first_of(",()", i);
+        auto const name = text.substr(i, end - i);
+        i = end == std::string_view::npos ? text.size() : end;
+
+        auto const pass = find_pass(name);
+        if (!pass)
+        {
+            std::println("Unknown pass `{}`; expected one of:", name);
+            for (auto const &p : pass_registry)
+                std::println("\t{} - {}", p.name, p.description);
+            return std::nullopt;
+        }
+
+        if (group)
+            group->passes.push_back(pass);
+        else
+            res.steps.push_back(step{.passes = {pass}});
+    }
+
+    if (group)
+    {
+        std::println("Unclosed pass group in `{}`", text);
+        return std::nullopt;
+    }
+
+    return res;
+}
+
+inline size_t pass_pipeline::run(builder &bld, std::optional<clock::time_point> deadline) const noexcept
+{
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const out_of_time = [&] { return deadline && clock::now() >= *deadline; };
+
+    pass_info const *cut = nullptr; // the pass the budget ran out in
+
+    auto const run_pass = [&](pass_info const &pass)
+    {
+        stats_zone _{pass.name};
+
+        auto const nodes = ops.size();
+        auto const start = clock::now();
+
+        size_t changes = 0;
+        if (!deadline || !pass.steps)
+            changes = pass.run(bld);
+        else
+        {
+            // NOTE: dropping the coroutine between two steps cancels the rest of the pass
+            auto task = pass.steps(bld);
+            while (task.step())
+                if (out_of_time())
+                {
+                    cut = &pass;
+                    break;
+                }
+
+            changes = task.changes();
+        }
+
+        if (active_stats)
+        {
+            auto &p = active_stats->pass(pass.name);
+            ++p.runs;
+            p.changes += changes;
+            p.node_delta += (int64_t)ops.size() - (int64_t)nodes;
+            p.wall += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            p.cancelled += cut == &pass;
+        }
+
+        return changes;
+    };
+
+    size_t total = 0;
+    for (auto const &s : steps)
+    {
+        for (size_t iter{}; iter < (s.fixed_point ? max_iterations : 1); ++iter)
+        {
+            size_t changes = 0;
+            for (auto const *pass : s.passes)
+            {
+                // NOTE: passes that cannot be stepped run whole, so the budget is only checked before them
+                if (!cut && out_of_time())
+                    cut = pass;
+                if (cut)
+                    break;
+
+                changes += run_pass(*pass);
+            }
+
+            total += changes;
+            if (changes == 0 || cut)
+                break;
+        }
+
+        if (cut)
+        {
+            std::println("Ran out of the optimization budget in `{}`; skipping the rest of the passes", cut->name);
+            break;
+        }
+    }
+
+    return total;
+}
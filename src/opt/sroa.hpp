@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "builder.hpp"
+
+// Escape analysis + scalar replacement of aggregates (SROA)
+
+// TODO:
+// - branches merge their memory with memory `Phi`s, but loops do not yet, so a `Store` in a loop body is seen as coming
+// ^ before the loop; this is fine for now as the parser only emits `Store`s for globals
+// - partially scalarize aggregates that are only indexed at runtime on some members
+// - handle nested aggregates (`a.b.c`) by scalarizing the inner aggregate as well
+
+// Does the aggregate `root` (an `Alloca` or a `Struct` value) outlive or leak out of the function that created it?
+inline bool escapes(builder &bld, entt::entity root) noexcept
+{
+    // globals are visible to every function in the package
+    if (bld.reg.storage<void>((entt::id_type)visibility::global).contains(root))
+        return true;
+
+    // NOTE: `Load`/`Store`s reach their aggregate through `mem_effect`, so any data user uses the aggregate as a whole:
+    // ^ `Addr`/`Deref` (a pointer to it can be stored anywhere), call arguments, `Return`, `Store`s (copied elsewhere),
+    // ^ `Struct`s (nested in another aggregate) and `Phi`s (merged with another aggregate)
+    auto const *root_users = bld.reg.try_get<users>(root);
+    return root_users && !root_users->entries.empty();
+}
+
+// Scalarize every non-escaping aggregate whose `Load`s all have a constant offset; return the number of aggregates removed
+inline size_t scalar_replace(builder &bld) noexcept
+{
+    auto &&ops = bld.reg.storage<node_op>();
+    auto &&ins = bld.reg.storage<node_inputs>();
+    auto &&mem = bld.reg.storage<mem_effect>();
+    auto &&writes = bld.reg.storage<mem_write>();
+
+    // the memory nodes of each aggregate
+    entt::dense_map<entt::entity, std::vector<entt::entity>> accesses;
+    for (auto [id, eff] : mem.each())
+    {
+        switch (ops.get(id))
+        {
+        case node_op::Load:
+        case node_op::VecLoad:
+        case node_op::Store:
+            if (auto const op = ops.get(eff.target); op == node_op::Alloca || op == node_op::Struct)
+                accesses[eff.target].push_back(id);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // The value of member `tag` of `root` as seen by `load`, or `null` if unknown
+    auto const field_value = [&](entt::entity root, entt::entity load) -> entt::entity
+    {
+        auto const tag = mem.get(load).tag;
+
+        // NOTE: the aggregate does not escape, so only `Store`s to it can change its members
+        for (auto prev = mem.get(load).prev; prev != root && prev != entt::null && mem.contains(prev); prev = mem.get(prev).prev)
+        {
+            auto const &eff = mem.get(prev);
+            if (eff.target == root && writes.contains(prev) && eff.tag == tag)
+                return ins.get(prev).nodes[0];
+        }
+
+        // no `Store` in between, so the member has its initial value
+        auto const &init = ins.get(root).nodes;
+        return (ops.get(root) == node_op::Struct && tag < init.n) ? init[tag] : entt::null;
+    };
+
+    entt::dense_set<entt::entity> removed;
+    std::vector<std::pair<entt::entity, entt::entity>> replaced;
+    size_t count{};
+
+    for (auto &&[root, nodes] : accesses)
+    {
+        if (escapes(bld, root))
+            continue;
+
+        replaced.clear();
+        bool const ok = std::ranges::all_of(nodes, [&](entt::entity n)
+                                            {
+                                                // NOTE: a `VecLoad` reads `vector_width` members at once, so it needs the aggregate
+                                                auto const &eff = mem.get(n);
+                                                if (eff.tag == ~uint32_t{} || ops.get(n) == node_op::VecLoad)
+                                                    return false; // indexed at runtime, or packed
+
+                                                // NOTE: `Store`s are only needed by the `Load`s, so they die together with the aggregate
+                                                if (ops.get(n) == node_op::Store)
+                                                    return !bld.reg.all_of<users>(n) || bld.reg.get<users>(n).entries.empty();
+
+                                                auto const val = field_value(root, n);
+                                                replaced.push_back({n, val});
+                                                return val != entt::null; //
+                                            });
+
+        if (!ok)
+            continue;
+
+        for (auto [load, val] : replaced)
+            bld.replace_uses(load, val);
+
+        removed.insert(nodes.begin(), nodes.end());
+        removed.insert(root);
+        ++count;
+    }
+
+    bld.unlink_mem([&](entt::entity n)
+                   { return removed.contains(n); });
+
+    // NOTE: `Load`/`Store`s go first, as they are not users of the aggregate but still reference it
+    for (auto n : removed)
+        if (ops.get(n) != node_op::Alloca && ops.get(n) != node_op::Struct)
+            bld.destroy(n);
+
+    for (auto n : removed)
+        if (bld.reg.valid(n))
+            bld.destroy(n);
+
+    return count;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include "nodegen/add.hpp"
+#include "opt/loops.hpp"
+
+// Strength reduction
+// `iv * c`, with `iv` an induction variable and `c` a constant, goes up by `step * c` every iteration, so it becomes an
+// induction variable of its own: a `Phi` starting at `init * c` that adds `step * c` on the back-edge
+// NOTE: both `Phi`s change on the same edges, so the new one equals `iv * c` everywhere, after the loop included
+
+// TODO:
+// - `iv << c` as well
+// - `iv * c + d` (eg. the offset of a member inside an array of structs), once the backends index with offsets
+// - drop the original induction variable if it is only used by the loop test, comparing against `bound * c` instead
+
+// Turn every `iv * c` into an induction variable of its own; return the number of multiplications removed
+inline size_t reduce_strength(builder &bld) noexcept
+{
+    scope_visibility vis;
+    bld.push_vis<visibility::reachable>(vis);
+
+    auto const &ops = bld.reg.storage<node_op>();
+    auto const &ins = bld.reg.storage<node_inputs>();
+
+    // NOTE: collected first, as new `Phi`s are made below
+    std::vector<induction_var> ivs;
+    for (auto [phi, region] : bld.reg.storage<region_of_phi>().each())
+        if (auto const iv = find_induction(bld, phi))
+            ivs.push_back(*iv);
+
+    size_t reduced = 0;
+    std::vector<entt::entity> muls;
+    for (auto const &iv : ivs)
+    {
+        muls.clear();
+        if (auto const *phi_users = bld.reg.try_get<users>(iv.phi))
+            for (auto [user, index] : phi_users->entries)
+                if (ops.get(user) == node_op::Mul && bld.reg.get<node_type>(user).type->as<int_value>())
+                    muls.push_back(user);
+
+        for (auto mul : muls)
+        {
+            auto const &mins = ins.get(mul).nodes;
+            auto const factor = (mins[0] == iv.phi) ? mins[1] : mins[0];
+
+            int64_t step = 0;
+            auto const c = int_const_of(bld, factor);
+            if (factor == iv.phi || !c || !checked_mul(iv.step, *c, step))
+                continue;
+
+            auto const loop = bld.reg.get<region_of_phi>(iv.phi).region;
+
+            // NOTE: `make` folds `init * c` if `init` is a constant
+            auto const init = make(bld, mul_node{iv.init, factor});
+            entt::entity const phi_ins[]{init, init}; // the back-edge is set below
+            auto const phi = bld.make(bld.reg.get<node_type>(mul).type, node_op::Phi, phi_ins);
+            bld.reg.emplace<region_of_phi>(phi, loop);
+
+            auto const next = make(bld, add_node{phi, make(bld, value_node{int_value::make((uint64_t)step)})});
+            entt::entity const back_ins[]{init, next};
+            bld.set_inputs(phi, back_ins);
+
+            bld.replace_uses(mul, phi);
+            bld.destroy(mul);
+            ++reduced;
+        }
+    }
+
+    bld.pop_vis();
+
+    return reduced;
+}
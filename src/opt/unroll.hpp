@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+
+#include "opt/loops.hpp"
+
+// Loop unrolling
+// A loop that runs a known number of times, a multiple of `k`, runs its body `k` times in a row before testing again
+// The body is cloned `k - 1` times after itself: each copy takes the back-edge values of the one before as its `Phi`s, and
+// the last copy feeds the back-edge; the tests in between are dropped, as the trip count says they would all hold
+// NOTE: only straight-line bodies (bounds checks, pure values and `Load`s) are unrolled, so the copies never need their
+// own `Region`s or memory `Phi`s
+
+// TODO:
+// - unroll loops with an unknown trip count, testing the bound before each copy (or once, with a remainder loop)
+// - bodies with `Store`s, once there are memory `Phi`s at `Loop`s
+// - replace loops that run once or never with their body
+// - pick the factor from the cost of the body, rather than a fixed one
+
+// how many times the body runs between two tests, at most; `--unroll` sets this, 1 turns unrolling off
+inline uint32_t unroll_factor = 4;
+
+// loops whose copies would add more nodes than this are unrolled fewer times, or not at all
+static constexpr uint32_t unroll_max_nodes = 128;
+
+// Unroll the loop `l` `factor` times, if its trip count allows it; return whether it did
+inline bool unroll_loop(builder &bld, loop_info const &l, uint32_t factor) noexcept
+{
+    auto &&types = bld.reg.storage<node_type>();
+    auto &&ops = bld.reg.storage<node_op>();
+    auto &&ins = bld.reg.storage<node_inputs>();
+    auto &&ctrl = bld.reg.storage<ctrl_effect>();
+    auto &&mem = bld.reg.storage<mem_effect>();
+    auto &&reads = bld.reg.storage<mem_read>();
+
+    auto const shape = shape_of(bld, l);
+    if (!shape)
+        return false;
+
+    auto const trips = trip_count(bld, l.head, shape->cond);
+    if (!trips || *trips < 2)
+        return false;
+
+    // the largest factor that divides the trip count and keeps the copies under the cap
+    auto const cost = shape->chain.size() + shape->values.size();
+    auto k = (uint64_t)factor;
+    while (k > 1 && (*trips % k != 0 || (k - 1) * cost > unroll_max_nodes))
+        --k;
+
+    if (k < 2)
+        return false;
+
+    // the value each `Phi` stands for in the copy being made; the first copy follows the original body
+    entt::dense_map<entt::entity, entt::entity> current;
+    for (auto phi : shape->phis)
+        current[phi] = ins.get(phi).nodes[1];
+
+    auto back = l.back;
+    entt::dense_map<entt::entity, entt::entity> cloned;
+    std::vector<entt::entity> nins;
+
+    for (uint64_t copy = 1; copy < k; ++copy)
+    {
+        cloned.clear();
+        for (auto n : shape->chain)
+            cloned[n] = bld.make(types.get(n).type, ops.get(n), {});
+        for (auto n : shape->values)
+            cloned[n] = bld.make(types.get(n).type, ops.get(n), {});
+
+        auto const map = [&](entt::entity n)
+        {
+            if (auto iter = cloned.find(n); iter != cloned.end())
+                return iter->second;
+            if (auto iter = current.find(n); iter != current.end())
+                return iter->second;
+            return n;
+        };
+
+        for (auto [n, c] : cloned)
+        {
+            nins.clear();
+            for (auto in : ins.get(n).nodes)
+                nins.push_back(map(in));
+            bld.set_inputs(c, nins);
+
+            // NOTE: the body only reads memory, so the copies can read the same memory state as the original
+            if (mem.contains(n))
+            {
+                auto const m = mem.get(n);
+                mem.emplace(c) = {.prev = map(m.prev), .target = map(m.target), .tag = m.tag};
+            }
+
+            if (reads.contains(n))
+                reads.emplace(c);
+        }
+
+        // the copy runs right after the body before it
+        for (auto n : shape->chain)
+        {
+            ctrl.emplace(cloned[n], back);
+            back = cloned[n];
+        }
+
+        // NOTE: computed before updating any of them, as `Phi`s take their values at the same time
+        nins.clear();
+        for (auto phi : shape->phis)
+            nins.push_back(map(ins.get(phi).nodes[1]));
+        for (size_t i{}; i < shape->phis.size(); ++i)
+            current[shape->phis[i]] = nins[i];
+    }
+
+    entt::entity const loop_ins[]{ins.get(l.head).nodes[0], back};
+    bld.set_inputs(l.head, loop_ins);
+
+    for (auto phi : shape->phis)
+    {
+        entt::entity const phi_ins[]{ins.get(phi).nodes[0], current[phi]};
+        bld.set_inputs(phi, phi_ins);
+    }
+
+    return true;
+}
+
+// Unroll the innermost loops with a known trip count `unroll_factor` times; return the number of loops unrolled
+inline size_t unroll_loops(builder &bld) noexcept
+{
+    if (unroll_factor < 2)
+        return 0;
+
+    scope_visibility vis;
+    bld.push_vis<visibility::reachable>(vis);
+
+    auto const tree = build_loop_tree(bld);
+
+    // NOTE: only innermost loops, so the bodies in `tree` stay valid while cloning
+    std::vector<uint8_t> has_child(tree.loops.size());
+    for (auto const &l : tree.loops)
+        if (l.parent != loop_tree::none)
+            has_child[l.parent] = true;
+
+    size_t unrolled = 0;
+    for (uint32_t i{}; i < tree.loops.size(); ++i)
+        if (!has_child[i])
+            unrolled += unroll_loop(bld, tree.loops[i], unroll_factor);
+
+    bld.pop_vis();
+
+    return unrolled;
+}
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+#include <entt/container/dense_set.hpp>
+
+#include "nodegen/add.hpp"
+#include "opt/loops.hpp"
+#include "types/float.hpp"
+
+// Loop vectorization
+// A counted loop `for i < n { ...; i = i + 1; }` whose body reads arrays at `i` and combines the elements lane by lane
+// runs `vector_width` iterations at once: the `Load`s become `VecLoad`s, the arithmetic becomes packed, and every sum
+// `s = s + e` gets a packed `Phi` of its own that is added up (`VecReduce`) after the loop
+// The last `trips % vector_width` iterations run after the loop as straight-line scalar code (the epilogue)
+// NOTE: the trip count, the start of `i` and the length of every array are constants, so the bounds checks of the body are
+// known to hold and are dropped; both the packed loop and the epilogue never leave the arrays
+
+// TODO:
+// - elementwise stores (`c[i] = a[i] + b[i]`), once arrays can be written to
+// - loops with an unknown trip count, testing the bound before the packed loop and running the epilogue as a loop
+// - float sums, behind a flag that allows reassociating them
+// - sized integers, with packed ops that wrap at the size of their lanes
+// - pick the width from the target (eg. 2 lanes with only SSE2)
+
+namespace vectorize_detail
+{
+    // What each data node of the body becomes
+    enum class lane_kind : uint8_t
+    {
+        Lanes,  // a value per iteration, computed `vector_width` at a time
+        Sum,    // `s + e`, with `s` a sum of the loop
+        Counter // `i + 1`
+    };
+
+    // Can `op` run lane by lane, and which packed node does it become?
+    inline std::optional<node_op> packed_op_of(node_op op) noexcept
+    {
+        switch (op)
+        {
+        case node_op::Add:
+        case node_op::Fadd:
+            return node_op::VecAdd;
+        case node_op::Sub:
+        case node_op::Fsub:
+            return node_op::VecSub;
+        case node_op::Mul:
+        case node_op::Fmul:
+            return node_op::VecMul;
+        default:
+            return std::nullopt;
+        }
+    }
+
+    // Only untyped integers and floats fill the 64-bit lanes without wrapping
+    inline bool has_lane_type(builder &bld, entt::entity n) noexcept
+    {
+        auto const ty = bld.reg.get<node_type>(n).type;
+        return ty->as<int_value>() || ty->as<float_value>();
+    }
+}
+
+// Vectorize the loop `l`, if it is a counted loop over arrays; return whether it did
+inline bool vectorize_loop(builder &bld, loop_info const &l) noexcept
+{
+    using namespace vectorize_detail;
+
+    auto &&types = bld.reg.storage<node_type>();
+    auto &&ops = bld.reg.storage<node_op>();
+    auto &&ins = bld.reg.storage<node_inputs>();
+    auto &&ctrl = bld.reg.storage<ctrl_effect>();
+    auto &&mem = bld.reg.storage<mem_effect>();
+    auto &&reads = bld.reg.storage<mem_read>();
+
+    auto const shape = shape_of(bld, l);
+    if (!shape)
+        return false;
+
+    auto const trips = trip_count(bld, l.head, shape->cond);
+    if (!trips || *trips < vector_width)
+        return false;
+
+    // `i` starts at a constant and goes up by one
+    auto const i = ins.get(shape->cond).nodes[0];
+    auto const start = int_const_of(bld, ins.get(i).nodes[0]);
+    auto const counter = ins.get(i).nodes[1];
+    if (!start || *start < 0 || ops.get(counter) != node_op::Add)
+        return false;
+
+    {
+        auto const &cins = ins.get(counter).nodes;
+        auto const one = (cins[0] == i) ? cins[1] : cins[0];
+        if ((cins[0] != i && cins[1] != i) || int_const_of(bld, one) != 1)
+            return false;
+
+        for (auto [user, index] : bld.reg.get<users>(counter).entries)
+            if (user != i)
+                return false;
+    }
+
+    int64_t end = 0;
+    if (!checked_add(*start, (int64_t)*trips, end))
+        return false;
+
+    // NOTE: the test is rewritten below, so nothing else may depend on it
+    if (auto const *cond_users = bld.reg.try_get<users>(shape->cond))
+        for (auto [user, index] : cond_users->entries)
+            if (auto const op = ops.get(user); op != node_op::IfYes && op != node_op::IfNot)
+                return false;
+
+    // every bounds check of the body is `i` against a constant length that `i` never reaches
+    for (auto c : shape->chain)
+    {
+        auto const &cins = ins.get(c).nodes;
+        auto const len = int_const_of(bld, cins[1]);
+        if (cins[0] != i || !len || *len < end)
+            return false;
+    }
+
+    entt::dense_set<entt::entity> body;
+    body.insert(shape->cond);
+    body.insert(shape->chain.begin(), shape->chain.end());
+    body.insert(shape->values.begin(), shape->values.end());
+    body.insert(shape->phis.begin(), shape->phis.end());
+
+    auto const is_index = [&](entt::entity n)
+    { return n == i || (ops.get(n) == node_op::CheckedIndex && body.contains(n)); };
+
+    // the other `Phi`s are sums, and the body only uses them to add to themselves
+    entt::dense_map<entt::entity, entt::entity> sum_of; // `s + e` -> `s`
+    for (auto s : shape->phis)
+    {
+        if (s == i)
+            continue;
+
+        auto const next = ins.get(s).nodes[1];
+        if (ops.get(next) != node_op::Add || !bld.reg.get<node_type>(s).type->as<int_value>())
+            return false;
+
+        auto const &nins = ins.get(next).nodes;
+        if ((nins[0] == s) == (nins[1] == s))
+            return false;
+
+        for (auto [user, index] : bld.reg.get<users>(s).entries)
+            if (user != next && body.contains(user))
+                return false;
+
+        for (auto [user, index] : bld.reg.get<users>(next).entries)
+            if (user != s)
+                return false;
+
+        sum_of[next] = s;
+    }
+
+    // NOTE: `values` has inputs first, so the inputs of a node are classified before it
+    entt::dense_map<entt::entity, lane_kind> kinds;
+    auto const is_lanes = [&](entt::entity n)
+    {
+        auto iter = kinds.find(n);
+        return iter != kinds.end() && iter->second == lane_kind::Lanes;
+    };
+
+    for (auto n : shape->values)
+    {
+        if (n == counter)
+        {
+            kinds[n] = lane_kind::Counter;
+            continue;
+        }
+
+        if (auto iter = sum_of.find(n); iter != sum_of.end())
+        {
+            auto const &nins = ins.get(n).nodes;
+            if (!is_lanes(nins[0] == iter->second ? nins[1] : nins[0]))
+                return false;
+
+            kinds[n] = lane_kind::Sum;
+            continue;
+        }
+
+        if (!has_lane_type(bld, n))
+            return false;
+
+        // lanes are only used by the body, as the last of them is not kept anywhere
+        for (auto [user, index] : bld.reg.get<users>(n).entries)
+            if (!body.contains(user))
+                return false;
+
+        auto const &nins = ins.get(n).nodes;
+        if (ops.get(n) == node_op::Load)
+        {
+            auto const target = mem.get(n).target;
+            if (nins.n != 1 || !is_index(nins[0]) || target == entt::null || body.contains(target))
+                return false;
+        }
+        else
+        {
+            // NOTE: inputs from outside the body are the same on every lane; `i` and the sums are not used as values
+            if (!packed_op_of(ops.get(n)))
+                return false;
+
+            for (auto in : nins)
+                if (body.contains(in) && !is_lanes(in))
+                    return false;
+        }
+
+        kinds[n] = lane_kind::Lanes;
+    }
+
+    // NOTE: collected before anything changes, as new users are added below
+    std::vector<users::entry> i_outside;
+    for (auto e : bld.reg.get<users>(i).entries)
+        if (!body.contains(e.id))
+            i_outside.push_back(e);
+
+    entt::dense_map<entt::entity, std::vector<users::entry>> sum_outside;
+    for (auto [next, s] : sum_of)
+    {
+        auto &outside = sum_outside[s];
+        for (auto e : bld.reg.get<users>(s).entries)
+            if (e.id != next)
+                outside.push_back(e);
+    }
+
+    auto const int_node = [&](int64_t n)
+    { return make(bld, value_node{int_value::make((uint64_t)n)}); };
+
+    // the packed loop
+    entt::dense_map<entt::entity, entt::entity> splats;
+    entt::dense_map<entt::entity, entt::entity> packed;
+
+    auto const splat = [&](entt::entity n)
+    {
+        auto [iter, added] = splats.try_emplace(n, entt::null);
+        if (added)
+            iter->second = bld.make(types.get(n).type, node_op::VecSplat, std::span(&n, 1));
+        return iter->second;
+    };
+
+    auto const packed_of = [&](entt::entity n)
+    { return body.contains(n) ? packed.at(n) : splat(n); };
+
+    std::vector<entt::entity> nins;
+    for (auto n : shape->values)
+    {
+        if (kinds.at(n) != lane_kind::Lanes)
+            continue;
+
+        if (ops.get(n) == node_op::Load)
+        {
+            auto const v = bld.make(types.get(n).type, node_op::VecLoad, std::span(&i, 1));
+            mem.emplace(v) = {.prev = mem.get(n).prev, .target = mem.get(n).target, .tag = ~uint32_t{}};
+            reads.emplace(v);
+            packed[n] = v;
+            continue;
+        }
+
+        nins.clear();
+        for (auto in : ins.get(n).nodes)
+            nins.push_back(packed_of(in));
+        packed[n] = bld.make(types.get(n).type, *packed_op_of(ops.get(n)), nins);
+    }
+
+    // every sum starts over from zero in each lane, and the lanes are added to its value before the loop at the end
+    entt::dense_map<entt::entity, entt::entity> sum_after; // `s` -> its value after the packed loop, then the epilogue
+    for (auto [next, s] : sum_of)
+    {
+        auto const &nins = ins.get(next).nodes;
+        auto const e = (nins[0] == s) ? nins[1] : nins[0];
+        auto const ty = types.get(s).type;
+
+        auto const zero = splat(int_node(0));
+        entt::entity const phi_ins[]{zero, zero}; // the back-edge is set below
+        auto const vs = bld.make(ty, node_op::Phi, phi_ins);
+        bld.reg.emplace<region_of_phi>(vs, l.head);
+
+        entt::entity const add_ins[]{vs, packed.at(e)};
+        entt::entity const back_ins[]{zero, bld.make(ty, node_op::VecAdd, add_ins)};
+        bld.set_inputs(vs, back_ins);
+
+        auto const total = bld.make(ty, node_op::VecReduce, std::span(&vs, 1));
+        sum_after[s] = make(bld, add_node{ins.get(s).nodes[0], total});
+    }
+
+    // the epilogue, one copy of the scalar body per iteration left
+    auto const done = *start + (int64_t)(*trips / vector_width * vector_width);
+    entt::dense_map<entt::entity, entt::entity> cloned;
+    for (auto index = done; index < end; ++index)
+    {
+        auto const at = int_node(index);
+
+        cloned.clear();
+        auto const map = [&](entt::entity n)
+        {
+            if (is_index(n))
+                return at;
+            if (auto iter = cloned.find(n); iter != cloned.end())
+                return iter->second;
+            return n;
+        };
+
+        for (auto n : shape->values)
+        {
+            if (kinds.at(n) != lane_kind::Lanes)
+                continue;
+
+            nins.clear();
+            for (auto in : ins.get(n).nodes)
+                nins.push_back(map(in));
+            auto const c = cloned[n] = bld.make(types.get(n).type, ops.get(n), nins);
+
+            if (mem.contains(n))
+            {
+                auto const m = mem.get(n);
+                mem.emplace(c) = {.prev = m.prev, .target = m.target, .tag = ~uint32_t{}};
+            }
+
+            if (reads.contains(n))
+                reads.emplace(c);
+        }
+
+        for (auto [next, s] : sum_of)
+        {
+            auto const &sins = ins.get(next).nodes;
+            auto const e = (sins[0] == s) ? sins[1] : sins[0];
+            sum_after[s] = make(bld, add_node{sum_after[s], map(e)});
+        }
+    }
+
+    // code after the loop sees the values of the scalar loop
+    auto const redirect = [&](std::vector<users::entry> const &uses, entt::entity with)
+    {
+        for (auto [user, index] : uses)
+        {
+            nins.assign(ins.get(user).nodes.begin(), ins.get(user).nodes.end());
+            nins[index] = with;
+            bld.set_inputs(user, nins);
+        }
+    };
+
+    redirect(i_outside, int_node(end));
+    for (auto &[s, outside] : sum_outside)
+        redirect(outside, sum_after.at(s));
+
+    // `i` goes up by `vector_width` and stops at the last full group of lanes
+    {
+        entt::entity const i_ins[]{ins.get(i).nodes[0], make(bld, add_node{i, int_node(vector_width)})};
+        bld.set_inputs(i, i_ins);
+
+        auto const bound = (ops.get(shape->cond) == node_op::CmpLe) ? done - 1 : done;
+        entt::entity const cond_ins[]{i, int_node(bound)};
+        bld.set_inputs(shape->cond, cond_ins);
+    }
+
+    // drop the scalar body
+    entt::dense_set<entt::entity> dead;
+    dead.insert(shape->values.begin(), shape->values.end());
+    bld.unlink_mem([&](entt::entity n)
+                   { return dead.contains(n); });
+
+    for (auto [next, s] : sum_of)
+        bld.set_inputs(s, {});
+
+    for (auto c : shape->chain)
+    {
+        bld.unlink_ctrl(c, ctrl.get(c).target, i);
+        bld.destroy(c);
+    }
+
+    for (auto iter = shape->values.rbegin(); iter != shape->values.rend(); ++iter)
+        bld.destroy(*iter);
+
+    for (auto [next, s] : sum_of)
+        bld.destroy(s);
+
+    return true;
+}
+
+// Vectorize the innermost counted loops over arrays; return the number of loops vectorized
+inline size_t vectorize_loops(builder &bld) noexcept
+{
+    scope_visibility vis;
+    bld.push_vis<visibility::reachable>(vis);
+
+    auto const tree = build_loop_tree(bld);
+
+    // NOTE: only innermost loops, so the bodies in `tree` stay valid while rewriting
+    std::vector<uint8_t> has_child(tree.loops.size());
+    for (auto const &l : tree.loops)
+        if (l.parent != loop_tree::none)
+            has_child[l.parent] = true;
+
+    size_t vectorized = 0;
+    for (uint32_t i{}; i < tree.loops.size(); ++i)
+        if (!has_child[i])
+            vectorized += vectorize_loop(bld, tree.loops[i]);
+
+    bld.pop_vis();
+
+    return vectorized;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+
+#include "decls.hpp"
+#include "parser/all.hpp"
+
+// Multi-file packages
+// Every file of a package is read and split into declarations on a worker thread of its own, then the declarations of all
+// files are merged into one table to resolve names across files. Files are then ordered so each comes after the files
+// it uses names from, which is what the parser needs as it does not support out-of-order declarations yet
+// The files that use no names from each other form a level; the files of a level are parsed on worker threads, each
+// into a registry of its own, then merged into the graph of the package before the next level starts
+
+// TODO:
+// - order declarations rather than whole files, so two files can use names from each other
+// ^ this needs `delay_typecheck` (see nodes.hpp) or the parser to skip to a declaration
+// - `import` of other packages
+
+struct source_file final
+{
+    char const *path;
+    std::unique_ptr<uchar[]> text; // `nullptr` if the file cannot be read
+    std::vector<decl_info> decls;
+    uint32_t level = 0; // 1 + the highest level of the files it uses names from
+};
+
+// Run `fn(i)` for every `i < n` on worker threads, the calling thread included
+// NOTE: the indices are handed out one at a time, so a big item does not hold back a whole batch
+inline void for_each_parallel(size_t n, function_ref<void(size_t)> fn) noexcept
+{
+    std::atomic<size_t> next = 0;
+    auto const work = [&]
+    {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;)
+            fn(i);
+    };
+
+    auto const n_workers = std::min<size_t>(n, std::max(std::thread::hardware_concurrency(), 1u));
+    if (n_workers == 0)
+        return;
+
+    std::vector<std::jthread> workers;
+    workers.reserve(n_workers - 1);
+    for (size_t i{1}; i < n_workers; ++i)
+        workers.emplace_back(work);
+
+    work(); // the calling thread takes its share too
+}
+
+// Read `path` whole, NUL-terminated; `nullptr` if it cannot be read
+inline std::unique_ptr<uchar[]> read_source(char const *path) noexcept
+{
+    auto const f = fopen(path, "rb");
+    if (!f)
+        return nullptr;
+
+    fseek(f, 0, SEEK_END);
+    auto const n = (size_t)ftell(f);
+    rewind(f);
+
+    std::unique_ptr<uchar[]> text{new uchar[n + 1]};
+    text[fread(text.get(), 1, n, f)] = '\0';
+    fclose(f);
+
+    return text;
+}
+
+// Read and scan every file of a package, in parallel, then order them for the parser; exits on errors
+// ^ the declarations of a file are in `decls`, the `package` clause first
+inline std::vector<source_file> load_package(std::span<char const *const> paths) noexcept
+{
+    std::vector<source_file> files(paths.size());
+    for (size_t i{}; i < paths.size(); ++i)
+        files[i].path = paths[i];
+
+    for_each_parallel(files.size(), [&](size_t i)
+                      {
+                          auto &file = files[i];
+                          file.text = read_source(file.path);
+                          if (file.text)
+                              file.decls = scan_decls(file.text.get()); });
+
+    // merge
+
+    entt::dense_map<hashed_name, uint32_t, token_hash> owner; // name -> file declaring it
+    hashed_name package{};
+
+    for (uint32_t i{}; i < files.size(); ++i)
+    {
+        auto const &file = files[i];
+        if (!file.text)
+        {
+            std::println("Cannot read input file {}!", file.path);
+            std::exit(-1);
+        }
+
+        if (file.decls.empty() || file.decls[0].keyword != token_kind::KwPackage || file.decls[0].defines.empty())
+        {
+            std::println("{}: Expected a `package` clause first!", file.path);
+            std::exit(-1);
+        }
+
+        auto const name = file.decls[0].defines[0];
+        if (i == 0)
+            package = name;
+        else if (name != package)
+        {
+            std::println("{}: Package name differs from the one in {}!", file.path, files[0].path);
+            std::exit(-1);
+        }
+
+        for (auto const &d : std::span{file.decls}.subspan(1))
+            for (auto n : d.defines)
+                if (auto [iter, fresh] = owner.try_emplace(n, i); !fresh && iter->second != i)
+                {
+                    std::println("{}: Name already declared in {}!", file.path, files[iter->second].path);
+                    std::exit(-1);
+                }
+    }
+
+    // order
+
+    // NOTE: Kahn's algorithm, always taking the first ready file in command line order, so one file stays as it was
+    std::vector<std::vector<uint32_t>> users(files.size());
+    std::vector<uint32_t> pending(files.size());
+    std::vector<std::vector<uint32_t>> deps_of(files.size());
+
+    for (uint32_t i{}; i < files.size(); ++i)
+    {
+        std::vector<uint32_t> deps;
+        for (auto const &d : files[i].decls)
+            for (auto use : d.uses)
+                if (auto iter = owner.find(use); iter != owner.end() && iter->second != i)
+                    deps.push_back(iter->second);
+
+        std::ranges::sort(deps);
+        auto const [first, last] = std::ranges::unique(deps);
+        deps.erase(first, last);
+
+        pending[i] = (uint32_t)deps.size();
+        for (auto d : deps)
+            users[d].push_back(i);
+
+        deps_of[i] = std::move(deps);
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(files.size());
+
+    std::vector<bool> done(files.size());
+    while (order.size() < files.size())
+    {
+        uint32_t ready = 0;
+        while (ready < files.size() && (done[ready] || pending[ready] != 0))
+            ++ready;
+
+        if (ready == files.size())
+        {
+            std::println("These files use names from each other, which is not supported yet:");
+            for (uint32_t i{}; i < files.size(); ++i)
+                if (!done[i])
+                    std::println("\t{}", files[i].path);
+            std::exit(-1);
+        }
+
+        done[ready] = true;
+        order.push_back(ready);
+        for (auto u : users[ready])
+            --pending[u];
+
+        // NOTE: the files it depends on are ordered already
+        for (auto d : deps_of[ready])
+            files[ready].level = std::max(files[ready].level, files[d].level + 1);
+    }
+
+    // NOTE: stable, so the files of a level keep the order from above
+    std::ranges::stable_sort(order, {}, [&](uint32_t i)
+                             { return files[i].level; });
+
+    std::vector<source_file> res;
+    res.reserve(files.size());
+    for (auto i : order)
+        res.push_back(std::move(files[i]));
+
+    return res;
+}
+
+// Parse the files of a package, in the order of `load_package`, into `p`, then generate the call to `main`
+inline void parse_package(parser &p, std::span<source_file const> files) noexcept
+{
+    // NOTE: a single file needs no merging, so it is parsed into `p` right away
+    if (files.size() == 1)
+    {
+        p.source_name = files[0].path;
+        p.scan = scanner{.text = files[0].text.get()};
+        return p.package();
+    }
+
+    stats_zone _{"parse"};
+
+    scope_visibility vis;
+    p.begin_package(vis);
+
+    scope global;
+    p.env.top = &global;
+    parser::import_builtin(p.env);
+
+    // one file parsed on its own; see `parser::unit_package`
+    struct unit final
+    {
+        parser p;
+        scope global;
+        scope_visibility vis;
+        parser::import_map imports;
+    };
+
+    std::vector<std::unique_ptr<unit>> units;
+    for (size_t first{}, last{}; first < files.size(); first = last)
+    {
+        while (last < files.size() && files[last].level == files[first].level)
+            ++last;
+
+        units.clear();
+        for (auto i = first; i < last; ++i)
+        {
+            auto &u = *units.emplace_back(std::make_unique<unit>());
+            u.p.source_name = files[i].path;
+            u.p.scan = scanner{.text = files[i].text.get()};
+            u.p.funcs = p.funcs;
+        }
+
+        // NOTE: `p` is only read until every file of the level is done
+        for_each_parallel(units.size(), [&](size_t i)
+                          {
+                              auto &u = *units[i];
+                              u.p.unit_package(p, u.global, u.vis, u.imports); });
+
+        for (auto const &u : units)
+            p.merge_unit(u->p, u->imports);
+    }
+
+    p.codegen_main();
+}
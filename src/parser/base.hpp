@@ -2,6 +2,9 @@
 #pragma once
 
 #include <algorithm>
+#include <span>
+
+#include <entt/container/dense_set.hpp>
 
 #include "nodegen/all.hpp"
 #include "env.hpp"
@@ -19,7 +22,6 @@
 // - define function names only after they are fully parsed
 // ^ in the meantime you can mark their call occurrences as `unresolved` and resolve later
 // ^ this allows you to also point the function node to the `Return` rather than `Start`
-// - compute an `inline score` for each function based on number of nodes, recursion, number of calls, etc.
 // - most calls to block need to be followed by a semicolon, except for the block after an `if` and before an `else`
 // ^ can you simply require no semicolon after `}` and avoid automatic semicolon insertion for it?
 // ^ this is not optimal as `Type{}` also uses `}` and a `;` is a valid following
@@ -99,6 +101,19 @@ struct expr_info final
 template <bool AsStmt>
 using rule_result = std::conditional_t<AsStmt, entt::entity, void>;
 
+struct func_cache; // see cache.hpp
+
+// a type every package sees without declaring it
+struct builtin_type final
+{
+    hashed_name name;
+    type const *ty;
+};
+
+// The built-in types; made once and shared by every parser, so the units of a package (and the requests of the
+// compile server) agree on them
+inline std::span<builtin_type const> builtin_types() noexcept;
+
 struct parser final
 {
     using block_then = function_ref<entt::entity(scope const *, entt::entity)>;
@@ -240,6 +255,9 @@ struct parser final
 
     // 'func' <ident> '(' param_decl,*, ')' type? block ';' decl
     inline void inline_func_decl() noexcept;
+    // '(' param_decl,*, ')' type? block ';'
+    // ^ the rest of a function whose graph is spliced from `funcs`, skipped without building anything
+    inline void skip_func() noexcept;
     // '@' 'extern' 'func' <ident> '(' param_decl,*, ')' type? ';' decl
     // ^ external function declaration; they do not have a body
     // HACK: handle `extern` just like other annotations
@@ -277,12 +295,51 @@ struct parser final
     // 'package' <ident> ';' decl
     inline void package() noexcept;
 
+    // `Import` node of a file -> the global of the package it stands for
+    using import_map = entt::dense_map<entt::entity, entt::entity>;
+
+    // 'package' <ident> ';' decl
+    // ^ one file of the package `pkg`, parsed on a registry of its own; `global` starts with the globals of `pkg`, where
+    // the values are `Import` nodes (kept in `imports`), and the parsing stops at the end of the file
+    // NOTE: `pkg` is only read, so the files that do not use names from each other can be parsed in parallel
+    inline void unit_package(parser const &pkg, scope &global, scope_visibility &vis, import_map &imports) noexcept;
+
+    // Move the nodes and the globals of `u` (see `unit_package`) into this package, after everything parsed so far
+    inline void merge_unit(parser &u, import_map const &imports) noexcept;
+
+    // Make the `Program` and `GlobalMemory` nodes of the package and start the global state from them
+    inline void begin_package(scope_visibility &vis) noexcept;
+
     scanner scan;
     builder bld;
     env env;
 
+    char const *source_name = "<source>"; // the file being parsed, for errors
+    bool unit = false;                    // see `unit_package`
+    func_cache const *funcs = nullptr;    // the graphs of unchanged functions from the last build, if any
+
     stacklist<entt::entity> *defer_stack = nullptr;
 
+    // a loop whose body is being parsed
+    // NOTE: the variables bound before the loop get a `Phi` the first time the body reads or assigns them, so the
+    // variables the body never touches do not get one
+    struct loop_state final
+    {
+        struct carried final
+        {
+            hashed_name name;
+            uint32_t index; // slot of the value before the loop in `env.values`
+            entt::entity phi;
+        };
+
+        entt::entity loop;
+        size_t first_value;          // slots at or past this one are bound inside the loop
+        std::vector<carried> phis;   // in the order they were made
+        loop_state *prev = nullptr; // the enclosing loop, if any
+    };
+
+    loop_state *loops = nullptr; // the innermost loop being parsed
+
 private:
     // helpers
 
@@ -344,7 +401,9 @@ private:
     inline void const_body() noexcept;
 
     // helper to parse the `else` part of an `if` statement
-    inline entt::entity else_branch(scope const *then_env, entt::entity then_state, entt::entity then_ret) noexcept;
+    // ^ `mem_before` is the memory state before the `if`, `then_mem` the one at the end of its `then` branch
+    inline entt::entity else_branch(scope const *then_env, entt::entity then_state, entt::entity then_ret,
+                                    builder::mem_state const &mem_before, builder::mem_state const &then_mem) noexcept;
 
     // type
 
@@ -371,6 +430,22 @@ private:
     // other helpers
 
     inline void merge(entt::entity region, scope &parent, scope const &lhs, scope const &rhs) noexcept;
+    // Merge the memory of two branches at `region`: every object the branches leave in different states (or the whole
+    // memory, after a call) gets a memory `Phi`
+    // NOTE: `lhs` is the state at the end of the first branch, the current state is the one at the end of the second
+    inline void merge_mem(entt::entity region, builder::mem_state const &before, builder::mem_state const &lhs) noexcept;
+
+    // The value of `name`, bound at slot `index`; inside a loop this is the loop `Phi` of values bound before the loop
+    inline entt::entity read_value(hashed_name name, name_index index) noexcept;
+    inline entt::entity loop_value(loop_state *loop, hashed_name name, uint32_t index) noexcept;
+
+    // Start the loop `ls`, whose `Loop` node is made already
+    inline void open_loop(loop_state &ls) noexcept;
+    // Link the end of the body back to the `Loop` and give its `Phi`s their value from the back-edge
+    // NOTE: call once the body scope is popped, while `ls` is still the innermost loop
+    inline void close_loop(loop_state &ls, entt::entity entry, scope const &body) noexcept;
+    // Leave the loop `ls`; the variables it carries are its `Phi`s from here on, as the loop is left from its header
+    inline void exit_loop(loop_state &ls) noexcept;
 
     // codegen the `Start` and `Exit` nodes of the program, pass the control flow to `main` (and initializing globals when added).
     inline void codegen_main() noexcept;
@@ -399,27 +474,188 @@ inline void parser::merge(entt::entity region, scope &parent, scope const &lhs,
 
     // TODO: hash the `key` for faster lookup
 
+    // NOTE: a variable assigned in a branch is in the table of that branch, even if it was declared further out than `parent`
+    entt::dense_set<hashed_name, token_hash> seen;
+    auto const merge_name = [&](hashed_name key)
+    {
+        if (!seen.emplace(key).second || !is_value(parent.get_name(key)))
+            return;
+
+        // NOTE: `lhs` and `rhs` see every name of `parent` and a node is needed only if there is a change in either lhs or rhs
+        // TODO: handle case where `else` is missing
+        auto const left = lhs.get_name(key);
+        auto const right = rhs.get_name(key);
+        if (left == right)
+            return;
+
+        auto const node = make(bld, phi_node{region, read_value(key, left), read_value(key, right)});
+
+        // NOTE: bound anew rather than overwriting the slot, as the slot might be read by a loop before this one
+        parent.table[key] = name_index(env.values.size());
+        env.values.push_back(node);
+    };
+
     // TODO: only merge variables, nothing else
     for (auto &&[key, index] : parent.table)
         if (is_value(index))
+            merge_name(key);
+    for (auto &&[key, index] : lhs.table)
+        if (is_value(index))
+            merge_name(key);
+    for (auto &&[key, index] : rhs.table)
+        if (is_value(index))
+            merge_name(key);
+}
+
+inline void parser::merge_mem(entt::entity region, builder::mem_state const &before, builder::mem_state const &lhs) noexcept
+{
+    auto const rhs = bld.save_mem();
+
+    // the last node touching `root` (`null` for the whole memory) in `branch`
+    auto const last = [](builder::mem_state const &branch, entt::entity root)
+    {
+        if (root == entt::null)
+            return branch.mem;
+
+        auto iter = branch.chains.find(root);
+        return iter != branch.chains.end() ? iter->second.last : branch.mem;
+    };
+
+    // NOTE: memory `Phi`s have a `mem_effect` and no data users, so the backends never give them a value
+    auto const mem_phi = [&](entt::entity root)
+    {
+        auto const l = last(lhs, root), r = last(rhs, root);
+        if (l == r)
+            return l;
+
+        entt::entity const phi_ins[]{l, r};
+        auto const phi = bld.make(top_value::self(), node_op::Phi, phi_ins);
+        bld.reg.emplace<region_of_phi>(phi, region);
+        bld.reg.emplace<mem_effect>(phi) = {.prev = last(before, root), .target = root};
+        return phi;
+    };
+
+    builder::mem_state merged{.mem = mem_phi(entt::null)};
+    auto const merge_root = [&](entt::entity root)
+    {
+        if (merged.chains.contains(root))
+            return;
+
+        // NOTE: an object neither branch touched keeps its chain from before the branches
+        auto const n = mem_phi(root);
+        if (auto iter = before.chains.find(root); iter != before.chains.end() && iter->second.last == n)
+            merged.chains[root] = iter->second;
+        else if (n != merged.mem)
+            merged.chains[root] = {n, n};
+    };
+
+    for (auto &&[root, chain] : lhs.chains)
+        merge_root(root);
+    for (auto &&[root, chain] : rhs.chains)
+        merge_root(root);
+
+    bld.restore_mem(merged);
+}
+
+inline entt::entity parser::read_value(hashed_name name, name_index index) noexcept
+{
+    return loop_value(loops, name, (uint32_t)index);
+}
+
+inline entt::entity parser::loop_value(loop_state *loop, hashed_name name, uint32_t index) noexcept
+{
+    if (!loop || index >= loop->first_value)
+        return env.values[index];
+
+    // globals (including functions and constants) never change inside a function
+    for (auto s = env.top; s; s = s->prev)
+        if (auto iter = s->table.find(name); iter != s->table.end() && (uint32_t)iter->second == index)
         {
-            // NOTE: `lhs` and `rhs` have every key from `parent` and a node is needed only if there is a change in either lhs or rhs
-            // ^ this means you can search until you reach the beginning of `parent` for a variable and ignore everything before
-            // TODO: handle case where `else` is missing
-            auto const left = lhs.get_name(key);
-            auto const right = rhs.get_name(key);
-
-            // TODO: recheck this
-            // TODO: is it that if a value is not modified in a branch, it will point to `old`?
-            auto &&val = env.values[(uint32_t)index];
-            auto &&lval = env.values[(uint32_t)left];
-            auto &&rval = env.values[(uint32_t)right];
-
-            auto const node = make(bld, phi_node{region, lval, rval});
-            // TODO: is this correct? should you update the index instead?
-            // TODO: only update iff a `Phi` is generated
-            val = node;
+            if (!s->prev)
+                return env.values[index];
+            break;
         }
+
+    auto const iter = std::ranges::find(loop->phis, index, &loop_state::carried::index);
+    if (iter != loop->phis.end())
+        return iter->phi;
+
+    // NOTE: the entry is the value at the start of this loop, which is the `Phi` of the enclosing loop if nested
+    auto const entry = loop_value(loop->prev, name, index);
+    entt::entity const phi_ins[]{entry, entry}; // the back-edge is set by `close_loop`
+
+    auto const phi = bld.make(loop_phi_type(bld.reg.get<node_type>(entry).type), node_op::Phi, phi_ins);
+    bld.reg.emplace<region_of_phi>(phi, loop->loop);
+
+    loop->phis.push_back({.name = name, .index = index, .phi = phi});
+    return phi;
+}
+
+inline void parser::open_loop(loop_state &ls) noexcept
+{
+    ls.first_value = env.values.size();
+    ls.prev = std::exchange(loops, &ls);
+}
+
+inline void parser::close_loop(loop_state &ls, entt::entity entry, scope const &body) noexcept
+{
+    // the variables assigned in the body need a `Phi` even if the body never read them before
+    for (auto &&[key, index] : body.table)
+    {
+        if (!is_value(index))
+            continue;
+
+        auto const outer = env.top->get_name(key);
+        if (is_value(outer) && (uint32_t)outer < ls.first_value)
+            (void)loop_value(&ls, key, (uint32_t)outer);
+    }
+
+    entt::entity const loop_ins[]{entry, bld.state.ctrl};
+    bld.set_inputs(ls.loop, loop_ins);
+
+    // NOTE: the `Phi` inputs are [before the loop, end of the body], same as the `Loop`
+    // TODO: a variable the body shadows with its own `var` takes the inner value here
+    std::vector<entt::entity> backs;
+    for (auto const &c : ls.phis)
+        backs.push_back(loop_value(&ls, c.name, (uint32_t)body.get_name(c.name)));
+
+    // the body reads these variables but never changes them, so there is no need for a `Phi`
+    entt::dense_map<entt::entity, entt::entity> unchanged; // `Phi` -> value before the loop
+    for (size_t i{}; i < backs.size(); ++i)
+        if (backs[i] == ls.phis[i].phi)
+            unchanged[backs[i]] = bld.reg.get<node_inputs>(backs[i]).nodes[0];
+
+    for (size_t i{}; i < backs.size(); ++i)
+    {
+        auto const phi = ls.phis[i].phi;
+        if (unchanged.contains(phi))
+            continue;
+
+        auto back = backs[i];
+        if (auto iter = unchanged.find(back); iter != unchanged.end())
+            back = iter->second;
+
+        entt::entity const phi_ins[]{bld.reg.get<node_inputs>(phi).nodes[0], back};
+        bld.set_inputs(phi, phi_ins);
+    }
+
+    for (auto [phi, before] : unchanged)
+    {
+        bld.replace_uses(phi, before);
+        std::ranges::replace(std::span{env.values}.subspan(ls.first_value), phi, before);
+        bld.destroy(phi);
+    }
+
+    std::erase_if(ls.phis, [&](loop_state::carried const &c)
+                  { return !bld.reg.valid(c.phi); });
+}
+
+inline void parser::exit_loop(loop_state &ls) noexcept
+{
+    loops = ls.prev;
+
+    for (auto const &c : ls.phis)
+        env.set_value(c.name, c.phi);
 }
 
 inline void parser::fail(token const &t, std::string_view msg, std::string_view ctx) const
@@ -470,8 +706,7 @@ inline void parser::fail(token const &t, std::string_view msg, std::string_view
     // TODO: handle unicode characters case when showing the arrow (nr-chars(unicode) != nr-bytes)
     std::println(
         "{}:{}:{}: {}. {}.\n\n{}" console_red "{}" console_reset "{}\n{:>{}}^--",
-        // TODO: use actual file name
-        "<source>", line_num, t.start - start,
+        source_name, line_num, t.start - start,
         msg, ctx, ok_part, ecode, rcode,
         "", ok_part.size() //
     );
@@ -510,6 +745,34 @@ inline token parser::eat(std::span<token_kind const> kinds) noexcept
         fail(scan.peek, "Unexpected token", ""); // TODO: say something here
 }
 
+inline std::span<builtin_type const> builtin_types() noexcept
+{
+    using namespace entt::literals;
+
+    // HACK: do something better here
+    static builtin_type const types[]{
+        {(hashed_name)(uint32_t)"bool"_hs, new bool_type},
+
+        {(hashed_name)(uint32_t)"int"_hs, new sint_type},
+        {(hashed_name)(uint32_t)"int8"_hs, new sized_int_type<int8_t>},
+        {(hashed_name)(uint32_t)"int16"_hs, new sized_int_type<int16_t>},
+        {(hashed_name)(uint32_t)"int32"_hs, new sized_int_type<int32_t>},
+        {(hashed_name)(uint32_t)"int64"_hs, new sized_int_type<int64_t>},
+
+        {(hashed_name)(uint32_t)"uint8"_hs, new sized_int_type<uint8_t>},
+        {(hashed_name)(uint32_t)"uint16"_hs, new sized_int_type<uint16_t>},
+        {(hashed_name)(uint32_t)"uint32"_hs, new sized_int_type<uint32_t>},
+        {(hashed_name)(uint32_t)"uint64"_hs, new sized_int_type<uint64_t>},
+
+        {(hashed_name)(uint32_t)"float64"_hs, new float64_type},
+        {(hashed_name)(uint32_t)"rune"_hs, new rune_type},
+        {(hashed_name)(uint32_t)"string"_hs, new string_type},
+        // TODO: more built-in types
+    };
+
+    return types;
+}
+
 inline void parser::import_builtin(::env &e) noexcept
 {
     // TODO: eventually this can be replaced for an implicit `import "builtin"`
@@ -519,27 +782,7 @@ inline void parser::import_builtin(::env &e) noexcept
     // defs
     // TODO: add built-in functions, such as `print`
 
-    using namespace entt::literals;
-
     // types
-
-    // TODO: use a singleton here for now
-    e.new_type((hashed_name)(uint32_t)"bool"_hs, new bool_type);
-
-    e.new_type((hashed_name)(uint32_t)"int"_hs, new sint_type);
-    // HACK: do something better here
-    e.new_type((hashed_name)(uint32_t)"int8"_hs, new sized_int_type<int8_t>);
-    e.new_type((hashed_name)(uint32_t)"int16"_hs, new sized_int_type<int16_t>);
-    e.new_type((hashed_name)(uint32_t)"int32"_hs, new sized_int_type<int32_t>);
-    e.new_type((hashed_name)(uint32_t)"int64"_hs, new sized_int_type<int64_t>);
-
-    e.new_type((hashed_name)(uint32_t)"uint8"_hs, new sized_int_type<uint8_t>);
-    e.new_type((hashed_name)(uint32_t)"uint16"_hs, new sized_int_type<uint16_t>);
-    e.new_type((hashed_name)(uint32_t)"uint32"_hs, new sized_int_type<uint32_t>);
-    e.new_type((hashed_name)(uint32_t)"uint64"_hs, new sized_int_type<uint64_t>);
-
-    e.new_type((hashed_name)(uint32_t)"float64"_hs, new float64_type);
-    e.new_type((hashed_name)(uint32_t)"rune"_hs, new rune_type);
-    e.new_type((hashed_name)(uint32_t)"string"_hs, new string_type);
-    // TODO: more built-in types
+    for (auto const &[name, ty] : builtin_types())
+        e.new_type(name, ty);
 }
\ No newline at end of file
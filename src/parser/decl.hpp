@@ -1,29 +1,44 @@
 
 #pragma once
 
+#include "cache.hpp"
 #include "parser/base.hpp"
 #include "opt/all.hpp"
 
 inline void parser::inline_func_decl() noexcept
 {
-    // some setup codegen before parsing
-    // NOTE: this needs to be here because parameters depend on `mem_state`
     // TODO: rollback this in case of errors during parsing
     // TODO: `Start` is a value node; address that
     // TODO: `Start` should have a `$ctrl` child and `arg`, which are separate; address that
     // TODO: are `CtrlState` and `MemState` the same node initially? when inlining they might be different
 
-    scope_visibility vis;
-    auto const old_state = bld.new_func(vis);
+    trace_zone zone{"func"};
 
     // parsing
 
     eat(token_kind::KwFunc);                     // 'func'
     auto const nametok = eat(token_kind::Ident); // <ident>
+    zone.event.detail = scan.lexeme(nametok);
 
     if (env.top->table.contains(nametok.hash))
         fail(nametok, "Function already defined", ""); // TODO: say something here
 
+    // NOTE: an unchanged function is not parsed again; its graph from the last build is spliced in instead
+    if (funcs)
+        if (auto const start = funcs->splice(nametok.hash, bld, env); start != entt::null)
+        {
+            env.new_value(nametok.hash, start);
+            skip_func();
+
+            zone.finish();
+            return decl();
+        }
+
+    // some setup codegen before parsing the parameters
+    // NOTE: this needs to be here because parameters depend on `mem_state`
+    scope_visibility vis;
+    auto const old_state = bld.new_func(vis);
+
     // TODO: should the function point to the `Start`, `Return`, or where?
     // ^ you can actually pre-define the `Return` node here, attach it to the env table, then set the node's inputs accordingly
     // ^ this way you don't need to specially handle the case where a `return void` function does not have a `return` stmt
@@ -50,6 +65,7 @@ inline void parser::inline_func_decl() noexcept
 
     // TODO: typecheck that the return type matches what's expected
     // TODO: is this actually the `Return` node?
+    bool rebinds = false; // whether the body rebinds a global name, see below
     auto const ret = block(noscope_t{}, [&](scope const *func_env, entt::entity ret)
                            {
                                rule_sep<false>(); // ';' or <end-of-file>
@@ -67,19 +83,72 @@ inline void parser::inline_func_decl() noexcept
                                {
                                    auto const iter = func_env->table.find(name);
                                    if (iter != func_env->table.end())
+                                   {
+                                       rebinds |= idx != iter->second;
                                        idx = iter->second;
+                                   }
                                }
 
                                return out; //
                            });
 
+    bld.reg.emplace<return_of_func>(bld.state.func, ret);
+
+    // NOTE: this needs to be known before any call to this function is parsed
+    {
+        func_info info{.start = bld.state.func, .ret = ret};
+        collect_func_body(bld, info);
+        bld.reg.emplace<effect_of_func>(bld.state.func, classify_func(bld, info));
+    }
+
+    auto const start = bld.state.func;
     bld.state = old_state;
     prune_dead_code(bld, ret);
 
     // TODO: is this correct?
     bld.pop_vis();
 
-    decl(); // TODO: maybe call this inside the `block`?
+    // NOTE: splicing the function back would not bind those names again
+    if (funcs && !rebinds)
+        funcs->store(nametok.hash, start, bld, env);
+
+    zone.finish(); // NOTE: the rest of the package is parsed from here on
+    decl();        // TODO: maybe call this inside the `block`?
+}
+
+inline void parser::skip_func() noexcept
+{
+    // NOTE: the body is the first `{` outside of the parameters, as types have no braces
+    uint32_t depth = 0;
+    while (true)
+    {
+        auto const t = scan.next();
+        switch (t.kind)
+        {
+        case token_kind::LeftParen:
+        case token_kind::LeftBracket:
+        case token_kind::LeftBrace:
+            ++depth;
+            break;
+
+        case token_kind::RightParen:
+        case token_kind::RightBracket:
+            --depth;
+            break;
+
+        case token_kind::RightBrace:
+            if (--depth == 0)
+                return rule_sep<false>(); // ';' or <end-of-file>
+            break;
+
+        case token_kind::Eof:
+            fail(t, "Unexpected end of file in function", "");
+            return;
+
+        default:
+            break;
+        }
+    }
 }
 
 inline void parser::extern_func_decl() noexcept
@@ -345,6 +414,9 @@ inline void parser::decl() noexcept
         return type_decl<false>();
 
     case token_kind::Eof:
+        if (unit)
+            return; // NOTE: merged into the package afterwards, see `merge_unit`
+
         return codegen_main();
 
     default:
@@ -354,13 +426,29 @@ inline void parser::decl() noexcept
 
 inline void parser::package() noexcept
 {
+    stats_zone _{"parse"};
+
     // TODO: use the name of the package when exporting
     eat(token_kind::KwPackage);                  // 'package'
     auto const nametok = eat(token_kind::Ident); // <ident>
     eat(token_kind::Semicolon);                  // ';'
 
-    // TODO: is this correct?
     scope_visibility vis;
+    begin_package(vis);
+
+    // TODO: do you need a new scope here?
+    // (void)bld.new_func();
+
+    scope global;
+    env.top = &global;
+    import_builtin(env);
+
+    decl(); // decl*
+}
+
+inline void parser::begin_package(scope_visibility &vis) noexcept
+{
+    // TODO: is this correct?
     bld.push_vis<visibility::global>(vis);
 
     // TODO: correctly represent this
@@ -377,17 +465,173 @@ inline void parser::package() noexcept
 
     bld.reg.emplace<mem_effect>(bld.glob_mem);
     // TODO: read/write tag
+}
 
-    // TODO: do you need a new scope here?
-    // (void)bld.new_func();
-
-    scope global;
+inline void parser::unit_package(parser const &pkg, scope &global, scope_visibility &vis, import_map &imports) noexcept
+{
+    unit = true;
+    begin_package(vis);
     env.top = &global;
-    import_builtin(env);
+
+    // NOTE: the types are shared as they are, as nodes only point to them
+    auto const &pkg_types = *pkg.bld.reg.storage<node_type>();
+    auto const pkg_effects = pkg.bld.reg.storage<effect_of_func>();
+
+    for (auto &&[name, index] : pkg.env.top->table)
+    {
+        if (is_type(index))
+        {
+            env.new_type(name, pkg.env.get_type(index));
+            continue;
+        }
+
+        // NOTE: calls look at the effect of the function, so the `Import` of a function carries it too
+        auto const of = pkg.env.values[(uint32_t)index];
+        auto const n = bld.make(pkg_types.get(of).type, node_op::Import, {});
+        if (pkg_effects && pkg_effects->contains(of))
+            bld.reg.emplace<effect_of_func>(n, pkg_effects->get(of));
+
+        imports[n] = of;
+        env.new_value(name, n);
+    }
+
+    // NOTE: `load_package` checks that every file has the same package name
+    eat(token_kind::KwPackage); // 'package'
+    eat(token_kind::Ident);     // <ident>
+    eat(token_kind::Semicolon); // ';'
 
     decl(); // decl*
 }
 
+inline void parser::merge_unit(parser &u, import_map const &imports) noexcept
+{
+    auto &&from = u.bld.reg;
+    auto const &ops = from.storage<node_op>();
+    auto const &types = from.storage<node_type>();
+    auto const &ins = from.storage<node_inputs>();
+    auto const &ctrl = from.storage<ctrl_effect>();
+    auto const &mem = from.storage<mem_effect>();
+    auto const &reads = from.storage<mem_read>();
+    auto const &writes = from.storage<mem_write>();
+    auto const &errors = from.storage<error_node>();
+    auto const &regions = from.storage<region_of_phi>();
+    auto const &calls = from.storage<func_of_call>();
+    auto const &rets = from.storage<return_of_func>();
+    auto const &effects = from.storage<effect_of_func>();
+
+    constexpr visibility visibilities[]{
+        visibility::reachable,
+        visibility::global,
+        visibility::maybe_reachable,
+        visibility::unreachable,
+    };
+
+    // the file goes after everything parsed so far, so its first memory node comes after every memory node of the package
+    auto const ctrl_before = bld.state.ctrl;
+    auto const mem_before = bld.join_mem();
+
+    // NOTE: the entities are all created first, as a node can refer to any node after it
+    auto ids = imports;
+    ids[u.bld.pkg_mem] = bld.pkg_mem;
+    ids[u.bld.glob_mem] = bld.glob_mem;
+
+    std::vector<entt::entity> nodes;
+    for (auto [n, op] : ops.each())
+        if (!ids.contains(n))
+            nodes.push_back(n);
+
+    for (auto n : nodes)
+        ids[n] = bld.reg.create();
+
+    auto const id = [&](entt::entity n) -> entt::entity
+    {
+        if (n == entt::null)
+            return n;
+
+        auto iter = ids.find(n);
+        return iter != ids.end() ? iter->second : entt::null;
+    };
+
+    for (auto n : nodes)
+    {
+        auto const self = ids[n];
+        auto const op = ops.get(n);
+
+        bld.reg.emplace<node_op>(self, op);
+        bld.reg.emplace<node_type>(self, types.get(n).type);
+
+        auto const &n_ins = ins.get(n).nodes;
+        auto nins = smallvec<entt::entity>::gen(n_ins.n, [&](size_t in)
+                                                { return id(n_ins[in]); });
+        for (uint32_t in{}; in < nins.n; ++in)
+            if (nins[in] != entt::null)
+                bld.reg.get_or_emplace<users>(nins[in]).entries.push_back({self, in});
+        bld.reg.emplace<node_inputs>(self, std::move(nins));
+
+        if (ctrl.contains(n))
+        {
+            auto const target = ctrl.get(n).target;
+            bld.reg.emplace<ctrl_effect>(self, target == u.bld.pkg_mem ? ctrl_before : id(target));
+        }
+
+        // NOTE: `Start`s hang off `GlobalMemory`, with a slot after the ones of the package; the rest follows the package
+        if (mem.contains(n))
+        {
+            auto const &eff = mem.get(n);
+            auto const is_func = op == node_op::Start && eff.target == u.bld.glob_mem;
+            bld.reg.emplace<mem_effect>(self) = {
+                .prev = (eff.prev == u.bld.glob_mem && !is_func) ? mem_before : id(eff.prev),
+                .target = id(eff.target),
+                .tag = is_func ? eff.tag + bld.state.next_slot : eff.tag,
+            };
+        }
+
+        if (reads.contains(n))
+            bld.reg.emplace<mem_read>(self);
+        if (writes.contains(n))
+            bld.reg.emplace<mem_write>(self);
+        if (errors.contains(n))
+            bld.reg.emplace<error_node>(self);
+        if (effects.contains(n))
+            bld.reg.emplace<effect_of_func>(self, effects.get(n));
+
+        if (regions.contains(n))
+            bld.reg.emplace<region_of_phi>(self, id(regions.get(n).region));
+        if (calls.contains(n))
+            bld.reg.emplace<func_of_call>(self, id(calls.get(n).func));
+        if (rets.contains(n))
+            bld.reg.emplace<return_of_func>(self, id(rets.get(n).ret));
+
+        for (auto v : visibilities)
+            if (from.storage<void>((entt::id_type)v).contains(n))
+                bld.reg.storage<void>((entt::id_type)v).emplace(self);
+    }
+
+    // the global state goes on from where the file left it
+
+    if (u.bld.state.ctrl != u.bld.pkg_mem)
+        bld.state.ctrl = id(u.bld.state.ctrl);
+    if (u.bld.state.mem != u.bld.glob_mem)
+        bld.state.mem = id(u.bld.state.mem);
+
+    for (auto &&[root, chain] : u.bld.state.chains)
+        bld.state.chains[id(root)] = {.first = id(chain.first), .last = id(chain.last)};
+
+    bld.state.next_slot += u.bld.state.next_slot;
+
+    // NOTE: the globals of the package are in the file too, under the same name
+    for (auto &&[name, index] : u.env.top->table)
+    {
+        if (env.top->table.contains(name))
+            continue;
+
+        if (is_type(index))
+            env.new_type(name, u.env.get_type(index));
+        else
+            env.new_value(name, id(u.env.values[(uint32_t)index]));
+    }
+}
+
 // helper rules
 
 inline ::type const *parser::param_decl(int64_t i) noexcept
@@ -533,6 +777,9 @@ inline void parser::codegen_main() noexcept
     bld.reg.storage<mem_read>();
     bld.reg.storage<mem_write>();
     bld.reg.storage<region_of_phi>();
+    bld.reg.storage<func_of_call>();
+    bld.reg.storage<return_of_func>();
+    bld.reg.storage<effect_of_func>();
 
     using namespace entt::literals;
 
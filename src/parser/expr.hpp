@@ -87,9 +87,25 @@ inline expr_info parser::index(expr_info base) noexcept
 
     // TODO: is this correct? (consider mutability, generalizing `Load`, etc.)
     // TODO: error if node is not integer
+    // NOTE: a sized integer index is read through its bounds, so a constant one is still checked when typechecking
+    auto const ity = bld.reg.get<node_type>(i).type;
+    auto offset = ity->as<int_value>();
+    if (auto const sized = ity->as<sized_int_value>())
+        offset = int_value::make_range(sized->bounds());
+
+    // constant indices are checked when typechecking, the rest are checked at runtime
+    // TODO: check runtime-sized arrays and pointers too
+    auto index = i;
+    if (auto arr = bld.reg.get<node_type>(base.node).type->as<array_value>(); arr && offset && !offset->is_const())
+    {
+        auto const len = make(bld, value_node{int_value::make(arr->type->n_members)});
+        index = make(bld, checked_index_node{.index = i, .len = len});
+    }
+
     auto const node = make(bld, load_node{
                                     .base = base.node,
-                                    .offset = bld.reg.get<node_type>(i).type->as<int_value>(),
+                                    .offset = offset,
+                                    .index = index,
                                 });
 
     // TODO: inline CPS this
@@ -486,7 +502,7 @@ inline expr_info parser::type_expr_or_ident() noexcept
         else if (index != name_index::missing)
             return post_expr({
                 // TODO: is this correct?
-                .node = env.values[(uint32_t)index],
+                .node = read_value(nametok.hash, index),
                 .assign = nametok.hash, // TODO: is this correct?
             });
         // TODO: address this
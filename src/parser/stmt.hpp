@@ -208,15 +208,21 @@ inline entt::entity parser::if_stmt() noexcept
 
     bld.state.ctrl = if_yes_node;
 
+    // NOTE: each branch starts from the memory before the `if`, and both are merged at the `Region`
+    auto const mem_before = bld.save_mem();
+
     return block(
         [&](scope const *then_env, entt::entity then_ret)
         {
             auto const then_state = bld.state.ctrl; // TODO: link this to `region` instead
             bld.state.ctrl = if_not_node;
 
+            auto const then_mem = bld.save_mem();
+            bld.restore_mem(mem_before);
+
             if (scan.peek.kind == token_kind::KwElse)
             {
-                return else_branch(then_env, then_state, then_ret);
+                return else_branch(then_env, then_state, then_ret, mem_before, then_mem);
             }
             else
             {
@@ -227,6 +233,7 @@ inline entt::entity parser::if_stmt() noexcept
 
                 auto const region = make(bld, region_node{then_state, bld.state.ctrl});
                 merge(region, *env.top, *then_env, *env.top); // TODO: is this correct?
+                merge_mem(region, mem_before, then_mem);
 
                 // TODO: implement
                 // TODO: also merge `then_env` with `env.top` in this case
@@ -263,51 +270,56 @@ inline entt::entity parser::for_range_stmt() noexcept
     eat(token_kind::KwRange); // 'range'
     auto bound = expr().node; // expr
 
-    auto const loop = make(bld, loop_node{});
-
+    // NOTE: made before the loop, as they do not change between iterations
     // TODO: make sure `bound` is a positive integer expression; the `<` takes care of that but the error message can be better
     auto const counter = make(bld, value_node{int_value::make(0)});
     auto const one = make(bld, value_node{int_value::make(1)});
 
-    // TODO: figure out the exact value of this node
+    auto const entry = bld.state.ctrl;
+    loop_state ls{.loop = make(bld, loop_node{entry})};
+    open_loop(ls);
+
+    // the counter goes over [0, bound], the last value being the one that exits the loop
+    // NOTE: the `+ 1` only runs while `counter < bound`, so it never goes above `bound`
+    // TODO: handle sized integer bounds as well
+    // TODO: bind a name to the counter; inside the body it is in [0, bound - 1], which lets `eliminate_bounds_checks` drop `a[i]` checks
+    auto counter_type = sint_type{}.top(), counter_plus_one_type = sint_type{}.top();
+    if (auto bound_int = bld.reg.get<node_type>(bound).type->as<int_value>())
+    {
+        auto const hi = std::max<int64_t>(bound_int->bounds().hi, 0);
+        counter_type = int_value::make_range({0, hi});
+        counter_plus_one_type = int_value::make_range({std::min<int64_t>(1, hi), hi});
+    }
+
     entt::entity const counter_plus_one_args[]{counter, one};
-    auto const counter_plus_one = bld.make(sint_type{}.top(), node_op::Add, counter_plus_one_args);
+    auto const counter_plus_one = bld.make(counter_plus_one_type, node_op::Add, counter_plus_one_args);
 
+    // NOTE: the `Phi` inputs are [before the loop, end of the body], same as the `Loop`
     entt::entity const counter_phi_args[]{counter, counter_plus_one};
-    // TODO: figure out the type of this
-    auto const counter_phi = bld.make(sint_type{}.top(), node_op::Phi, counter_phi_args);
-    bld.reg.emplace<region_of_phi>(counter_phi, loop);
+    auto const counter_phi = bld.make(counter_type, node_op::Phi, counter_phi_args);
+    bld.reg.emplace<region_of_phi>(counter_phi, ls.loop);
 
-    bld.reg.get<node_inputs>(counter_plus_one).nodes[0] = counter_phi; // attach the Phi node to the `x + 1` node
+    entt::entity const plus_one_ins[]{counter_phi, one};
+    bld.set_inputs(counter_plus_one, plus_one_ins); // attach the Phi node to the `x + 1` node
 
     auto const cond = make(bld, lt_node{counter_phi, bound});
 
     // TODO: recheck the type of this
     auto const if_yes_node = bld.make(top_value::self(), node_op::IfYes, std::span(&cond, 1));
-    bld.reg.emplace<ctrl_effect>(if_yes_node, bld.state.ctrl);
+    bld.reg.emplace<ctrl_effect>(if_yes_node, ls.loop);
     bld.state.ctrl = if_yes_node;
 
-    auto const for_ret = block([&](scope const *loop_env, entt::entity ret)
-                               {
-                                   // TODO: implement
-                                   // TODO: drop this; `Loop` is the region node
-                                   //    auto const region = make(bld, region_node{loop, bld.state.ctrl});
-
-                                   // TODO: all this is common on both branches
-                                   // TODO: is this correct? (from here to return)
-                                   // TODO: pass the region here
-                                   // codegen
-                                   merge(loop, *env.top, *loop_env, *env.top);
+    (void)block([&](scope const *loop_env, entt::entity ret)
+                {
+                    close_loop(ls, entry, *loop_env);
+                    return ret; //
+                });
 
-                                   // TODO: generate the "loop-back" node
+    exit_loop(ls);
 
-                                   return ret; //
-                               });
-
-    bld.state.ctrl = loop;
     // TODO: recheck the type of this
     auto const rest_node = bld.make(top_value::self(), node_op::IfNot, std::span(&cond, 1));
-    bld.reg.emplace<ctrl_effect>(rest_node, bld.state.ctrl);
+    bld.reg.emplace<ctrl_effect>(rest_node, ls.loop);
     bld.state.ctrl = rest_node;
 
     auto const rest_ret = stmt(); // stmt
@@ -320,35 +332,30 @@ inline entt::entity parser::for_cond_stmt() noexcept
     // TODO: everything here is temporary, fix the problems eventually
     // TODO: make sure the condition is boolean-like
 
+    // NOTE: the condition is part of the loop, as it runs again before every iteration
+    auto const entry = bld.state.ctrl;
+    loop_state ls{.loop = make(bld, loop_node{entry})};
+    open_loop(ls);
+
     // parsing
     auto cond = expr().node; // expr
 
-    auto const loop = make(bld, loop_node{});
-
     // TODO: recheck the type of this
     auto const if_yes_node = bld.make(top_value::self(), node_op::IfYes, std::span(&cond, 1));
-    bld.reg.emplace<ctrl_effect>(if_yes_node, bld.state.ctrl);
+    bld.reg.emplace<ctrl_effect>(if_yes_node, ls.loop);
     bld.state.ctrl = if_yes_node;
 
-    auto const for_ret = block([&](scope const *loop_env, entt::entity ret)
-                               {
-                                   // TODO: implement
-                                   auto const region = make(bld, region_node{loop, bld.state.ctrl});
+    (void)block([&](scope const *loop_env, entt::entity ret)
+                {
+                    close_loop(ls, entry, *loop_env);
+                    return ret; //
+                });
 
-                                   // TODO: all this is common on both branches
-                                   // TODO: is this correct? (from here to return)
-                                   // codegen
-                                   merge(region, *env.top, *loop_env, *env.top);
+    exit_loop(ls);
 
-                                   // TODO: generate the "loop-back" node
-
-                                   return ret; //
-                               });
-
-    bld.state.ctrl = loop;
     // TODO: recheck the type of this
     auto const rest_node = bld.make(top_value::self(), node_op::IfNot, std::span(&cond, 1));
-    bld.reg.emplace<ctrl_effect>(rest_node, bld.state.ctrl);
+    bld.reg.emplace<ctrl_effect>(rest_node, ls.loop);
     bld.state.ctrl = rest_node;
 
     auto const rest_ret = stmt(); // stmt
@@ -417,9 +424,12 @@ inline entt::entity parser::return_stmt() noexcept
     // TODO: is this correct?
     while (defer_stack)
     {
-        bld.reg.get<mem_effect>(defer_stack->value).target = bld.state.mem;
-        // TODO: add read/write here
-        bld.state.mem = defer_stack->value;
+        // NOTE: pure calls are not part of the memory chain
+        if (auto mem = bld.reg.try_get<mem_effect>(defer_stack->value))
+        {
+            mem->target = bld.join_mem();
+            bld.state.mem = defer_stack->value;
+        }
 
         bld.reg.get<ctrl_effect>(defer_stack->value).target = bld.state.ctrl;
         bld.state.ctrl = defer_stack->value;
@@ -564,7 +574,8 @@ inline entt::entity parser::stmt() noexcept
 
 // helpers
 
-inline entt::entity parser::else_branch(scope const *then_env, entt::entity then_state, entt::entity then_ret) noexcept
+inline entt::entity parser::else_branch(scope const *then_env, entt::entity then_state, entt::entity then_ret,
+                                        builder::mem_state const &mem_before, builder::mem_state const &then_mem) noexcept
 {
     eat(token_kind::KwElse); // 'else'
 
@@ -590,6 +601,7 @@ inline entt::entity parser::else_branch(scope const *then_env, entt::entity then
         auto const else_ret = if_stmt();
 
         auto const region = make(bld, region_node{then_state, bld.state.ctrl});
+        merge_mem(region, mem_before, then_mem);
 
         // TODO: all this is common on both branches
         // TODO: is this correct? (from here to return)
@@ -615,6 +627,7 @@ inline entt::entity parser::else_branch(scope const *then_env, entt::entity then
                            // TODO: is this correct? (from here to return)
                            // codegen
                            merge(region, *env.top, *then_env, *else_env);
+                           merge_mem(region, mem_before, then_mem);
 
                            // TODO: if either `if` or `else` has a return, codegen a phi node and return it
                            // TODO: is this correct?
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <entt/container/dense_map.hpp>
+
+#include "backends/ir.hpp"
+#include "base.hpp"
+#include "parser/base.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define QUICKPROTO_SERVER 1
+#else
+#define QUICKPROTO_SERVER 0
+#endif
+
+// Compile server
+// `quickproto --serve <socket>` stays up and listens on a Unix domain socket; `quickproto --connect <socket> <args>...`
+// sends its arguments over and prints whatever the compiler writes, so a build system skips process startup
+// Every request runs in a child forked from the warm server, so a failing compile (which exits) never takes the server
+// down, and whatever the server has in memory is shared with the child at no cost:
+// - the built-in types, made before the first request
+// - the optimized graph of every package compiled so far (see `resident_graphs`); a child sends the graph it built
+// ^ back to the server, and the next request of an unchanged package loads it from memory instead of parsing it again
+
+// Protocol:
+// - request: working directory, then the arguments, each NUL-terminated, then an empty string
+// - response: everything the compile writes to stdout/stderr, then one byte with its exit code
+// - graph (child to server, over a pipe): the key of the package, then its graph as binary IR
+
+// TODO:
+// - serve requests concurrently; they are serialized for now so the output of the compiles does not interleave
+// - evict resident graphs; like the on-disk cache, they only grow for now
+// - keep the parsed (not yet optimized) graphs of files, so a change in one file of a package does not parse the rest again
+// - shut down after some idle time
+// - Windows support (named pipes instead of Unix sockets, and no `fork`)
+
+using compile_fn = int (*)(int argc, char **argv);
+
+// The graphs the compile server keeps in memory, keyed like `build_cache`
+// The server owns them; a child sees the ones made before it was forked, and sends the one it builds to `out`
+struct resident_graphs final
+{
+    struct graph final
+    {
+        std::vector<uint64_t> data; // NOTE: `uint64_t`s keep the arrays of the IR aligned
+        size_t size;
+    };
+
+    // whether this process is a child of the compile server
+    inline bool serving() const noexcept { return out >= 0; }
+
+    // The resident graph of `key`, if any
+    inline std::optional<ir_view> find(uint64_t key) const noexcept
+    {
+        auto iter = graphs.find(key);
+        if (iter == graphs.end())
+            return std::nullopt;
+
+        return ir_view::borrow(iter->second.data, iter->second.size);
+    }
+
+    // Send the graph of `reg` to the server as the one of `key`; does nothing outside the compile server
+    inline void store(uint64_t key, entt::registry const &reg) const noexcept
+    {
+#if QUICKPROTO_SERVER
+        if (!serving())
+            return;
+
+        // NOTE: `fclose` closes the descriptor too, so write through a copy of `out`
+        auto f = fdopen(dup(out), "wb");
+        if (!f)
+            return;
+
+        fwrite(&key, sizeof(key), 1, f);
+        ir_backend{}.compile(f, reg);
+        fclose(f);
+#else
+        (void)key;
+        (void)reg;
+#endif
+    }
+
+    entt::dense_map<uint64_t, graph> graphs;
+    int out = -1;
+};
+
+inline resident_graphs server_graphs;
+
+#if QUICKPROTO_SERVER
+
+namespace server_detail
+{
+    inline bool write_all(int fd, void const *data, size_t n) noexcept
+    {
+        auto bytes = (char const *)data;
+        while (n != 0)
+        {
+            auto const written = write(fd, bytes, n);
+            if (written <= 0)
+                return false;
+
+            bytes += written;
+            n -= (size_t)written;
+        }
+
+        return true;
+    }
+
+    inline bool socket_address(char const *path, sockaddr_un &addr) noexcept
+    {
+        addr = {};
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path))
+            return false;
+
+        strcpy(addr.sun_path, path);
+        return true;
+    }
+
+    // Read a request from `fd`; an empty vector if the client hung up early
+    inline std::vector<std::string> read_request(int fd) noexcept
+    {
+        std::vector<std::string> res(1);
+        char buf[4096];
+
+        while (true)
+        {
+            auto const n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+                return {};
+
+            for (ssize_t i{}; i < n; ++i)
+            {
+                if (buf[i] != '\0')
+                    res.back() += buf[i];
+                else if (res.back().empty())
+                {
+                    res.pop_back();
+                    return res;
+                }
+                else
+                    res.emplace_back();
+            }
+        }
+    }
+
+    // Read what a child sent over `fd` until it exits, and keep it as a resident graph
+    inline void receive_graph(int fd) noexcept
+    {
+        std::string bytes;
+        char buf[4096];
+
+        while (true)
+        {
+            auto const n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+
+            bytes.append(buf, (size_t)n);
+        }
+
+        uint64_t key;
+        if (bytes.size() <= sizeof(key))
+            return;
+
+        memcpy(&key, bytes.data(), sizeof(key));
+
+        auto const size = bytes.size() - sizeof(key);
+        resident_graphs::graph g{.data = std::vector<uint64_t>((size + 7) / 8), .size = size};
+        memcpy(g.data.data(), bytes.data() + sizeof(key), size);
+
+        // NOTE: checked once here, rather than by every child that loads it
+        if (ir_view::borrow(g.data, g.size))
+            server_graphs.graphs.insert_or_assign(key, std::move(g));
+    }
+
+    // Run one request on a child; return its exit code
+    inline int handle(int conn, std::vector<std::string> &request, compile_fn compile) noexcept
+    {
+        int graph[2];
+        if (pipe(graph) != 0)
+            return -1;
+
+        // NOTE: the child would write whatever is still buffered (eg. "Serving on ...") into the client's output
+        fflush(stdout);
+        fflush(stderr);
+
+        auto const child = fork();
+        if (child < 0)
+        {
+            close(graph[0]);
+            close(graph[1]);
+            return -1;
+        }
+
+        if (child == 0)
+        {
+            close(graph[0]);
+            // NOTE: a compiler spawned by the child (see `build_c_source`) would keep the pipe open otherwise
+            fcntl(graph[1], F_SETFD, FD_CLOEXEC);
+            server_graphs.out = graph[1];
+
+            dup2(conn, STDOUT_FILENO);
+            dup2(conn, STDERR_FILENO);
+            close(conn);
+
+            if (chdir(request[0].c_str()) != 0)
+                fail("Cannot enter the working directory of the client!");
+
+            // NOTE: `argv[0]` is the working directory, which only matters for the usage text
+            std::vector<char *> argv;
+            for (auto &arg : request)
+                argv.push_back(arg.data());
+            argv.push_back(nullptr);
+
+            auto const code = compile((int)argv.size() - 1, argv.data());
+            fflush(stdout);
+            fflush(stderr);
+            _exit(code);
+        }
+
+        // NOTE: read before waiting, so a child with a large graph does not block on a full pipe
+        close(graph[1]);
+        receive_graph(graph[0]);
+        close(graph[0]);
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+}
+
+// Listen on `path` and run every request with `compile`; only returns if the socket cannot be set up
+inline int serve(char const *path, compile_fn compile) noexcept
+{
+    sockaddr_un addr;
+    ensure(server_detail::socket_address(path, addr), "Socket path is too long!");
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ensure(fd >= 0, "Cannot create the server socket!");
+
+    // NOTE: a socket left behind by a server that crashed would make `bind` fail
+    unlink(path);
+    ensure(bind(fd, (sockaddr const *)&addr, sizeof(addr)) == 0, "Cannot bind the server socket!");
+    ensure(listen(fd, 64) == 0, "Cannot listen on the server socket!");
+
+    // NOTE: made once here, so no request pays for them
+    (void)builtin_types();
+
+    std::println("Serving on {}", path);
+
+    size_t served = 0;
+    while (true)
+    {
+        auto const conn = accept(fd, nullptr, nullptr);
+        if (conn < 0)
+            continue;
+
+        auto request = server_detail::read_request(conn);
+        if (!request.empty())
+        {
+            auto const code = (uint8_t)server_detail::handle(conn, request, compile);
+            (void)server_detail::write_all(conn, &code, 1);
+            ++served;
+        }
+
+        close(conn);
+    }
+
+    // unreachable for now, see the TODO on shutting down
+    std::println("Served {} request(s)", served);
+    close(fd);
+    unlink(path);
+    return 0;
+}
+
+// Send `argv` to the server on `path` and print its output; return the exit code of the compile
+inline int connect_server(char const *path, int argc, char **argv) noexcept
+{
+    sockaddr_un addr;
+    ensure(server_detail::socket_address(path, addr), "Socket path is too long!");
+
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ensure(fd >= 0, "Cannot create the client socket!");
+    ensure(connect(fd, (sockaddr const *)&addr, sizeof(addr)) == 0, "Cannot reach the compile server!");
+
+    char cwd[4096];
+    ensure(getcwd(cwd, sizeof(cwd)), "Cannot read the working directory!");
+
+    std::string request{cwd, strlen(cwd) + 1};
+    for (int i{}; i < argc; ++i)
+    {
+        ensure(argv[i][0] != '\0', "Empty arguments cannot be sent to the server!");
+        request.append(argv[i], strlen(argv[i]) + 1);
+    }
+    request += '\0';
+
+    ensure(server_detail::write_all(fd, request.data(), request.size()), "Cannot send the request to the server!");
+
+    // NOTE: the last byte is the exit code, so every chunk is printed one byte late
+    char buf[4096];
+    int last = -1;
+    while (true)
+    {
+        auto const n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+
+        if (last != -1)
+            fputc(last, stdout);
+
+        fwrite(buf, 1, (size_t)n - 1, stdout);
+        last = (uint8_t)buf[n - 1];
+    }
+
+    close(fd);
+    ensure(last != -1, "The compile server hung up!");
+    return last;
+}
+
+#else
+
+inline int serve(char const *, compile_fn) noexcept
+{
+    fail("The compile server is not supported on this platform yet!");
+    return -1;
+}
+
+inline int connect_server(char const *, int, char **) noexcept
+{
+    fail("The compile server is not supported on this platform yet!");
+    return -1;
+}
+
+#endif
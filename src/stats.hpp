@@ -0,0 +1,266 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <print>
+#include <string_view>
+#include <vector>
+
+#include <entt/entity/registry.hpp>
+
+#include "nodes.hpp"
+#include "trace.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Compile statistics (`--stats`)
+// Wall and CPU time per phase of the compiler, the shape of the final graph, peak memory and allocations
+// Phases are `stats_zone`s; they nest, and a zone entered many times (eg. DCE, once per function) adds up into one entry
+
+// TODO:
+// - CPU time of the calling thread only; `std::clock` counts every thread of the process, so the parallel phases show more CPU than wall time
+// - allocated bytes, not only the count of allocations (needs sized `operator delete` to track live bytes too)
+// - nodes per function, to find the ones that blow up after inlining
+
+// allocations made through `operator new` and frees through `operator delete`, counted in main.cpp
+inline std::atomic<size_t> stats_allocs = 0;
+inline std::atomic<size_t> stats_frees = 0;
+
+struct phase_stats final
+{
+    std::string_view name;
+    uint32_t depth;    // how many zones this one is nested in
+    size_t calls = 0;  // how many times the zone was entered
+    double wall = 0.0; // milliseconds
+    double cpu = 0.0;  // milliseconds
+    size_t allocs = 0;
+};
+
+// one pass of the pipeline (`--passes`), over every time it ran
+struct pass_stats final
+{
+    std::string_view name;
+    size_t runs = 0;        // more than once in a fixed-point group
+    size_t changes = 0;     // as reported by the pass, eg. calls inlined or nodes merged
+    int64_t node_delta = 0; // nodes after minus nodes before
+    double wall = 0.0;      // milliseconds
+    size_t cancelled = 0;   // runs cut short by the time budget (`--budget`)
+};
+
+struct compile_stats final
+{
+    // Find the entry of `name`, or add it last
+    inline phase_stats &phase(std::string_view name) noexcept
+    {
+        for (auto &p : phases)
+            if (p.name == name)
+                return p;
+
+        return phases.emplace_back(phase_stats{.name = name, .depth = depth});
+    }
+
+    // Find the entry of the pass `name`, or add it last
+    inline pass_stats &pass(std::string_view name) noexcept
+    {
+        for (auto &p : passes)
+            if (p.name == name)
+                return p;
+
+        return passes.emplace_back(pass_stats{.name = name});
+    }
+
+    std::vector<phase_stats> phases; // in the order they were first entered
+    std::vector<pass_stats> passes;  // in the order they first ran
+    uint32_t depth = 0;
+};
+
+// the statistics being collected, if any
+// NOTE: per thread, so the zones entered on worker threads (eg. while parsing the files of a package) are left out
+inline thread_local compile_stats *active_stats = nullptr;
+
+// Time the enclosing scope as the phase `name`; does nothing unless `--stats` was given
+// ^ phases also show up in traces (`--trace`)
+struct stats_zone final
+{
+    using clock = std::chrono::steady_clock;
+
+    inline explicit stats_zone(std::string_view name) noexcept
+        : trace{name}, stats{active_stats}
+    {
+        if (!stats)
+            return;
+
+        // NOTE: found before timing, so the lookup is not counted
+        index = &stats->phase(name) - stats->phases.data();
+        ++stats->depth;
+
+        allocs = stats_allocs.load(std::memory_order_relaxed);
+        cpu = std::clock();
+        wall = clock::now();
+    }
+
+    stats_zone(stats_zone const &) = delete;
+    stats_zone &operator=(stats_zone const &) = delete;
+
+    inline ~stats_zone() noexcept
+    {
+        if (!stats)
+            return;
+
+        auto const wall_end = clock::now();
+        auto const cpu_end = std::clock();
+
+        // NOTE: by index, as nested zones may add phases and move the vector
+        auto &p = stats->phases[index];
+        ++p.calls;
+        p.wall += std::chrono::duration<double, std::milli>(wall_end - wall).count();
+        p.cpu += 1000.0 * double(cpu_end - cpu) / CLOCKS_PER_SEC;
+        p.allocs += stats_allocs.load(std::memory_order_relaxed) - allocs;
+
+        --stats->depth;
+    }
+
+    trace_zone trace;
+    compile_stats *stats;
+    size_t index = 0;
+    size_t allocs = 0;
+    std::clock_t cpu = 0;
+    clock::time_point wall;
+};
+
+inline constexpr std::string_view node_op_names[]{
+    "Program", "GlobalMemory", "Start",
+    "Load", "Store", "Proj", "Alloca", "Return", "Exit",
+    "IfYes", "IfNot", "Loop", "Region", "Phi",
+    "UnaryCompl", "UnaryNeg", "UnaryNot",
+    "Add", "Sub", "Mul", "Div",
+    "LogicAnd", "LogicOr",
+    "BitAnd", "BitXor", "BitOr",
+    "ShiftLeft", "ShiftRight",
+    "Fadd", "Fsub", "Fmul", "Fdiv",
+    "CmpEq", "CmpNe", "CmpLt", "CmpLe", "CmpGt", "CmpGe",
+    "CallStatic", "ExternCall",
+    "Cast",
+    "Deref", "Addr",
+    "IConst", "FConst", "SConst", "BConst", "Struct",
+    "Error",
+    "CheckedIndex",
+    "VecSplat", "VecLoad", "VecAdd", "VecSub", "VecMul", "VecReduce",
+    "Import",
+};
+
+static_assert(std::size(node_op_names) == size_t(node_op::Import) + 1, "Name every `node_op`!");
+
+// the shape of a graph
+struct graph_stats final
+{
+    std::array<size_t, std::size(node_op_names)> per_op{};
+    size_t nodes = 0;
+    size_t data_edges = 0; // `node_inputs`
+    size_t ctrl_edges = 0; // `ctrl_effect`
+    size_t mem_edges = 0;  // `mem_effect`, both the previous state and the target
+};
+
+inline graph_stats count_graph(entt::registry const &reg) noexcept
+{
+    graph_stats res;
+
+    if (auto const ops = reg.storage<node_op>())
+        for (auto [id, op] : ops->each())
+        {
+            ++res.nodes;
+            ++res.per_op[size_t(op)];
+        }
+
+    if (auto const ins = reg.storage<node_inputs>())
+        for (auto [id, in] : ins->each())
+            res.data_edges += in.nodes.n;
+
+    if (auto const ctrl = reg.storage<ctrl_effect>())
+        res.ctrl_edges = ctrl->size();
+
+    if (auto const mem = reg.storage<mem_effect>())
+        for (auto [id, eff] : mem->each())
+            res.mem_edges += (eff.prev != entt::null) + (eff.target != entt::null);
+
+    return res;
+}
+
+// Peak resident memory of the process in KiB; 0 if unknown
+inline size_t peak_rss_kib() noexcept
+{
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#if defined(__APPLE__)
+    return size_t(usage.ru_maxrss) / 1024; // bytes on macOS
+#else
+    return size_t(usage.ru_maxrss);
+#endif
+#else
+    // TODO: `GetProcessMemoryInfo` on Windows
+    return 0;
+#endif
+}
+
+inline void print_stats(FILE *out, compile_stats const &stats, graph_stats const &graph) noexcept
+{
+    std::println(out, "{:<24} {:>8} {:>12} {:>12} {:>10}", "phase", "calls", "wall (ms)", "cpu (ms)", "allocs");
+    for (auto const &p : stats.phases)
+    {
+        // NOTE: nested phases are indented; their time is part of the phase above too
+        auto const indent = 2 * p.depth;
+        std::println(out, "{:{}}{:<{}} {:>8} {:>12.3f} {:>12.3f} {:>10}",
+                     "", indent, p.name, 24 - indent, p.calls, p.wall, p.cpu, p.allocs);
+    }
+
+    if (!stats.passes.empty())
+    {
+        std::println(out, "\n{:<24} {:>8} {:>12} {:>12} {:>10} {:>10}", "pass", "runs", "wall (ms)", "changes", "nodes", "cancelled");
+        for (auto const &p : stats.passes)
+            std::println(out, "{:<24} {:>8} {:>12.3f} {:>12} {:>+10} {:>10}", p.name, p.runs, p.wall, p.changes, p.node_delta, p.cancelled);
+    }
+
+    std::println(out, "\nnodes: {} ({} data, {} ctrl, {} mem edges)", graph.nodes, graph.data_edges, graph.ctrl_edges, graph.mem_edges);
+    for (size_t i{}; i < graph.per_op.size(); ++i)
+        if (graph.per_op[i] != 0)
+            std::println(out, "  {:<22} {:>10}", node_op_names[i], graph.per_op[i]);
+
+    std::println(out, "\npeak rss: {} KiB", peak_rss_kib());
+    std::println(out, "allocations: {} ({} freed)", stats_allocs.load(std::memory_order_relaxed), stats_frees.load(std::memory_order_relaxed));
+}
+
+inline void write_stats_json(FILE *out, compile_stats const &stats, graph_stats const &graph) noexcept
+{
+    // NOTE: every name written here is an identifier, so nothing needs escaping
+    std::print(out, "{{\n  \"phases\": [");
+    for (size_t i{}; i < stats.phases.size(); ++i)
+    {
+        auto const &p = stats.phases[i];
+        std::print(out, "{}\n    {{\"name\": \"{}\", \"depth\": {}, \"calls\": {}, \"wall_ms\": {:.3f}, \"cpu_ms\": {:.3f}, \"allocs\": {}}}",
+                   i == 0 ? "" : ",", p.name, p.depth, p.calls, p.wall, p.cpu, p.allocs);
+    }
+
+    std::print(out, "\n  ],\n  \"passes\": [");
+    for (size_t i{}; i < stats.passes.size(); ++i)
+    {
+        auto const &p = stats.passes[i];
+        std::print(out, "{}\n    {{\"name\": \"{}\", \"runs\": {}, \"wall_ms\": {:.3f}, \"changes\": {}, \"node_delta\": {}, \"cancelled\": {}}}",
+                   i == 0 ? "" : ",", p.name, p.runs, p.wall, p.changes, p.node_delta, p.cancelled);
+    }
+
+    std::print(out, "\n  ],\n  \"nodes\": {{\"total\": {}", graph.nodes);
+    for (size_t i{}; i < graph.per_op.size(); ++i)
+        if (graph.per_op[i] != 0)
+            std::print(out, ", \"{}\": {}", node_op_names[i], graph.per_op[i]);
+
+    std::println(out, "}},\n  \"edges\": {{\"data\": {}, \"ctrl\": {}, \"mem\": {}}},", graph.data_edges, graph.ctrl_edges, graph.mem_edges);
+    std::println(out, "  \"peak_rss_kib\": {},\n  \"allocs\": {},\n  \"frees\": {}\n}}",
+                 peak_rss_kib(), stats_allocs.load(std::memory_order_relaxed), stats_frees.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Tracing (`--trace <json-name>`)
+// Scoped zones record a begin/end pair into a ring buffer of the thread they run on; on exit every buffer is written out
+// in the Chrome trace-event format, which chrome://tracing and Perfetto (ui.perfetto.dev) open as a timeline
+// When tracing is off a zone costs one relaxed load and a branch
+
+// TODO:
+// - counters (eg. live nodes over time) as `"ph": "C"` events
+// - flow events between a zone and the zones it hands work to on other threads
+// - write the buffers out while compiling, for traces that do not fit in the rings
+
+inline std::atomic<bool> trace_enabled = false;
+
+struct trace_event final
+{
+    std::string_view name;   // static, eg. the name of the phase
+    std::string_view detail; // optional, eg. the name of the function; must outlive the trace
+    uint64_t begin;          // nanoseconds since `trace_detail::epoch`
+    uint64_t end;
+};
+
+// the events of one thread; the oldest are overwritten once full
+struct trace_buffer final
+{
+    static constexpr size_t capacity = size_t(1) << 16;
+
+    inline void push(trace_event const &e) noexcept { events[n++ & (capacity - 1)] = e; }
+
+    std::unique_ptr<trace_event[]> events{new trace_event[capacity]};
+    size_t n = 0; // events ever pushed
+    uint32_t tid;
+};
+
+namespace trace_detail
+{
+    inline auto const epoch = std::chrono::steady_clock::now();
+
+    // every buffer ever made; they outlive their threads, so nothing is lost when a worker exits
+    inline std::mutex buffers_mutex;
+    inline std::vector<std::unique_ptr<trace_buffer>> buffers;
+
+    inline thread_local trace_buffer *local = nullptr;
+
+    inline uint64_t now() noexcept
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    inline trace_buffer &buffer() noexcept
+    {
+        if (!local) [[unlikely]]
+        {
+            std::lock_guard _{buffers_mutex};
+
+            auto &b = buffers.emplace_back(new trace_buffer);
+            b->tid = (uint32_t)buffers.size();
+            local = b.get();
+        }
+
+        return *local;
+    }
+}
+
+// Record the enclosing scope as the zone `name`
+struct trace_zone final
+{
+    inline explicit trace_zone(std::string_view name, std::string_view detail = {}) noexcept
+    {
+        if (!trace_enabled.load(std::memory_order_relaxed)) [[likely]]
+            return;
+
+        event = {.name = name, .detail = detail, .begin = trace_detail::now()};
+        active = true;
+    }
+
+    trace_zone(trace_zone const &) = delete;
+    trace_zone &operator=(trace_zone const &) = delete;
+
+    inline ~trace_zone() noexcept { finish(); }
+
+    // End the zone before the end of the scope, eg. before a tail call into the next declaration
+    inline void finish() noexcept
+    {
+        if (!active) [[likely]]
+            return;
+
+        event.end = trace_detail::now();
+        trace_detail::buffer().push(event);
+        active = false;
+    }
+
+    trace_event event;
+    bool active = false;
+};
+
+// Write every recorded event as a Chrome trace; only call once the traced threads are done
+inline void write_trace(FILE *out) noexcept
+{
+    std::lock_guard _{trace_detail::buffers_mutex};
+
+    std::print(out, "{{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+
+    auto first = true;
+    auto const sep = [&] { return std::exchange(first, false) ? "\n  " : ",\n  "; };
+
+    for (auto const &b : trace_detail::buffers)
+    {
+        std::print(out, "{}{{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": {}, \"args\": {{\"name\": \"thread {}\"}}}}",
+                   sep(), b->tid, b->tid);
+
+        // NOTE: if the ring wrapped around, the oldest event left is the one after the newest
+        auto const n = std::min(b->n, trace_buffer::capacity);
+        for (size_t i = b->n - n; i < b->n; ++i)
+        {
+            auto const &e = b->events[i & (trace_buffer::capacity - 1)];
+
+            // NOTE: timestamps are in microseconds; names are identifiers, so nothing needs escaping
+            std::print(out, "{}{{\"ph\": \"X\", \"name\": \"{}\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}",
+                       sep(), e.name, b->tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+
+            if (!e.detail.empty())
+                std::print(out, ", \"args\": {{\"name\": \"{}\"}}", e.detail);
+
+            std::print(out, "}}");
+        }
+    }
+
+    std::println(out, "\n]}}");
+}
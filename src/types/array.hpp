@@ -70,7 +70,8 @@ struct array_value final : composite_value
         if (auto int_i = i->as<int_value>())
         {
             // TODO: handle the runtime-sized array case
-            if (auto c_i = int_i->as<int_const>(); c_i->n >= type->n_members)
+            // NOTE: runtime indices are checked by a `CheckedIndex` node instead
+            if (auto c_i = int_i->as<int_const>(); c_i && c_i->n >= type->n_members)
                 return new out_of_bounds{type, c_i};
 
             // TODO: return the actual value, if known
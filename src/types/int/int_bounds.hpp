@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+// TODO:
+// - known-bits (known zeros/ones masks) next to the bounds, for better `&`/`|`/`^` results
+// - unsigned 64-bit values above `int64` max are treated as unknown for now
+
+// [lo, hi] bounds of an integer value, both inclusive
+// NOTE: the bounds are always signed 64-bit; the full range means nothing is known about the value
+struct int_bounds final
+{
+    static constexpr int64_t min = std::numeric_limits<int64_t>::min();
+    static constexpr int64_t max = std::numeric_limits<int64_t>::max();
+
+    inline static constexpr int_bounds full() noexcept { return {min, max}; }
+
+    constexpr bool is_full() const noexcept { return lo == min && hi == max; }
+    constexpr bool is_single() const noexcept { return lo == hi; }
+
+    constexpr bool operator==(int_bounds const &) const noexcept = default;
+
+    int64_t lo, hi;
+};
+
+// checked arithmetic, returns false on overflow
+
+constexpr bool checked_add(int64_t a, int64_t b, int64_t &out) noexcept
+{
+    if ((b > 0 && a > int_bounds::max - b) || (b < 0 && a < int_bounds::min - b))
+        return false;
+
+    out = a + b;
+    return true;
+}
+
+constexpr bool checked_sub(int64_t a, int64_t b, int64_t &out) noexcept
+{
+    if ((b < 0 && a > int_bounds::max + b) || (b > 0 && a < int_bounds::min + b))
+        return false;
+
+    out = a - b;
+    return true;
+}
+
+constexpr bool checked_mul(int64_t a, int64_t b, int64_t &out) noexcept
+{
+    constexpr auto min = int_bounds::min, max = int_bounds::max;
+
+    if (a > 0 ? (b > 0 ? a > max / b : b < min / a)
+              : (b > 0 ? a < min / b : a != 0 && b < max / a))
+        return false;
+
+    out = a * b;
+    return true;
+}
+
+// range arithmetic; any overflow gives out the full range
+
+constexpr int_bounds range_add(int_bounds a, int_bounds b) noexcept
+{
+    int_bounds r;
+    return (checked_add(a.lo, b.lo, r.lo) && checked_add(a.hi, b.hi, r.hi)) ? r : int_bounds::full();
+}
+
+constexpr int_bounds range_sub(int_bounds a, int_bounds b) noexcept
+{
+    int_bounds r;
+    return (checked_sub(a.lo, b.hi, r.lo) && checked_sub(a.hi, b.lo, r.hi)) ? r : int_bounds::full();
+}
+
+constexpr int_bounds range_mul(int_bounds a, int_bounds b) noexcept
+{
+    int64_t p[4];
+    if (!checked_mul(a.lo, b.lo, p[0]) || !checked_mul(a.lo, b.hi, p[1]) ||
+        !checked_mul(a.hi, b.lo, p[2]) || !checked_mul(a.hi, b.hi, p[3]))
+        return int_bounds::full();
+
+    auto const [lo, hi] = std::minmax({p[0], p[1], p[2], p[3]});
+    return {lo, hi};
+}
+
+constexpr int_bounds range_div(int_bounds a, int_bounds b) noexcept
+{
+    // TODO: handle negative operands
+    if (a.lo < 0 || b.lo <= 0)
+        return int_bounds::full();
+
+    return {a.lo / b.hi, a.hi / b.lo};
+}
+
+// x & mask is never above a non-negative mask
+constexpr int_bounds range_band(int_bounds a, int_bounds b) noexcept
+{
+    if (a.lo >= 0 && b.lo >= 0)
+        return {0, std::min(a.hi, b.hi)};
+    if (a.lo >= 0)
+        return {0, a.hi};
+    if (b.lo >= 0)
+        return {0, b.hi};
+
+    return int_bounds::full();
+}
+
+// for non-negative operands, `|` and `^` never set a bit above the highest bit of either side
+constexpr int_bounds range_bor(int_bounds a, int_bounds b) noexcept
+{
+    if (a.lo < 0 || b.lo < 0)
+        return int_bounds::full();
+
+    auto const top_bits = std::bit_width((uint64_t)std::max(a.hi, b.hi));
+    return {std::max(a.lo, b.lo), (int64_t)((uint64_t(1) << top_bits) - 1)};
+}
+
+constexpr int_bounds range_bxor(int_bounds a, int_bounds b) noexcept
+{
+    auto const r = range_bor(a, b);
+    return r.is_full() ? r : int_bounds{0, r.hi};
+}
+
+// x << k == x * 2^k
+constexpr int_bounds range_lsh(int_bounds a, int_bounds b) noexcept
+{
+    if (b.lo < 0 || b.hi > 62)
+        return int_bounds::full();
+
+    return range_mul(a, {int64_t(1) << b.lo, int64_t(1) << b.hi});
+}
+
+constexpr int_bounds range_rsh(int_bounds a, int_bounds b) noexcept
+{
+    // TODO: handle negative operands; constants are shifted as signed
+    if (a.lo < 0 || b.lo < 0 || b.hi > 63)
+        return int_bounds::full();
+
+    return {a.lo >> b.hi, a.hi >> b.lo};
+}
+
+constexpr int_bounds range_neg(int_bounds a) noexcept
+{
+    int_bounds r;
+    return (checked_sub(0, a.hi, r.lo) && checked_sub(0, a.lo, r.hi)) ? r : int_bounds::full();
+}
+
+constexpr int_bounds range_compl(int_bounds a) noexcept { return {~a.hi, ~a.lo}; }
+
+// aka. `join`, the smallest range containing both
+constexpr int_bounds range_phi(int_bounds a, int_bounds b) noexcept
+{
+    return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+// range comparisons; `nullopt` if the result depends on the runtime value
+
+constexpr std::optional<bool> range_eq(int_bounds a, int_bounds b) noexcept
+{
+    if (a.is_single() && b.is_single() && a.lo == b.lo)
+        return true;
+    if (a.hi < b.lo || b.hi < a.lo)
+        return false;
+
+    return std::nullopt;
+}
+
+constexpr std::optional<bool> range_lt(int_bounds a, int_bounds b) noexcept
+{
+    if (a.hi < b.lo)
+        return true;
+    if (a.lo >= b.hi)
+        return false;
+
+    return std::nullopt;
+}
+
+// Do the bounds fit in `T`? Bounds outside of it mean that the value wrapped around
+template <std::integral T>
+constexpr bool fits_in(int_bounds b) noexcept
+{
+    constexpr auto tmin = (int64_t)std::numeric_limits<T>::min();
+    // NOTE: values of `uint64` above `int64` max cannot be represented by the bounds
+    constexpr auto tmax = (uint64_t)std::numeric_limits<T>::max() > (uint64_t)int_bounds::max
+                              ? int_bounds::max
+                              : (int64_t)std::numeric_limits<T>::max();
+
+    return b.lo >= tmin && b.hi <= tmax;
+}
@@ -6,6 +6,7 @@
 
 #include "types/covariant_helper.hpp"
 #include "types/float.hpp"
+#include "types/int/int_bounds.hpp"
 #include "types/int/sized_int.hpp"
 
 // HACK: do something better
@@ -23,11 +24,18 @@ struct int_value : covariant_helper<int_value>
     // TODO: cache the constants (do you have to?)
     inline static int_value *make(uint64_t n) noexcept;
     inline static int_value const *bot() noexcept;
+    // constant if `b` is a single value, top if `b` is the full range
+    inline static int_value const *make_range(int_bounds b) noexcept;
 
     inline static void operator delete(int_value *val, std::destroying_delete_t) noexcept;
 
     constexpr bool is_const() const noexcept final { return level == 1; }
 
+    // the values this can hold at runtime; the full range for top and bot
+    constexpr int_bounds bounds() const noexcept;
+
+    inline value const *cast(type const *target) const noexcept final;
+
     constexpr int_value const *bcompl() const noexcept final;
     constexpr int_value const *neg() const noexcept final;
 
@@ -55,7 +63,7 @@ protected:
     explicit constexpr int_value(uint8_t level) : level{level} {}
 
 private:
-    uint8_t level; // top, const or bot
+    uint8_t level; // top, const, bot or range
 };
 
 // TODO: rename this
@@ -76,42 +84,6 @@ struct int_const final : int_value
 {
     explicit constexpr int_const(uint64_t n) noexcept : int_value{1}, n{n} {}
 
-    inline value const *cast(type const *target) const noexcept
-    {
-        if (target->as<float64_type>())
-            return new float64{(double)n};
-        else if (target->as<sint_type>())
-            return this;
-            // intN
-        else if (target->as<sized_int_type<int8_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<int8_t>();
-        else if (target->as<sized_int_type<int16_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<int16_t>();
-                else if (target->as<sized_int_type<int32_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<int32_t>();
-        else if (target->as<sized_int_type<int64_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<int64_t>();
-            // uintN
-        else if (target->as<sized_int_type<uint8_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<uint8_t>();
-        else if (target->as<sized_int_type<uint16_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<uint16_t>();
-                else if (target->as<sized_int_type<uint32_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<uint32_t>();
-        else if (target->as<sized_int_type<uint64_t>>())
-            // HACK: propagate const-ness if possible
-            return new sized_int_top<uint64_t>();
-        else
-            return new invalid_cast{this, target};
-    }
-
     uint64_t n;
 };
 
@@ -120,6 +92,15 @@ struct int_bot final : int_value
     constexpr int_bot() : int_value{2} {}
 };
 
+// a runtime value in [lo, hi]
+// NOTE: never a single value nor the full range, use `int_value::make_range` to create these
+struct int_range final : int_value
+{
+    explicit constexpr int_range(int_bounds b) noexcept : int_value{3}, b{b} {}
+
+    int_bounds b;
+};
+
 inline value const *sint_type::zero() const noexcept { return int_value::make(0); }
 
 inline int_value const *int_value::top() noexcept
@@ -145,6 +126,51 @@ inline int_value const *int_value::bot() noexcept
     return &bot;
 }
 
+inline int_value const *int_value::make_range(int_bounds b) noexcept
+{
+    if (b.is_full())
+        return int_value::top();
+    if (b.is_single())
+        return int_value::make((uint64_t)b.lo);
+
+    return new int_range{b};
+}
+
+constexpr int_bounds int_value::bounds() const noexcept
+{
+    switch (level)
+    {
+    case 1:
+        return {(int64_t) static_cast<int_const const *>(this)->n, (int64_t) static_cast<int_const const *>(this)->n};
+    case 3:
+        return static_cast<int_range const *>(this)->b;
+    default:
+        return int_bounds::full();
+    }
+}
+
+inline value const *int_value::cast(type const *target) const noexcept
+{
+    if (target->as<sint_type>())
+        return this;
+    else if (target->as<float64_type>())
+        return is_const() ? new float64{(double)static_cast<int_const const *>(this)->n} : target->top();
+    // NOTE: values that do not fit in the target type are only known at runtime
+    else if (auto res = cast_to_sized<int8_t, int16_t, int32_t, int64_t,
+                                      uint8_t, uint16_t, uint32_t, uint64_t>(bounds(), target))
+        return res;
+    else
+        return new invalid_cast{this, target};
+}
+
+inline std::optional<int_bounds> literal_bounds(value const *val) noexcept
+{
+    if (auto i = val->as<int_value>())
+        return i->bounds();
+
+    return std::nullopt;
+}
+
 inline void int_value::operator delete(int_value *val, std::destroying_delete_t) noexcept
 {
     switch (val->level)
@@ -164,89 +190,85 @@ inline void int_value::operator delete(int_value *val, std::destroying_delete_t)
         ::operator delete(val, sizeof(int_bot));
         break;
 
+    case 3:
+        static_cast<int_range *>(val)->~int_range();
+        ::operator delete(val, sizeof(int_range));
+        break;
+
     default:
         std::unreachable();
     }
 }
 
 #define int_op(op, lhs, rhs) \
-    int_value::make(static_cast<int_const const *>(this)->n op static_cast<int_const const *>(rhs)->n)
-
-#define int_cmp_op(op, lhs, rhs) \
-    bool_const::make(static_cast<int_const const *>(this)->n op static_cast<int_const const *>(rhs)->n)
+    int_value::make(static_cast<int_const const *>(lhs)->n op static_cast<int_const const *>(rhs)->n)
 
 #define iadd(lhs, rhs) int_op(+, lhs, rhs)
 #define isub(lhs, rhs) int_op(-, lhs, rhs)
 #define imul(lhs, rhs) int_op(*, lhs, rhs)
-#define idiv(lhs, rhs) int_op(/, lhs, rhs)
 #define iband(lhs, rhs) int_op(&, lhs, rhs)
 #define ibor(lhs, rhs) int_op(|, lhs, rhs)
 #define ixor(lhs, rhs) int_op(^, lhs, rhs)
-#define ilsh(lhs, rhs) int_op(<<, lhs, rhs)
-#define irsh(lhs, rhs) int_op(>>, lhs, rhs)
-#define ine(lhs, rhs) int_cmp_op(+, lhs, rhs)
-#define ieq(lhs, rhs) int_cmp_op(+, lhs, rhs)
-#define ilt(lhs, rhs) int_cmp_op(+, lhs, rhs)
-#define ile(lhs, rhs) int_cmp_op(+, lhs, rhs)
-#define igt(lhs, rhs) int_cmp_op(+, lhs, rhs)
-#define ige(lhs, rhs) int_cmp_op(+, lhs, rhs)
-
-#define iphi(lhs, rhs) [](auto l, auto r) { return (l->n == r->n) ? (int_value const *)l : int_value::top(); }(static_cast<int_const const *>(lhs), static_cast<int_const const *>(rhs))
-
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, add, iadd);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, sub, isub);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, mul, imul);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, div, idiv);
-
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, band, iband);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, bor, ibor);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, bxor, ixor);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, lsh, ilsh);
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, rsh, irsh);
 
+// NOTE: the constants are signed, same as the comparisons and the runtime, so `/` and `>>` cannot work on `n` as it is
+#define int_sop(op, lhs, rhs) \
+    int_value::make((uint64_t)((int64_t)static_cast<int_const const *>(lhs)->n op (int64_t)static_cast<int_const const *>(rhs)->n))
+
+// NOTE: these are not folded when the result is undefined, so they trap/misbehave at runtime as they should
+// NOTE: `min / -1` overflows, so it wraps around to `min` as it does at runtime
+#define idiv(lhs, rhs) (static_cast<int_const const *>(rhs)->n == 0      ? int_value::top()                                            \
+                        : static_cast<int_const const *>(rhs)->n == ~0ull ? int_value::make(0 - static_cast<int_const const *>(lhs)->n) \
+                                                                          : int_sop(/, lhs, rhs))
+#define ilsh(lhs, rhs) (static_cast<int_const const *>(rhs)->n >= 64 ? int_value::top() : int_op(<<, lhs, rhs))
+#define irsh(lhs, rhs) (static_cast<int_const const *>(rhs)->n >= 64 ? int_value::top() : int_sop(>>, lhs, rhs))
+
+#define iphi(lhs, rhs) [](auto l, auto r) { return (l->n == r->n) ? (int_value const *)l : int_value::make_range(range_phi(l->bounds(), r->bounds())); }(static_cast<int_const const *>(lhs), static_cast<int_const const *>(rhs))
+
+// Same as `GENERATE_BINARY_JUMP_TABLE`, but non-constant operands give out a range instead of top
+#define GENERATE_RANGE_JUMP_TABLE(name, op, range_op)                                     \
+    constexpr int_value const *int_value::name(int_value const *rhs) const noexcept       \
+    {                                                                                     \
+        if (level == 2 || rhs->level == 2)                                                \
+            return int_value::bot();                                                      \
+        if (level == 1 && rhs->level == 1)                                                \
+            return op(this, rhs);                                                         \
+                                                                                          \
+        return int_value::make_range(range_op(bounds(), rhs->bounds()));                  \
+    }
+
+GENERATE_RANGE_JUMP_TABLE(add, iadd, range_add);
+GENERATE_RANGE_JUMP_TABLE(sub, isub, range_sub);
+GENERATE_RANGE_JUMP_TABLE(mul, imul, range_mul);
+GENERATE_RANGE_JUMP_TABLE(div, idiv, range_div);
+
+GENERATE_RANGE_JUMP_TABLE(band, iband, range_band);
+GENERATE_RANGE_JUMP_TABLE(bor, ibor, range_bor);
+GENERATE_RANGE_JUMP_TABLE(bxor, ixor, range_bxor);
+GENERATE_RANGE_JUMP_TABLE(lsh, ilsh, range_lsh);
+GENERATE_RANGE_JUMP_TABLE(rsh, irsh, range_rsh);
+
+GENERATE_RANGE_JUMP_TABLE(phi, iphi, range_phi);
+
+#undef GENERATE_RANGE_JUMP_TABLE
+
+// NOTE: comparisons are signed; `-1 < 0` is true
 constexpr value const *int_value::eq(int_value const *rhs) const noexcept
 {
-    switch (level * 3 + rhs->level)
-    {
-    case 0:
-    case 1:
-    case 3:
-        return bool_top::self();
-    case 4:
-        return bool_const::make(static_cast<int_const const *>(this)->n == static_cast<int_const const *>(rhs)->n);
-    case 2:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
+    if (level == 2 || rhs->level == 2)
         return bool_bot::self();
-    default:
-        std::unreachable();
-    }
+
+    auto const res = range_eq(bounds(), rhs->bounds());
+    return res ? (value const *)bool_const::make(*res) : bool_top::self();
 }
 
 constexpr value const *int_value::lt(int_value const *rhs) const noexcept
 {
-    switch (level * 3 + rhs->level)
-    {
-    case 0:
-    case 1:
-    case 3:
-        return bool_top::self();
-    case 4:
-        return bool_const::make(static_cast<int_const const *>(this)->n < static_cast<int_const const *>(rhs)->n);
-    case 2:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
+    if (level == 2 || rhs->level == 2)
         return bool_bot::self();
-    default:
-        std::unreachable();
-    }
-}
 
-GENERATE_BINARY_JUMP_TABLE(int_value, int_value, phi, iphi);
+    auto const res = range_lt(bounds(), rhs->bounds());
+    return res ? (value const *)bool_const::make(*res) : bool_top::self();
+}
 
 constexpr int_value const *int_value::bcompl() const noexcept
 {
@@ -258,6 +280,10 @@ constexpr int_value const *int_value::bcompl() const noexcept
         return int_value::make(~static_cast<int_const const *>(this)->n);
     case 2:
         return int_value::bot();
+    case 3:
+        return int_value::make_range(range_compl(bounds()));
+    default:
+        std::unreachable();
     }
 }
 
@@ -271,5 +297,9 @@ constexpr int_value const *int_value::neg() const noexcept
         return int_value::make(-static_cast<int_const const *>(this)->n);
     case 2:
         return int_value::bot();
+    case 3:
+        return int_value::make_range(range_neg(bounds()));
+    default:
+        std::unreachable();
     }
-}
\ No newline at end of file
+}
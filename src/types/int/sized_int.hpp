@@ -1,14 +1,72 @@
-
 #pragma once
 
 #include <concepts>
-#include "types/value.hpp"
+#include <optional>
+
+#include "types/bool.hpp"
+#include "types/int/int_bounds.hpp"
 
 // TODO: try doing something better to avoid template instantiations
+// - `lit <op> sized` (eg. `1 + x`) is still an error, as `int_value` does not know about sized integers
+
+// bounds of `val` if it is an untyped integer (`int_value`); defined in "types/int/int_lit.hpp"
+inline std::optional<int_bounds> literal_bounds(value const *val) noexcept;
+
+// common base of the sized integers, so that their bounds can be read without knowing `T`
+struct sized_int_value : value
+{
+    virtual int_bounds bounds() const noexcept = 0;
+};
 
 template <std::integral T>
-struct sized_int_ : value
+struct sized_int_ : sized_int_value
 {
+    // the bounds of every value of `T`
+    inline static constexpr int_bounds type_bounds() noexcept
+    {
+        // NOTE: `uint64` does not fit in the bounds, so nothing is known about it
+        if constexpr (std::is_same_v<T, uint64_t>)
+            return int_bounds::full();
+        else
+            return {(int64_t)std::numeric_limits<T>::min(), (int64_t)std::numeric_limits<T>::max()};
+    }
+
+    // `T` constant if `b` is a single value, a range if it fits in `T`, top if it might have wrapped around
+    inline static value const *from_bounds(int_bounds b) noexcept;
+
+    inline value const *bcompl() const noexcept;
+    inline value const *neg() const noexcept;
+
+    inline value const *add(value const *rhs) const noexcept;
+    inline value const *sub(value const *rhs) const noexcept;
+    inline value const *mul(value const *rhs) const noexcept;
+    inline value const *div(value const *rhs) const noexcept;
+
+    inline value const *band(value const *rhs) const noexcept;
+    inline value const *bor(value const *rhs) const noexcept;
+    inline value const *bxor(value const *rhs) const noexcept;
+    inline value const *lsh(value const *rhs) const noexcept;
+    inline value const *rsh(value const *rhs) const noexcept;
+
+    inline value const *eq(value const *rhs) const noexcept;
+    inline value const *lt(value const *rhs) const noexcept;
+
+    inline value const *phi(value const *other) const noexcept;
+
+private:
+    struct operand final
+    {
+        int_bounds bounds;
+        std::optional<T> value; // set only for constants
+    };
+
+    // `T` values and untyped integer literals can be mixed with `T`s; everything else is an error
+    inline static std::optional<operand> operand_of(value const *val) noexcept;
+
+    // `lhs <op> rhs`, folded with `const_op` (wrapping around in `T`) for constants and with `range_op` otherwise
+    // NOTE: returns `nullptr` if `rhs` is not a valid operand
+    template <typename RangeOp, typename ConstOp>
+    inline value const *binary(value const *rhs, RangeOp range_op, ConstOp const_op) const noexcept;
 };
 
 template <std::integral T>
@@ -20,18 +78,7 @@ struct sized_int_top final : sized_int_<T>
         return &top;
     }
 
-    inline value const *phi(value const *other) const noexcept
-    {
-        // HACK: temporary impl
-        if (auto rhs = other->as<sized_int_<T>>())
-            return sized_int_top::self();
-        else
-            return top_value::self();
-    }
-
-    inline value const *bcompl() const noexcept { return this; }
-
-    inline value const *band(value const *rhs) const noexcept { return rhs; }
+    inline int_bounds bounds() const noexcept { return sized_int_<T>::type_bounds(); }
 };
 
 template <std::integral T>
@@ -39,21 +86,34 @@ struct sized_int_const final : sized_int_<T>
 {
     inline explicit sized_int_const(T value) : value{value} {}
 
-    inline value const *phi(value const *other) const noexcept
+    inline int_bounds bounds() const noexcept
     {
-        // HACK: temporary impl
-        if (auto rhs = other->as<sized_int_<T>>())
-            return sized_int_top<T>::self();
-        else
-            return top_value::self();
+        // NOTE: `uint64` values above `int64` max are left unbounded
+        if constexpr (std::is_same_v<T, uint64_t>)
+            if (value > (uint64_t)int_bounds::max)
+                return int_bounds::full();
+
+        return {(int64_t)value, (int64_t)value};
     }
 
     T value;
 };
 
+// a value of `T` in [lo, hi]
+template <std::integral T>
+struct sized_int_range final : sized_int_<T>
+{
+    inline explicit sized_int_range(int_bounds b) noexcept : b{b} {}
+
+    inline int_bounds bounds() const noexcept { return b; }
+
+    int_bounds b;
+};
+
 template <std::integral T>
 struct sized_int_bot final : sized_int_<T>
 {
+    inline int_bounds bounds() const noexcept { return int_bounds::full(); }
 };
 
 template <std::integral T>
@@ -82,4 +142,171 @@ struct sized_int_type : type
         else if constexpr (std::is_same_v<T, uint64_t>)
             return "uint64";
     }
-};
\ No newline at end of file
+};
+
+// `b` as a value of whichever sized integer type `target` is, or `nullptr` if `target` is not one of `T...`
+template <std::integral... T>
+inline value const *cast_to_sized(int_bounds b, type const *target) noexcept
+{
+    value const *res = nullptr;
+    (void)(((target->as<sized_int_type<T>>() != nullptr) && (res = sized_int_<T>::from_bounds(b))) || ...);
+    return res;
+}
+
+template <std::integral T>
+inline value const *sized_int_<T>::from_bounds(int_bounds b) noexcept
+{
+    if (b == type_bounds() || !fits_in<T>(b))
+        return sized_int_top<T>::self();
+
+    if (b.is_single())
+        return new sized_int_const<T>{(T)b.lo};
+
+    return new sized_int_range<T>{b};
+}
+
+template <std::integral T>
+inline auto sized_int_<T>::operand_of(value const *val) noexcept -> std::optional<operand>
+{
+    if (auto c = val->as<sized_int_const<T>>())
+        return operand{c->bounds(), c->value};
+
+    if (auto v = val->as<sized_int_<T>>())
+    {
+        auto const b = v->bounds();
+        return operand{b, b.is_single() ? std::optional<T>{(T)b.lo} : std::nullopt};
+    }
+
+    // NOTE: literals are truncated to `T`, the same way a runtime cast would do, so the bounds are the truncated ones too
+    if (auto b = literal_bounds(val))
+    {
+        if (b->is_single())
+        {
+            auto const c = (T)b->lo;
+            return operand{sized_int_const<T>{c}.bounds(), c};
+        }
+
+        return operand{fits_in<T>(*b) ? *b : type_bounds(), std::nullopt};
+    }
+
+    return std::nullopt;
+}
+
+template <std::integral T>
+template <typename RangeOp, typename ConstOp>
+inline value const *sized_int_<T>::binary(value const *rhs, RangeOp range_op, ConstOp const_op) const noexcept
+{
+    auto const r = operand_of(rhs);
+    if (!r)
+        return nullptr;
+
+    if (this->template as<sized_int_bot<T>>() || rhs->as<sized_int_bot<T>>())
+        return new sized_int_bot<T>;
+
+    auto const l = *operand_of(this);
+
+    if (l.value && r.value)
+    {
+        if (std::optional<T> res = const_op(*l.value, *r.value))
+            return new sized_int_const<T>{*res};
+
+        // eg. division by zero; leave it for runtime
+        return sized_int_top<T>::self();
+    }
+
+    return from_bounds(range_op(l.bounds, r.bounds));
+}
+
+// NOTE: constants are computed in `uint64_t` so that they wrap around instead of overflowing
+#define SIZED_INT_BINARY_OP(name, range_op, ...)                                \
+    template <std::integral T>                                                  \
+    inline value const *sized_int_<T>::name(value const *rhs) const noexcept    \
+    {                                                                           \
+        auto const res = binary(rhs, range_op, [](T a, T b) -> std::optional<T> \
+                                { __VA_ARGS__ });                               \
+        return res ? res : value::name(rhs);                                    \
+    }
+
+SIZED_INT_BINARY_OP(add, range_add, return (T)((uint64_t)a + (uint64_t)b);)
+SIZED_INT_BINARY_OP(sub, range_sub, return (T)((uint64_t)a - (uint64_t)b);)
+SIZED_INT_BINARY_OP(mul, range_mul, return (T)((uint64_t)a * (uint64_t)b);)
+SIZED_INT_BINARY_OP(div, range_div,
+                    if (b == 0 || (std::is_signed_v<T> && a == std::numeric_limits<T>::min() && b == T(-1)))
+                        return std::nullopt;
+                    return (T)(a / b);)
+
+SIZED_INT_BINARY_OP(band, range_band, return (T)(a & b);)
+SIZED_INT_BINARY_OP(bor, range_bor, return (T)(a | b);)
+SIZED_INT_BINARY_OP(bxor, range_bxor, return (T)(a ^ b);)
+SIZED_INT_BINARY_OP(lsh, range_lsh,
+                    if (b < 0 || (uint64_t)b >= sizeof(T) * 8)
+                        return std::nullopt;
+                    return (T)((uint64_t)a << b);)
+SIZED_INT_BINARY_OP(rsh, range_rsh,
+                    if (b < 0 || (uint64_t)b >= sizeof(T) * 8)
+                        return std::nullopt;
+                    return (T)(a >> b);)
+
+#undef SIZED_INT_BINARY_OP
+
+template <std::integral T>
+inline value const *sized_int_<T>::bcompl() const noexcept
+{
+    if (auto c = this->template as<sized_int_const<T>>())
+        return new sized_int_const<T>{(T)~c->value};
+
+    return from_bounds(range_compl(this->bounds()));
+}
+
+template <std::integral T>
+inline value const *sized_int_<T>::neg() const noexcept
+{
+    if (auto c = this->template as<sized_int_const<T>>())
+        return new sized_int_const<T>{(T)(0 - (uint64_t)c->value)};
+
+    return from_bounds(range_neg(this->bounds()));
+}
+
+template <std::integral T>
+inline value const *sized_int_<T>::eq(value const *rhs) const noexcept
+{
+    auto const r = operand_of(rhs);
+    if (!r)
+        return value::eq(rhs);
+
+    auto const l = *operand_of(this);
+    if (l.value && r.value)
+        return bool_const::make(*l.value == *r.value);
+
+    auto const res = range_eq(l.bounds, r.bounds);
+    return res ? (value const *)bool_const::make(*res) : bool_top::self();
+}
+
+template <std::integral T>
+inline value const *sized_int_<T>::lt(value const *rhs) const noexcept
+{
+    auto const r = operand_of(rhs);
+    if (!r)
+        return value::lt(rhs);
+
+    auto const l = *operand_of(this);
+    if (l.value && r.value)
+        return bool_const::make(*l.value < *r.value);
+
+    auto const res = range_lt(l.bounds, r.bounds);
+    return res ? (value const *)bool_const::make(*res) : bool_top::self();
+}
+
+template <std::integral T>
+inline value const *sized_int_<T>::phi(value const *other) const noexcept
+{
+    auto const r = operand_of(other);
+    if (!r)
+        return top_value::self();
+
+    auto const l = *operand_of(this);
+    if (l.value && r.value && *l.value == *r.value)
+        return this;
+
+    return from_bounds(range_phi(l.bounds, r.bounds));
+}
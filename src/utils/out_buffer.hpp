@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <string_view>
+
+// TODO:
+// - write through a memory-mapped file instead once the output size can be estimated up front
+
+// Fixed-size buffer in front of a `FILE*`, flushed in big blocks; nothing is allocated while writing
+struct out_buffer final
+{
+    static constexpr size_t capacity = size_t(1) << 16;
+
+    // output iterator for `std::format_to`
+    struct iterator final
+    {
+        using difference_type = std::ptrdiff_t;
+
+        inline iterator &operator=(char c) noexcept
+        {
+            buf->put(c);
+            return *this;
+        }
+
+        inline iterator &operator*() noexcept { return *this; }
+        inline iterator &operator++() noexcept { return *this; }
+        inline iterator operator++(int) noexcept { return *this; }
+
+        out_buffer *buf;
+    };
+
+    static_assert(std::output_iterator<iterator, char>);
+
+    inline out_buffer() noexcept = default;
+    out_buffer(out_buffer const &) = delete;
+    out_buffer &operator=(out_buffer const &) = delete;
+    inline ~out_buffer() noexcept { flush(); }
+
+    // Start writing to `f`, flushing whatever was left for the previous file
+    inline void open(FILE *f) noexcept
+    {
+        flush();
+        out = f;
+    }
+
+    inline iterator iter() noexcept { return {this}; }
+
+    inline void put(char c) noexcept
+    {
+        if (n == capacity)
+            flush();
+
+        data[n++] = c;
+    }
+
+    inline void write(std::string_view str) noexcept
+    {
+        if (n + str.size() > capacity)
+        {
+            flush();
+
+            // too big for the buffer anyways, so skip it
+            if (str.size() > capacity)
+            {
+                fwrite(str.data(), 1, str.size(), out);
+                return;
+            }
+        }
+
+        memcpy(data + n, str.data(), str.size());
+        n += str.size();
+    }
+
+    template <typename... Args>
+    inline void print(std::format_string<Args...> fmt, Args &&...args) noexcept
+    {
+        std::format_to(iter(), fmt, std::forward<Args>(args)...);
+    }
+
+    inline void flush() noexcept
+    {
+        if (n != 0 && out)
+            fwrite(data, 1, n, out);
+
+        n = 0;
+    }
+
+private:
+    FILE *out = nullptr;
+    size_t n = 0;
+    char data[capacity];
+};
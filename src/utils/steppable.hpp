@@ -0,0 +1,80 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <utility>
+
+// A pass that can be run a bit at a time
+// The body is a coroutine that does a bounded amount of work between `co_yield`s, handing back how many changes it made
+// so far; the caller decides whether to `step` again, run it to the end, or drop it (cancel) between steps
+// invariant: the graph is consistent at every `co_yield`, so dropping the pass there leaves a valid (partly optimized) graph
+// invariant: nothing else changes the graph while the pass is suspended, as it keeps iterators into the storages
+
+// TODO:
+// - let the caller resize the steps, rather than each pass picking its own amount of work per step
+// - allocate the frames from an arena; each pass makes one per run
+
+struct steppable final
+{
+    struct promise_type final
+    {
+        // NOTE: not an aggregate, or the arguments of the pass would be used to initialize it
+        inline promise_type() noexcept = default;
+
+        inline steppable get_return_object() noexcept
+        {
+            return steppable{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        // NOTE: nothing runs until the first `step`, so making a pass is free
+        inline std::suspend_always initial_suspend() noexcept { return {}; }
+        inline std::suspend_always final_suspend() noexcept { return {}; }
+
+        inline std::suspend_always yield_value(size_t n) noexcept
+        {
+            changes += n;
+            return {};
+        }
+
+        inline void return_value(size_t n) noexcept { changes += n; }
+
+        [[noreturn]] inline void unhandled_exception() noexcept { std::terminate(); }
+
+        size_t changes = 0;
+    };
+
+    inline explicit steppable(std::coroutine_handle<promise_type> handle) noexcept : handle{handle} {}
+
+    inline steppable(steppable &&other) noexcept : handle{std::exchange(other.handle, {})} {}
+    steppable(steppable const &) = delete;
+    steppable &operator=(steppable const &) = delete;
+
+    inline ~steppable() noexcept
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    // Run until the next `co_yield`; return false once the pass is done
+    inline bool step() noexcept
+    {
+        if (!handle.done())
+            handle.resume();
+        return !handle.done();
+    }
+
+    // Run the rest of the pass; return the number of changes
+    inline size_t finish() noexcept
+    {
+        while (step())
+            ;
+        return changes();
+    }
+
+    inline bool done() const noexcept { return handle.done(); }
+    inline size_t changes() const noexcept { return handle.promise().changes; }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
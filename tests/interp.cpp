@@ -0,0 +1,72 @@
+#include <print>
+#include <string_view>
+
+#include "backends/interp.hpp"
+#include "parser/all.hpp"
+
+// quickproto_tests: run small programs on the interpreter, unoptimized, and fail if any of them traps
+// A program checks itself by indexing a one-element array with what should be 0, so a wrong value traps on the bounds check
+
+struct interp_case final
+{
+    char const *name;
+    std::string_view source;
+};
+
+inline constexpr interp_case cases[]{
+    {
+        // NOTE: `prev` and `cur` are both `Phi`s of the loop; `prev` must keep the old object when `cur` gets a new one
+        "struct carried through a loop",
+        "package test\n"
+        "\n"
+        "type P struct {\n"
+        "\tx int\n"
+        "}\n"
+        "\n"
+        "func main() {\n"
+        "\tvar prev P = P{0}\n"
+        "\tvar cur P = P{0}\n"
+        "\tfor range 3 {\n"
+        "\t\tprev = cur\n"
+        "\t\tcur = P{cur.x + 1}\n"
+        "\t}\n"
+        "\tvar check [1]int = [1]int{0}\n"
+        "\tvar ok int = check[cur.x - prev.x - 1]\n"
+        "}\n",
+    },
+    {
+        // NOTE: the index is only known at runtime and is not an `int`, so it still gets a `CheckedIndex`
+        "sized integer index",
+        "package test\n"
+        "\n"
+        "func main() {\n"
+        "\tvar k uint8 = uint8(0)\n"
+        "\tfor range 3 {\n"
+        "\t\tk = k + 1\n"
+        "\t}\n"
+        "\tvar check [1]int = [1]int{0}\n"
+        "\tvar ok int = check[k - 3]\n"
+        "}\n",
+    },
+};
+
+int main()
+{
+    int failed = 0;
+    for (auto const &c : cases)
+    {
+        auto p = parser{.scan{.text = (uchar const *)c.source.data()}};
+        p.package();
+
+        interp_backend interp;
+        if (auto const trapped = interp.run(p.bld.reg))
+        {
+            std::println("FAIL {}: {}", c.name, trapped);
+            ++failed;
+        }
+        else
+            std::println("ok   {}", c.name);
+    }
+
+    return failed;
+}